@@ -56,6 +56,7 @@
 #include <stdbool.h>
 #endif
 #include <stddef.h>
+#include <stdio.h>
 
 /** \brief Maximum length for the digest block **/
 #define FFUZZY_SPAMSUM_LENGTH 64
@@ -92,6 +93,21 @@
 **/
 #define FFUZZY_MIN_MATCH 7
 
+/**
+	\brief Size of a binary digest record
+	\details
+		A binary digest record is formed like this (all integers are little endian):
+
+		- 64-bit digest ID (8)
+		- 64-bit block size (8)
+		- Lengths of first and second digest blocks (1 each)
+		- Digest buffer (padded with zeroes) (128)
+
+	\see  bool ffuzzy_write_digest_record(FILE*, unsigned long long, const ffuzzy_digest*)
+	\see  bool ffuzzy_read_digest_record(FILE*, unsigned long long*, ffuzzy_digest*)
+**/
+#define FFUZZY_RECORD_SIZE 146
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -618,6 +634,2055 @@ void ffuzzy_convert_udigest_to_digest(ffuzzy_digest *digest, const ffuzzy_udiges
 
 
 
+/**
+	\name Digest Collections
+	\{
+**/
+
+/**
+	\struct ffuzzy_collection
+	\brief  Block size-partitioned collection of digests
+	\details
+		This is an opaque type to store many digests for one-to-many
+		and many-to-many comparison. Digests are grouped by their block sizes
+		and each group is sorted by the block size so that only
+		"near" groups are visited on comparison.
+
+		Each digest in the collection has an ID. IDs are assigned
+		sequentially (from 0) in the insertion order.
+	\see   ffuzzy_collection_new()
+**/
+typedef struct ffuzzy_collection ffuzzy_collection;
+
+/**
+	\fn     ffuzzy_collection* ffuzzy_collection_new(void)
+	\brief  Create an empty digest collection
+	\return The new collection if succeeds; NULL otherwise.
+**/
+ffuzzy_collection *ffuzzy_collection_new(void);
+
+/**
+	\fn     void ffuzzy_collection_free(ffuzzy_collection*)
+	\brief  Free the digest collection
+	\param  [in] coll  The collection to free (may be NULL)
+**/
+void ffuzzy_collection_free(ffuzzy_collection *coll);
+
+/**
+	\fn     bool ffuzzy_collection_add(ffuzzy_collection*, const ffuzzy_digest*, size_t*)
+	\brief  Add a digest to the collection
+	\param  [in,out] coll    The collection
+	\param  [in]     digest  A valid digest to add
+	\param  [out]    id      The pointer to store the ID of added digest (may be NULL)
+	\return true if succeeds; false otherwise.
+**/
+bool ffuzzy_collection_add(ffuzzy_collection *coll, const ffuzzy_digest *digest, size_t *id);
+
+/**
+	\fn     size_t ffuzzy_collection_size(const ffuzzy_collection*)
+	\brief  Retrieve the number of digests in the collection
+	\param  [in] coll  The collection
+	\return Number of digests (which is also the ID of the next digest to add).
+**/
+size_t ffuzzy_collection_size(const ffuzzy_collection *coll);
+
+/**
+	\fn     unsigned long long ffuzzy_collection_version(const ffuzzy_collection*)
+	\brief  Retrieve the modification counter of the collection
+	\details
+		The version changes whenever a digest is added
+		(search results from older versions may be outdated).
+	\param  [in] coll  The collection
+	\return The version of the collection.
+**/
+unsigned long long ffuzzy_collection_version(const ffuzzy_collection *coll);
+
+/**
+	\fn     const ffuzzy_digest* ffuzzy_collection_get(const ffuzzy_collection*, size_t)
+	\brief  Retrieve the digest by the ID
+	\details
+		The pointer is valid until the next modification of the collection.
+	\param  [in] coll  The collection
+	\param       id    The ID of the digest
+	\return The pointer to the digest or NULL if id is out of range.
+**/
+const ffuzzy_digest *ffuzzy_collection_get(const ffuzzy_collection *coll, size_t id);
+
+/**
+	\brief  Callback type to receive a matched pair of digests
+	\param  ctx    User-supplied context
+	\param  id1    ID of the first digest
+	\param  id2    ID of the second digest
+	\param  score  Similarity score of two digests
+**/
+typedef void (*ffuzzy_pair_callback)(void *ctx, size_t id1, size_t id2, int score);
+
+/** \} **/
+
+
+
+/**
+	\name Incremental Clustering
+	\{
+**/
+
+/**
+	\struct ffuzzy_clustering
+	\brief  Clustered digest collection which accepts new digests incrementally
+	\details
+		This is an opaque type which holds a digest collection and
+		its clusters (connected components where two digests are connected
+		if their similarity score is equal to or greater than the threshold).
+
+		Adding a batch of digests only compares new digests against
+		older digests (of "near" block sizes) and new digests each other.
+		It never recomputes pairs between existing digests.
+	\see   ffuzzy_clustering_new(int)
+**/
+typedef struct ffuzzy_clustering ffuzzy_clustering;
+
+/**
+	\fn     ffuzzy_clustering* ffuzzy_clustering_new(int)
+	\brief  Create an empty clustered collection
+	\param  threshold  Minimum similarity score to connect two digests [1,100]
+	\return The new clustered collection if succeeds; NULL otherwise.
+**/
+ffuzzy_clustering *ffuzzy_clustering_new(int threshold);
+
+/**
+	\fn     void ffuzzy_clustering_free(ffuzzy_clustering*)
+	\brief  Free the clustered collection
+	\param  [in] cl  The clustered collection to free (may be NULL)
+**/
+void ffuzzy_clustering_free(ffuzzy_clustering *cl);
+
+/**
+	\fn     bool ffuzzy_clustering_add(ffuzzy_clustering*, const ffuzzy_digest*, size_t, ffuzzy_pair_callback, void*)
+	\brief  Add a batch of digests and update clusters
+	\details
+		New digests get sequential IDs starting from the size of
+		the collection before the call.
+
+		If callback is not NULL, it is called for each new pair of digests
+		with the score equal to or greater than the threshold
+		(id1 is always less than id2 and id2 is one of new digests).
+		This can be used to maintain neighbor lists.
+		If callback is NULL, pairs already in the same cluster are not compared.
+
+		The cost is proportional to the batch size multiplied by
+		the number of digests with "near" block sizes.
+
+		If this function fails, some of new digests may be added
+		(and clustered) to the collection.
+	\param  [in,out] cl        The clustered collection
+	\param  [in]     digests   Valid digests to add
+	\param           count     Number of digests
+	\param           callback  The callback to receive new edges (may be NULL)
+	\param           ctx       User-supplied context for callback
+	\return true if succeeds; false otherwise.
+**/
+bool ffuzzy_clustering_add(
+	ffuzzy_clustering *cl,
+	const ffuzzy_digest *digests, size_t count,
+	ffuzzy_pair_callback callback, void *ctx
+);
+
+/**
+	\fn     size_t ffuzzy_clustering_label(ffuzzy_clustering*, size_t)
+	\brief  Retrieve the cluster label of the digest
+	\details
+		The label is the minimum digest ID in the cluster.
+		Because new digests always get greater IDs, labels of existing
+		clusters only change when two existing clusters are merged.
+	\param  [in,out] cl  The clustered collection (modified to speed up later queries)
+	\param           id  The ID of the digest
+	\return The cluster label.
+**/
+size_t ffuzzy_clustering_label(ffuzzy_clustering *cl, size_t id);
+
+/**
+	\fn     size_t ffuzzy_clustering_num_clusters(const ffuzzy_clustering*)
+	\brief  Retrieve the number of clusters (including singletons)
+	\param  [in] cl  The clustered collection
+	\return Number of clusters.
+**/
+size_t ffuzzy_clustering_num_clusters(const ffuzzy_clustering *cl);
+
+/**
+	\fn     const ffuzzy_collection* ffuzzy_clustering_collection(const ffuzzy_clustering*)
+	\brief  Retrieve the underlying digest collection
+	\param  [in] cl  The clustered collection
+	\return The digest collection (IDs are shared with the clustered collection).
+**/
+const ffuzzy_collection *ffuzzy_clustering_collection(const ffuzzy_clustering *cl);
+
+/** \} **/
+
+
+
+/**
+	\name Nearest Neighbor Search
+	\{
+**/
+
+/**
+	\struct ffuzzy_match
+	\brief  A search result (matched digest in the collection)
+	\details
+		Search results are ordered by scores (descending) and
+		then by IDs (ascending).
+
+	\var   ffuzzy_match::id
+	\brief ID of the matched digest.
+
+	\var   ffuzzy_match::score
+	\brief Similarity score between the query and the matched digest.
+**/
+typedef struct
+{
+	size_t id;
+	int score;
+} ffuzzy_match;
+
+/**
+	\fn     size_t ffuzzy_collection_topk(const ffuzzy_collection*, const ffuzzy_digest*, size_t, int, ffuzzy_match*)
+	\brief  Find k most similar digests in the collection
+	\details
+		This function keeps k best matches in a bounded heap.
+		Once the heap is full, the minimum score in the heap is used
+		as the threshold and remaining candidates are rejected
+		by the score bound (from block sizes and block lengths)
+		before computing edit distances.
+	\param  [in]  coll       The collection
+	\param  [in]  query      Valid digest to search
+	\param        k          Maximum number of matches
+	\param        min_score  Minimum score to match (values less than 1 are treated as 1)
+	\param  [out] matches    Buffer to store (up to k) matches (best match first)
+	\return Number of matches stored to matches.
+**/
+size_t ffuzzy_collection_topk(
+	const ffuzzy_collection *coll, const ffuzzy_digest *query,
+	size_t k, int min_score, ffuzzy_match *matches
+);
+
+/**
+	\fn     bool ffuzzy_collection_knn_graph(const ffuzzy_collection*, size_t, int, unsigned, ffuzzy_match*, size_t*)
+	\brief  Build k-nearest neighbor graph of the collection in parallel
+	\details
+		For each digest ID i, (up to k) neighbors (excluding i itself)
+		are stored to matches[i*k] ... matches[i*k+counts[i]-1].
+	\param  [in]  coll       The collection
+	\param        k          Maximum number of neighbors per digest
+	\param        min_score  Minimum score to match (values less than 1 are treated as 1)
+	\param        nthreads   Number of threads (0 to use all online processors)
+	\param  [out] matches    Buffer to store neighbors (ffuzzy_collection_size(coll) * k entries)
+	\param  [out] counts     Buffer to store the numbers of neighbors (ffuzzy_collection_size(coll) entries)
+	\return true if succeeds; false otherwise.
+**/
+bool ffuzzy_collection_knn_graph(
+	const ffuzzy_collection *coll,
+	size_t k, int min_score, unsigned nthreads,
+	ffuzzy_match *matches, size_t *counts
+);
+
+/** \} **/
+
+
+
+/**
+	\name Threshold Search
+	\{
+**/
+
+/**
+	\struct ffuzzy_match_list
+	\brief  Growable list of search results
+	\details
+		Initialize with ffuzzy_match_list_init and release with
+		ffuzzy_match_list_free. A list can be reused for multiple searches
+		(previous results are discarded but the buffer is kept).
+
+	\var   ffuzzy_match_list::matches
+	\brief Matches (best match first).
+
+	\var   ffuzzy_match_list::count
+	\brief Number of matches.
+
+	\var   ffuzzy_match_list::capacity
+	\brief Allocated number of entries for ffuzzy_match_list::matches.
+**/
+typedef struct
+{
+	ffuzzy_match *matches;
+	size_t count, capacity;
+} ffuzzy_match_list;
+
+/**
+	\fn     void ffuzzy_match_list_init(ffuzzy_match_list*)
+	\brief  Initialize an empty match list
+	\param  [out] list  The list to initialize
+**/
+void ffuzzy_match_list_init(ffuzzy_match_list *list);
+
+/**
+	\fn     void ffuzzy_match_list_free(ffuzzy_match_list*)
+	\brief  Release the buffer of a match list (the list becomes empty)
+	\param  [in,out] list  The list to release
+**/
+void ffuzzy_match_list_free(ffuzzy_match_list *list);
+
+/**
+	\fn     bool ffuzzy_collection_search(const ffuzzy_collection*, const ffuzzy_digest*, int, ffuzzy_match_list*)
+	\brief  Find all digests in the collection with scores equal to or greater than the threshold
+	\param  [in]     coll       The collection
+	\param  [in]     query      Valid digest to search
+	\param           threshold  Minimum score to match (values less than 1 are treated as 1)
+	\param  [in,out] results    Initialized list to store matches (best match first)
+	\return true if succeeds; false otherwise (results may be incomplete).
+**/
+bool ffuzzy_collection_search(
+	const ffuzzy_collection *coll, const ffuzzy_digest *query,
+	int threshold, ffuzzy_match_list *results
+);
+
+/**
+	\fn     bool ffuzzy_collection_search_batch(const ffuzzy_collection*, const ffuzzy_digest*, size_t, int, unsigned, ffuzzy_match_list*)
+	\brief  Search many queries at once (sharing one pass over the collection)
+	\details
+		Queries are grouped by block sizes and each partition of
+		the collection is scanned once in cache-sized tiles.
+		Every tile is compared against all queries with "near" block sizes
+		before moving to the next tile so that the corpus is read from
+		memory once per batch (not once per query).
+		Each tile is stored transposed so that one query block is
+		compared against 16 or 32 corpus blocks at once
+		(unless disabled by configure --disable-simd).
+
+		Results are the same as calling ffuzzy_collection_search
+		for each query.
+	\param  [in]     coll       The collection
+	\param  [in]     queries    Valid digests to search
+	\param           nqueries   Number of queries
+	\param           threshold  Minimum score to match (values less than 1 are treated as 1)
+	\param           nthreads   Number of threads (0 to use all online processors)
+	\param  [in,out] results    Initialized lists to store matches (nqueries entries)
+	\return true if succeeds; false otherwise (results may be incomplete).
+**/
+bool ffuzzy_collection_search_batch(
+	const ffuzzy_collection *coll,
+	const ffuzzy_digest *queries, size_t nqueries,
+	int threshold, unsigned nthreads,
+	ffuzzy_match_list *results
+);
+
+/** \} **/
+
+
+
+/**
+	\name Query Planning
+	\{
+**/
+
+/**
+	\struct ffuzzy_partition_stats
+	\brief  Statistics of digests with one block size in a collection
+
+	\var   ffuzzy_partition_stats::block_size
+	\brief Block size of the partition.
+
+	\var   ffuzzy_partition_stats::count
+	\brief Number of digests.
+
+	\var   ffuzzy_partition_stats::indexed
+	\brief Number of digests covered by the n-gram index (0 if not indexed).
+
+	\var   ffuzzy_partition_stats::len1
+	\brief Number of digests by the length of the first block.
+
+	\var   ffuzzy_partition_stats::len2
+	\brief Number of digests by the length of the second block.
+**/
+typedef struct
+{
+	unsigned long block_size;
+	size_t count;
+	size_t indexed;
+	size_t len1[FFUZZY_SPAMSUM_LENGTH + 1];
+	size_t len2[FFUZZY_SPAMSUM_LENGTH + 1];
+} ffuzzy_partition_stats;
+
+/**
+	\fn     size_t ffuzzy_collection_num_partitions(const ffuzzy_collection*)
+	\brief  Retrieve the number of block sizes in the collection
+	\param  [in] coll  The collection
+	\return Number of partitions (in ascending order of block sizes).
+**/
+size_t ffuzzy_collection_num_partitions(const ffuzzy_collection *coll);
+
+/**
+	\fn     bool ffuzzy_collection_partition_stats(const ffuzzy_collection*, size_t, ffuzzy_partition_stats*)
+	\brief  Retrieve statistics of a partition
+	\param  [in]  coll   The collection
+	\param        i      Index of the partition
+	\param  [out] stats  Buffer to store statistics
+	\return true if succeeds; false if i is out of range.
+**/
+bool ffuzzy_collection_partition_stats(const ffuzzy_collection *coll, size_t i, ffuzzy_partition_stats *stats);
+
+/**
+	\fn     bool ffuzzy_collection_build_index(ffuzzy_collection*, size_t)
+	\brief  Build n-gram indexes of large partitions
+	\details
+		Every partition with at least min_count digests gets an index of
+		all n-grams (FFUZZY_MIN_MATCH characters) in its blocks.
+		Indexes of smaller partitions are removed and up-to-date indexes
+		are kept. Digests added later are not indexed (but still found)
+		until this function is called again.
+
+		This function must not be called concurrently with searches.
+	\param  [in,out] coll       The collection
+	\param           min_count  Minimum number of digests to index a partition
+	\return true if succeeds; false otherwise (some indexes may be missing).
+**/
+bool ffuzzy_collection_build_index(ffuzzy_collection *coll, size_t min_count);
+
+/**
+	\enum  ffuzzy_plan_strategy
+	\brief Strategy to search one partition
+**/
+typedef enum
+{
+	/** \brief No digest can reach the threshold (by block lengths) **/
+	FFUZZY_PLAN_EMPTY,
+	/** \brief Compare all digests (after the length filter) **/
+	FFUZZY_PLAN_SCAN,
+	/** \brief Compare digests sharing an n-gram with the query **/
+	FFUZZY_PLAN_INDEX,
+} ffuzzy_plan_strategy;
+
+/**
+	\struct ffuzzy_plan_step
+	\brief  Decision for one partition
+	\details
+		Costs are estimated in units of one digest comparison.
+
+	\var   ffuzzy_plan_step::candidates
+	\brief Number of digests passing the length filter (from the histograms).
+
+	\var   ffuzzy_plan_step::cost
+	\brief Estimated cost of the chosen strategy.
+
+	\var   ffuzzy_plan_step::scan_cost
+	\brief Estimated cost of a linear scan.
+
+	\var   ffuzzy_plan_step::index_cost
+	\brief Estimated cost of an index probe (negative if not indexed).
+**/
+typedef struct
+{
+	unsigned long block_size;
+	ffuzzy_plan_strategy strategy;
+	size_t count;
+	size_t candidates;
+	double cost;
+	double scan_cost;
+	double index_cost;
+} ffuzzy_plan_step;
+
+/**
+	\struct ffuzzy_plan
+	\brief  Query plan (one step per partition with a "near" block size)
+**/
+typedef struct
+{
+	unsigned long block_size;
+	int threshold;
+	ffuzzy_plan_step steps[3];
+	size_t nsteps;
+	double cost;
+} ffuzzy_plan;
+
+/**
+	\fn     bool ffuzzy_collection_plan(const ffuzzy_collection*, const ffuzzy_digest*, int, ffuzzy_plan*)
+	\brief  Choose the cheapest strategy for each partition to search
+	\details
+		Partitions where no digest passes the length filter
+		(including all partitions if query blocks are shorter than
+		FFUZZY_MIN_MATCH) are answered empty. Otherwise, the estimated cost of
+		a linear scan (from block length histograms) is compared with
+		the cost of an index probe (from actual lengths of posting lists).
+
+		The plan is valid until the collection is modified.
+	\param  [in]  coll       The collection
+	\param  [in]  query      Valid digest to search
+	\param        threshold  Minimum score to match (values less than 1 are treated as 1)
+	\param  [out] plan       Buffer to store the plan
+	\return true if succeeds; false otherwise.
+**/
+bool ffuzzy_collection_plan(const ffuzzy_collection *coll, const ffuzzy_digest *query, int threshold, ffuzzy_plan *plan);
+
+/**
+	\fn     bool ffuzzy_collection_search_planned(const ffuzzy_collection*, const ffuzzy_digest*, int, const ffuzzy_plan*, ffuzzy_match_list*)
+	\brief  Search the collection by the plan
+	\details
+		Results are the same as ffuzzy_collection_search.
+	\param  [in]     coll       The collection
+	\param  [in]     query      Valid digest to search
+	\param           threshold  Minimum score to match (must be the same as the plan)
+	\param  [in]     plan       The plan made for the query (or NULL to plan here)
+	\param  [in,out] results    Initialized list to store matches (best match first)
+	\return true if succeeds; false otherwise (results may be incomplete).
+**/
+bool ffuzzy_collection_search_planned(
+	const ffuzzy_collection *coll, const ffuzzy_digest *query,
+	int threshold, const ffuzzy_plan *plan, ffuzzy_match_list *results
+);
+
+/**
+	\struct ffuzzy_search_budget
+	\brief  Limits of a bounded search
+
+	\var   ffuzzy_search_budget::timeout_usec
+	\brief Time limit in microseconds (0 for no limit).
+
+	\var   ffuzzy_search_budget::max_comparisons
+	\brief Maximum number of digest comparisons (0 for no limit).
+	\details
+		Digests rejected by block lengths are not counted.
+**/
+typedef struct
+{
+	unsigned long long timeout_usec;
+	unsigned long long max_comparisons;
+} ffuzzy_search_budget;
+
+/**
+	\struct ffuzzy_partition_coverage
+	\brief  Progress of a bounded search on one partition
+
+	\var   ffuzzy_partition_coverage::covered
+	\brief Number of digests searched (the partition is completed if equal to count).
+**/
+typedef struct
+{
+	unsigned long block_size;
+	size_t count;
+	size_t covered;
+} ffuzzy_partition_coverage;
+
+/**
+	\struct ffuzzy_search_coverage
+	\brief  Progress of a bounded search
+
+	\var   ffuzzy_search_coverage::complete
+	\brief Whether all partitions are completed (results are exact).
+
+	\var   ffuzzy_search_coverage::parts
+	\brief Partitions with "near" block sizes (in the processing order).
+
+	\var   ffuzzy_search_coverage::count
+	\brief Total number of digests in partitions.
+
+	\var   ffuzzy_search_coverage::covered
+	\brief Total number of digests searched.
+**/
+typedef struct
+{
+	bool complete;
+	ffuzzy_partition_coverage parts[3];
+	size_t nparts;
+	size_t count;
+	size_t covered;
+	unsigned long long comparisons;
+	unsigned long long elapsed_usec;
+} ffuzzy_search_coverage;
+
+/**
+	\fn     bool ffuzzy_collection_search_bounded(const ffuzzy_collection*, const ffuzzy_digest*, int, const ffuzzy_search_budget*, ffuzzy_match_list*, ffuzzy_search_coverage*)
+	\brief  Search the collection within the time limit and/or the comparison budget
+	\details
+		The query is planned as ffuzzy_collection_plan and partitions
+		are searched in the order of promise: partitions answered empty,
+		the equal block size and then others by estimated costs.
+		The budget is checked once per tile (256 digests or index candidates),
+		so the search may exceed the budget by one tile.
+
+		When the budget runs out, results contain matches found so far
+		(all matches in completed partitions) and the coverage tells
+		which part of each partition was searched.
+	\param  [in]     coll       The collection
+	\param  [in]     query      Valid digest to search
+	\param           threshold  Minimum score to match (values less than 1 are treated as 1)
+	\param  [in]     budget     Limits of the search (NULL for no limits)
+	\param  [in,out] results    Initialized list to store matches (best match first)
+	\param  [out]    coverage   Buffer to store the progress of the search
+	\return true if succeeds (even if the budget runs out); false otherwise.
+**/
+bool ffuzzy_collection_search_bounded(
+	const ffuzzy_collection *coll, const ffuzzy_digest *query,
+	int threshold, const ffuzzy_search_budget *budget,
+	ffuzzy_match_list *results, ffuzzy_search_coverage *coverage
+);
+
+/**
+	\fn     const char* ffuzzy_plan_strategy_name(ffuzzy_plan_strategy)
+	\brief  Retrieve the name of the strategy ("empty", "scan" or "index")
+**/
+const char *ffuzzy_plan_strategy_name(ffuzzy_plan_strategy strategy);
+
+/**
+	\fn     int ffuzzy_plan_explain(const ffuzzy_plan*, char*, size_t)
+	\brief  Describe the plan in human-readable text
+	\details
+		The output has one line for the query and one line for each
+		partition (the decision and estimated costs).
+		Like snprintf, the output is truncated to fit in the buffer.
+	\param  [in]  plan  The plan
+	\param  [out] buf   Buffer to store the text (may be NULL if size is 0)
+	\param        size  Size of the buffer
+	\return Length of the whole text (excluding the terminator) or a negative value on errors.
+**/
+int ffuzzy_plan_explain(const ffuzzy_plan *plan, char *buf, size_t size);
+
+/** \} **/
+
+
+
+/**
+	\name Result Cache
+	\{
+**/
+
+/**
+	\struct ffuzzy_result_cache
+	\brief  Bounded cache of query results
+	\details
+		This is an opaque type to reuse results of repeated queries.
+		Results are keyed by the fingerprint of the query digest and
+		query parameters and are valid only for the version of
+		the collection they are computed from
+		(see ffuzzy_collection_version).
+
+		The cache is split into shards with independent locks and
+		each shard evicts entries by the CLOCK algorithm.
+		One cache may be shared by many threads and collections
+		(but results of different collections with equal versions
+		are not distinguished).
+	\see   ffuzzy_result_cache_new()
+**/
+typedef struct ffuzzy_result_cache ffuzzy_result_cache;
+
+/**
+	\struct ffuzzy_result_cache_counters
+	\brief  Counters of the result cache
+
+	\var   ffuzzy_result_cache_counters::hits
+	\brief Number of queries answered from the cache.
+
+	\var   ffuzzy_result_cache_counters::misses
+	\brief Number of queries not found in the cache (or outdated).
+
+	\var   ffuzzy_result_cache_counters::evictions
+	\brief Number of entries replaced to store new results.
+
+	\var   ffuzzy_result_cache_counters::entries
+	\brief Number of entries currently stored.
+**/
+typedef struct
+{
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long evictions;
+	size_t entries;
+} ffuzzy_result_cache_counters;
+
+/**
+	\fn     ffuzzy_result_cache* ffuzzy_result_cache_new(size_t, unsigned)
+	\brief  Create an empty result cache
+	\param  capacity  Maximum number of cached results (must not be 0)
+	\param  nshards   Number of shards (0 for the default)
+	\return The new cache if succeeds; NULL otherwise.
+**/
+ffuzzy_result_cache *ffuzzy_result_cache_new(size_t capacity, unsigned nshards);
+
+/**
+	\fn     void ffuzzy_result_cache_free(ffuzzy_result_cache*)
+	\brief  Free the result cache
+	\param  [in] cache  The cache to free (may be NULL)
+**/
+void ffuzzy_result_cache_free(ffuzzy_result_cache *cache);
+
+/**
+	\fn     void ffuzzy_result_cache_clear(ffuzzy_result_cache*)
+	\brief  Remove all cached results (counters are kept)
+	\param  [in,out] cache  The cache
+**/
+void ffuzzy_result_cache_clear(ffuzzy_result_cache *cache);
+
+/**
+	\fn     void ffuzzy_result_cache_stats(ffuzzy_result_cache*, ffuzzy_result_cache_counters*)
+	\brief  Retrieve counters of the cache
+	\param  [in]  cache  The cache
+	\param  [out] stats  Buffer to store counters
+**/
+void ffuzzy_result_cache_stats(ffuzzy_result_cache *cache, ffuzzy_result_cache_counters *stats);
+
+/**
+	\fn     bool ffuzzy_collection_search_cached(ffuzzy_result_cache*, const ffuzzy_collection*, const ffuzzy_digest*, int, ffuzzy_match_list*)
+	\brief  Threshold search through the result cache
+	\details
+		Results are the same as ffuzzy_collection_search.
+		The collection must not be modified during the search.
+	\param  [in,out] cache      The cache
+	\param  [in]     coll       The collection
+	\param  [in]     query      Valid digest to search
+	\param           threshold  Minimum score to match (values less than 1 are treated as 1)
+	\param  [in,out] results    Initialized list to store matches (best match first)
+	\return true if succeeds; false otherwise (results may be incomplete).
+**/
+bool ffuzzy_collection_search_cached(
+	ffuzzy_result_cache *cache,
+	const ffuzzy_collection *coll, const ffuzzy_digest *query,
+	int threshold, ffuzzy_match_list *results
+);
+
+/**
+	\fn     size_t ffuzzy_collection_topk_cached(ffuzzy_result_cache*, const ffuzzy_collection*, const ffuzzy_digest*, size_t, int, ffuzzy_match*)
+	\brief  Top-k search through the result cache
+	\details
+		Results are the same as ffuzzy_collection_topk.
+		The collection must not be modified during the search.
+	\param  [in,out] cache      The cache
+	\param  [in]     coll       The collection
+	\param  [in]     query      Valid digest to search
+	\param           k          Maximum number of matches
+	\param           min_score  Minimum score to match (values less than 1 are treated as 1)
+	\param  [out]    matches    Buffer to store (up to k) matches (best match first)
+	\return Number of matches stored to matches.
+**/
+size_t ffuzzy_collection_topk_cached(
+	ffuzzy_result_cache *cache,
+	const ffuzzy_collection *coll, const ffuzzy_digest *query,
+	size_t k, int min_score, ffuzzy_match *matches
+);
+
+/** \} **/
+
+
+
+/**
+	\name Similarity Join
+	\{
+**/
+
+/**
+	\fn     bool ffuzzy_join(const ffuzzy_digest*, size_t, const ffuzzy_digest*, size_t, int, unsigned, ffuzzy_pair_callback, void*)
+	\brief  Find all pairs between two digest sets with scores equal to or greater than the threshold
+	\details
+		Both sets are sorted by block sizes (without modifying given arrays)
+		and merged so that only pairs with "near" block sizes
+		(equal, half or double) are compared. Pairs of runs are split into
+		tiles in both dimensions so that the work is balanced even if
+		one of the sets is much larger than the other.
+
+		Block strings of both sets are interned (see ffuzzy_block_table)
+		so that identical blocks are never compared. If the sets have
+		many duplicate blocks, each worker also memoizes recent
+		block comparisons.
+
+		The callback receives indices into a (id1) and b (id2).
+		It is never called concurrently but the order of pairs
+		is not specified.
+	\param  [in] a          Valid digests (set A)
+	\param       na         Number of digests in a
+	\param  [in] b          Valid digests (set B)
+	\param       nb         Number of digests in b
+	\param       threshold  Minimum score to report (values less than 1 are treated as 1)
+	\param       nthreads   Number of threads (0 to use all online processors)
+	\param       callback   The callback to receive matched pairs
+	\param       ctx        User-supplied context for callback
+	\return true if succeeds; false otherwise (callback is not called on failure).
+**/
+bool ffuzzy_join(
+	const ffuzzy_digest *a, size_t na,
+	const ffuzzy_digest *b, size_t nb,
+	int threshold, unsigned nthreads,
+	ffuzzy_pair_callback callback, void *ctx
+);
+
+/**
+	\fn     bool ffuzzy_join_self(const ffuzzy_digest*, size_t, int, unsigned, ffuzzy_pair_callback, void*)
+	\brief  Find all pairs in the digest set with scores equal to or greater than the threshold
+	\details
+		This is the self-join version of ffuzzy_join.
+		Each unordered pair is reported once (id1 is always less than id2).
+	\param  [in] digests    Valid digests
+	\param       n          Number of digests
+	\param       threshold  Minimum score to report (values less than 1 are treated as 1)
+	\param       nthreads   Number of threads (0 to use all online processors)
+	\param       callback   The callback to receive matched pairs
+	\param       ctx        User-supplied context for callback
+	\return true if succeeds; false otherwise (callback is not called on failure).
+	\see    bool ffuzzy_join(const ffuzzy_digest*, size_t, const ffuzzy_digest*, size_t, int, unsigned, ffuzzy_pair_callback, void*)
+**/
+bool ffuzzy_join_self(
+	const ffuzzy_digest *digests, size_t n,
+	int threshold, unsigned nthreads,
+	ffuzzy_pair_callback callback, void *ctx
+);
+
+/**
+	\fn     bool ffuzzy_join_qgram(const ffuzzy_digest*, size_t, const ffuzzy_digest*, size_t, int, ffuzzy_pair_callback, void*)
+	\brief  Find all pairs between two digest sets by q-gram count filtering
+	\details
+		This function returns the same pairs as ffuzzy_join but generates
+		candidates from block strings instead of comparing all pairs of
+		"near" digests. Each block is converted to a set of q-grams
+		(substrings of length FFUZZY_MIN_MATCH, numbered by occurrences)
+		ordered by rarity and only the prefix of each set is indexed
+		(prefix filtering). Candidates must share the number of q-grams
+		required by the threshold (at least one) before they are verified
+		by ffuzzy_compare_digest.
+
+		This is efficient for high thresholds and sets with diverse blocks.
+		Unlike ffuzzy_join, it runs on the calling thread.
+		Pairs are reported in ascending order of (id1, id2).
+	\param  [in] a          Valid digests (set A)
+	\param       na         Number of digests in a
+	\param  [in] b          Valid digests (set B)
+	\param       nb         Number of digests in b
+	\param       threshold  Minimum score to report (values less than 1 are treated as 1)
+	\param       callback   The callback to receive matched pairs
+	\param       ctx        User-supplied context for callback
+	\return true if succeeds; false otherwise (callback is not called on failure).
+**/
+bool ffuzzy_join_qgram(
+	const ffuzzy_digest *a, size_t na,
+	const ffuzzy_digest *b, size_t nb,
+	int threshold,
+	ffuzzy_pair_callback callback, void *ctx
+);
+
+/**
+	\fn     bool ffuzzy_join_self_qgram(const ffuzzy_digest*, size_t, int, ffuzzy_pair_callback, void*)
+	\brief  Find all pairs in the digest set by q-gram count filtering
+	\details
+		This is the self-join version of ffuzzy_join_qgram.
+		Each unordered pair is reported once (id1 is always less than id2).
+	\param  [in] digests    Valid digests
+	\param       n          Number of digests
+	\param       threshold  Minimum score to report (values less than 1 are treated as 1)
+	\param       callback   The callback to receive matched pairs
+	\param       ctx        User-supplied context for callback
+	\return true if succeeds; false otherwise (callback is not called on failure).
+	\see    bool ffuzzy_join_qgram(const ffuzzy_digest*, size_t, const ffuzzy_digest*, size_t, int, ffuzzy_pair_callback, void*)
+**/
+bool ffuzzy_join_self_qgram(
+	const ffuzzy_digest *digests, size_t n,
+	int threshold,
+	ffuzzy_pair_callback callback, void *ctx
+);
+
+/** \} **/
+
+
+
+/**
+	\name Block String Interning
+	\{
+**/
+
+/**
+	\brief  Block ID which represents "no block"
+**/
+#define FFUZZY_BLOCK_ID_NONE ((size_t)-1)
+
+/**
+	\struct ffuzzy_block_table
+	\brief  Interning table of block strings
+	\details
+		This is an opaque type which maps each pair of
+		(effective block size, block string) to a block ID.
+		The effective block size of the first block of a digest is
+		its block size and the second one is double of the block size.
+		So, the second block of a digest with block size b and
+		the first block of a digest with block size 2b of the same file
+		share the same block ID.
+
+		Block IDs are assigned sequentially (from 0).
+		Identical block strings are always compared to get the same score
+		so that comparing block IDs can replace most comparisons in corpora
+		with many duplicate blocks.
+	\see   ffuzzy_block_table_new()
+**/
+typedef struct ffuzzy_block_table ffuzzy_block_table;
+
+/**
+	\struct ffuzzy_score_memo
+	\brief  Bounded memo table of block comparisons
+	\details
+		This is an opaque type which caches recent scores of
+		block ID pairs (direct-mapped; new entries replace old ones).
+		It must not be shared between threads.
+	\see   ffuzzy_score_memo_new()
+**/
+typedef struct ffuzzy_score_memo ffuzzy_score_memo;
+
+/**
+	\fn     ffuzzy_block_table* ffuzzy_block_table_new(void)
+	\brief  Create an empty interning table
+	\return The new table if succeeds; NULL otherwise.
+**/
+ffuzzy_block_table *ffuzzy_block_table_new(void);
+
+/**
+	\fn     void ffuzzy_block_table_free(ffuzzy_block_table*)
+	\brief  Free the interning table
+	\param  [in] tbl  The table to free (may be NULL)
+**/
+void ffuzzy_block_table_free(ffuzzy_block_table *tbl);
+
+/**
+	\fn     bool ffuzzy_block_table_intern(ffuzzy_block_table*, unsigned long, const char*, size_t, size_t*)
+	\brief  Intern a block string
+	\param  [in,out] tbl         The table
+	\param           block_size  Effective block size of the block string
+	\param  [in]     s           The block string
+	\param           slen        Length of s (at most FFUZZY_SPAMSUM_LENGTH)
+	\param  [out]    id          The pointer to store the block ID (may be NULL)
+	\return true if succeeds; false otherwise.
+**/
+bool ffuzzy_block_table_intern(
+	ffuzzy_block_table *tbl,
+	unsigned long block_size, const char *s, size_t slen,
+	size_t *id
+);
+
+/**
+	\fn     bool ffuzzy_block_table_intern_digest(ffuzzy_block_table*, const ffuzzy_digest*, size_t[2])
+	\brief  Intern both blocks of a digest
+	\details
+		If the second block cannot have an effective block size
+		(the block size is greater than ULONG_MAX / 2),
+		ids[1] is set to FFUZZY_BLOCK_ID_NONE.
+	\param  [in,out] tbl     The table
+	\param  [in]     digest  Valid digest
+	\param  [out]    ids     Buffer to store block IDs of first and second blocks
+	\return true if succeeds; false otherwise.
+**/
+bool ffuzzy_block_table_intern_digest(ffuzzy_block_table *tbl, const ffuzzy_digest *digest, size_t ids[2]);
+
+/**
+	\fn     size_t ffuzzy_block_table_size(const ffuzzy_block_table*)
+	\brief  Get the number of unique block strings
+	\param  [in] tbl  The table
+	\return Number of unique (effective block size, block string) pairs.
+**/
+size_t ffuzzy_block_table_size(const ffuzzy_block_table *tbl);
+
+/**
+	\fn     unsigned long long ffuzzy_block_table_total(const ffuzzy_block_table*)
+	\brief  Get the number of interned block strings (including duplicates)
+	\details
+		Together with ffuzzy_block_table_size, this gives
+		deduplication statistics of the corpus.
+	\param  [in] tbl  The table
+	\return Number of successful calls of ffuzzy_block_table_intern.
+**/
+unsigned long long ffuzzy_block_table_total(const ffuzzy_block_table *tbl);
+
+/**
+	\fn     int ffuzzy_block_table_score(const ffuzzy_block_table*, ffuzzy_score_memo*, size_t, size_t)
+	\brief  Compare two interned block strings
+	\details
+		The result is the same as ffuzzy_score_strings for
+		the block strings and their effective block size.
+	\param  [in]     tbl   The table
+	\param  [in,out] memo  The memo table (may be NULL)
+	\param           id1   Block ID 1
+	\param           id2   Block ID 2
+	\return [0,100] values represent partial similarity score or
+	        negative values if IDs are invalid or effective block sizes differ.
+**/
+int ffuzzy_block_table_score(const ffuzzy_block_table *tbl, ffuzzy_score_memo *memo, size_t id1, size_t id2);
+
+/**
+	\fn     ffuzzy_score_memo* ffuzzy_score_memo_new(size_t)
+	\brief  Create an empty memo table
+	\param  capacity  Number of entries (rounded up to a power of two)
+	\return The new memo table if succeeds; NULL otherwise.
+**/
+ffuzzy_score_memo *ffuzzy_score_memo_new(size_t capacity);
+
+/**
+	\fn     void ffuzzy_score_memo_free(ffuzzy_score_memo*)
+	\brief  Free the memo table
+	\param  [in] memo  The memo table to free (may be NULL)
+**/
+void ffuzzy_score_memo_free(ffuzzy_score_memo *memo);
+
+/**
+	\fn     void ffuzzy_score_memo_clear(ffuzzy_score_memo*)
+	\brief  Clear all entries and statistics of the memo table
+	\details
+		Entries are valid only for the interning table they were made for.
+		Clear the memo table before using it with another interning table.
+	\param  [in,out] memo  The memo table
+**/
+void ffuzzy_score_memo_clear(ffuzzy_score_memo *memo);
+
+/**
+	\fn     void ffuzzy_score_memo_stats(const ffuzzy_score_memo*, unsigned long long*, unsigned long long*)
+	\brief  Get hit and miss counts of the memo table
+	\param  [in]  memo    The memo table
+	\param  [out] hits    The pointer to store the number of hits (may be NULL)
+	\param  [out] misses  The pointer to store the number of misses (may be NULL)
+**/
+void ffuzzy_score_memo_stats(const ffuzzy_score_memo *memo, unsigned long long *hits, unsigned long long *misses);
+
+/** \} **/
+
+
+
+/**
+	\name Block-granular Index
+	\{
+**/
+
+/**
+	\struct ffuzzy_block_index
+	\brief  Digest index which stores each block separately
+	\details
+		This is an opaque type which splits each digest into two
+		single-block entries tagged with the effective block size
+		and the owner (digest ID). Entries are grouped into buckets by
+		the effective block size.
+
+		Since only blocks with the same effective block size
+		are compared, a query touches exactly two buckets
+		(its block size and double of it) and each comparison is
+		a same-bucket lookup. The digest-level score is the maximum of
+		partial scores of the owner. Buckets are independent so that
+		they can be distributed to threads or machines.
+
+		Blocks shorter than FFUZZY_MIN_MATCH are not indexed
+		because they never match.
+	\see   ffuzzy_block_index_new()
+**/
+typedef struct ffuzzy_block_index ffuzzy_block_index;
+
+/**
+	\fn     ffuzzy_block_index* ffuzzy_block_index_new(void)
+	\brief  Create an empty block-granular index
+	\return The new index if succeeds; NULL otherwise.
+**/
+ffuzzy_block_index *ffuzzy_block_index_new(void);
+
+/**
+	\fn     void ffuzzy_block_index_free(ffuzzy_block_index*)
+	\brief  Free the index
+	\param  [in] idx  The index to free (may be NULL)
+**/
+void ffuzzy_block_index_free(ffuzzy_block_index *idx);
+
+/**
+	\fn     bool ffuzzy_block_index_add(ffuzzy_block_index*, const ffuzzy_digest*, size_t*)
+	\brief  Add a digest to the index
+	\param  [in,out] idx     The index
+	\param  [in]     digest  Valid digest to add
+	\param  [out]    id      The pointer to store the digest ID (may be NULL)
+	\return true if succeeds; false otherwise (the index is left unchanged).
+**/
+bool ffuzzy_block_index_add(ffuzzy_block_index *idx, const ffuzzy_digest *digest, size_t *id);
+
+/**
+	\fn     size_t ffuzzy_block_index_size(const ffuzzy_block_index*)
+	\brief  Get the number of digests in the index
+	\param  [in] idx  The index
+	\return Number of digests.
+**/
+size_t ffuzzy_block_index_size(const ffuzzy_block_index *idx);
+
+/**
+	\fn     const ffuzzy_digest* ffuzzy_block_index_get(const ffuzzy_block_index*, size_t)
+	\brief  Get the digest by the ID
+	\param  [in] idx  The index
+	\param       id   Digest ID
+	\return The pointer to the digest if id is valid; NULL otherwise.
+**/
+const ffuzzy_digest *ffuzzy_block_index_get(const ffuzzy_block_index *idx, size_t id);
+
+/**
+	\fn     size_t ffuzzy_block_index_num_buckets(const ffuzzy_block_index*)
+	\brief  Get the number of buckets (distinct effective block sizes)
+	\param  [in] idx  The index
+	\return Number of buckets.
+**/
+size_t ffuzzy_block_index_num_buckets(const ffuzzy_block_index *idx);
+
+/**
+	\fn     bool ffuzzy_block_index_bucket(const ffuzzy_block_index*, size_t, unsigned long*, size_t*)
+	\brief  Get the effective block size and the number of entries of a bucket
+	\details
+		Buckets are sorted by the effective block size.
+	\param  [in]  idx         The index
+	\param        i           Bucket index [0,ffuzzy_block_index_num_buckets(idx))
+	\param  [out] block_size  The pointer to store the effective block size (may be NULL)
+	\param  [out] count       The pointer to store the number of entries (may be NULL)
+	\return true if i is valid; false otherwise.
+**/
+bool ffuzzy_block_index_bucket(const ffuzzy_block_index *idx, size_t i, unsigned long *block_size, size_t *count);
+
+/**
+	\fn     bool ffuzzy_block_index_search(const ffuzzy_block_index*, const ffuzzy_digest*, int, ffuzzy_match_list*)
+	\brief  Find all digests in the index with scores equal to or greater than the threshold
+	\details
+		Results are the same as ffuzzy_collection_search
+		(for block sizes up to ULONG_MAX / 2).
+	\param  [in]     idx        The index
+	\param  [in]     query      Valid digest to search
+	\param           threshold  Minimum score to match (values less than 1 are treated as 1)
+	\param  [in,out] results    Initialized list to store matches (best match first)
+	\return true if succeeds; false otherwise (results may be incomplete).
+**/
+bool ffuzzy_block_index_search(
+	const ffuzzy_block_index *idx, const ffuzzy_digest *query,
+	int threshold, ffuzzy_match_list *results
+);
+
+/**
+	\fn     bool ffuzzy_block_index_prepare(ffuzzy_block_index*)
+	\brief  Build sorted (trie) views of buckets for ffuzzy_block_index_search_trie
+	\details
+		Each bucket is sorted by block strings so that strings
+		with a common prefix form a contiguous range (a subtree).
+		Buckets modified after this call fall back to the linear scan
+		until this function is called again.
+	\param  [in,out] idx  The index
+	\return true if succeeds; false otherwise.
+**/
+bool ffuzzy_block_index_prepare(ffuzzy_block_index *idx);
+
+/**
+	\fn     bool ffuzzy_block_index_search_trie(const ffuzzy_block_index*, const ffuzzy_digest*, int, ffuzzy_match_list*)
+	\brief  Find all digests in the index with scores equal to or greater than the threshold (trie traversal)
+	\details
+		Buckets are traversed depth-first over the sorted view.
+		Bit-parallel LCS states along the prefix shared with the previous
+		string are reused, and a subtree is skipped once no string in it
+		can reach the threshold.
+
+		Results are the same as ffuzzy_block_index_search.
+	\param  [in]     idx        The index (prepared by ffuzzy_block_index_prepare)
+	\param  [in]     query      Valid digest to search
+	\param           threshold  Minimum score to match (values less than 1 are treated as 1)
+	\param  [in,out] results    Initialized list to store matches (best match first)
+	\return true if succeeds; false otherwise (results may be incomplete).
+**/
+bool ffuzzy_block_index_search_trie(
+	const ffuzzy_block_index *idx, const ffuzzy_digest *query,
+	int threshold, ffuzzy_match_list *results
+);
+
+/** \} **/
+
+
+
+/**
+	\name Approximate Search (MinHash/LSH)
+	\{
+**/
+
+/** \brief Maximum number of MinHash values per block signature (bands * rows) **/
+#define FFUZZY_LSH_MAX_HASHES 256
+
+/**
+	\struct ffuzzy_lsh_index
+	\brief  Approximate digest index by MinHash and locality-sensitive hashing
+	\details
+		This is an opaque type. Each block (tagged with its effective
+		block size) is converted to a MinHash signature over its q-grams
+		(substrings of length FFUZZY_MIN_MATCH, hashed by the rolling hash).
+		The signature is split into bands of rows and each band is
+		inserted to the LSH table under the effective block size.
+
+		Digests which share at least one band with the query are
+		candidates and they are verified by ffuzzy_compare_digest_near.
+		Scores are exact but some matches may be missed.
+		More bands (or less rows per band) increase recall
+		and the number of candidates.
+	\see   ffuzzy_lsh_index_new()
+**/
+typedef struct ffuzzy_lsh_index ffuzzy_lsh_index;
+
+/**
+	\fn     ffuzzy_lsh_index* ffuzzy_lsh_index_new(unsigned, unsigned)
+	\brief  Create an empty MinHash/LSH index
+	\param  bands  Number of bands (non-zero)
+	\param  rows   Number of rows per band (non-zero)
+	\return The new index if succeeds; NULL otherwise
+		(including bands * rows is greater than FFUZZY_LSH_MAX_HASHES).
+**/
+ffuzzy_lsh_index *ffuzzy_lsh_index_new(unsigned bands, unsigned rows);
+
+/**
+	\fn     void ffuzzy_lsh_index_free(ffuzzy_lsh_index*)
+	\brief  Free the index
+	\param  [in] idx  The index to free (may be NULL)
+**/
+void ffuzzy_lsh_index_free(ffuzzy_lsh_index *idx);
+
+/**
+	\fn     bool ffuzzy_lsh_index_add(ffuzzy_lsh_index*, const ffuzzy_digest*, size_t*)
+	\brief  Add a digest to the index
+	\param  [in,out] idx     The index
+	\param  [in]     digest  Valid digest to add
+	\param  [out]    id      The pointer to store the digest ID (may be NULL)
+	\return true if succeeds; false otherwise (the index is left unchanged).
+**/
+bool ffuzzy_lsh_index_add(ffuzzy_lsh_index *idx, const ffuzzy_digest *digest, size_t *id);
+
+/**
+	\fn     size_t ffuzzy_lsh_index_size(const ffuzzy_lsh_index*)
+	\brief  Get the number of digests in the index
+	\param  [in] idx  The index
+	\return Number of digests.
+**/
+size_t ffuzzy_lsh_index_size(const ffuzzy_lsh_index *idx);
+
+/**
+	\fn     const ffuzzy_digest* ffuzzy_lsh_index_get(const ffuzzy_lsh_index*, size_t)
+	\brief  Get the digest by the ID
+	\param  [in] idx  The index
+	\param       id   Digest ID
+	\return The pointer to the digest if id is valid; NULL otherwise.
+**/
+const ffuzzy_digest *ffuzzy_lsh_index_get(const ffuzzy_lsh_index *idx, size_t id);
+
+/**
+	\fn     bool ffuzzy_lsh_index_search(const ffuzzy_lsh_index*, const ffuzzy_digest*, int, ffuzzy_match_list*, size_t*)
+	\brief  Find digests in the index with scores equal to or greater than the threshold (approximate)
+	\details
+		Results are a subset of ffuzzy_collection_search on the same digests.
+		Digests identical to the query are always found
+		(if they score at least the threshold).
+	\param  [in]     idx          The index
+	\param  [in]     query        Valid digest to search
+	\param           threshold    Minimum score to match (values less than 1 are treated as 1)
+	\param  [in,out] results      Initialized list to store matches (best match first)
+	\param  [out]    ncandidates  The pointer to store the number of verified candidates (may be NULL)
+	\return true if succeeds; false otherwise (results may be incomplete).
+**/
+bool ffuzzy_lsh_index_search(
+	const ffuzzy_lsh_index *idx, const ffuzzy_digest *query,
+	int threshold, ffuzzy_match_list *results, size_t *ncandidates
+);
+
+/** \} **/
+
+
+
+/**
+	\name Concurrent Index
+	\{
+**/
+
+/**
+	\struct ffuzzy_concurrent_index
+	\brief  Block size-partitioned digest index which allows searching during insertion
+	\details
+		This is an opaque type. Insertion and compaction may be called
+		from any thread (they are serialized internally) while readers
+		search the index without taking any locks.
+
+		Each partition is a chain of append-only segments.
+		New digests are published atomically: a search sees each digest
+		either completely or not at all, and it sees all digests
+		inserted before the search started.
+		Compaction merges full segments of a partition into one
+		(for faster scanning). Replaced memory is freed after
+		all readers which may use it leave (epoch-based reclamation).
+
+		If threads are disabled, this index is not thread-safe
+		and the background compactor is not available.
+	\see   ffuzzy_concurrent_index_new()
+**/
+typedef struct ffuzzy_concurrent_index ffuzzy_concurrent_index;
+
+/**
+	\struct ffuzzy_concurrent_reader
+	\brief  Reader handle for ffuzzy_concurrent_index
+	\details
+		This is an opaque type. Each thread which searches
+		the index needs its own reader handle.
+	\see   ffuzzy_concurrent_reader_new()
+**/
+typedef struct ffuzzy_concurrent_reader ffuzzy_concurrent_reader;
+
+/**
+	\fn     ffuzzy_concurrent_index* ffuzzy_concurrent_index_new(void)
+	\brief  Create an empty concurrent index
+	\return The new index if succeeds; NULL otherwise.
+**/
+ffuzzy_concurrent_index *ffuzzy_concurrent_index_new(void);
+
+/**
+	\fn     void ffuzzy_concurrent_index_free(ffuzzy_concurrent_index*)
+	\brief  Free the index (and remaining reader handles)
+	\details
+		The background compactor is stopped if running.
+		No other threads may use the index (or its readers) at this time.
+	\param  [in] idx  The index to free (may be NULL)
+**/
+void ffuzzy_concurrent_index_free(ffuzzy_concurrent_index *idx);
+
+/**
+	\fn     bool ffuzzy_concurrent_index_add(ffuzzy_concurrent_index*, const ffuzzy_digest*, size_t*)
+	\brief  Add a digest to the index
+	\details
+		Digest IDs are assigned in the order of publication.
+	\param  [in,out] idx     The index
+	\param  [in]     digest  Valid digest to add
+	\param  [out]    id      The pointer to store the digest ID (may be NULL)
+	\return true if succeeds; false otherwise (the digest is not added).
+**/
+bool ffuzzy_concurrent_index_add(ffuzzy_concurrent_index *idx, const ffuzzy_digest *digest, size_t *id);
+
+/**
+	\fn     size_t ffuzzy_concurrent_index_size(const ffuzzy_concurrent_index*)
+	\brief  Get the number of published digests
+	\details
+		All digests with IDs less than the return value
+		are visible to searches started after this call.
+	\param  [in] idx  The index
+	\return Number of digests.
+**/
+size_t ffuzzy_concurrent_index_size(const ffuzzy_concurrent_index *idx);
+
+/**
+	\fn     bool ffuzzy_concurrent_index_compact(ffuzzy_concurrent_index*)
+	\brief  Merge segments of partitions which have many segments
+	\details
+		Segments are merged without blocking insertions or searches;
+		insertions only wait while a merged segment is linked in.
+		Compactions are serialized.
+	\param  [in,out] idx  The index
+	\return true if succeeds; false otherwise (some partitions may not be compacted).
+**/
+bool ffuzzy_concurrent_index_compact(ffuzzy_concurrent_index *idx);
+
+/**
+	\fn     bool ffuzzy_concurrent_index_start_compactor(ffuzzy_concurrent_index*, unsigned)
+	\brief  Start the background thread which periodically compacts the index
+	\param  [in,out] idx          The index
+	\param           interval_ms  Interval of compaction in milliseconds (non-zero)
+	\return true if succeeds; false otherwise (including threads are disabled or it is already running).
+**/
+bool ffuzzy_concurrent_index_start_compactor(ffuzzy_concurrent_index *idx, unsigned interval_ms);
+
+/**
+	\fn     void ffuzzy_concurrent_index_stop_compactor(ffuzzy_concurrent_index*)
+	\brief  Stop the background compactor (if running)
+	\param  [in,out] idx  The index
+**/
+void ffuzzy_concurrent_index_stop_compactor(ffuzzy_concurrent_index *idx);
+
+/**
+	\fn     ffuzzy_concurrent_reader* ffuzzy_concurrent_reader_new(ffuzzy_concurrent_index*)
+	\brief  Create a reader handle (this function takes the writer lock)
+	\param  [in,out] idx  The index
+	\return The new reader if succeeds; NULL otherwise.
+**/
+ffuzzy_concurrent_reader *ffuzzy_concurrent_reader_new(ffuzzy_concurrent_index *idx);
+
+/**
+	\fn     void ffuzzy_concurrent_reader_free(ffuzzy_concurrent_reader*)
+	\brief  Free the reader handle (this function takes the writer lock)
+	\param  [in] reader  The reader to free (may be NULL)
+**/
+void ffuzzy_concurrent_reader_free(ffuzzy_concurrent_reader *reader);
+
+/**
+	\fn     bool ffuzzy_concurrent_index_search(ffuzzy_concurrent_reader*, const ffuzzy_digest*, int, ffuzzy_match_list*)
+	\brief  Find all published digests with scores equal to or greater than the threshold
+	\details
+		This function never blocks.
+	\param  [in,out] reader     Reader handle of the calling thread
+	\param  [in]     query      Valid digest to search
+	\param           threshold  Minimum score to match (values less than 1 are treated as 1)
+	\param  [in,out] results    Initialized list to store matches (best match first)
+	\return true if succeeds; false otherwise (results may be incomplete).
+**/
+bool ffuzzy_concurrent_index_search(
+	ffuzzy_concurrent_reader *reader, const ffuzzy_digest *query,
+	int threshold, ffuzzy_match_list *results
+);
+
+/** \} **/
+
+
+
+/**
+	\name Binary Digest Records and Out-of-core Processing
+	\{
+**/
+
+/**
+	\fn     void ffuzzy_encode_digest_record(unsigned char*, unsigned long long, const ffuzzy_digest*)
+	\brief  Encode the digest to a binary digest record
+	\param  [out] buf     Buffer to store the record (FFUZZY_RECORD_SIZE bytes)
+	\param        id      Digest ID
+	\param  [in]  digest  A valid digest to encode
+	\see    FFUZZY_RECORD_SIZE
+**/
+void ffuzzy_encode_digest_record(unsigned char *buf, unsigned long long id, const ffuzzy_digest *digest);
+
+/**
+	\fn     bool ffuzzy_decode_digest_record(unsigned long long*, ffuzzy_digest*, const unsigned char*)
+	\brief  Decode the binary digest record
+	\details
+		This function always sets valid digest if succeeds.
+	\param  [out] id      The pointer to store the digest ID (may be NULL)
+	\param  [out] digest  The pointer to the buffer to store valid digest
+	\param  [in]  buf     The record (FFUZZY_RECORD_SIZE bytes)
+	\return true if succeeds; false if the record is invalid.
+**/
+bool ffuzzy_decode_digest_record(unsigned long long *id, ffuzzy_digest *digest, const unsigned char *buf);
+
+/**
+	\fn     bool ffuzzy_write_digest_record(FILE*, unsigned long long, const ffuzzy_digest*)
+	\brief  Write the digest as a binary digest record
+	\param  [in,out] fp      The file to write
+	\param           id      Digest ID
+	\param  [in]     digest  A valid digest to write
+	\return true if succeeds; false otherwise.
+**/
+bool ffuzzy_write_digest_record(FILE *fp, unsigned long long id, const ffuzzy_digest *digest);
+
+/**
+	\fn     bool ffuzzy_read_digest_record(FILE*, unsigned long long*, ffuzzy_digest*)
+	\brief  Read a binary digest record
+	\param  [in,out] fp      The file to read
+	\param  [out]    id      The pointer to store the digest ID (may be NULL)
+	\param  [out]    digest  The pointer to the buffer to store valid digest
+	\return
+		true if succeeds; false on the end of file, I/O error or an invalid record
+		(use feof and ferror to distinguish).
+**/
+bool ffuzzy_read_digest_record(FILE *fp, unsigned long long *id, ffuzzy_digest *digest);
+
+/**
+	\fn     bool ffuzzy_external_sort(FILE*, bool, FILE*, size_t)
+	\brief  Sort digests by block sizes using bounded memory
+	\details
+		Digests are sorted by ffuzzy_digestcmp_blocksize (and IDs for stable order)
+		into binary digest records. If the input does not fit in mem_budget bytes,
+		sorted runs are written to temporary files (tmpfile) and merged.
+
+		If text is true, the input is a list of ssdeep digests
+		(one per line, like the output of ssdeep -l) and IDs are assigned
+		sequentially to parsed digests. Lines which cannot be parsed
+		(such as the ssdeep header) are skipped.
+		Otherwise, the input consists of binary digest records and IDs are preserved.
+	\param  [in,out] in          The input file
+	\param           text        true if the input is a text digest list
+	\param  [in,out] out         The output file (binary digest records)
+	\param           mem_budget  Memory budget in bytes
+	\return true if succeeds; false otherwise.
+**/
+bool ffuzzy_external_sort(FILE *in, bool text, FILE *out, size_t mem_budget);
+
+/**
+	\fn     bool ffuzzy_external_allpairs(FILE*, int, size_t, ffuzzy_pair_callback, void*)
+	\brief  Find all similar pairs in a block size-sorted file using bounded memory
+	\details
+		Since digests only match if their block sizes are "near",
+		each block size group is only compared with itself and the group
+		with half block size. A sliding window of (up to) two groups is
+		kept in memory. Groups which do not fit in the memory budget are
+		processed in chunks (block nested loop with re-reading the file).
+
+		The callback receives digest IDs stored in the records
+		(the record with smaller block size or the earlier record comes first).
+	\param  [in,out] sorted      Seekable file of binary digest records sorted by ffuzzy_external_sort
+	\param           threshold   Minimum score to report (values less than 1 are treated as 1)
+	\param           mem_budget  Memory budget in bytes
+	\param           callback    The callback to receive matched pairs
+	\param           ctx         User-supplied context for callback
+	\return true if succeeds; false otherwise (including the file is not sorted).
+**/
+bool ffuzzy_external_allpairs(
+	FILE *sorted, int threshold, size_t mem_budget,
+	ffuzzy_pair_callback callback, void *ctx
+);
+
+/** \} **/
+
+
+
+/**
+	\name Hot-swappable Digest Databases
+	\{
+**/
+
+/**
+	\struct ffuzzy_db
+	\brief  Handle of a memory-mapped digest database
+	\details
+		This is an opaque type. A database file consists of binary digest
+		records sorted by block sizes (the output of ffuzzy_external_sort).
+
+		Readers pin the current snapshot (without locks) and
+		search it. ffuzzy_db_swap maps another file and replaces the
+		current snapshot atomically. The old file is unmapped when the
+		last reader releases it, so queries are never dropped or paused.
+	\see   ffuzzy_db_open()
+**/
+typedef struct ffuzzy_db ffuzzy_db;
+
+/**
+	\struct ffuzzy_db_snapshot
+	\brief  Pinned snapshot of a digest database
+	\details
+		This is an opaque type. The snapshot stays valid
+		until it is released by ffuzzy_db_release.
+	\see   ffuzzy_db_pin()
+**/
+typedef struct ffuzzy_db_snapshot ffuzzy_db_snapshot;
+
+/**
+	\fn     ffuzzy_db* ffuzzy_db_open(const char*)
+	\brief  Open a digest database file
+	\details
+		The whole file is validated on opening
+		(all records must be valid and sorted by block sizes).
+	\param  [in] path  Path to the database file
+	\return The new handle if succeeds; NULL otherwise.
+**/
+ffuzzy_db *ffuzzy_db_open(const char *path);
+
+/**
+	\fn     void ffuzzy_db_close(ffuzzy_db*)
+	\brief  Close the handle (and unmap the database)
+	\details
+		All pinned snapshots must be released before closing.
+	\param  [in] db  The handle to close (may be NULL)
+**/
+void ffuzzy_db_close(ffuzzy_db *db);
+
+/**
+	\fn     bool ffuzzy_db_swap(ffuzzy_db*, const char*)
+	\brief  Replace the current snapshot with another database file
+	\details
+		The new file is mapped and validated before the swap.
+		Readers which have pinned the old snapshot can continue using it.
+		A small header per swapped snapshot is kept until the handle is closed.
+	\param  [in,out] db    The handle
+	\param  [in]     path  Path to the new database file
+	\return true if succeeds; false otherwise (the current snapshot is not changed).
+**/
+bool ffuzzy_db_swap(ffuzzy_db *db, const char *path);
+
+/**
+	\fn     const ffuzzy_db_snapshot* ffuzzy_db_pin(ffuzzy_db*)
+	\brief  Pin the current snapshot
+	\details
+		This function takes no locks (it takes a reference with atomic
+		operations and retries only if it races with a swap).
+	\param  [in,out] db  The handle
+	\return The pinned snapshot.
+**/
+const ffuzzy_db_snapshot *ffuzzy_db_pin(ffuzzy_db *db);
+
+/**
+	\fn     void ffuzzy_db_release(const ffuzzy_db_snapshot*)
+	\brief  Release the pinned snapshot
+	\param  [in] snap  The snapshot to release (may be NULL)
+**/
+void ffuzzy_db_release(const ffuzzy_db_snapshot *snap);
+
+/**
+	\fn     size_t ffuzzy_db_snapshot_size(const ffuzzy_db_snapshot*)
+	\brief  Get the number of records in the snapshot
+	\param  [in] snap  The snapshot
+	\return Number of records.
+**/
+size_t ffuzzy_db_snapshot_size(const ffuzzy_db_snapshot *snap);
+
+/**
+	\fn     bool ffuzzy_db_snapshot_get(const ffuzzy_db_snapshot*, size_t, unsigned long long*, ffuzzy_digest*)
+	\brief  Get the record by the index
+	\param  [in]  snap    The snapshot
+	\param        index   Record index [0,ffuzzy_db_snapshot_size(snap))
+	\param  [out] id      The pointer to store the digest ID of the record (may be NULL)
+	\param  [out] digest  The pointer to store the digest
+	\return true if index is valid; false otherwise.
+**/
+bool ffuzzy_db_snapshot_get(const ffuzzy_db_snapshot *snap, size_t index, unsigned long long *id, ffuzzy_digest *digest);
+
+/**
+	\fn     bool ffuzzy_db_snapshot_search(const ffuzzy_db_snapshot*, const ffuzzy_digest*, int, ffuzzy_match_list*)
+	\brief  Find all records in the snapshot with scores equal to or greater than the threshold
+	\details
+		Match IDs are record indices (use ffuzzy_db_snapshot_get
+		to get digest IDs stored in the records).
+	\param  [in]     snap       The snapshot
+	\param  [in]     query      Valid digest to search
+	\param           threshold  Minimum score to match (values less than 1 are treated as 1)
+	\param  [in,out] results    Initialized list to store matches (best match first)
+	\return true if succeeds; false otherwise (results may be incomplete).
+**/
+bool ffuzzy_db_snapshot_search(
+	const ffuzzy_db_snapshot *snap, const ffuzzy_digest *query,
+	int threshold, ffuzzy_match_list *results
+);
+
+/** \} **/
+
+
+
+/**
+	\name Persistent Digest Stores
+	\{
+**/
+
+/**
+	\struct ffuzzy_store
+	\brief  Handle of a persistent incremental digest store
+	\details
+		This is an opaque type. A store is a directory which contains
+		an immutable base segment (a digest database sorted by block sizes)
+		and append-only delta segments. Searches merge the base and deltas.
+		ffuzzy_store_compact merges deltas into a new base
+		without blocking additions and searches.
+
+		Every delta entry and the manifest are protected by CRC-32 and
+		files are replaced in crash-safe order; a torn tail left by a crash
+		is discarded on opening. Additions are durable after ffuzzy_store_sync.
+	\see   ffuzzy_store_open()
+**/
+typedef struct ffuzzy_store ffuzzy_store;
+
+/**
+	\fn     ffuzzy_store* ffuzzy_store_open(const char*)
+	\brief  Open a digest store (creating it if it does not exist)
+	\details
+		Files left by interrupted compaction are removed and
+		a torn tail of delta segments is truncated on opening.
+	\param  [in] dir  Path to the store directory
+	\return The new handle if succeeds; NULL otherwise.
+**/
+ffuzzy_store *ffuzzy_store_open(const char *dir);
+
+/**
+	\fn     bool ffuzzy_store_close(ffuzzy_store*)
+	\brief  Sync and close the store
+	\param  [in] store  The store to close (may be NULL)
+	\return true if all additions are durable; false otherwise.
+**/
+bool ffuzzy_store_close(ffuzzy_store *store);
+
+/**
+	\fn     bool ffuzzy_store_add(ffuzzy_store*, const ffuzzy_digest*, size_t*)
+	\brief  Append a digest to the store
+	\details
+		IDs are assigned sequentially (and persist across reopening).
+		The digest is searchable immediately
+		but it is not durable until ffuzzy_store_sync is called.
+	\param  [in,out] store   The store
+	\param  [in]     digest  Valid digest to add
+	\param  [out]    id      The ID assigned to the digest (may be NULL)
+	\return true if succeeds; false otherwise.
+**/
+bool ffuzzy_store_add(ffuzzy_store *store, const ffuzzy_digest *digest, size_t *id);
+
+/**
+	\fn     bool ffuzzy_store_sync(ffuzzy_store*)
+	\brief  Make all additions durable
+	\param  [in,out] store  The store
+	\return true if succeeds; false otherwise.
+**/
+bool ffuzzy_store_sync(ffuzzy_store *store);
+
+/**
+	\fn     size_t ffuzzy_store_size(ffuzzy_store*)
+	\brief  Retrieve number of digests in the store
+	\param  [in] store  The store
+	\return Number of digests (the next ID to assign).
+**/
+size_t ffuzzy_store_size(ffuzzy_store *store);
+
+/**
+	\fn     bool ffuzzy_store_search(ffuzzy_store*, const ffuzzy_digest*, int, ffuzzy_match_list*)
+	\brief  Search for digests similar to the query
+	\param  [in]  store      The store
+	\param  [in]  query      Valid query digest
+	\param        threshold  Minimum score to report (values less than 1 are treated as 1)
+	\param  [out] results    Initialized match list (overwritten and sorted by score)
+	\return true if succeeds; false otherwise.
+**/
+bool ffuzzy_store_search(
+	ffuzzy_store *store, const ffuzzy_digest *query,
+	int threshold, ffuzzy_match_list *results
+);
+
+/**
+	\fn     bool ffuzzy_store_compact(ffuzzy_store*)
+	\brief  Merge delta segments into a new base segment
+	\details
+		The new base is written outside the store lock;
+		it may be called from a background thread.
+		On failure, the store is left consistent (the old base and deltas are kept).
+	\param  [in,out] store  The store
+	\return true if succeeds; false otherwise.
+**/
+bool ffuzzy_store_compact(ffuzzy_store *store);
+
+/** \} **/
+
+
+
+/**
+	\name Sharding
+	\{
+**/
+
+/**
+	\struct ffuzzy_shard_map
+	\brief  Rule to partition a digest collection into shards
+	\details
+		This is an opaque type. Each digest is stored in one shard (its owner)
+		and a query is sent to all shards which may have matches (its targets).
+		Per-shard results are combined with ffuzzy_match_list_merge.
+
+		Block size range partitioning keeps all digests with the same
+		block size in one shard and neighboring block sizes mostly together,
+		so most queries are sent to one or two shards.
+		Hash partitioning balances shards exactly but sends queries to all shards.
+	\see   ffuzzy_shard_map_new_range()
+	\see   ffuzzy_shard_map_new_hash()
+**/
+typedef struct ffuzzy_shard_map ffuzzy_shard_map;
+
+/**
+	\fn     ffuzzy_shard_map* ffuzzy_shard_map_new_range(const ffuzzy_digest*, size_t, unsigned)
+	\brief  Create a block size range partitioning balanced for the corpus
+	\details
+		Ranges are chosen so that each shard owns about the same number
+		of digests in the corpus (some shards may be empty if
+		the corpus has only a few distinct block sizes).
+		If the corpus is empty, natural block sizes are spread evenly.
+	\param  [in] digests  Valid digests (the corpus, may be NULL if n is 0)
+	\param       n        Number of digests
+	\param       nshards  Number of shards (non-zero)
+	\return The new map if succeeds; NULL otherwise.
+**/
+ffuzzy_shard_map *ffuzzy_shard_map_new_range(const ffuzzy_digest *digests, size_t n, unsigned nshards);
+
+/**
+	\fn     ffuzzy_shard_map* ffuzzy_shard_map_new_hash(unsigned)
+	\brief  Create a hash partitioning (by the digest)
+	\param  nshards  Number of shards (non-zero)
+	\return The new map if succeeds; NULL otherwise.
+**/
+ffuzzy_shard_map *ffuzzy_shard_map_new_hash(unsigned nshards);
+
+/**
+	\fn     void ffuzzy_shard_map_free(ffuzzy_shard_map*)
+	\brief  Free the map
+	\param  [in] map  The map to free (may be NULL)
+**/
+void ffuzzy_shard_map_free(ffuzzy_shard_map *map);
+
+/**
+	\fn     unsigned ffuzzy_shard_map_count(const ffuzzy_shard_map*)
+	\brief  Retrieve number of shards
+	\param  [in] map  The map
+	\return Number of shards.
+**/
+unsigned ffuzzy_shard_map_count(const ffuzzy_shard_map *map);
+
+/**
+	\fn     unsigned ffuzzy_shard_map_owner(const ffuzzy_shard_map*, const ffuzzy_digest*)
+	\brief  Retrieve the shard to store the digest
+	\param  [in] map     The map
+	\param  [in] digest  Valid digest
+	\return The shard index [0,ffuzzy_shard_map_count(map)).
+**/
+unsigned ffuzzy_shard_map_owner(const ffuzzy_shard_map *map, const ffuzzy_digest *digest);
+
+/**
+	\fn     unsigned ffuzzy_shard_map_targets(const ffuzzy_shard_map*, const ffuzzy_digest*, unsigned*)
+	\brief  Retrieve shards which may contain digests similar to the query
+	\param  [in]  map     The map
+	\param  [in]  query   Valid query digest
+	\param  [out] shards  Buffer to store shard indices in ascending order
+	                       (with ffuzzy_shard_map_count(map) elements)
+	\return Number of target shards.
+**/
+unsigned ffuzzy_shard_map_targets(const ffuzzy_shard_map *map, const ffuzzy_digest *query, unsigned *shards);
+
+/**
+	\fn     bool ffuzzy_match_list_merge(ffuzzy_match_list*, const ffuzzy_match_list*, size_t, size_t)
+	\brief  Merge sorted match lists (of disjoint shards)
+	\details
+		Matches are ranked by scores (descending) and then IDs (ascending)
+		as all search functions do, so the result does not depend on
+		the order of lists. If each list holds the best limit matches of
+		its shard, the result is the best limit matches of all shards.
+	\param  [out] results  Initialized list to store merged matches (overwritten)
+	\param  [in]  lists    Match lists (best match first)
+	\param        nlists   Number of lists
+	\param        limit    Maximum number of matches (0 for no limit)
+	\return true if succeeds; false otherwise.
+**/
+bool ffuzzy_match_list_merge(
+	ffuzzy_match_list *results,
+	const ffuzzy_match_list *lists, size_t nlists,
+	size_t limit
+);
+
+/** \} **/
+
+
+
+/**
+	\name Statistics
+	\{
+**/
+
+/**
+	\enum  ffuzzy_stat_counter
+	\brief Comparison stages counted by statistics
+	\details
+		A digest comparison either rejects block sizes or becomes a "near"
+		comparison. A near comparison either takes the fast path for
+		identical digests or compares pairs of blocks (one or two).
+		Each pair of blocks is rejected by block lengths, rejected
+		because of no common substrings or gets the edit distance.
+		With equal block sizes, the second pair is skipped instead
+		if the score of the first pair is already its upper bound.
+
+		Threshold searches count digest comparisons only for digests
+		which may reach the threshold. Their lane-parallel kernels count
+		pairs of blocks for whole lane blocks (including digests
+		which cannot reach the threshold).
+**/
+typedef enum
+{
+	/** \brief Digest pairs rejected because block sizes are not "near" **/
+	FFUZZY_STAT_BLOCKSIZE_REJECTS,
+	/** \brief Digest pairs compared with "near" block sizes **/
+	FFUZZY_STAT_NEAR_COMPARISONS,
+	/** \brief Near comparisons of identical digests (fast path) **/
+	FFUZZY_STAT_IDENTICAL,
+	/** \brief Block pairs rejected by block lengths **/
+	FFUZZY_STAT_LENGTH_REJECTS,
+	/** \brief Block pairs without common substrings of length FFUZZY_MIN_MATCH **/
+	FFUZZY_STAT_SUBSTRING_REJECTS,
+	/** \brief Block pairs whose edit distances are computed **/
+	FFUZZY_STAT_EDIT_DISTANCES,
+	/** \brief Block pairs skipped because the other pair already has a score they cannot exceed **/
+	FFUZZY_STAT_BOUND_SKIPS,
+	/** \brief Number of counters **/
+	FFUZZY_STAT_NUM_COUNTERS
+} ffuzzy_stat_counter;
+
+/**
+	\struct ffuzzy_stats
+	\brief  Snapshot of statistics (sum of all threads)
+	\var   ffuzzy_stats::counters
+	\brief Counters indexed by ffuzzy_stat_counter.
+**/
+typedef struct
+{
+	unsigned long long counters[FFUZZY_STAT_NUM_COUNTERS];
+} ffuzzy_stats;
+
+/**
+	\fn     bool ffuzzy_stats_available(void)
+	\brief  Determines whether statistics are compiled in (configure --enable-stats)
+	\return true if available; false otherwise (other functions do nothing).
+**/
+bool ffuzzy_stats_available(void);
+
+/**
+	\fn     void ffuzzy_stats_enable(bool)
+	\brief  Start or stop collecting statistics (disabled by default)
+	\details
+		While disabled, each counting point costs one load and a branch.
+	\param  enable  true to start; false to stop
+**/
+void ffuzzy_stats_enable(bool enable);
+
+/**
+	\fn     void ffuzzy_stats_get(ffuzzy_stats*)
+	\brief  Aggregate counters of all threads (since the last reset)
+	\details
+		Counters of exited threads are kept. Counters may be slightly
+		inconsistent with each other if other threads are comparing.
+	\param  [out] stats  Buffer to store counters
+**/
+void ffuzzy_stats_get(ffuzzy_stats *stats);
+
+/**
+	\fn     void ffuzzy_stats_reset(void)
+	\brief  Reset all counters to zero
+**/
+void ffuzzy_stats_reset(void);
+
+/**
+	\fn     const char* ffuzzy_stat_name(ffuzzy_stat_counter)
+	\brief  Retrieve the name of the counter (such as "edit_distances")
+	\return The name or NULL if the counter is invalid.
+**/
+const char *ffuzzy_stat_name(ffuzzy_stat_counter counter);
+
+/**
+	\enum  ffuzzy_timer
+	\brief Entry points measured by latency histograms
+**/
+typedef enum
+{
+	/** \brief ffuzzy_read_digest **/
+	FFUZZY_TIMER_READ_DIGEST,
+	/** \brief ffuzzy_compare **/
+	FFUZZY_TIMER_COMPARE,
+	/** \brief ffuzzy_collection_search and ffuzzy_collection_search_batch (per batch) **/
+	FFUZZY_TIMER_SEARCH,
+	/** \brief ffuzzy_collection_topk **/
+	FFUZZY_TIMER_TOPK,
+	/** \brief ffuzzy_join, ffuzzy_join_self and their q-gram variants **/
+	FFUZZY_TIMER_JOIN,
+	/** \brief Number of timers **/
+	FFUZZY_TIMER_NUM_TIMERS
+} ffuzzy_timer;
+
+/** \brief log2 of the number of linear sub-buckets in each power of two **/
+#define FFUZZY_LATENCY_SUB_BITS  3
+/** \brief Number of buckets in a latency histogram (up to 2^41 nanoseconds) **/
+#define FFUZZY_LATENCY_BUCKETS   ((41 - FFUZZY_LATENCY_SUB_BITS + 1) << FFUZZY_LATENCY_SUB_BITS)
+
+/**
+	\struct ffuzzy_latency_histogram
+	\brief  Log-linear histogram of latencies (in nanoseconds)
+	\details
+		Bucket i covers [ffuzzy_latency_bucket_lower(i), ffuzzy_latency_bucket_lower(i+1)).
+		Each power of two is split into 2^FFUZZY_LATENCY_SUB_BITS buckets
+		(relative error is at most 12.5%). The last bucket also holds
+		all larger latencies.
+
+	\var   ffuzzy_latency_histogram::counts
+	\brief Number of samples in each bucket.
+
+	\var   ffuzzy_latency_histogram::total
+	\brief Number of samples.
+
+	\var   ffuzzy_latency_histogram::sum_nsec
+	\brief Sum of all sampled latencies.
+**/
+typedef struct
+{
+	unsigned long long counts[FFUZZY_LATENCY_BUCKETS];
+	unsigned long long total;
+	unsigned long long sum_nsec;
+} ffuzzy_latency_histogram;
+
+/**
+	\enum  ffuzzy_latency_format
+	\brief Format of ffuzzy_latency_export
+**/
+typedef enum
+{
+	/** \brief One line per timer with percentiles (human readable) **/
+	FFUZZY_LATENCY_TEXT,
+	/** \brief One JSON object with percentiles and non-empty buckets **/
+	FFUZZY_LATENCY_JSON,
+} ffuzzy_latency_format;
+
+/**
+	\fn     void ffuzzy_latency_enable(bool)
+	\brief  Start or stop measuring latencies (disabled by default)
+	\details
+		Latencies are only measured if statistics are compiled in
+		(see ffuzzy_stats_available). While disabled, each entry point
+		costs one load and a branch.
+	\param  enable  true to start; false to stop
+**/
+void ffuzzy_latency_enable(bool enable);
+
+/**
+	\fn     bool ffuzzy_latency_set_sampling(ffuzzy_timer, unsigned)
+	\brief  Measure only one in every period calls of the entry point (per thread)
+	\details
+		By default, ffuzzy_read_digest and ffuzzy_compare are sampled
+		once in 16 calls and other entry points are always measured.
+	\param  timer   The timer
+	\param  period  Sampling period (1 to measure all calls)
+	\return true if succeeds; false if arguments are invalid.
+**/
+bool ffuzzy_latency_set_sampling(ffuzzy_timer timer, unsigned period);
+
+/**
+	\fn     void ffuzzy_latency_snapshot(ffuzzy_timer, ffuzzy_latency_histogram*)
+	\brief  Aggregate histograms of all threads (since the last reset)
+	\param        timer  The timer
+	\param  [out] hist   Buffer to store the histogram
+**/
+void ffuzzy_latency_snapshot(ffuzzy_timer timer, ffuzzy_latency_histogram *hist);
+
+/**
+	\fn     void ffuzzy_latency_reset(void)
+	\brief  Reset all latency histograms
+**/
+void ffuzzy_latency_reset(void);
+
+/**
+	\fn     void ffuzzy_latency_merge(ffuzzy_latency_histogram*, const ffuzzy_latency_histogram*)
+	\brief  Add a histogram to another (for example, from other processes)
+	\param  [in,out] dst  The histogram to add to
+	\param  [in]     src  The histogram to add
+**/
+void ffuzzy_latency_merge(ffuzzy_latency_histogram *dst, const ffuzzy_latency_histogram *src);
+
+/**
+	\fn     unsigned long long ffuzzy_latency_bucket_lower(size_t)
+	\brief  Retrieve the lower bound (inclusive) of a bucket in nanoseconds
+	\param  i  Index of the bucket (up to FFUZZY_LATENCY_BUCKETS)
+**/
+unsigned long long ffuzzy_latency_bucket_lower(size_t i);
+
+/**
+	\fn     unsigned long long ffuzzy_latency_percentile(const ffuzzy_latency_histogram*, double)
+	\brief  Estimate a percentile of latencies
+	\param  [in] hist  The histogram
+	\param       p     Percentile (in [0,100])
+	\return Upper bound of the bucket containing the percentile
+	        (in nanoseconds) or 0 if the histogram is empty.
+**/
+unsigned long long ffuzzy_latency_percentile(const ffuzzy_latency_histogram *hist, double p);
+
+/**
+	\fn     const char* ffuzzy_timer_name(ffuzzy_timer)
+	\brief  Retrieve the name of the timer (such as "compare")
+	\return The name or NULL if the timer is invalid.
+**/
+const char *ffuzzy_timer_name(ffuzzy_timer timer);
+
+/**
+	\fn     bool ffuzzy_latency_export(FILE*, ffuzzy_latency_format)
+	\brief  Write snapshots of all timers
+	\param  [out] fp      The stream to write to
+	\param        format  Output format
+	\return true if succeeds; false on write errors.
+**/
+bool ffuzzy_latency_export(FILE *fp, ffuzzy_latency_format format);
+
+/** \} **/
+
+
+
 /**
 	\name Internal Comparison Utilities
 	\{
@@ -0,0 +1,93 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_atomic.h
+	Atomic operations (internal)
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef FFUZZY_FFUZZY_ATOMIC_H
+#define FFUZZY_FFUZZY_ATOMIC_H
+
+/**
+	\internal
+	\file  ffuzzy_atomic.h
+	\brief Atomic operations
+	\details
+		These macros wrap GCC-compatible __atomic builtins
+		(checked by configure together with threads).
+		If threads are disabled, they are plain memory accesses.
+**/
+
+#include "ffuzzy_config.h"
+
+#ifdef FFUZZY_ENABLE_THREADS
+
+/** \internal \brief Load with acquire ordering **/
+#define ffuzzy_atomic_load_acquire_(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+/** \internal \brief Load without ordering constraints **/
+#define ffuzzy_atomic_load_relaxed_(p)      __atomic_load_n((p), __ATOMIC_RELAXED)
+/** \internal \brief Store with release ordering **/
+#define ffuzzy_atomic_store_release_(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+/** \internal \brief Store without ordering constraints **/
+#define ffuzzy_atomic_store_relaxed_(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+/** \internal \brief Add and return the previous value (sequentially consistent) **/
+#define ffuzzy_atomic_fetch_add_(p, v)      __atomic_fetch_add((p), (v), __ATOMIC_SEQ_CST)
+/** \internal \brief Subtract and return the previous value (sequentially consistent) **/
+#define ffuzzy_atomic_fetch_sub_(p, v)      __atomic_fetch_sub((p), (v), __ATOMIC_SEQ_CST)
+/** \internal \brief Replace the value if it is equal to expected one (sequentially consistent) **/
+#define ffuzzy_atomic_cas_(p, expected, desired) \
+	__atomic_compare_exchange_n((p), &(expected), (desired), false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+/** \internal \brief Full memory barrier **/
+#define ffuzzy_atomic_fence_()              __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#else
+
+#define ffuzzy_atomic_load_acquire_(p)      (*(p))
+#define ffuzzy_atomic_load_relaxed_(p)      (*(p))
+#define ffuzzy_atomic_store_release_(p, v)  ((void)(*(p) = (v)))
+#define ffuzzy_atomic_store_relaxed_(p, v)  ((void)(*(p) = (v)))
+#define ffuzzy_atomic_fetch_add_(p, v)      ffuzzy_atomic_fetch_add_ulong_((p), (v))
+#define ffuzzy_atomic_fetch_sub_(p, v)      ffuzzy_atomic_fetch_sub_ulong_((p), (v))
+#define ffuzzy_atomic_cas_(p, expected, desired) \
+	(*(p) == (expected) ? (*(p) = (desired), true) : ((expected) = *(p), false))
+#define ffuzzy_atomic_fence_()              ((void)0)
+
+/*
+	Functions (not expressions) so that the previous value
+	can be discarded without warnings. All counters are unsigned long.
+*/
+static inline unsigned long ffuzzy_atomic_fetch_add_ulong_(unsigned long *p, unsigned long v)
+{
+	unsigned long old = *p;
+	*p = old + v;
+	return old;
+}
+
+static inline unsigned long ffuzzy_atomic_fetch_sub_ulong_(unsigned long *p, unsigned long v)
+{
+	unsigned long old = *p;
+	*p = old - v;
+	return old;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,604 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_block_index.c
+	Block-granular index keyed by effective block sizes
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\internal
+	\file  ffuzzy_block_index.c
+	\brief Block-granular index keyed by effective block sizes
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_compare.h"
+#include "ffuzzy_match.h"
+#include "str_lcs_bitpar.h"
+#include "util.h"
+
+
+/**
+	\internal
+	\struct ffuzzy_block_index_entry
+	\brief  Single-block entry (a block string and its owner)
+**/
+typedef struct
+{
+	size_t owner;
+	unsigned char len;
+	char s[FFUZZY_SPAMSUM_LENGTH];
+} ffuzzy_block_index_entry;
+
+
+/**
+	\internal
+	\struct ffuzzy_block_bucket
+	\brief  Entries which share the same effective block size
+	\details
+		Entries are stored in insertion order
+		(so that owner IDs are sorted in ascending order).
+
+	\internal
+	\var   ffuzzy_block_bucket::sorted
+	\brief Entry indices sorted by block strings (lexicographically).
+	\details
+		Together with ffuzzy_block_bucket::lcp, this represents a trie of
+		block strings (subtrees are contiguous ranges).
+	\internal
+	\var   ffuzzy_block_bucket::lcp
+	\brief Length of longest common prefix of each sorted string and the previous one.
+	\internal
+	\var   ffuzzy_block_bucket::nsorted
+	\brief Number of entries when the sorted view was built (stale if not equal to count).
+**/
+typedef struct
+{
+	unsigned long block_size;
+	size_t count, capacity;
+	ffuzzy_block_index_entry *entries;
+	size_t *sorted;
+	unsigned char *lcp;
+	size_t nsorted;
+} ffuzzy_block_bucket;
+
+
+/**
+	\internal
+	\struct ffuzzy_block_index
+	\brief  Block-granular digest index
+
+	\internal
+	\var   ffuzzy_block_index::buckets
+	\brief Buckets (sorted by the effective block size).
+	\internal
+	\var   ffuzzy_block_index::nbuckets
+	\brief Number of buckets.
+	\internal
+	\var   ffuzzy_block_index::bucketcap
+	\brief Allocated number of entries for ffuzzy_block_index::buckets.
+	\internal
+	\var   ffuzzy_block_index::digests
+	\brief Original digests (indexed by digest ID).
+	\internal
+	\var   ffuzzy_block_index::count
+	\brief Number of digests.
+	\internal
+	\var   ffuzzy_block_index::capacity
+	\brief Allocated number of entries for ffuzzy_block_index::digests.
+**/
+struct ffuzzy_block_index
+{
+	ffuzzy_block_bucket **buckets;
+	size_t nbuckets, bucketcap;
+	ffuzzy_digest *digests;
+	size_t count, capacity;
+};
+
+
+ffuzzy_block_index *ffuzzy_block_index_new(void)
+{
+	return calloc(1, sizeof(ffuzzy_block_index));
+}
+
+
+void ffuzzy_block_index_free(ffuzzy_block_index *idx)
+{
+	if (!idx)
+		return;
+	for (size_t i = 0; i < idx->nbuckets; i++)
+	{
+		free(idx->buckets[i]->entries);
+		free(idx->buckets[i]->sorted);
+		free(idx->buckets[i]->lcp);
+		free(idx->buckets[i]);
+	}
+	free(idx->buckets);
+	free(idx->digests);
+	free(idx);
+}
+
+
+/**
+	\internal
+	\fn     size_t ffuzzy_block_index_lower_(const ffuzzy_block_index*, unsigned long)
+	\brief  Find the first bucket with the effective block size not less than given one
+**/
+static size_t ffuzzy_block_index_lower_(const ffuzzy_block_index *idx, unsigned long block_size)
+{
+	size_t lo = 0, hi = idx->nbuckets;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if (idx->buckets[mid]->block_size < block_size)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+
+/**
+	\internal
+	\fn     ffuzzy_block_bucket* ffuzzy_block_index_find_(const ffuzzy_block_index*, unsigned long)
+	\brief  Find the bucket with given effective block size
+	\return The bucket if exists; NULL otherwise.
+**/
+static ffuzzy_block_bucket *ffuzzy_block_index_find_(const ffuzzy_block_index *idx, unsigned long block_size)
+{
+	size_t i = ffuzzy_block_index_lower_(idx, block_size);
+	if (i < idx->nbuckets && idx->buckets[i]->block_size == block_size)
+		return idx->buckets[i];
+	return NULL;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_block_index_put_(ffuzzy_block_index*, unsigned long, size_t, const char*, size_t)
+	\brief  Append a single-block entry to the bucket (creating the bucket if necessary)
+	\return true if succeeds; false otherwise.
+**/
+static bool ffuzzy_block_index_put_(
+	ffuzzy_block_index *idx,
+	unsigned long block_size, size_t owner,
+	const char *s, size_t slen
+)
+{
+	size_t i = ffuzzy_block_index_lower_(idx, block_size);
+	ffuzzy_block_bucket *bucket;
+	if (i < idx->nbuckets && idx->buckets[i]->block_size == block_size)
+		bucket = idx->buckets[i];
+	else
+	{
+		if (!util_grow_array((void**)&idx->buckets, &idx->bucketcap, idx->nbuckets + 1, sizeof(ffuzzy_block_bucket*)))
+			return false;
+		bucket = calloc(1, sizeof(ffuzzy_block_bucket));
+		if (!bucket)
+			return false;
+		bucket->block_size = block_size;
+		memmove(idx->buckets + i + 1, idx->buckets + i, (idx->nbuckets - i) * sizeof(ffuzzy_block_bucket*));
+		idx->buckets[i] = bucket;
+		idx->nbuckets++;
+	}
+	if (!util_grow_array((void**)&bucket->entries, &bucket->capacity, bucket->count + 1, sizeof(ffuzzy_block_index_entry)))
+		return false;
+	ffuzzy_block_index_entry *e = &bucket->entries[bucket->count++];
+	e->owner = owner;
+	e->len = (unsigned char)slen;
+	memcpy(e->s, s, slen);
+	return true;
+}
+
+
+bool ffuzzy_block_index_add(ffuzzy_block_index *idx, const ffuzzy_digest *digest, size_t *id)
+{
+	assert(ffuzzy_digest_is_valid(digest));
+	if (!util_grow_array((void**)&idx->digests, &idx->capacity, idx->count + 1, sizeof(ffuzzy_digest)))
+		return false;
+	size_t owner = idx->count;
+	// blocks shorter than FFUZZY_MIN_MATCH never match (and are not indexed)
+	if (digest->len1 >= FFUZZY_MIN_MATCH)
+	{
+		if (!ffuzzy_block_index_put_(idx, digest->block_size, owner, digest->digest, digest->len1))
+			return false;
+	}
+	if (digest->len2 >= FFUZZY_MIN_MATCH && digest->block_size <= ULONG_MAX / 2)
+	{
+		if (!ffuzzy_block_index_put_(idx, digest->block_size * 2, owner, digest->digest + digest->len1, digest->len2))
+		{
+			// roll back the first block
+			if (digest->len1 >= FFUZZY_MIN_MATCH)
+				ffuzzy_block_index_find_(idx, digest->block_size)->count--;
+			return false;
+		}
+	}
+	idx->digests[owner] = *digest;
+	idx->count++;
+	if (id)
+		*id = owner;
+	return true;
+}
+
+
+size_t ffuzzy_block_index_size(const ffuzzy_block_index *idx)
+{
+	return idx->count;
+}
+
+
+const ffuzzy_digest *ffuzzy_block_index_get(const ffuzzy_block_index *idx, size_t id)
+{
+	if (id >= idx->count)
+		return NULL;
+	return &idx->digests[id];
+}
+
+
+size_t ffuzzy_block_index_num_buckets(const ffuzzy_block_index *idx)
+{
+	return idx->nbuckets;
+}
+
+
+bool ffuzzy_block_index_bucket(const ffuzzy_block_index *idx, size_t i, unsigned long *block_size, size_t *count)
+{
+	if (i >= idx->nbuckets)
+		return false;
+	if (block_size)
+		*block_size = idx->buckets[i]->block_size;
+	if (count)
+		*count = idx->buckets[i]->count;
+	return true;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_block_index_scan_(const ffuzzy_block_bucket*, const char*, size_t, int, ffuzzy_match_list*)
+	\brief  Compare a query block against all entries in the bucket
+	\details
+		Matched owners (and the partial scores) are appended to results.
+		Each owner appears at most once per bucket.
+	\return true if succeeds; false otherwise.
+**/
+static bool ffuzzy_block_index_scan_(
+	const ffuzzy_block_bucket *bucket,
+	const char *s, size_t slen,
+	int threshold, ffuzzy_match_list *results
+)
+{
+	bool ok = true;
+	unsigned long bs = bucket->block_size;
+	for (size_t k = 0; k < bucket->count; k++)
+	{
+		const ffuzzy_block_index_entry *e = &bucket->entries[k];
+		if (ffuzzy_score_strings_max_(slen, e->len, bs) < threshold)
+			continue;
+		int score = ffuzzy_score_strings_bitpar_(s, slen, e->s, e->len, bs);
+		if (score >= threshold && !ffuzzy_match_list_push_(results, e->owner, score))
+			ok = false;
+	}
+	return ok;
+}
+
+
+static int ffuzzy_block_index_owner_cmp_(const void *p1, const void *p2)
+{
+	const ffuzzy_match *m1 = p1, *m2 = p2;
+	if (m1->id != m2->id)
+		return m1->id < m2->id ? -1 : +1;
+	return m1->score > m2->score ? -1 : m1->score < m2->score ? +1 : 0;
+}
+
+
+/**
+	\internal
+	\fn     int ffuzzy_block_index_entry_cmp_(const ffuzzy_block_index_entry*, const ffuzzy_block_index_entry*)
+	\brief  Compare two entries by block strings (lexicographically)
+**/
+static int ffuzzy_block_index_entry_cmp_(const ffuzzy_block_index_entry *e1, const ffuzzy_block_index_entry *e2)
+{
+	int c = memcmp(e1->s, e2->s, MIN(e1->len, e2->len));
+	if (c)
+		return c;
+	return e1->len < e2->len ? -1 : e1->len > e2->len ? +1 : 0;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_block_index_sort_bucket_(ffuzzy_block_bucket*)
+	\brief  Build the sorted view of the bucket
+	\return true if succeeds; false otherwise.
+**/
+static bool ffuzzy_block_index_sort_bucket_(ffuzzy_block_bucket *bucket)
+{
+	size_t n = bucket->count;
+	if (n > ((size_t)-1) / sizeof(size_t))
+		return false;
+	size_t *sorted = malloc(sizeof(size_t) * (n ? n : 1));
+	unsigned char *lcp = malloc(n ? n : 1);
+	if (!sorted || !lcp)
+	{
+		free(sorted);
+		free(lcp);
+		return false;
+	}
+	for (size_t k = 0; k < n; k++)
+		sorted[k] = k;
+	// bottom-up merge sort (qsort cannot take entries as the context)
+	size_t *tmp = malloc(sizeof(size_t) * (n ? n : 1));
+	if (!tmp)
+	{
+		free(sorted);
+		free(lcp);
+		return false;
+	}
+	const ffuzzy_block_index_entry *entries = bucket->entries;
+	for (size_t width = 1; width < n; width *= 2)
+	{
+		for (size_t lo = 0; lo < n; lo += 2 * width)
+		{
+			size_t mid = MIN(lo + width, n), hi = MIN(lo + 2 * width, n);
+			size_t i = lo, j = mid, o = lo;
+			while (i < mid && j < hi)
+				tmp[o++] = ffuzzy_block_index_entry_cmp_(&entries[sorted[j]], &entries[sorted[i]]) < 0 ? sorted[j++] : sorted[i++];
+			while (i < mid)
+				tmp[o++] = sorted[i++];
+			while (j < hi)
+				tmp[o++] = sorted[j++];
+		}
+		size_t *t = sorted; sorted = tmp; tmp = t;
+		if (width > ((size_t)-1) / 2)
+			break;
+	}
+	free(tmp);
+	for (size_t k = 0; k < n; k++)
+	{
+		size_t l = 0;
+		if (k)
+		{
+			const ffuzzy_block_index_entry *e1 = &entries[sorted[k-1]], *e2 = &entries[sorted[k]];
+			size_t m = MIN(e1->len, e2->len);
+			while (l < m && e1->s[l] == e2->s[l])
+				l++;
+		}
+		lcp[k] = (unsigned char)l;
+	}
+	free(bucket->sorted);
+	free(bucket->lcp);
+	bucket->sorted = sorted;
+	bucket->lcp = lcp;
+	bucket->nsorted = n;
+	return true;
+}
+
+
+bool ffuzzy_block_index_prepare(ffuzzy_block_index *idx)
+{
+	for (size_t i = 0; i < idx->nbuckets; i++)
+	{
+		ffuzzy_block_bucket *bucket = idx->buckets[i];
+		if (bucket->nsorted == bucket->count && bucket->sorted)
+			continue;
+		if (!ffuzzy_block_index_sort_bucket_(bucket))
+			return false;
+	}
+	return true;
+}
+
+
+/**
+	\internal
+	\fn     int ffuzzy_block_index_trie_bound_(const lcs_bitpar_state*, size_t, size_t, const bool*, unsigned long, int)
+	\brief  Upper bound of the scores in a subtree
+	\details
+		When d characters of the target are processed,
+		LCS of the query and a target of length tlen is at most
+		H(slen - (tlen - d)) + (tlen - d) where H(j) is the LCS of
+		the first j characters of the query and the prefix.
+	\param  [in] st          Bit-parallel state after processing the prefix
+	\param       d           Length of the prefix
+	\param       slen        Length of the query block
+	\param  [in] lenok       Whether each target length may reach the threshold
+	\param       block_size  Effective block size
+	\param       threshold   Threshold (the bound is not computed beyond it)
+	\return Upper bound of partial scores (or a value not less than threshold).
+**/
+static int ffuzzy_block_index_trie_bound_(
+	const lcs_bitpar_state *st, size_t d, size_t slen,
+	const bool *lenok, unsigned long block_size, int threshold
+)
+{
+	int best = 0;
+	for (size_t tlen = MAX(d, FFUZZY_MIN_MATCH); tlen <= FFUZZY_SPAMSUM_LENGTH; tlen++)
+	{
+		if (!lenok[tlen])
+			continue;
+		size_t xlen = tlen - d;
+		int lcs;
+		if (xlen >= slen)
+			lcs = (int)slen;
+		else
+			lcs = lcs_bitpar_result(st, slen - xlen) + (int)xlen;
+		lcs = MIN(lcs, (int)MIN(tlen, slen));
+		int score = ffuzzy_score_dist_((int)slen + (int)tlen - 2 * lcs, slen, tlen, block_size);
+		if (score > best)
+		{
+			best = score;
+			if (best >= threshold)
+				break;
+		}
+	}
+	return best;
+}
+
+
+/** \internal \brief Depth interval of subtree pruning checks **/
+#define FFUZZY_BLOCK_INDEX_PRUNE_INTERVAL 4
+
+/**
+	\internal
+	\fn     bool ffuzzy_block_index_scan_trie_(const ffuzzy_block_bucket*, const char*, size_t, int, ffuzzy_match_list*)
+	\brief  Compare a query block against all entries in the bucket (depth-first over the trie)
+	\details
+		Sorted strings are visited in order and bit-parallel states
+		of the shared prefix (with the previous string) are reused.
+		If no string below the current prefix can reach the threshold,
+		the whole subtree is skipped.
+	\return true if succeeds; false otherwise.
+**/
+static bool ffuzzy_block_index_scan_trie_(
+	const ffuzzy_block_bucket *bucket,
+	const char *s, size_t slen,
+	int threshold, ffuzzy_match_list *results
+)
+{
+	if (bucket->nsorted != bucket->count || !bucket->sorted)
+		return ffuzzy_block_index_scan_(bucket, s, slen, threshold, results);
+	bool ok = true;
+	unsigned long bs = bucket->block_size;
+	bool lenok[FFUZZY_SPAMSUM_LENGTH + 1];
+	bool any = false;
+	for (size_t tlen = 0; tlen <= FFUZZY_SPAMSUM_LENGTH; tlen++)
+		any |= lenok[tlen] = ffuzzy_score_strings_max_(slen, tlen, bs) >= threshold;
+	if (!any)
+		return true;
+	lcs_bitpar_table table;
+	lcs_bitpar_state states[FFUZZY_SPAMSUM_LENGTH + 1];
+	memset(table, 0, sizeof(table));
+	for (size_t i = 0; i < slen; i++)
+		table[(unsigned char)s[i]] |= (uint_least64_t)1 << i;
+	lcs_bitpar_init(&states[0]);
+	size_t valid = 0;
+	for (size_t k = 0; k < bucket->count; k++)
+	{
+		const ffuzzy_block_index_entry *e = &bucket->entries[bucket->sorted[k]];
+		valid = MIN(valid, bucket->lcp[k]);
+		if (!lenok[e->len])
+			continue;
+		// states deeper than the prefix shared with the next string are never reused
+		// and subtrees with only this string are not worth pruning
+		size_t next = k + 1 < bucket->count ? bucket->lcp[k+1] : 0;
+		bool pruned = false;
+		lcs_bitpar_state st = states[valid];
+		for (size_t d = valid; d < e->len; )
+		{
+			lcs_bitpar_step(&st, table[(unsigned char)e->s[d]]);
+			d++;
+			if (d > next)
+				continue;
+			states[d] = st;
+			valid = d;
+			if (d % FFUZZY_BLOCK_INDEX_PRUNE_INTERVAL == 0 && d < e->len &&
+				ffuzzy_block_index_trie_bound_(&st, d, slen, lenok, bs, threshold) < threshold)
+			{
+				// skip all strings which share this prefix
+				while (k + 1 < bucket->count && bucket->lcp[k+1] >= d)
+					k++;
+				pruned = true;
+				break;
+			}
+		}
+		if (pruned || !st.hit)
+			continue;
+		int dist = (int)slen + (int)e->len - 2 * lcs_bitpar_result(&st, slen);
+		int score = ffuzzy_score_dist_(dist, slen, e->len, bs);
+		if (score >= threshold && !ffuzzy_match_list_push_(results, e->owner, score))
+			ok = false;
+	}
+	return ok;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_block_index_search_(const ffuzzy_block_index*, const ffuzzy_digest*, int, ffuzzy_match_list*, bool)
+	\brief  Common implementation of ffuzzy_block_index_search and ffuzzy_block_index_search_trie
+**/
+static bool ffuzzy_block_index_search_(
+	const ffuzzy_block_index *idx, const ffuzzy_digest *query,
+	int threshold, ffuzzy_match_list *results, bool trie
+)
+{
+	bool (*scan)(const ffuzzy_block_bucket*, const char*, size_t, int, ffuzzy_match_list*) =
+		trie ? ffuzzy_block_index_scan_trie_ : ffuzzy_block_index_scan_;
+	assert(ffuzzy_digest_is_valid(query));
+	bool ok = true;
+	unsigned long bs = query->block_size;
+	const ffuzzy_block_bucket *bucket;
+	results->count = 0;
+	threshold = MAX(threshold, 1);
+	// each query touches two buckets: bs (block 1) and bs*2 (block 2)
+	if (query->len1 >= FFUZZY_MIN_MATCH && (bucket = ffuzzy_block_index_find_(idx, bs)))
+		ok &= scan(bucket, query->digest, query->len1, threshold, results);
+	if (query->len2 >= FFUZZY_MIN_MATCH && bs <= ULONG_MAX / 2 && (bucket = ffuzzy_block_index_find_(idx, bs * 2)))
+		ok &= scan(bucket, query->digest + query->len1, query->len2, threshold, results);
+	// digest-level score is the maximum of partial scores of the owner
+	qsort(results->matches, results->count, sizeof(ffuzzy_match), ffuzzy_block_index_owner_cmp_);
+	size_t n = 0;
+	for (size_t i = 0; i < results->count; i++)
+	{
+		if (n && results->matches[n-1].id == results->matches[i].id)
+			continue;
+		ffuzzy_match m = results->matches[i];
+		// digests with extremely large block sizes have no effective block size
+		// for the second block; rescore them with the digest-level comparison
+		if (bs > ULONG_MAX / 2 || idx->digests[m.id].block_size > ULONG_MAX / 2)
+		{
+			m.score = ffuzzy_compare_digest_near(query, &idx->digests[m.id]);
+			if (m.score < threshold)
+				continue;
+		}
+		results->matches[n++] = m;
+	}
+	results->count = n;
+	ffuzzy_match_sort_(results->matches, results->count);
+	return ok;
+}
+
+
+bool ffuzzy_block_index_search(
+	const ffuzzy_block_index *idx, const ffuzzy_digest *query,
+	int threshold, ffuzzy_match_list *results
+)
+{
+	return ffuzzy_block_index_search_(idx, query, threshold, results, false);
+}
+
+bool ffuzzy_block_index_search_trie(
+	const ffuzzy_block_index *idx, const ffuzzy_digest *query,
+	int threshold, ffuzzy_match_list *results
+)
+{
+	return ffuzzy_block_index_search_(idx, query, threshold, results, true);
+}
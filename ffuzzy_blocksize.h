@@ -61,7 +61,7 @@ static inline bool ffuzzy_blocksize_is_natural_(unsigned long block_size)
 	\fn   bool ffuzzy_blocksize_is_near_(unsigned long, unsigned long)
 	\see  bool ffuzzy_blocksize_is_near(unsigned long, unsigned long)
 **/
-static inline bool ffuzzy_blocksize_is_near_(unsigned long block_size1, unsigned block_size2)
+static inline bool ffuzzy_blocksize_is_near_(unsigned long block_size1, unsigned long block_size2)
 {
 	return (
 		block_size1 == block_size2 ||
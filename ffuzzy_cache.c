@@ -0,0 +1,485 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_cache.c
+	Query result cache
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\internal
+	\file  ffuzzy_cache.c
+	\brief Query result cache
+	\details
+		Results are keyed by a 64-bit fingerprint of the (normalized)
+		query digest and query parameters. The fingerprint selects
+		a shard (each with its own lock) and a hash bucket in it.
+		Keys are compared exactly so that fingerprint collisions never
+		return wrong results.
+
+		Each shard is a fixed number of entries replaced by
+		the CLOCK algorithm (an approximation of LRU): a hit sets
+		the reference bit and the clock hand skips (and clears)
+		referenced entries once before evicting them.
+
+		Entries remember the version of the collection. Results from
+		older versions are treated as misses and replaced on the next store.
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_parallel.h"
+#include "util.h"
+
+/** \internal \brief End of bucket chains **/
+#define FFUZZY_CACHE_NONE ((size_t)-1)
+
+/** \internal \brief Query kind: threshold search **/
+#define FFUZZY_CACHE_SEARCH 1
+/** \internal \brief Query kind: top-k search **/
+#define FFUZZY_CACHE_TOPK   2
+
+
+/**
+	\internal
+	\struct ffuzzy_cache_key
+	\brief  Query and its parameters
+**/
+typedef struct
+{
+	uint_least64_t fp;
+	const ffuzzy_digest *query;
+	int kind;
+	int threshold;
+	size_t k;
+} ffuzzy_cache_key;
+
+/**
+	\internal
+	\struct ffuzzy_cache_entry
+	\brief  Cached result
+	\internal
+	\var   ffuzzy_cache_entry::next
+	\brief Next entry in the same bucket (or FFUZZY_CACHE_NONE).
+	\internal
+	\var   ffuzzy_cache_entry::ref
+	\brief Reference bit (set on hits, cleared by the clock hand).
+**/
+typedef struct
+{
+	uint_least64_t fp;
+	ffuzzy_digest query;
+	int kind;
+	int threshold;
+	size_t k;
+	unsigned long long version;
+	ffuzzy_match *matches;
+	size_t count;
+	size_t next;
+	bool ref;
+} ffuzzy_cache_entry;
+
+/**
+	\internal
+	\struct ffuzzy_cache_shard
+	\brief  Independently locked part of the cache
+	\internal
+	\var   ffuzzy_cache_shard::used
+	\brief Number of entries used (entries are never freed before the cache).
+	\internal
+	\var   ffuzzy_cache_shard::hand
+	\brief Clock hand (next entry to consider for eviction).
+**/
+typedef struct
+{
+	ffuzzy_mutex mutex;
+	ffuzzy_cache_entry *entries;
+	size_t capacity, used, hand;
+	size_t *buckets;
+	size_t mask;
+	unsigned long long hits, misses, evictions;
+} ffuzzy_cache_shard;
+
+/**
+	\internal
+	\struct ffuzzy_result_cache
+	\brief  Sharded query result cache
+**/
+struct ffuzzy_result_cache
+{
+	unsigned nshards;
+	ffuzzy_cache_shard *shards;
+};
+
+
+/**
+	\internal
+	\fn     uint_least64_t ffuzzy_cache_fingerprint_(const ffuzzy_digest*, int, int, size_t)
+	\brief  Compute the fingerprint (FNV-1a) of the query and parameters
+**/
+static uint_least64_t ffuzzy_cache_fingerprint_(const ffuzzy_digest *query, int kind, int threshold, size_t k)
+{
+	uint_least64_t h = UINT64_C(0xcbf29ce484222325);
+	unsigned long long params[4] = {
+		(unsigned long long)query->block_size,
+		(unsigned long long)query->len1 | (unsigned long long)kind << 8,
+		(unsigned long long)(unsigned)threshold,
+		(unsigned long long)k,
+	};
+	for (size_t i = 0; i < 4; i++)
+	{
+		for (size_t b = 0; b < sizeof(params[i]); b++)
+		{
+			h ^= (unsigned char)(params[i] >> (b * CHAR_BIT));
+			h *= UINT64_C(0x100000001b3);
+		}
+	}
+	for (size_t i = 0; i < query->len1 + query->len2; i++)
+	{
+		h ^= (unsigned char)query->digest[i];
+		h *= UINT64_C(0x100000001b3);
+	}
+	return h ^ (h >> 29);
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_cache_match_(const ffuzzy_cache_entry*, const ffuzzy_cache_key*)
+	\brief  Determines whether the entry has given key
+**/
+static inline bool ffuzzy_cache_match_(const ffuzzy_cache_entry *e, const ffuzzy_cache_key *key)
+{
+	return e->fp == key->fp
+		&& e->kind == key->kind
+		&& e->threshold == key->threshold
+		&& e->k == key->k
+		&& e->query.block_size == key->query->block_size
+		&& e->query.len1 == key->query->len1
+		&& e->query.len2 == key->query->len2
+		&& !memcmp(e->query.digest, key->query->digest, key->query->len1 + key->query->len2);
+}
+
+
+static inline ffuzzy_cache_shard *ffuzzy_cache_shard_(ffuzzy_result_cache *cache, uint_least64_t fp)
+{
+	return &cache->shards[(fp >> 32) % cache->nshards];
+}
+
+
+static inline size_t *ffuzzy_cache_bucket_(ffuzzy_cache_shard *shard, uint_least64_t fp)
+{
+	return &shard->buckets[(size_t)fp & shard->mask];
+}
+
+
+/**
+	\internal
+	\fn     ffuzzy_cache_entry* ffuzzy_cache_find_(ffuzzy_cache_shard*, const ffuzzy_cache_key*)
+	\brief  Find the entry with given key (the shard must be locked)
+**/
+static ffuzzy_cache_entry *ffuzzy_cache_find_(ffuzzy_cache_shard *shard, const ffuzzy_cache_key *key)
+{
+	for (size_t i = *ffuzzy_cache_bucket_(shard, key->fp); i != FFUZZY_CACHE_NONE; i = shard->entries[i].next)
+		if (ffuzzy_cache_match_(&shard->entries[i], key))
+			return &shard->entries[i];
+	return NULL;
+}
+
+
+/**
+	\internal
+	\fn     ffuzzy_cache_entry* ffuzzy_cache_evict_(ffuzzy_cache_shard*, ffuzzy_match**)
+	\brief  Take an unused entry or evict one by the clock (the shard must be locked)
+	\param  [out] old  Matches of the evicted entry (to be freed after unlocking)
+	\return The entry detached from buckets.
+**/
+static ffuzzy_cache_entry *ffuzzy_cache_evict_(ffuzzy_cache_shard *shard, ffuzzy_match **old)
+{
+	*old = NULL;
+	if (shard->used < shard->capacity)
+		return &shard->entries[shard->used++];
+	ffuzzy_cache_entry *e;
+	for (;;)
+	{
+		e = &shard->entries[shard->hand];
+		shard->hand = (shard->hand + 1) % shard->capacity;
+		if (!e->ref)
+			break;
+		e->ref = false;
+	}
+	// unlink from the bucket
+	size_t idx = (size_t)(e - shard->entries);
+	size_t *p = ffuzzy_cache_bucket_(shard, e->fp);
+	while (*p != idx)
+		p = &shard->entries[*p].next;
+	*p = e->next;
+	*old = e->matches;
+	shard->evictions++;
+	return e;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_cache_lookup_(ffuzzy_result_cache*, const ffuzzy_cache_key*, unsigned long long, ffuzzy_match_list*)
+	\brief  Copy cached results to the list
+	\return true if hit; false otherwise (including memory failures).
+**/
+static bool ffuzzy_cache_lookup_(
+	ffuzzy_result_cache *cache, const ffuzzy_cache_key *key,
+	unsigned long long version, ffuzzy_match_list *results
+)
+{
+	ffuzzy_cache_shard *shard = ffuzzy_cache_shard_(cache, key->fp);
+	bool hit = false;
+	ffuzzy_mutex_lock_(&shard->mutex);
+	ffuzzy_cache_entry *e = ffuzzy_cache_find_(shard, key);
+	if (e && e->version == version
+		&& util_grow_array((void**)&results->matches, &results->capacity, e->count, sizeof(ffuzzy_match)))
+	{
+		if (e->count)
+			memcpy(results->matches, e->matches, sizeof(ffuzzy_match) * e->count);
+		results->count = e->count;
+		e->ref = true;
+		hit = true;
+		shard->hits++;
+	}
+	else
+		shard->misses++;
+	ffuzzy_mutex_unlock_(&shard->mutex);
+	return hit;
+}
+
+
+/**
+	\internal
+	\fn     void ffuzzy_cache_store_(ffuzzy_result_cache*, const ffuzzy_cache_key*, unsigned long long, const ffuzzy_match*, size_t)
+	\brief  Store results (silently ignored on memory failures)
+**/
+static void ffuzzy_cache_store_(
+	ffuzzy_result_cache *cache, const ffuzzy_cache_key *key,
+	unsigned long long version, const ffuzzy_match *matches, size_t count
+)
+{
+	// copy outside the lock
+	ffuzzy_match *copy = NULL, *old;
+	if (count)
+	{
+		if (count > ((size_t)-1) / sizeof(ffuzzy_match))
+			return;
+		copy = malloc(sizeof(ffuzzy_match) * count);
+		if (!copy)
+			return;
+		memcpy(copy, matches, sizeof(ffuzzy_match) * count);
+	}
+	ffuzzy_cache_shard *shard = ffuzzy_cache_shard_(cache, key->fp);
+	ffuzzy_mutex_lock_(&shard->mutex);
+	ffuzzy_cache_entry *e = ffuzzy_cache_find_(shard, key);
+	if (e)
+	{
+		// another thread may have stored newer results
+		if (e->version > version)
+		{
+			ffuzzy_mutex_unlock_(&shard->mutex);
+			free(copy);
+			return;
+		}
+		old = e->matches;
+	}
+	else
+	{
+		e = ffuzzy_cache_evict_(shard, &old);
+		size_t *bucket = ffuzzy_cache_bucket_(shard, key->fp);
+		e->fp = key->fp;
+		e->query = *key->query;
+		e->kind = key->kind;
+		e->threshold = key->threshold;
+		e->k = key->k;
+		e->next = *bucket;
+		e->ref = false;
+		*bucket = (size_t)(e - shard->entries);
+	}
+	e->version = version;
+	e->matches = copy;
+	e->count = count;
+	ffuzzy_mutex_unlock_(&shard->mutex);
+	free(old);
+}
+
+
+ffuzzy_result_cache *ffuzzy_result_cache_new(size_t capacity, unsigned nshards)
+{
+	if (!capacity)
+		return NULL;
+	if (!nshards)
+		nshards = 16;
+	if (nshards > capacity)
+		nshards = (unsigned)capacity;
+	ffuzzy_result_cache *cache = malloc(sizeof(ffuzzy_result_cache));
+	if (!cache)
+		return NULL;
+	cache->shards = calloc(nshards, sizeof(ffuzzy_cache_shard));
+	if (!cache->shards)
+	{
+		free(cache);
+		return NULL;
+	}
+	cache->nshards = 0;
+	for (unsigned s = 0; s < nshards; s++)
+	{
+		ffuzzy_cache_shard *shard = &cache->shards[s];
+		// distribute capacity (first shards get one more entry)
+		shard->capacity = capacity / nshards + (s < capacity % nshards);
+		size_t nbuckets = 1;
+		while (nbuckets < shard->capacity)
+			nbuckets *= 2;
+		shard->mask = nbuckets - 1;
+		shard->entries = malloc(sizeof(ffuzzy_cache_entry) * shard->capacity);
+		shard->buckets = malloc(sizeof(size_t) * nbuckets);
+		if (!shard->entries || !shard->buckets || !ffuzzy_mutex_init_(&shard->mutex))
+		{
+			free(shard->entries);
+			free(shard->buckets);
+			ffuzzy_result_cache_free(cache);
+			return NULL;
+		}
+		for (size_t i = 0; i < nbuckets; i++)
+			shard->buckets[i] = FFUZZY_CACHE_NONE;
+		cache->nshards++;
+	}
+	return cache;
+}
+
+
+void ffuzzy_result_cache_free(ffuzzy_result_cache *cache)
+{
+	if (!cache)
+		return;
+	for (unsigned s = 0; s < cache->nshards; s++)
+	{
+		ffuzzy_cache_shard *shard = &cache->shards[s];
+		for (size_t i = 0; i < shard->used; i++)
+			free(shard->entries[i].matches);
+		free(shard->entries);
+		free(shard->buckets);
+		ffuzzy_mutex_destroy_(&shard->mutex);
+	}
+	free(cache->shards);
+	free(cache);
+}
+
+
+void ffuzzy_result_cache_clear(ffuzzy_result_cache *cache)
+{
+	for (unsigned s = 0; s < cache->nshards; s++)
+	{
+		ffuzzy_cache_shard *shard = &cache->shards[s];
+		ffuzzy_mutex_lock_(&shard->mutex);
+		for (size_t i = 0; i < shard->used; i++)
+			free(shard->entries[i].matches);
+		for (size_t i = 0; i <= shard->mask; i++)
+			shard->buckets[i] = FFUZZY_CACHE_NONE;
+		shard->used = 0;
+		shard->hand = 0;
+		ffuzzy_mutex_unlock_(&shard->mutex);
+	}
+}
+
+
+void ffuzzy_result_cache_stats(ffuzzy_result_cache *cache, ffuzzy_result_cache_counters *stats)
+{
+	stats->hits = 0;
+	stats->misses = 0;
+	stats->evictions = 0;
+	stats->entries = 0;
+	for (unsigned s = 0; s < cache->nshards; s++)
+	{
+		ffuzzy_cache_shard *shard = &cache->shards[s];
+		ffuzzy_mutex_lock_(&shard->mutex);
+		stats->hits += shard->hits;
+		stats->misses += shard->misses;
+		stats->evictions += shard->evictions;
+		stats->entries += shard->used;
+		ffuzzy_mutex_unlock_(&shard->mutex);
+	}
+}
+
+
+bool ffuzzy_collection_search_cached(
+	ffuzzy_result_cache *cache,
+	const ffuzzy_collection *coll, const ffuzzy_digest *query,
+	int threshold, ffuzzy_match_list *results
+)
+{
+	assert(ffuzzy_digest_is_valid(query));
+	ffuzzy_cache_key key;
+	// thresholds less than 1 are equivalent
+	threshold = MAX(threshold, 1);
+	key.query = query;
+	key.kind = FFUZZY_CACHE_SEARCH;
+	key.threshold = threshold;
+	key.k = 0;
+	key.fp = ffuzzy_cache_fingerprint_(query, key.kind, key.threshold, key.k);
+	unsigned long long version = ffuzzy_collection_version(coll);
+	if (ffuzzy_cache_lookup_(cache, &key, version, results))
+		return true;
+	if (!ffuzzy_collection_search(coll, query, threshold, results))
+		return false;
+	ffuzzy_cache_store_(cache, &key, version, results->matches, results->count);
+	return true;
+}
+
+
+size_t ffuzzy_collection_topk_cached(
+	ffuzzy_result_cache *cache,
+	const ffuzzy_collection *coll, const ffuzzy_digest *query,
+	size_t k, int min_score, ffuzzy_match *matches
+)
+{
+	assert(ffuzzy_digest_is_valid(query));
+	ffuzzy_cache_key key;
+	min_score = MAX(min_score, 1);
+	key.query = query;
+	key.kind = FFUZZY_CACHE_TOPK;
+	key.threshold = min_score;
+	key.k = k;
+	key.fp = ffuzzy_cache_fingerprint_(query, key.kind, key.threshold, key.k);
+	unsigned long long version = ffuzzy_collection_version(coll);
+	// cached results have at most k matches (the list never grows)
+	ffuzzy_match_list list;
+	list.matches = matches;
+	list.count = 0;
+	list.capacity = k;
+	if (ffuzzy_cache_lookup_(cache, &key, version, &list))
+		return list.count;
+	size_t n = ffuzzy_collection_topk(coll, query, k, min_score, matches);
+	ffuzzy_cache_store_(cache, &key, version, matches, n);
+	return n;
+}
@@ -0,0 +1,218 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_cluster.c
+	Incremental clustering of fuzzy hashes
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\internal
+	\file  ffuzzy_cluster.c
+	\brief Incremental clustering of fuzzy hashes
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_collection.h"
+#include "util.h"
+
+
+/**
+	\internal
+	\struct ffuzzy_clustering
+	\brief  Clustered digest collection
+
+	\internal
+	\var   ffuzzy_clustering::coll
+	\brief Digests (IDs are shared with ffuzzy_clustering::parent).
+	\internal
+	\var   ffuzzy_clustering::parent
+	\brief Disjoint-set forest (parent of each digest ID).
+	\details
+		Each root is the minimum ID of its cluster.
+	\internal
+	\var   ffuzzy_clustering::capacity
+	\brief Allocated number of entries for ffuzzy_clustering::parent.
+	\internal
+	\var   ffuzzy_clustering::nclusters
+	\brief Number of clusters.
+	\internal
+	\var   ffuzzy_clustering::threshold
+	\brief Minimum score to link two digests.
+**/
+struct ffuzzy_clustering
+{
+	ffuzzy_collection *coll;
+	size_t *parent;
+	size_t capacity;
+	size_t nclusters;
+	int threshold;
+};
+
+
+ffuzzy_clustering *ffuzzy_clustering_new(int threshold)
+{
+	if (threshold <= 0 || threshold > 100)
+		return NULL;
+	ffuzzy_clustering *cl = calloc(1, sizeof(ffuzzy_clustering));
+	if (!cl)
+		return NULL;
+	cl->coll = ffuzzy_collection_new();
+	if (!cl->coll)
+	{
+		free(cl);
+		return NULL;
+	}
+	cl->threshold = threshold;
+	return cl;
+}
+
+
+void ffuzzy_clustering_free(ffuzzy_clustering *cl)
+{
+	if (!cl)
+		return;
+	ffuzzy_collection_free(cl->coll);
+	free(cl->parent);
+	free(cl);
+}
+
+
+/**
+	\internal
+	\fn     size_t ffuzzy_clustering_find_(ffuzzy_clustering*, size_t)
+	\brief  Find the root of given digest (with path halving)
+**/
+static inline size_t ffuzzy_clustering_find_(ffuzzy_clustering *cl, size_t id)
+{
+	size_t *parent = cl->parent;
+	while (parent[id] != id)
+	{
+		parent[id] = parent[parent[id]];
+		id = parent[id];
+	}
+	return id;
+}
+
+
+/**
+	\internal
+	\fn     size_t ffuzzy_clustering_union_(ffuzzy_clustering*, size_t, size_t)
+	\brief  Merge two clusters (given by their roots)
+	\return The root of merged cluster.
+**/
+static inline size_t ffuzzy_clustering_union_(ffuzzy_clustering *cl, size_t root1, size_t root2)
+{
+	if (root1 == root2)
+		return root1;
+	cl->nclusters--;
+	// keep minimum ID as the root (label) to make labels stable
+	if (root1 < root2)
+	{
+		cl->parent[root2] = root1;
+		return root1;
+	}
+	else
+	{
+		cl->parent[root1] = root2;
+		return root2;
+	}
+}
+
+
+bool ffuzzy_clustering_add(
+	ffuzzy_clustering *cl,
+	const ffuzzy_digest *digests, size_t count,
+	ffuzzy_pair_callback callback, void *ctx
+)
+{
+	bool ok = true;
+	size_t first = cl->coll->count;
+	if (count > ((size_t)-1) - first)
+		return false;
+	if (!util_grow_array((void**)&cl->parent, &cl->capacity, first + count, sizeof(size_t)))
+		return false;
+	// insert new digests first (new-vs-new pairs are handled below)
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t id;
+		if (!ffuzzy_collection_add(cl->coll, &digests[i], &id))
+		{
+			ok = false;
+			break;
+		}
+		cl->parent[id] = id;
+		cl->nclusters++;
+	}
+	// compare each new digest with all older digests (of "near" block sizes)
+	size_t last = cl->coll->count;
+	for (size_t id = first; id < last; id++)
+	{
+		const ffuzzy_digest *d = ffuzzy_collection_get(cl->coll, id);
+		ffuzzy_partition *parts[3];
+		size_t nparts = ffuzzy_collection_near_partitions_(cl->coll, d->block_size, parts);
+		size_t root = ffuzzy_clustering_find_(cl, id);
+		for (size_t p = 0; p < nparts; p++)
+		{
+			const ffuzzy_partition *part = parts[p];
+			// IDs in a partition are sorted: stop on the first non-older digest
+			for (size_t j = 0; j < part->count && part->ids[j] < id; j++)
+			{
+				size_t other = part->ids[j];
+				// if we don't need edges, skip digests in the same cluster
+				if (!callback && ffuzzy_clustering_find_(cl, other) == root)
+					continue;
+				int score = ffuzzy_compare_digest_near(d, &part->digests[j]);
+				if (score < cl->threshold)
+					continue;
+				root = ffuzzy_clustering_union_(cl, root, ffuzzy_clustering_find_(cl, other));
+				if (callback)
+					callback(ctx, other, id, score);
+			}
+		}
+	}
+	return ok;
+}
+
+
+size_t ffuzzy_clustering_label(ffuzzy_clustering *cl, size_t id)
+{
+	assert(id < cl->coll->count);
+	return ffuzzy_clustering_find_(cl, id);
+}
+
+
+size_t ffuzzy_clustering_num_clusters(const ffuzzy_clustering *cl)
+{
+	return cl->nclusters;
+}
+
+
+const ffuzzy_collection *ffuzzy_clustering_collection(const ffuzzy_clustering *cl)
+{
+	return cl->coll;
+}
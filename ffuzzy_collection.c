@@ -0,0 +1,151 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_collection.c
+	Block size-partitioned digest collection
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\internal
+	\file  ffuzzy_collection.c
+	\brief Block size-partitioned digest collection
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_collection.h"
+#include "util.h"
+
+
+ffuzzy_collection *ffuzzy_collection_new(void)
+{
+	return calloc(1, sizeof(ffuzzy_collection));
+}
+
+
+void ffuzzy_collection_free(ffuzzy_collection *coll)
+{
+	if (!coll)
+		return;
+	for (size_t i = 0; i < coll->nparts; i++)
+	{
+		free(coll->parts[i]->digests);
+		free(coll->parts[i]->ids);
+		ffuzzy_gram_index_free_(coll->parts[i]->index);
+		free(coll->parts[i]);
+	}
+	free(coll->parts);
+	free(coll->locs);
+	free(coll);
+}
+
+
+/**
+	\internal
+	\fn     ffuzzy_partition* ffuzzy_collection_get_partition_(ffuzzy_collection*, unsigned long)
+	\brief  Find the partition which has given block size (or create new one)
+	\param  [in,out] coll        The collection
+	\param           block_size  Block size to find
+	\return The partition if succeeds; NULL otherwise.
+**/
+static ffuzzy_partition *ffuzzy_collection_get_partition_(ffuzzy_collection *coll, unsigned long block_size)
+{
+	size_t lo = 0, hi = coll->nparts;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		unsigned long bs = coll->parts[mid]->block_size;
+		if (bs == block_size)
+			return coll->parts[mid];
+		if (bs < block_size)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	// insert new partition (keeping partitions sorted)
+	if (!util_grow_array((void**)&coll->parts, &coll->partcap, coll->nparts + 1, sizeof(ffuzzy_partition*)))
+		return NULL;
+	ffuzzy_partition *part = calloc(1, sizeof(ffuzzy_partition));
+	if (!part)
+		return NULL;
+	part->block_size = block_size;
+	memmove(coll->parts + lo + 1, coll->parts + lo, (coll->nparts - lo) * sizeof(ffuzzy_partition*));
+	coll->parts[lo] = part;
+	coll->nparts++;
+	return part;
+}
+
+
+bool ffuzzy_collection_add(ffuzzy_collection *coll, const ffuzzy_digest *digest, size_t *id)
+{
+	assert(ffuzzy_digest_is_valid(digest));
+	if (!util_grow_array((void**)&coll->locs, &coll->capacity, coll->count + 1, sizeof(ffuzzy_collection_loc)))
+		return false;
+	ffuzzy_partition *part = ffuzzy_collection_get_partition_(coll, digest->block_size);
+	if (!part)
+		return false;
+	size_t cap = part->capacity;
+	if (!util_grow_array((void**)&part->digests, &cap, part->count + 1, sizeof(ffuzzy_digest)))
+		return false;
+	cap = part->capacity;
+	if (!util_grow_array((void**)&part->ids, &cap, part->count + 1, sizeof(size_t)))
+		return false;
+	part->capacity = cap;
+	part->digests[part->count] = *digest;
+	part->ids[part->count] = coll->count;
+	coll->locs[coll->count].part  = part;
+	coll->locs[coll->count].index = part->count;
+	part->hist1[digest->len1]++;
+	part->hist2[digest->len2]++;
+	part->count++;
+	if (id)
+		*id = coll->count;
+	coll->count++;
+	coll->version++;
+	return true;
+}
+
+
+size_t ffuzzy_collection_size(const ffuzzy_collection *coll)
+{
+	return coll->count;
+}
+
+
+unsigned long long ffuzzy_collection_version(const ffuzzy_collection *coll)
+{
+	return coll->version;
+}
+
+
+const ffuzzy_digest *ffuzzy_collection_get(const ffuzzy_collection *coll, size_t id)
+{
+	if (id >= coll->count)
+		return NULL;
+	return &coll->locs[id].part->digests[coll->locs[id].index];
+}
@@ -0,0 +1,294 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_collection.h
+	Block size-partitioned digest collection (internal)
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef FFUZZY_FFUZZY_COLLECTION_H
+#define FFUZZY_FFUZZY_COLLECTION_H
+
+/**
+	\internal
+	\file  ffuzzy_collection.h
+	\brief Block size-partitioned digest collection
+**/
+
+#include "ffuzzy_config.h"
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "ffuzzy.h"
+
+
+/**
+	\internal
+	\struct ffuzzy_gram_postings
+	\brief  Inverted lists of n-grams (FFUZZY_MIN_MATCH characters) in one block of digests
+	\details
+		Keys are n-grams packed into integers (8 bits per character)
+		in ascending order. Postings of the key i are
+		postings[offsets[i]] ... postings[offsets[i+1]-1]
+		(partition indices in ascending order, without duplicates).
+**/
+typedef struct
+{
+	size_t nkeys;
+	uint_least64_t *keys;
+	size_t *offsets;
+	size_t *postings;
+} ffuzzy_gram_postings;
+
+
+/**
+	\internal
+	\struct ffuzzy_gram_index
+	\brief  N-gram index of a partition
+	\details
+		A digest with a non-zero score against the query shares at least
+		one n-gram with the query in a compared pair of blocks.
+		So looking up n-grams of the query finds all candidates.
+
+	\internal
+	\var   ffuzzy_gram_index::count
+	\brief Number of digests indexed (digests added later are not indexed).
+	\internal
+	\var   ffuzzy_gram_index::blocks
+	\brief Postings of the first and second blocks.
+**/
+typedef struct
+{
+	size_t count;
+	ffuzzy_gram_postings blocks[2];
+} ffuzzy_gram_index;
+
+
+/**
+	\internal
+	\fn     void ffuzzy_gram_index_free_(ffuzzy_gram_index*)
+	\brief  Free the n-gram index
+	\param  [in] index  The index to free (may be NULL)
+**/
+static inline void ffuzzy_gram_index_free_(ffuzzy_gram_index *index)
+{
+	if (!index)
+		return;
+	for (int b = 0; b < 2; b++)
+	{
+		free(index->blocks[b].keys);
+		free(index->blocks[b].offsets);
+		free(index->blocks[b].postings);
+	}
+	free(index);
+}
+
+
+/**
+	\internal
+	\struct ffuzzy_partition
+	\brief  Digests which share the same block size
+	\details
+		Digests are stored contiguously (in insertion order) so that
+		scanning a partition touches memory sequentially.
+		Since digest IDs are assigned in insertion order,
+		ffuzzy_partition::ids is always sorted in ascending order.
+
+	\internal
+	\var   ffuzzy_partition::block_size
+	\brief Block size of all digests in this partition.
+	\internal
+	\var   ffuzzy_partition::count
+	\brief Number of digests in this partition.
+	\internal
+	\var   ffuzzy_partition::capacity
+	\brief Allocated number of entries for ffuzzy_partition::digests and ffuzzy_partition::ids.
+	\internal
+	\var   ffuzzy_partition::digests
+	\brief Digests in this partition.
+	\internal
+	\var   ffuzzy_partition::ids
+	\brief Collection-wide IDs of the digests.
+	\internal
+	\var   ffuzzy_partition::hist1
+	\brief Number of digests by the length of the first block (for query planning).
+	\internal
+	\var   ffuzzy_partition::hist2
+	\brief Number of digests by the length of the second block (for query planning).
+	\internal
+	\var   ffuzzy_partition::index
+	\brief N-gram index (NULL if not built).
+**/
+typedef struct
+{
+	unsigned long block_size;
+	size_t count, capacity;
+	ffuzzy_digest *digests;
+	size_t *ids;
+	size_t hist1[FFUZZY_SPAMSUM_LENGTH + 1];
+	size_t hist2[FFUZZY_SPAMSUM_LENGTH + 1];
+	ffuzzy_gram_index *index;
+} ffuzzy_partition;
+
+
+/**
+	\internal
+	\struct ffuzzy_collection_loc
+	\brief  Location of a digest inside the collection
+**/
+typedef struct
+{
+	ffuzzy_partition *part;
+	size_t index;
+} ffuzzy_collection_loc;
+
+
+/**
+	\internal
+	\struct ffuzzy_collection
+	\brief  Block size-partitioned digest collection
+
+	\internal
+	\var   ffuzzy_collection::parts
+	\brief Partitions (sorted by the block size).
+	\internal
+	\var   ffuzzy_collection::nparts
+	\brief Number of partitions.
+	\internal
+	\var   ffuzzy_collection::partcap
+	\brief Allocated number of entries for ffuzzy_collection::parts.
+	\internal
+	\var   ffuzzy_collection::locs
+	\brief Locations of digests (indexed by digest ID).
+	\internal
+	\var   ffuzzy_collection::count
+	\brief Number of digests in the collection.
+	\internal
+	\var   ffuzzy_collection::capacity
+	\brief Allocated number of entries for ffuzzy_collection::locs.
+	\internal
+	\var   ffuzzy_collection::version
+	\brief Modification counter (invalidates cached results).
+**/
+struct ffuzzy_collection
+{
+	ffuzzy_partition **parts;
+	size_t nparts, partcap;
+	ffuzzy_collection_loc *locs;
+	size_t count, capacity;
+	unsigned long long version;
+};
+
+
+/**
+	\internal
+	\fn     ffuzzy_partition* ffuzzy_collection_find_partition_(const ffuzzy_collection*, unsigned long)
+	\brief  Find the partition which has given block size
+	\param  [in] coll        The collection
+	\param       block_size  Block size to find
+	\return The partition if exists; NULL otherwise.
+**/
+static inline ffuzzy_partition *ffuzzy_collection_find_partition_(
+	const ffuzzy_collection *coll, unsigned long block_size
+)
+{
+	size_t lo = 0, hi = coll->nparts;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		unsigned long bs = coll->parts[mid]->block_size;
+		if (bs == block_size)
+			return coll->parts[mid];
+		if (bs < block_size)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return NULL;
+}
+
+
+/**
+	\internal
+	\fn     size_t ffuzzy_collection_near_partitions_(const ffuzzy_collection*, unsigned long, ffuzzy_partition**)
+	\brief  Enumerate partitions whose block sizes are "near" to given one
+	\details
+		Partitions are stored in block size order
+		(half of block_size, block_size and double of block_size).
+	\param  [in]  coll        The collection
+	\param        block_size  Block size of the query
+	\param  [out] parts       Buffer to store (up to three) partitions
+	\return Number of partitions stored to parts.
+**/
+static inline size_t ffuzzy_collection_near_partitions_(
+	const ffuzzy_collection *coll, unsigned long block_size,
+	ffuzzy_partition *parts[3]
+)
+{
+	size_t n = 0;
+	ffuzzy_partition *p;
+	// block size 0 is "near" only to itself
+	if (block_size && !(block_size & 1ul) && (p = ffuzzy_collection_find_partition_(coll, block_size / 2)))
+		parts[n++] = p;
+	if ((p = ffuzzy_collection_find_partition_(coll, block_size)))
+		parts[n++] = p;
+	if (block_size && block_size <= (ULONG_MAX / 2) && (p = ffuzzy_collection_find_partition_(coll, block_size * 2)))
+		parts[n++] = p;
+	return n;
+}
+
+
+/**
+	\internal
+	\brief Callback before each tile of ffuzzy_search_partition_
+	\details
+		It receives the range of digests [j0, j1) in the next tile
+		and returns false to stop the search.
+**/
+typedef bool (*ffuzzy_search_tile_fn)(void *arg, size_t j0, size_t j1);
+
+/**
+	\internal
+	\fn     bool ffuzzy_search_partition_(const ffuzzy_partition*, const ffuzzy_digest*, int, size_t, ffuzzy_search_tile_fn, void*, ffuzzy_match_list*, size_t*)
+	\brief  Search digests of a partition from j0 with the tile kernels of batch searches
+	\details
+		The query must have a "near" block size. Matches are appended
+		to results (without sorting). Tiles have 256 digests.
+	\param  [in]     part       The partition
+	\param  [in]     query      Valid digest to search
+	\param           threshold  Minimum score to match (values less than 1 are treated as 1)
+	\param           j0         Index of the first digest to search
+	\param           next_tile  Callback before each tile (may be NULL)
+	\param           arg        Argument to next_tile
+	\param  [in,out] results    Initialized list to append matches
+	\param  [out]    covered    Digests [0, *covered) are searched
+	\return true if succeeds (even if stopped by next_tile); false otherwise.
+**/
+bool ffuzzy_search_partition_(
+	const ffuzzy_partition *part, const ffuzzy_digest *query,
+	int threshold, size_t j0, ffuzzy_search_tile_fn next_tile, void *arg,
+	ffuzzy_match_list *results, size_t *covered
+);
+
+#endif
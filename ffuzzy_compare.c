@@ -52,33 +52,13 @@
 
 #include "ffuzzy.h"
 #include "ffuzzy_blocksize.h"
+#include "ffuzzy_compare.h"
 #include "ffuzzy_parse.h"
+#include "ffuzzy_probes.h"
+#include "ffuzzy_stats.h"
 
-#include "str_common_substr.h"
-#include "str_edit_dist.h"
 #include "util.h"
 
-#if FFUZZY_SPAMSUM_LENGTH > EDIT_DISTN_MAXLEN
-#error EDIT_DISTN_MAXLEN must be large enough to contain FFUZZY_SPAMSUM_LENGTH string
-#endif
-#if FFUZZY_SPAMSUM_LENGTH > HAS_COMMON_SUBSTR_MAXLEN
-#error HAS_COMMON_SUBSTR_MAXLEN must be large enough to contain FFUZZY_SPAMSUM_LENGTH string
-#endif
-
-
-/**
-	\internal
-	\fn   int ffuzzy_score_cap_1_(int, unsigned long)
-	\see  int ffuzzy_score_cap_1(int, unsigned long)
-**/
-static inline int ffuzzy_score_cap_1_(int minslen, unsigned long block_size)
-{
-	assert(minslen > 0 && minslen < FFUZZY_SPAMSUM_LENGTH);
-	if (block_size >= FFUZZY_MIN_BLOCKSIZE * 100)
-		return 100;
-	return (int)block_size / FFUZZY_MIN_BLOCKSIZE * minslen;
-}
-
 
 inline int ffuzzy_score_cap_1(int minslen, unsigned long block_size)
 {
@@ -94,44 +74,6 @@ int ffuzzy_score_cap(int s1len, int s2len, unsigned long block_size)
 }
 
 
-/**
-	\internal
-	\fn     int ffuzzy_score_strings_unsafe(const char*, size_t, const char*, size_t, unsigned long)
-	\brief  Compute partial similarity score for given two block strings and block size (unsafe version)
-	\param  [in] s1          Digest block 1
-	\param       s1len       Length of s1
-	\param  [in] s2          Digest block 2
-	\param       s2len       Length of s2
-	\param       block_size  Block size for two digest blocks
-	\return [0,100] values represent partial similarity score or negative values on failure.
-	\see    fuzzy_score_strings(const char*, size_t, const char*, size_t, unsigned long)
-**/
-static inline int ffuzzy_score_strings_unsafe(
-	const char *s1, size_t s1len,
-	const char *s2, size_t s2len,
-	unsigned long block_size
-)
-{
-	// the two strings must have a common substring
-	// of length FFUZZY_MIN_MATCH to be candidates
-	if (!has_common_substring(s1, s1len, s2, s2len))
-		return 0;
-	// compute the score by scaling edit distance by
-	// the lengths of the two strings, and then
-	// scale it to [0,100] scale (0 is the worst match)
-	int score = edit_distn_norm(s1, s1len, s2, s2len) * FFUZZY_SPAMSUM_LENGTH / ((int)s1len + (int)s2len);
-	score = 100 - (100 * score) / FFUZZY_SPAMSUM_LENGTH;
-	// when the blocksize is small we don't want to exaggerate the match size
-	if (block_size >= FFUZZY_MIN_BLOCKSIZE * 100)
-	{
-		// don't cap first (to avoid arithmetic overflow)
-		return score;
-	}
-	int score_cap = (int)block_size / FFUZZY_MIN_BLOCKSIZE * MIN((int)s1len, (int)s2len);
-	return MIN(score, score_cap);
-}
-
-
 int ffuzzy_score_strings(
 	const char *s1, size_t s1len,
 	const char *s2, size_t s2len,
@@ -145,11 +87,12 @@ int ffuzzy_score_strings(
 }
 
 
-inline int ffuzzy_compare_digest_near(const ffuzzy_digest *d1, const ffuzzy_digest *d2)
+static inline int ffuzzy_compare_digest_near_(const ffuzzy_digest *d1, const ffuzzy_digest *d2)
 {
 	assert(ffuzzy_blocksize_is_near_(d1->block_size, d2->block_size));
 	assert(ffuzzy_digest_is_valid(d1));
 	assert(ffuzzy_digest_is_valid(d2));
+	FFUZZY_STATS_COUNT_(FFUZZY_STAT_NEAR_COMPARISONS);
 	// special case if two signatures are identical
 	if (
 		d1->block_size == d2->block_size &&
@@ -158,6 +101,8 @@ inline int ffuzzy_compare_digest_near(const ffuzzy_digest *d1, const ffuzzy_dige
 		!memcmp(d1->digest, d2->digest, d1->len1 + d1->len2)
 	)
 	{
+		FFUZZY_STATS_COUNT_(FFUZZY_STAT_IDENTICAL);
+		FFUZZY_PROBE3_(identical, d1->block_size, d1->len1, d1->len2);
 		// cap scores (same as ffuzzy_score_strings)
 		int score_cap;
 		if (d1->len2 >= FFUZZY_MIN_MATCH)
@@ -183,15 +128,11 @@ inline int ffuzzy_compare_digest_near(const ffuzzy_digest *d1, const ffuzzy_dige
 	if (d1->block_size <= (ULONG_MAX / 2))
 	{
 		if (d1->block_size == d2->block_size)
-		{
-			int score1 = ffuzzy_score_strings_unsafe(d1->digest, d1->len1, d2->digest, d2->len1, d1->block_size);
-			int score2 = ffuzzy_score_strings_unsafe(d1->digest+d1->len1, d1->len2, d2->digest+d2->len1, d2->len2, d1->block_size * 2);
-			return MAX(score1, score2);
-		}
+			return ffuzzy_compare_digest_eq_fused_(d1, d2);
 		else if (d1->block_size * 2 == d2->block_size)
-			return ffuzzy_score_strings_unsafe(d1->digest + d1->len1, d1->len2, d2->digest, d2->len1, d2->block_size);
+			return ffuzzy_score_strings_bitpar_(d1->digest + d1->len1, d1->len2, d2->digest, d2->len1, d2->block_size);
 		else
-			return ffuzzy_score_strings_unsafe(d1->digest, d1->len1, d2->digest + d2->len1, d2->len2, d1->block_size);
+			return ffuzzy_score_strings_bitpar_(d1->digest, d1->len1, d2->digest + d2->len1, d2->len2, d1->block_size);
 	}
 	else
 	{
@@ -204,12 +145,20 @@ inline int ffuzzy_compare_digest_near(const ffuzzy_digest *d1, const ffuzzy_dige
 	}
 }
 
+inline int ffuzzy_compare_digest_near(const ffuzzy_digest *d1, const ffuzzy_digest *d2)
+{
+	int score = ffuzzy_compare_digest_near_(d1, d2);
+	FFUZZY_PROBE3_(score, d1->block_size, d2->block_size, score);
+	return score;
+}
+
 
-int ffuzzy_compare_digest_near_eq(const ffuzzy_digest *d1, const ffuzzy_digest *d2)
+static inline int ffuzzy_compare_digest_near_eq_(const ffuzzy_digest *d1, const ffuzzy_digest *d2)
 {
 	assert(ffuzzy_digest_is_valid(d1));
 	assert(ffuzzy_digest_is_valid(d2));
 	assert(d1->block_size == d2->block_size);
+	FFUZZY_STATS_COUNT_(FFUZZY_STAT_NEAR_COMPARISONS);
 	// special case if two signatures are identical
 	if (
 		d1->len1 == d2->len1 &&
@@ -217,6 +166,8 @@ int ffuzzy_compare_digest_near_eq(const ffuzzy_digest *d1, const ffuzzy_digest *
 		!memcmp(d1->digest, d2->digest, d1->len1 + d1->len2)
 	)
 	{
+		FFUZZY_STATS_COUNT_(FFUZZY_STAT_IDENTICAL);
+		FFUZZY_PROBE3_(identical, d1->block_size, d1->len1, d1->len2);
 		// cap scores (same as ffuzzy_score_strings)
 		int score_cap;
 		if (d1->len2 >= FFUZZY_MIN_MATCH)
@@ -237,11 +188,7 @@ int ffuzzy_compare_digest_near_eq(const ffuzzy_digest *d1, const ffuzzy_digest *
 		return MIN(100, score_cap);
 	}
 	if (d1->block_size <= (ULONG_MAX / 2))
-	{
-		int score1 = ffuzzy_score_strings_unsafe(d1->digest, d1->len1, d2->digest, d2->len1, d1->block_size);
-		int score2 = ffuzzy_score_strings_unsafe(d1->digest+d1->len1, d1->len2, d2->digest+d2->len1, d2->len2, d1->block_size * 2);
-		return MAX(score1, score2);
-	}
+		return ffuzzy_compare_digest_eq_fused_(d1, d2);
 	else
 	{
 		// second digest block is empty or invalid
@@ -249,6 +196,13 @@ int ffuzzy_compare_digest_near_eq(const ffuzzy_digest *d1, const ffuzzy_digest *
 	}
 }
 
+int ffuzzy_compare_digest_near_eq(const ffuzzy_digest *d1, const ffuzzy_digest *d2)
+{
+	int score = ffuzzy_compare_digest_near_eq_(d1, d2);
+	FFUZZY_PROBE3_(score, d1->block_size, d2->block_size, score);
+	return score;
+}
+
 
 int ffuzzy_compare_digest_near_lt(const ffuzzy_digest *d1, const ffuzzy_digest *d2)
 {
@@ -256,7 +210,10 @@ int ffuzzy_compare_digest_near_lt(const ffuzzy_digest *d1, const ffuzzy_digest *
 	assert(ffuzzy_digest_is_valid(d2));
 	assert(d1->block_size <= (ULONG_MAX / 2));
 	assert(d1->block_size * 2 == d2->block_size);
-	return ffuzzy_score_strings_unsafe(d1->digest + d1->len1, d1->len2, d2->digest, d2->len1, d2->block_size);
+	FFUZZY_STATS_COUNT_(FFUZZY_STAT_NEAR_COMPARISONS);
+	int score = ffuzzy_score_strings_bitpar_(d1->digest + d1->len1, d1->len2, d2->digest, d2->len1, d2->block_size);
+	FFUZZY_PROBE3_(score, d1->block_size, d2->block_size, score);
+	return score;
 }
 
 
@@ -264,12 +221,16 @@ int ffuzzy_compare_digest(const ffuzzy_digest *d1, const ffuzzy_digest *d2)
 {
 	// don't compare if the blocksizes are not close.
 	if (!ffuzzy_blocksize_is_near_(d1->block_size, d2->block_size))
+	{
+		FFUZZY_STATS_COUNT_(FFUZZY_STAT_BLOCKSIZE_REJECTS);
+		FFUZZY_PROBE2_(blocksize_reject, d1->block_size, d2->block_size);
 		return 0;
+	}
 	return ffuzzy_compare_digest_near(d1, d2);
 }
 
 
-int ffuzzy_compare(const char *str1, const char *str2)
+static inline int ffuzzy_compare_(const char *str1, const char *str2)
 {
 	ffuzzy_digest d1, d2;
 	char *p1, *p2;
@@ -278,10 +239,22 @@ int ffuzzy_compare(const char *str1, const char *str2)
 		return -1;
 	// don't compare if the blocksizes are not close.
 	if (!ffuzzy_blocksize_is_near_(d1.block_size, d2.block_size))
+	{
+		FFUZZY_STATS_COUNT_(FFUZZY_STAT_BLOCKSIZE_REJECTS);
+		FFUZZY_PROBE2_(blocksize_reject, d1.block_size, d2.block_size);
 		return 0;
+	}
 	// read remaining parts
 	if (!ffuzzy_read_digest_after_blocksize(&d1, p1) || !ffuzzy_read_digest_after_blocksize(&d2, p2))
 		return -1;
 	// then compare without blocksize checks
 	return ffuzzy_compare_digest_near(&d1, &d2);
 }
+
+int ffuzzy_compare(const char *str1, const char *str2)
+{
+	FFUZZY_LATENCY_BEGIN_(FFUZZY_TIMER_COMPARE);
+	int score = ffuzzy_compare_(str1, str2);
+	FFUZZY_LATENCY_END_(FFUZZY_TIMER_COMPARE);
+	return score;
+}
@@ -0,0 +1,346 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_compare.h
+	Fuzzy hash comparison implementation (internal)
+
+
+	CREDITS OF ORIGINAL VERSION OF SSDEEP
+
+	Copyright (C) 2002 Andrew Tridgell <tridge@samba.org>
+	Copyright (C) 2006 ManTech International Corporation
+	Copyright (C) 2013 Helmut Grohne <helmut@subdivi.de>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+
+	CREDIT OF MODIFIED PORTIONS
+
+	Copyright (C) 2014, 2026 Tsukasa OI <li@livegrid.org>
+
+*/
+#ifndef FFUZZY_FFUZZY_COMPARE_H
+#define FFUZZY_FFUZZY_COMPARE_H
+
+/**
+	\internal
+	\file  ffuzzy_compare.h
+	\brief Fuzzy hash comparison implementation
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_probes.h"
+#include "ffuzzy_stats.h"
+#include "str_common_substr.h"
+#include "str_edit_dist.h"
+#include "str_lcs_bitpar.h"
+#include "util.h"
+
+#if FFUZZY_SPAMSUM_LENGTH > EDIT_DISTN_MAXLEN
+#error EDIT_DISTN_MAXLEN must be large enough to contain FFUZZY_SPAMSUM_LENGTH string
+#endif
+#if FFUZZY_SPAMSUM_LENGTH > HAS_COMMON_SUBSTR_MAXLEN
+#error HAS_COMMON_SUBSTR_MAXLEN must be large enough to contain FFUZZY_SPAMSUM_LENGTH string
+#endif
+#if FFUZZY_SPAMSUM_LENGTH > LCS_BITPAR_MAXLEN
+#error LCS_BITPAR_MAXLEN must be large enough to contain FFUZZY_SPAMSUM_LENGTH string
+#endif
+
+
+/**
+	\internal
+	\fn   int ffuzzy_score_cap_1_(int, unsigned long)
+	\see  int ffuzzy_score_cap_1(int, unsigned long)
+**/
+static inline int ffuzzy_score_cap_1_(int minslen, unsigned long block_size)
+{
+	assert(minslen > 0 && minslen <= FFUZZY_SPAMSUM_LENGTH);
+	if (block_size >= FFUZZY_MIN_BLOCKSIZE * 100)
+		return 100;
+	return (int)block_size / FFUZZY_MIN_BLOCKSIZE * minslen;
+}
+
+
+/**
+	\internal
+	\fn     int ffuzzy_score_dist_(int, size_t, size_t, unsigned long)
+	\brief  Compute partial similarity score from the edit distance
+	\details
+		This is the scoring part of ffuzzy_score_strings_unsafe
+		(after the common substring check) so that other comparison
+		kernels can share the same scoring semantics.
+	\param  dist        Edit distance between two digest blocks (insertion and removal only)
+	\param  s1len       Length of digest block 1 (non-zero)
+	\param  s2len       Length of digest block 2 (non-zero)
+	\param  block_size  Block size for two digest blocks
+	\return [0,100] values represent partial similarity score.
+**/
+static inline int ffuzzy_score_dist_(int dist, size_t s1len, size_t s2len, unsigned long block_size)
+{
+	// compute the score by scaling edit distance by
+	// the lengths of the two strings, and then
+	// scale it to [0,100] scale (0 is the worst match)
+	int score = dist * FFUZZY_SPAMSUM_LENGTH / ((int)s1len + (int)s2len);
+	score = 100 - (100 * score) / FFUZZY_SPAMSUM_LENGTH;
+	// when the blocksize is small we don't want to exaggerate the match size
+	if (block_size >= FFUZZY_MIN_BLOCKSIZE * 100)
+	{
+		// don't cap first (to avoid arithmetic overflow)
+		return score;
+	}
+	int score_cap = (int)block_size / FFUZZY_MIN_BLOCKSIZE * MIN((int)s1len, (int)s2len);
+	return MIN(score, score_cap);
+}
+
+
+/**
+	\internal
+	\fn     int ffuzzy_score_strings_unsafe(const char*, size_t, const char*, size_t, unsigned long)
+	\brief  Compute partial similarity score for given two block strings and block size (unsafe version)
+	\param  [in] s1          Digest block 1
+	\param       s1len       Length of s1
+	\param  [in] s2          Digest block 2
+	\param       s2len       Length of s2
+	\param       block_size  Block size for two digest blocks
+	\return [0,100] values represent partial similarity score or negative values on failure.
+	\see    fuzzy_score_strings(const char*, size_t, const char*, size_t, unsigned long)
+**/
+static inline int ffuzzy_score_strings_unsafe(
+	const char *s1, size_t s1len,
+	const char *s2, size_t s2len,
+	unsigned long block_size
+)
+{
+	if (s1len < FFUZZY_MIN_MATCH || s2len < FFUZZY_MIN_MATCH)
+	{
+		FFUZZY_STATS_COUNT_(FFUZZY_STAT_LENGTH_REJECTS);
+		FFUZZY_PROBE3_(length_reject, s1len, s2len, block_size);
+		return 0;
+	}
+	// the two strings must have a common substring
+	// of length FFUZZY_MIN_MATCH to be candidates
+	if (!has_common_substring(s1, s1len, s2, s2len))
+	{
+		FFUZZY_STATS_COUNT_(FFUZZY_STAT_SUBSTRING_REJECTS);
+		FFUZZY_PROBE3_(substring_reject, s1len, s2len, block_size);
+		return 0;
+	}
+	FFUZZY_STATS_COUNT_(FFUZZY_STAT_EDIT_DISTANCES);
+	int dist = edit_distn_norm(s1, s1len, s2, s2len);
+	FFUZZY_PROBE4_(distance, s1len, s2len, block_size, dist);
+	return ffuzzy_score_dist_(dist, s1len, s2len, block_size);
+}
+
+
+/**
+	\internal
+	\fn     int ffuzzy_score_strings_max_(size_t, size_t, unsigned long)
+	\brief  Compute upper bound of partial similarity score by block lengths
+	\details
+		The edit distance is at least the difference of two lengths.
+		This bound also contains the score cap and the requirement
+		for common substrings (of length FFUZZY_MIN_MATCH).
+		It can be used to reject candidates before computing the edit distance.
+	\param  s1len       Length of digest block 1
+	\param  s2len       Length of digest block 2
+	\param  block_size  Block size for two digest blocks
+	\return Maximum partial similarity score ffuzzy_score_strings_unsafe may return.
+**/
+static inline int ffuzzy_score_strings_max_(size_t s1len, size_t s2len, unsigned long block_size)
+{
+	if (s1len < FFUZZY_MIN_MATCH || s2len < FFUZZY_MIN_MATCH)
+		return 0;
+	int dist = s1len < s2len ? (int)(s2len - s1len) : (int)(s1len - s2len);
+	return ffuzzy_score_dist_(dist, s1len, s2len, block_size);
+}
+
+
+/**
+	\internal
+	\fn     int ffuzzy_compare_digest_near_max_(const ffuzzy_digest*, const ffuzzy_digest*)
+	\brief  Compute upper bound of similarity score for two "near" digests
+	\details
+		This function only uses block sizes and block lengths
+		(so that callers may fill digest blocks after the check).
+		The return value is always equal to or greater than
+		ffuzzy_compare_digest_near(d1, d2).
+	\param  [in] d1  Valid digest 1
+	\param  [in] d2  Valid digest 2 (block size must be "near" to d1)
+	\return Maximum similarity score ffuzzy_compare_digest_near may return.
+**/
+static inline int ffuzzy_compare_digest_near_max_(const ffuzzy_digest *d1, const ffuzzy_digest *d2)
+{
+	if (d1->block_size == d2->block_size)
+	{
+		int score1 = ffuzzy_score_strings_max_(d1->len1, d2->len1, d1->block_size);
+		if (d1->block_size > (ULONG_MAX / 2))
+		{
+			// block 2 is only compared if two digests are identical
+			// (see ffuzzy_compare_digest_near); they may be if lengths match
+			if (d1->len2 >= FFUZZY_MIN_MATCH && d1->len1 == d2->len1 && d1->len2 == d2->len2)
+				return 100;
+			return score1;
+		}
+		int score2 = ffuzzy_score_strings_max_(d1->len2, d2->len2, d1->block_size * 2);
+		return MAX(score1, score2);
+	}
+	else if (d1->block_size <= (ULONG_MAX / 2) && d1->block_size * 2 == d2->block_size)
+		return ffuzzy_score_strings_max_(d1->len2, d2->len1, d2->block_size);
+	else
+		return ffuzzy_score_strings_max_(d1->len1, d2->len2, d1->block_size);
+}
+
+/**
+	\internal
+	\fn     int ffuzzy_score_strings_bitpar_(const char*, size_t, const char*, size_t, unsigned long)
+	\brief  Compute partial similarity score (bit-parallel version)
+	\details
+		The result is the same as ffuzzy_score_strings_unsafe
+		but the edit distance and the common substring check
+		are computed in one bit-parallel pass.
+	\see    int ffuzzy_score_strings_unsafe(const char*, size_t, const char*, size_t, unsigned long)
+**/
+static inline int ffuzzy_score_strings_bitpar_(
+	const char *s1, size_t s1len,
+	const char *s2, size_t s2len,
+	unsigned long block_size
+)
+{
+	if (s1len < FFUZZY_MIN_MATCH || s2len < FFUZZY_MIN_MATCH)
+	{
+		FFUZZY_STATS_COUNT_(FFUZZY_STAT_LENGTH_REJECTS);
+		FFUZZY_PROBE3_(length_reject, s1len, s2len, block_size);
+		return 0;
+	}
+	lcs_bitpar_table table;
+	lcs_bitpar_state st;
+	lcs_bitpar_table_set(table, s1, s1len, s2, s2len);
+	lcs_bitpar_init(&st);
+	for (size_t j = 0; j < s2len; j++)
+		lcs_bitpar_step(&st, table[(unsigned char)s2[j]]);
+	if (!st.hit)
+	{
+		FFUZZY_STATS_COUNT_(FFUZZY_STAT_SUBSTRING_REJECTS);
+		FFUZZY_PROBE3_(substring_reject, s1len, s2len, block_size);
+		return 0;
+	}
+	FFUZZY_STATS_COUNT_(FFUZZY_STAT_EDIT_DISTANCES);
+	int dist = (int)s1len + (int)s2len - 2 * lcs_bitpar_result(&st, s1len);
+	FFUZZY_PROBE4_(distance, s1len, s2len, block_size, dist);
+	return ffuzzy_score_dist_(dist, s1len, s2len, block_size);
+}
+
+
+/**
+	\internal
+	\fn     int ffuzzy_compare_digest_eq_fused_(const ffuzzy_digest*, const ffuzzy_digest*)
+	\brief  Compare two non-identical digests with the same block size (fused version)
+	\details
+		Both block pairs are processed in one loop (two independent
+		bit-parallel states) so that the processor can overlap them.
+
+		If one block pair cannot reach a positive score (by block lengths),
+		only the other one is computed. If the score of block 1 is
+		at least the upper bound of block 2, block 2 is skipped.
+		To make use of it, block 1 is computed first when
+		its upper bound is not less than the bound of block 2.
+	\param  [in] d1  Valid digest 1
+	\param  [in] d2  Valid digest 2 (not identical to d1, with the same block size)
+	\return The similarity score (same as ffuzzy_compare_digest_near_eq).
+**/
+static inline int ffuzzy_compare_digest_eq_fused_(const ffuzzy_digest *d1, const ffuzzy_digest *d2)
+{
+	unsigned long bs = d1->block_size;
+	assert(bs == d2->block_size && bs <= (ULONG_MAX / 2));
+	const char *s11 = d1->digest, *s12 = d1->digest + d1->len1;
+	const char *s21 = d2->digest, *s22 = d2->digest + d2->len1;
+	int max1 = ffuzzy_score_strings_max_(d1->len1, d2->len1, bs);
+	int max2 = ffuzzy_score_strings_max_(d1->len2, d2->len2, bs * 2);
+	if (!max2)
+	{
+		FFUZZY_STATS_COUNT_(FFUZZY_STAT_LENGTH_REJECTS);
+		FFUZZY_PROBE3_(length_reject, d1->len2, d2->len2, bs * 2);
+		if (!max1)
+		{
+			FFUZZY_STATS_COUNT_(FFUZZY_STAT_LENGTH_REJECTS);
+			FFUZZY_PROBE3_(length_reject, d1->len1, d2->len1, bs);
+			return 0;
+		}
+		return ffuzzy_score_strings_bitpar_(s11, d1->len1, s21, d2->len1, bs);
+	}
+	if (!max1)
+	{
+		FFUZZY_STATS_COUNT_(FFUZZY_STAT_LENGTH_REJECTS);
+		FFUZZY_PROBE3_(length_reject, d1->len1, d2->len1, bs);
+		return ffuzzy_score_strings_bitpar_(s12, d1->len2, s22, d2->len2, bs * 2);
+	}
+	if (max1 >= max2)
+	{
+		int score1 = ffuzzy_score_strings_bitpar_(s11, d1->len1, s21, d2->len1, bs);
+		if (score1 >= max2)
+		{
+			FFUZZY_STATS_COUNT_(FFUZZY_STAT_BOUND_SKIPS);
+			FFUZZY_PROBE3_(bound_skip, d1->len2, d2->len2, bs * 2);
+			return score1;
+		}
+		return MAX(score1, ffuzzy_score_strings_bitpar_(s12, d1->len2, s22, d2->len2, bs * 2));
+	}
+	lcs_bitpar_table table1, table2;
+	lcs_bitpar_state st1, st2;
+	lcs_bitpar_table_set(table1, s11, d1->len1, s21, d2->len1);
+	lcs_bitpar_table_set(table2, s12, d1->len2, s22, d2->len2);
+	lcs_bitpar_init(&st1);
+	lcs_bitpar_init(&st2);
+	size_t n = MIN(d2->len1, d2->len2);
+	for (size_t j = 0; j < n; j++)
+	{
+		lcs_bitpar_step(&st1, table1[(unsigned char)s21[j]]);
+		lcs_bitpar_step(&st2, table2[(unsigned char)s22[j]]);
+	}
+	for (size_t j = n; j < d2->len1; j++)
+		lcs_bitpar_step(&st1, table1[(unsigned char)s21[j]]);
+	for (size_t j = n; j < d2->len2; j++)
+		lcs_bitpar_step(&st2, table2[(unsigned char)s22[j]]);
+	int score1 = 0, score2 = 0;
+	if (st1.hit)
+	{
+		int dist = (int)d1->len1 + (int)d2->len1 - 2 * lcs_bitpar_result(&st1, d1->len1);
+		FFUZZY_PROBE4_(distance, d1->len1, d2->len1, bs, dist);
+		score1 = ffuzzy_score_dist_(dist, d1->len1, d2->len1, bs);
+	}
+	else
+		FFUZZY_PROBE3_(substring_reject, d1->len1, d2->len1, bs);
+	if (st2.hit)
+	{
+		int dist = (int)d1->len2 + (int)d2->len2 - 2 * lcs_bitpar_result(&st2, d1->len2);
+		FFUZZY_PROBE4_(distance, d1->len2, d2->len2, bs * 2, dist);
+		score2 = ffuzzy_score_dist_(dist, d1->len2, d2->len2, bs * 2);
+	}
+	else
+		FFUZZY_PROBE3_(substring_reject, d1->len2, d2->len2, bs * 2);
+	FFUZZY_STATS_ADD_(FFUZZY_STAT_EDIT_DISTANCES, (unsigned)(st1.hit != 0) + (st2.hit != 0));
+	FFUZZY_STATS_ADD_(FFUZZY_STAT_SUBSTRING_REJECTS, (unsigned)(st1.hit == 0) + (st2.hit == 0));
+	return MAX(score1, score2);
+}
+
+#endif
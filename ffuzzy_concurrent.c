@@ -0,0 +1,723 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_concurrent.c
+	Concurrent digest index with non-blocking readers
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\internal
+	\file  ffuzzy_concurrent.c
+	\brief Concurrent digest index with non-blocking readers
+	\details
+		Writers (insertion and compaction) are serialized by a mutex.
+		Readers never take locks: all shared structures are published by
+		release stores and read by acquire loads.
+
+		Each partition (digests with the same block size) is a chain of
+		append-only segments. A writer fills the item and then publishes
+		the new count of the segment. Only the last segment of a chain
+		is appended to; other segments are full and immutable.
+
+		Compaction merges full segments of a chain into one segment
+		without the writer lock (compactions are serialized by
+		another lock because they are the only ones to retire segments).
+		The writer lock is only taken to find chains and to link the
+		merged segment in front of the last segment.
+		Replaced segments and partition directories are retired
+		and freed by epoch-based reclamation: an object retired at epoch e
+		is freed once the global epoch reaches e + 2 (every reader which
+		might hold a reference has left by then).
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef FFUZZY_ENABLE_THREADS
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#include "ffuzzy.h"
+#include "ffuzzy_atomic.h"
+#include "ffuzzy_compare.h"
+#include "ffuzzy_match.h"
+#include "ffuzzy_parallel.h"
+#include "util.h"
+
+/** \internal \brief Capacity of the first segment of a partition **/
+#define FFUZZY_CONCURRENT_SEGMENT_MIN 16
+/** \internal \brief Maximum capacity of appended segments **/
+#define FFUZZY_CONCURRENT_SEGMENT_MAX 4096
+/** \internal \brief Minimum number of segments of a partition to compact **/
+#define FFUZZY_CONCURRENT_COMPACT_SEGMENTS 4
+
+
+/**
+	\internal
+	\struct ffuzzy_concurrent_garbage
+	\brief  Header of objects which can be retired (the first member of such objects)
+**/
+typedef struct ffuzzy_concurrent_garbage
+{
+	struct ffuzzy_concurrent_garbage *next;
+	unsigned long epoch;
+} ffuzzy_concurrent_garbage;
+
+
+/**
+	\internal
+	\struct ffuzzy_concurrent_item
+	\brief  Digest and its ID
+**/
+typedef struct
+{
+	size_t id;
+	ffuzzy_digest digest;
+} ffuzzy_concurrent_item;
+
+
+/**
+	\internal
+	\struct ffuzzy_concurrent_segment
+	\brief  Append-only segment of a partition
+	\internal
+	\var   ffuzzy_concurrent_segment::next
+	\brief Next segment (published by a writer).
+	\internal
+	\var   ffuzzy_concurrent_segment::count
+	\brief Number of published items (items before this index are immutable).
+**/
+typedef struct ffuzzy_concurrent_segment
+{
+	ffuzzy_concurrent_garbage gc;
+	struct ffuzzy_concurrent_segment *next;
+	size_t count;
+	size_t capacity;
+	ffuzzy_concurrent_item items[];
+} ffuzzy_concurrent_segment;
+
+
+/**
+	\internal
+	\struct ffuzzy_concurrent_partition
+	\brief  Digests which share the same block size
+	\details
+		Partitions are never freed until the index is freed.
+	\internal
+	\var   ffuzzy_concurrent_partition::head
+	\brief The first segment (published by a writer).
+	\internal
+	\var   ffuzzy_concurrent_partition::tail
+	\brief The last segment (only used by writers).
+	\internal
+	\var   ffuzzy_concurrent_partition::nsegments
+	\brief Number of segments (only used by writers).
+	\internal
+	\var   ffuzzy_concurrent_partition::count
+	\brief Number of digests (only used by writers).
+**/
+typedef struct
+{
+	unsigned long block_size;
+	ffuzzy_concurrent_segment *head;
+	ffuzzy_concurrent_segment *tail;
+	size_t nsegments;
+	size_t count;
+} ffuzzy_concurrent_partition;
+
+
+/**
+	\internal
+	\struct ffuzzy_concurrent_dir
+	\brief  Immutable directory of partitions (sorted by the block size)
+**/
+typedef struct
+{
+	ffuzzy_concurrent_garbage gc;
+	size_t count;
+	ffuzzy_concurrent_partition *parts[];
+} ffuzzy_concurrent_dir;
+
+
+/**
+	\internal
+	\struct ffuzzy_concurrent_reader
+	\brief  Reader handle
+	\internal
+	\var   ffuzzy_concurrent_reader::state
+	\brief (epoch << 1) | 1 while reading; 0 otherwise.
+**/
+struct ffuzzy_concurrent_reader
+{
+	ffuzzy_concurrent_index *idx;
+	unsigned long state;
+	struct ffuzzy_concurrent_reader *next;
+};
+
+
+/**
+	\internal
+	\struct ffuzzy_concurrent_index
+	\brief  Concurrent digest index
+
+	\internal
+	\var   ffuzzy_concurrent_index::lock
+	\brief Writer lock (which also protects the reader list and the limbo list).
+	\internal
+	\var   ffuzzy_concurrent_index::compact_lock
+	\brief Compaction lock (taken before the writer lock if both are needed).
+	\internal
+	\var   ffuzzy_concurrent_index::dir
+	\brief Current partition directory (published by a writer).
+	\internal
+	\var   ffuzzy_concurrent_index::count
+	\brief Number of published digests.
+	\internal
+	\var   ffuzzy_concurrent_index::epoch
+	\brief Global epoch (only advanced by writers).
+	\internal
+	\var   ffuzzy_concurrent_index::limbo
+	\brief Retired objects (newest first).
+**/
+struct ffuzzy_concurrent_index
+{
+	ffuzzy_mutex lock;
+	ffuzzy_mutex compact_lock;
+	ffuzzy_concurrent_dir *dir;
+	size_t count;
+	unsigned long epoch;
+	ffuzzy_concurrent_reader *readers;
+	ffuzzy_concurrent_garbage *limbo;
+#ifdef FFUZZY_ENABLE_THREADS
+	pthread_t compactor;
+	pthread_mutex_t cmutex;
+	pthread_cond_t ccond;
+	bool crunning, cstop;
+	unsigned interval_ms;
+#endif
+};
+
+
+ffuzzy_concurrent_index *ffuzzy_concurrent_index_new(void)
+{
+	ffuzzy_concurrent_index *idx = calloc(1, sizeof(ffuzzy_concurrent_index));
+	if (!idx)
+		return NULL;
+	idx->dir = calloc(1, sizeof(ffuzzy_concurrent_dir));
+	if (!idx->dir || !ffuzzy_mutex_init_(&idx->lock))
+	{
+		free(idx->dir);
+		free(idx);
+		return NULL;
+	}
+	if (!ffuzzy_mutex_init_(&idx->compact_lock))
+	{
+		ffuzzy_mutex_destroy_(&idx->lock);
+		free(idx->dir);
+		free(idx);
+		return NULL;
+	}
+#ifdef FFUZZY_ENABLE_THREADS
+	if (pthread_mutex_init(&idx->cmutex, NULL))
+	{
+		ffuzzy_mutex_destroy_(&idx->compact_lock);
+		ffuzzy_mutex_destroy_(&idx->lock);
+		free(idx->dir);
+		free(idx);
+		return NULL;
+	}
+	if (pthread_cond_init(&idx->ccond, NULL))
+	{
+		pthread_mutex_destroy(&idx->cmutex);
+		ffuzzy_mutex_destroy_(&idx->compact_lock);
+		ffuzzy_mutex_destroy_(&idx->lock);
+		free(idx->dir);
+		free(idx);
+		return NULL;
+	}
+#endif
+	return idx;
+}
+
+
+void ffuzzy_concurrent_index_free(ffuzzy_concurrent_index *idx)
+{
+	if (!idx)
+		return;
+	ffuzzy_concurrent_index_stop_compactor(idx);
+	for (size_t i = 0; i < idx->dir->count; i++)
+	{
+		ffuzzy_concurrent_segment *seg = idx->dir->parts[i]->head;
+		while (seg)
+		{
+			ffuzzy_concurrent_segment *next = seg->next;
+			free(seg);
+			seg = next;
+		}
+		free(idx->dir->parts[i]);
+	}
+	free(idx->dir);
+	while (idx->limbo)
+	{
+		ffuzzy_concurrent_garbage *next = idx->limbo->next;
+		free(idx->limbo);
+		idx->limbo = next;
+	}
+	while (idx->readers)
+	{
+		ffuzzy_concurrent_reader *next = idx->readers->next;
+		free(idx->readers);
+		idx->readers = next;
+	}
+#ifdef FFUZZY_ENABLE_THREADS
+	pthread_cond_destroy(&idx->ccond);
+	pthread_mutex_destroy(&idx->cmutex);
+#endif
+	ffuzzy_mutex_destroy_(&idx->compact_lock);
+	ffuzzy_mutex_destroy_(&idx->lock);
+	free(idx);
+}
+
+
+/**
+	\internal
+	\fn     void ffuzzy_concurrent_retire_(ffuzzy_concurrent_index*, ffuzzy_concurrent_garbage*)
+	\brief  Retire an unlinked object (writer lock must be held)
+**/
+static void ffuzzy_concurrent_retire_(ffuzzy_concurrent_index *idx, ffuzzy_concurrent_garbage *obj)
+{
+	obj->epoch = idx->epoch;
+	obj->next = idx->limbo;
+	idx->limbo = obj;
+}
+
+
+/**
+	\internal
+	\fn     void ffuzzy_concurrent_reclaim_(ffuzzy_concurrent_index*)
+	\brief  Try to advance the epoch and free retired objects (writer lock must be held)
+**/
+static void ffuzzy_concurrent_reclaim_(ffuzzy_concurrent_index *idx)
+{
+	if (!idx->limbo)
+		return;
+	// the epoch can be advanced if all active readers have observed it
+	ffuzzy_atomic_fence_();
+	unsigned long epoch = idx->epoch;
+	bool advance = true;
+	for (ffuzzy_concurrent_reader *r = idx->readers; r; r = r->next)
+	{
+		unsigned long state = ffuzzy_atomic_load_acquire_(&r->state);
+		if ((state & 1) && (state >> 1) != epoch)
+		{
+			advance = false;
+			break;
+		}
+	}
+	if (advance)
+		ffuzzy_atomic_store_release_(&idx->epoch, ++epoch);
+	// objects are retired in epoch order (newest first)
+	ffuzzy_concurrent_garbage **p = &idx->limbo;
+	while (*p && (*p)->epoch + 2 > epoch)
+		p = &(*p)->next;
+	ffuzzy_concurrent_garbage *obj = *p;
+	*p = NULL;
+	while (obj)
+	{
+		ffuzzy_concurrent_garbage *next = obj->next;
+		free(obj);
+		obj = next;
+	}
+}
+
+
+/**
+	\internal
+	\fn     ffuzzy_concurrent_segment* ffuzzy_concurrent_segment_new_(size_t)
+	\brief  Allocate an empty segment
+	\return The new segment if succeeds; NULL otherwise.
+**/
+static ffuzzy_concurrent_segment *ffuzzy_concurrent_segment_new_(size_t capacity)
+{
+	if (capacity > (((size_t)-1) - sizeof(ffuzzy_concurrent_segment)) / sizeof(ffuzzy_concurrent_item))
+		return NULL;
+	ffuzzy_concurrent_segment *seg = malloc(sizeof(ffuzzy_concurrent_segment) + sizeof(ffuzzy_concurrent_item) * capacity);
+	if (!seg)
+		return NULL;
+	seg->next = NULL;
+	seg->count = 0;
+	seg->capacity = capacity;
+	return seg;
+}
+
+
+/**
+	\internal
+	\fn     ffuzzy_concurrent_partition* ffuzzy_concurrent_find_(const ffuzzy_concurrent_dir*, unsigned long)
+	\brief  Find the partition with given block size
+	\return The partition if exists; NULL otherwise.
+**/
+static ffuzzy_concurrent_partition *ffuzzy_concurrent_find_(const ffuzzy_concurrent_dir *dir, unsigned long block_size)
+{
+	size_t lo = 0, hi = dir->count;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		unsigned long bs = dir->parts[mid]->block_size;
+		if (bs == block_size)
+			return dir->parts[mid];
+		if (bs < block_size)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return NULL;
+}
+
+
+/**
+	\internal
+	\fn     ffuzzy_concurrent_partition* ffuzzy_concurrent_get_partition_(ffuzzy_concurrent_index*, unsigned long)
+	\brief  Find the partition with given block size or publish new one (writer lock must be held)
+	\return The partition if succeeds; NULL otherwise.
+**/
+static ffuzzy_concurrent_partition *ffuzzy_concurrent_get_partition_(ffuzzy_concurrent_index *idx, unsigned long block_size)
+{
+	ffuzzy_concurrent_dir *dir = idx->dir;
+	ffuzzy_concurrent_partition *part = ffuzzy_concurrent_find_(dir, block_size);
+	if (part)
+		return part;
+	// copy-on-write: readers may still use the old directory
+	if (dir->count >= (((size_t)-1) - sizeof(ffuzzy_concurrent_dir)) / sizeof(ffuzzy_concurrent_partition*) - 1)
+		return NULL;
+	ffuzzy_concurrent_dir *newdir = malloc(sizeof(ffuzzy_concurrent_dir) + sizeof(ffuzzy_concurrent_partition*) * (dir->count + 1));
+	part = calloc(1, sizeof(ffuzzy_concurrent_partition));
+	if (!newdir || !part)
+	{
+		free(newdir);
+		free(part);
+		return NULL;
+	}
+	part->block_size = block_size;
+	size_t n = 0;
+	while (n < dir->count && dir->parts[n]->block_size < block_size)
+	{
+		newdir->parts[n] = dir->parts[n];
+		n++;
+	}
+	newdir->parts[n] = part;
+	memcpy(newdir->parts + n + 1, dir->parts + n, sizeof(ffuzzy_concurrent_partition*) * (dir->count - n));
+	newdir->count = dir->count + 1;
+	ffuzzy_atomic_store_release_(&idx->dir, newdir);
+	ffuzzy_concurrent_retire_(idx, &dir->gc);
+	return part;
+}
+
+
+bool ffuzzy_concurrent_index_add(ffuzzy_concurrent_index *idx, const ffuzzy_digest *digest, size_t *id)
+{
+	assert(ffuzzy_digest_is_valid(digest));
+	bool ok = false;
+	ffuzzy_mutex_lock_(&idx->lock);
+	ffuzzy_concurrent_partition *part = ffuzzy_concurrent_get_partition_(idx, digest->block_size);
+	if (!part)
+		goto cleanup;
+	ffuzzy_concurrent_segment *seg = part->tail;
+	if (!seg || seg->count == seg->capacity)
+	{
+		size_t capacity = seg ? MIN(seg->capacity * 2, FFUZZY_CONCURRENT_SEGMENT_MAX) : FFUZZY_CONCURRENT_SEGMENT_MIN;
+		ffuzzy_concurrent_segment *newseg = ffuzzy_concurrent_segment_new_(MAX(capacity, FFUZZY_CONCURRENT_SEGMENT_MIN));
+		if (!newseg)
+			goto cleanup;
+		if (seg)
+			ffuzzy_atomic_store_release_(&seg->next, newseg);
+		else
+			ffuzzy_atomic_store_release_(&part->head, newseg);
+		part->tail = seg = newseg;
+		part->nsegments++;
+	}
+	// fill the item first and then publish it
+	size_t n = seg->count;
+	size_t newid = idx->count;
+	seg->items[n].id = newid;
+	seg->items[n].digest = *digest;
+	ffuzzy_atomic_store_release_(&seg->count, n + 1);
+	ffuzzy_atomic_store_release_(&idx->count, newid + 1);
+	part->count++;
+	if (id)
+		*id = newid;
+	ffuzzy_concurrent_reclaim_(idx);
+	ok = true;
+cleanup:
+	ffuzzy_mutex_unlock_(&idx->lock);
+	return ok;
+}
+
+
+size_t ffuzzy_concurrent_index_size(const ffuzzy_concurrent_index *idx)
+{
+	return ffuzzy_atomic_load_acquire_(&idx->count);
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_concurrent_compact_partition_(ffuzzy_concurrent_index*, ffuzzy_concurrent_partition*)
+	\brief  Merge full segments of the partition (compaction lock must be held)
+	\return true if succeeds; false otherwise (the partition is not changed).
+**/
+static bool ffuzzy_concurrent_compact_partition_(ffuzzy_concurrent_index *idx, ffuzzy_concurrent_partition *part)
+{
+	// segments before the tail are full and cannot be retired by others
+	ffuzzy_mutex_lock_(&idx->lock);
+	ffuzzy_concurrent_segment *head = part->head, *stop = part->tail;
+	size_t nsegments = part->nsegments;
+	ffuzzy_mutex_unlock_(&idx->lock);
+	if (nsegments < FFUZZY_CONCURRENT_COMPACT_SEGMENTS)
+		return true;
+	size_t n = 0, nmerged = 0;
+	for (ffuzzy_concurrent_segment *seg = head; seg != stop; seg = seg->next, nmerged++)
+		n += seg->count;
+	ffuzzy_concurrent_segment *newseg = ffuzzy_concurrent_segment_new_(n);
+	if (!newseg)
+		return false;
+	n = 0;
+	for (ffuzzy_concurrent_segment *seg = head; seg != stop; seg = seg->next)
+	{
+		memcpy(newseg->items + n, seg->items, sizeof(ffuzzy_concurrent_item) * seg->count);
+		n += seg->count;
+	}
+	newseg->count = n;
+	// publish: the tail (and segments appended since) follow the merged segment
+	newseg->next = stop;
+	ffuzzy_mutex_lock_(&idx->lock);
+	assert(part->head == head);
+	ffuzzy_atomic_store_release_(&part->head, newseg);
+	part->nsegments -= nmerged - 1;
+	while (head != stop)
+	{
+		ffuzzy_concurrent_segment *next = head->next;
+		ffuzzy_concurrent_retire_(idx, &head->gc);
+		head = next;
+	}
+	ffuzzy_concurrent_reclaim_(idx);
+	ffuzzy_mutex_unlock_(&idx->lock);
+	return true;
+}
+
+
+bool ffuzzy_concurrent_index_compact(ffuzzy_concurrent_index *idx)
+{
+	bool ok = true;
+	ffuzzy_mutex_lock_(&idx->compact_lock);
+	// partitions are never freed (but the directory may be replaced)
+	ffuzzy_mutex_lock_(&idx->lock);
+	size_t nparts = idx->dir->count;
+	ffuzzy_concurrent_partition **parts = malloc(sizeof(ffuzzy_concurrent_partition*) * (nparts ? nparts : 1));
+	if (parts)
+		memcpy(parts, idx->dir->parts, sizeof(ffuzzy_concurrent_partition*) * nparts);
+	ffuzzy_mutex_unlock_(&idx->lock);
+	if (!parts)
+	{
+		ffuzzy_mutex_unlock_(&idx->compact_lock);
+		return false;
+	}
+	for (size_t i = 0; i < nparts; i++)
+		if (!ffuzzy_concurrent_compact_partition_(idx, parts[i]))
+			ok = false;
+	free(parts);
+	ffuzzy_mutex_unlock_(&idx->compact_lock);
+	return ok;
+}
+
+
+#ifdef FFUZZY_ENABLE_THREADS
+/**
+	\internal
+	\fn     void* ffuzzy_concurrent_compactor_(void*)
+	\brief  Background compaction thread
+**/
+static void *ffuzzy_concurrent_compactor_(void *arg)
+{
+	ffuzzy_concurrent_index *idx = arg;
+	pthread_mutex_lock(&idx->cmutex);
+	while (!idx->cstop)
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec  += idx->interval_ms / 1000;
+		ts.tv_nsec += (long)(idx->interval_ms % 1000) * 1000000L;
+		if (ts.tv_nsec >= 1000000000L)
+		{
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+		pthread_cond_timedwait(&idx->ccond, &idx->cmutex, &ts);
+		if (idx->cstop)
+			break;
+		pthread_mutex_unlock(&idx->cmutex);
+		ffuzzy_concurrent_index_compact(idx);
+		pthread_mutex_lock(&idx->cmutex);
+	}
+	pthread_mutex_unlock(&idx->cmutex);
+	return NULL;
+}
+#endif
+
+
+bool ffuzzy_concurrent_index_start_compactor(ffuzzy_concurrent_index *idx, unsigned interval_ms)
+{
+#ifdef FFUZZY_ENABLE_THREADS
+	if (idx->crunning || !interval_ms)
+		return false;
+	idx->cstop = false;
+	idx->interval_ms = interval_ms;
+	if (pthread_create(&idx->compactor, NULL, ffuzzy_concurrent_compactor_, idx))
+		return false;
+	idx->crunning = true;
+	return true;
+#else
+	(void)idx;
+	(void)interval_ms;
+	return false;
+#endif
+}
+
+
+void ffuzzy_concurrent_index_stop_compactor(ffuzzy_concurrent_index *idx)
+{
+#ifdef FFUZZY_ENABLE_THREADS
+	if (!idx->crunning)
+		return;
+	pthread_mutex_lock(&idx->cmutex);
+	idx->cstop = true;
+	pthread_cond_signal(&idx->ccond);
+	pthread_mutex_unlock(&idx->cmutex);
+	pthread_join(idx->compactor, NULL);
+	idx->crunning = false;
+#else
+	(void)idx;
+#endif
+}
+
+
+ffuzzy_concurrent_reader *ffuzzy_concurrent_reader_new(ffuzzy_concurrent_index *idx)
+{
+	ffuzzy_concurrent_reader *r = calloc(1, sizeof(ffuzzy_concurrent_reader));
+	if (!r)
+		return NULL;
+	r->idx = idx;
+	ffuzzy_mutex_lock_(&idx->lock);
+	r->next = idx->readers;
+	idx->readers = r;
+	ffuzzy_mutex_unlock_(&idx->lock);
+	return r;
+}
+
+
+void ffuzzy_concurrent_reader_free(ffuzzy_concurrent_reader *r)
+{
+	if (!r)
+		return;
+	ffuzzy_concurrent_index *idx = r->idx;
+	ffuzzy_mutex_lock_(&idx->lock);
+	for (ffuzzy_concurrent_reader **p = &idx->readers; *p; p = &(*p)->next)
+	{
+		if (*p == r)
+		{
+			*p = r->next;
+			break;
+		}
+	}
+	ffuzzy_mutex_unlock_(&idx->lock);
+	free(r);
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_concurrent_scan_(const ffuzzy_concurrent_partition*, const ffuzzy_digest*, int, ffuzzy_match_list*)
+	\brief  Compare the query against all published digests in the partition
+	\return true if succeeds; false otherwise.
+**/
+static bool ffuzzy_concurrent_scan_(
+	const ffuzzy_concurrent_partition *part,
+	const ffuzzy_digest *query, int threshold,
+	ffuzzy_match_list *results
+)
+{
+	bool ok = true;
+	for (
+		const ffuzzy_concurrent_segment *seg = ffuzzy_atomic_load_acquire_(&part->head);
+		seg;
+		seg = ffuzzy_atomic_load_acquire_(&seg->next)
+	)
+	{
+		size_t n = ffuzzy_atomic_load_acquire_(&seg->count);
+		for (size_t i = 0; i < n; i++)
+		{
+			const ffuzzy_concurrent_item *item = &seg->items[i];
+			if (ffuzzy_compare_digest_near_max_(query, &item->digest) < threshold)
+				continue;
+			int score = ffuzzy_compare_digest_near(query, &item->digest);
+			if (score >= threshold && !ffuzzy_match_list_push_(results, item->id, score))
+				ok = false;
+		}
+	}
+	return ok;
+}
+
+
+bool ffuzzy_concurrent_index_search(
+	ffuzzy_concurrent_reader *reader, const ffuzzy_digest *query,
+	int threshold, ffuzzy_match_list *results
+)
+{
+	assert(ffuzzy_digest_is_valid(query));
+	ffuzzy_concurrent_index *idx = reader->idx;
+	bool ok = true;
+	unsigned long bs = query->block_size;
+	results->count = 0;
+	threshold = MAX(threshold, 1);
+	// enter the read-side critical section
+	unsigned long epoch = ffuzzy_atomic_load_relaxed_(&idx->epoch);
+	ffuzzy_atomic_store_relaxed_(&reader->state, (epoch << 1) | 1);
+	ffuzzy_atomic_fence_();
+	const ffuzzy_concurrent_dir *dir = ffuzzy_atomic_load_acquire_(&idx->dir);
+	const ffuzzy_concurrent_partition *part;
+	// block size 0 is "near" only to itself
+	if (bs && !(bs & 1ul) && (part = ffuzzy_concurrent_find_(dir, bs / 2)))
+		ok &= ffuzzy_concurrent_scan_(part, query, threshold, results);
+	if ((part = ffuzzy_concurrent_find_(dir, bs)))
+		ok &= ffuzzy_concurrent_scan_(part, query, threshold, results);
+	if (bs && bs <= ULONG_MAX / 2 && (part = ffuzzy_concurrent_find_(dir, bs * 2)))
+		ok &= ffuzzy_concurrent_scan_(part, query, threshold, results);
+	// leave the critical section
+	ffuzzy_atomic_store_release_(&reader->state, 0ul);
+	ffuzzy_match_sort_(results->matches, results->count);
+	return ok;
+}
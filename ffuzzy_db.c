@@ -0,0 +1,443 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_db.c
+	Hot-swappable memory-mapped digest databases
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\internal
+	\file  ffuzzy_db.c
+	\brief Hot-swappable memory-mapped digest databases
+	\details
+		Each snapshot has a reference count. The handle holds one
+		reference to the current snapshot and each pin holds another.
+		When the count drops to zero, it is marked as "dead"
+		(FFUZZY_DB_DEAD) by compare-and-swap and its data is unmapped.
+		A reader which loses the race against a swap may increment
+		the count of a dead snapshot; it sees the mark and retries
+		without touching the data. Since a reader may still read the count,
+		snapshot headers are kept until the handle is closed.
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define FFUZZY_DB_USE_MMAP 1
+#endif
+
+#include "ffuzzy.h"
+#include "ffuzzy_atomic.h"
+#include "ffuzzy_compare.h"
+#include "ffuzzy_match.h"
+#include "ffuzzy_parallel.h"
+#include "ffuzzy_record.h"
+#include "util.h"
+
+/** \internal \brief Reference count mark for snapshots whose data is released **/
+#define FFUZZY_DB_DEAD (((unsigned long)-1 >> 1) + 1)
+
+
+/**
+	\internal
+	\struct ffuzzy_db_group
+	\brief  Range of records with the same block size
+**/
+typedef struct
+{
+	unsigned long block_size;
+	size_t first, count;
+} ffuzzy_db_group;
+
+
+/**
+	\internal
+	\struct ffuzzy_db_snapshot
+	\brief  Mapped database file
+
+	\internal
+	\var   ffuzzy_db_snapshot::next
+	\brief Next (older) snapshot of the same handle.
+	\internal
+	\var   ffuzzy_db_snapshot::refs
+	\brief Reference count (with FFUZZY_DB_DEAD mark).
+	\internal
+	\var   ffuzzy_db_snapshot::data
+	\brief Binary digest records (sorted by block sizes).
+	\internal
+	\var   ffuzzy_db_snapshot::groups
+	\brief Block size groups (sorted by the block size).
+**/
+struct ffuzzy_db_snapshot
+{
+	struct ffuzzy_db_snapshot *next;
+	unsigned long refs;
+	unsigned char *data;
+	size_t size;
+	size_t count;
+	ffuzzy_db_group *groups;
+	size_t ngroups;
+};
+
+
+/**
+	\internal
+	\struct ffuzzy_db
+	\brief  Database handle
+
+	\internal
+	\var   ffuzzy_db::current
+	\brief Current snapshot (published by swaps).
+	\internal
+	\var   ffuzzy_db::snapshots
+	\brief All snapshots (newest first; protected by ffuzzy_db::lock).
+**/
+struct ffuzzy_db
+{
+	ffuzzy_db_snapshot *current;
+	ffuzzy_db_snapshot *snapshots;
+	ffuzzy_mutex lock;
+};
+
+
+/**
+	\internal
+	\fn     void ffuzzy_db_unmap_(ffuzzy_db_snapshot*)
+	\brief  Release data of the snapshot (keeping the header)
+**/
+static void ffuzzy_db_unmap_(ffuzzy_db_snapshot *snap)
+{
+#ifdef FFUZZY_DB_USE_MMAP
+	if (snap->data)
+		munmap(snap->data, snap->size);
+#else
+	free(snap->data);
+#endif
+	free(snap->groups);
+	snap->data = NULL;
+	snap->groups = NULL;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_db_map_(ffuzzy_db_snapshot*, const char*)
+	\brief  Map (or read) the whole database file
+	\return true if succeeds; false otherwise.
+**/
+static bool ffuzzy_db_map_(ffuzzy_db_snapshot *snap, const char *path)
+{
+#ifdef FFUZZY_DB_USE_MMAP
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) || st.st_size < 0 || (unsigned long long)st.st_size > (size_t)-1)
+	{
+		close(fd);
+		return false;
+	}
+	snap->size = (size_t)st.st_size;
+	if (snap->size)
+	{
+		void *p = mmap(NULL, snap->size, PROT_READ, MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED)
+		{
+			close(fd);
+			return false;
+		}
+		snap->data = p;
+	}
+	close(fd);
+	return true;
+#else
+	FILE *fp = fopen(path, "rb");
+	if (!fp)
+		return false;
+	size_t capacity = 0;
+	for (;;)
+	{
+		if (!util_grow_array((void**)&snap->data, &capacity, snap->size + FFUZZY_RECORD_SIZE * 1024, 1))
+			break;
+		size_t n = fread(snap->data + snap->size, 1, capacity - snap->size, fp);
+		snap->size += n;
+		if (n == 0)
+		{
+			bool ok = !ferror(fp);
+			fclose(fp);
+			return ok;
+		}
+	}
+	fclose(fp);
+	return false;
+#endif
+}
+
+
+/**
+	\internal
+	\fn     ffuzzy_db_snapshot* ffuzzy_db_load_(const char*)
+	\brief  Map the database file and validate it
+	\details
+		All records must be valid and sorted by block sizes.
+	\return The new snapshot (with one reference) if succeeds; NULL otherwise.
+**/
+static ffuzzy_db_snapshot *ffuzzy_db_load_(const char *path)
+{
+	ffuzzy_db_snapshot *snap = calloc(1, sizeof(ffuzzy_db_snapshot));
+	if (!snap)
+		return NULL;
+	if (!ffuzzy_db_map_(snap, path) || snap->size % FFUZZY_RECORD_SIZE)
+		goto fail;
+	snap->count = snap->size / FFUZZY_RECORD_SIZE;
+	size_t groupcap = 0;
+	for (size_t i = 0; i < snap->count; i++)
+	{
+		ffuzzy_digest d;
+		if (!ffuzzy_decode_digest_record(NULL, &d, snap->data + i * FFUZZY_RECORD_SIZE))
+			goto fail;
+		ffuzzy_db_group *last = snap->ngroups ? &snap->groups[snap->ngroups - 1] : NULL;
+		if (last && last->block_size == d.block_size)
+		{
+			last->count++;
+			continue;
+		}
+		if (last && last->block_size > d.block_size)
+			goto fail;
+		if (!util_grow_array((void**)&snap->groups, &groupcap, snap->ngroups + 1, sizeof(ffuzzy_db_group)))
+			goto fail;
+		snap->groups[snap->ngroups].block_size = d.block_size;
+		snap->groups[snap->ngroups].first = i;
+		snap->groups[snap->ngroups].count = 1;
+		snap->ngroups++;
+	}
+	snap->refs = 1;
+	return snap;
+fail:
+	ffuzzy_db_unmap_(snap);
+	free(snap);
+	return NULL;
+}
+
+
+/**
+	\internal
+	\fn     void ffuzzy_db_unref_(ffuzzy_db_snapshot*)
+	\brief  Drop a reference (and release data on the last one)
+**/
+static void ffuzzy_db_unref_(ffuzzy_db_snapshot *snap)
+{
+	unsigned long refs = ffuzzy_atomic_fetch_sub_(&snap->refs, 1ul) - 1;
+	if (refs)
+		return;
+	// only one thread can mark the snapshot dead
+	unsigned long expected = 0;
+	if (ffuzzy_atomic_cas_(&snap->refs, expected, FFUZZY_DB_DEAD))
+		ffuzzy_db_unmap_(snap);
+}
+
+
+ffuzzy_db *ffuzzy_db_open(const char *path)
+{
+	ffuzzy_db *db = calloc(1, sizeof(ffuzzy_db));
+	if (!db)
+		return NULL;
+	if (!ffuzzy_mutex_init_(&db->lock))
+	{
+		free(db);
+		return NULL;
+	}
+	db->current = db->snapshots = ffuzzy_db_load_(path);
+	if (!db->current)
+	{
+		ffuzzy_mutex_destroy_(&db->lock);
+		free(db);
+		return NULL;
+	}
+	return db;
+}
+
+
+void ffuzzy_db_close(ffuzzy_db *db)
+{
+	if (!db)
+		return;
+	ffuzzy_db_unref_(db->current);
+	while (db->snapshots)
+	{
+		ffuzzy_db_snapshot *next = db->snapshots->next;
+		assert(db->snapshots->refs == FFUZZY_DB_DEAD);
+		free(db->snapshots);
+		db->snapshots = next;
+	}
+	ffuzzy_mutex_destroy_(&db->lock);
+	free(db);
+}
+
+
+bool ffuzzy_db_swap(ffuzzy_db *db, const char *path)
+{
+	// mapping and validation are done before the swap
+	ffuzzy_db_snapshot *snap = ffuzzy_db_load_(path);
+	if (!snap)
+		return false;
+	ffuzzy_mutex_lock_(&db->lock);
+	snap->next = db->snapshots;
+	db->snapshots = snap;
+	ffuzzy_db_snapshot *old = db->current;
+	ffuzzy_atomic_store_release_(&db->current, snap);
+	ffuzzy_mutex_unlock_(&db->lock);
+	ffuzzy_db_unref_(old);
+	return true;
+}
+
+
+const ffuzzy_db_snapshot *ffuzzy_db_pin(ffuzzy_db *db)
+{
+	for (;;)
+	{
+		ffuzzy_db_snapshot *snap = ffuzzy_atomic_load_acquire_(&db->current);
+		unsigned long refs = ffuzzy_atomic_fetch_add_(&snap->refs, 1ul);
+		// the snapshot is still current (and alive) after taking a reference
+		if (!(refs & FFUZZY_DB_DEAD) && ffuzzy_atomic_load_acquire_(&db->current) == snap)
+			return snap;
+		ffuzzy_db_unref_(snap);
+	}
+}
+
+
+void ffuzzy_db_release(const ffuzzy_db_snapshot *snap)
+{
+	if (snap)
+		ffuzzy_db_unref_((ffuzzy_db_snapshot*)snap);
+}
+
+
+size_t ffuzzy_db_snapshot_size(const ffuzzy_db_snapshot *snap)
+{
+	return snap->count;
+}
+
+
+bool ffuzzy_db_snapshot_get(const ffuzzy_db_snapshot *snap, size_t index, unsigned long long *id, ffuzzy_digest *digest)
+{
+	if (index >= snap->count)
+		return false;
+	return ffuzzy_decode_digest_record(id, digest, snap->data + index * FFUZZY_RECORD_SIZE);
+}
+
+
+/**
+	\internal
+	\fn     const ffuzzy_db_group* ffuzzy_db_find_(const ffuzzy_db_snapshot*, unsigned long)
+	\brief  Find the group with given block size
+	\return The group if exists; NULL otherwise.
+**/
+static const ffuzzy_db_group *ffuzzy_db_find_(const ffuzzy_db_snapshot *snap, unsigned long block_size)
+{
+	size_t lo = 0, hi = snap->ngroups;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		unsigned long bs = snap->groups[mid].block_size;
+		if (bs == block_size)
+			return &snap->groups[mid];
+		if (bs < block_size)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return NULL;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_db_scan_(const ffuzzy_db_snapshot*, const ffuzzy_db_group*, const ffuzzy_digest*, int, ffuzzy_match_list*)
+	\brief  Compare the query against all records in the group
+	\details
+		Records are validated on loading but the mapped file may be
+		modified afterwards, so each record is checked again
+		(block lengths before copying digest blocks).
+		Records which became invalid are skipped.
+	\return true if succeeds; false otherwise.
+**/
+static bool ffuzzy_db_scan_(
+	const ffuzzy_db_snapshot *snap, const ffuzzy_db_group *group,
+	const ffuzzy_digest *query, int threshold,
+	ffuzzy_match_list *results
+)
+{
+	bool ok = true;
+	ffuzzy_digest d;
+	d.block_size = group->block_size;
+	for (size_t i = group->first; i < group->first + group->count; i++)
+	{
+		const unsigned char *rec = snap->data + i * FFUZZY_RECORD_SIZE;
+		d.len1 = rec[FFUZZY_RECORD_OFFSET_LEN1];
+		d.len2 = rec[FFUZZY_RECORD_OFFSET_LEN2];
+		if (!ffuzzy_digest_is_valid_lengths(&d))
+			continue;
+		if (ffuzzy_compare_digest_near_max_(query, &d) < threshold)
+			continue;
+		memcpy(d.digest, rec + FFUZZY_RECORD_OFFSET_DIGEST, d.len1 + d.len2);
+		if (!ffuzzy_digest_is_valid_buffer(&d))
+			continue;
+		int score = ffuzzy_compare_digest_near(query, &d);
+		if (score >= threshold && !ffuzzy_match_list_push_(results, i, score))
+			ok = false;
+	}
+	return ok;
+}
+
+
+bool ffuzzy_db_snapshot_search(
+	const ffuzzy_db_snapshot *snap, const ffuzzy_digest *query,
+	int threshold, ffuzzy_match_list *results
+)
+{
+	assert(ffuzzy_digest_is_valid(query));
+	bool ok = true;
+	unsigned long bs = query->block_size;
+	const ffuzzy_db_group *group;
+	results->count = 0;
+	threshold = MAX(threshold, 1);
+	// block size 0 is "near" only to itself
+	if (bs && !(bs & 1ul) && (group = ffuzzy_db_find_(snap, bs / 2)))
+		ok &= ffuzzy_db_scan_(snap, group, query, threshold, results);
+	if ((group = ffuzzy_db_find_(snap, bs)))
+		ok &= ffuzzy_db_scan_(snap, group, query, threshold, results);
+	if (bs && bs <= ULONG_MAX / 2 && (group = ffuzzy_db_find_(snap, bs * 2)))
+		ok &= ffuzzy_db_scan_(snap, group, query, threshold, results);
+	ffuzzy_match_sort_(results->matches, results->count);
+	return ok;
+}
@@ -53,11 +53,13 @@ inline bool ffuzzy_digest_is_valid_lengths(const ffuzzy_digest *digest)
 
 bool ffuzzy_digest_is_valid_buffer(const ffuzzy_digest *digest)
 {
-	assert(fuzzy_digest_is_valid_lengths(digest));
+	assert(ffuzzy_digest_is_valid_lengths(digest));
 	const char *buf = digest->digest;
 	for (size_t i = 3; i < digest->len1; i++, buf++)
 		if (buf[0] == buf[1] && buf[0] == buf[2] && buf[0] == buf[3])
 			return false;
+	// sequences must not span two blocks
+	buf = digest->digest + digest->len1;
 	for (size_t i = 3; i < digest->len2; i++, buf++)
 		if (buf[0] == buf[1] && buf[0] == buf[2] && buf[0] == buf[3])
 			return false;
@@ -67,7 +69,7 @@ bool ffuzzy_digest_is_valid_buffer(const ffuzzy_digest *digest)
 
 bool ffuzzy_digest_is_natural_buffer(const ffuzzy_digest *digest)
 {
-	assert(fuzzy_digest_is_valid_lengths(digest));
+	assert(ffuzzy_digest_is_valid_lengths(digest));
 	const char *buf = digest->digest;
 	for (size_t i = 0; i < digest->len1 && i < 3; i++)
 		if (!is_base64(buf[i]))
@@ -75,8 +77,10 @@ bool ffuzzy_digest_is_natural_buffer(const ffuzzy_digest *digest)
 	for (size_t i = 3; i < digest->len1; i++, buf++)
 		if (!is_base64(buf[3]) || (buf[0] == buf[1] && buf[0] == buf[2] && buf[0] == buf[3]))
 			return false;
-	for (size_t i = 0; i < digest->len2 && i < 3; i++, buf++)
-		if (!is_base64(buf[3]))
+	// sequences must not span two blocks
+	buf = digest->digest + digest->len1;
+	for (size_t i = 0; i < digest->len2 && i < 3; i++)
+		if (!is_base64(buf[i]))
 			return false;
 	for (size_t i = 3; i < digest->len2; i++, buf++)
 		if (!is_base64(buf[3]) || (buf[0] == buf[1] && buf[0] == buf[2] && buf[0] == buf[3]))
@@ -144,7 +148,7 @@ int ffuzzy_digestcmp_blocksize_n(const ffuzzy_digest *d1, const ffuzzy_digest *d
 
 bool ffuzzy_pretty_digest(char *buf, size_t buflen, const ffuzzy_digest *digest)
 {
-	assert(fuzzy_digest_is_valid_lengths(digest));
+	assert(ffuzzy_digest_is_valid_lengths(digest));
 	// pretty hash contains two colons and trailing '\0'
 	if (buflen < 3)
 		return false;
@@ -53,7 +53,7 @@ inline bool ffuzzy_udigest_is_valid_lengths(const ffuzzy_udigest *udigest)
 
 bool ffuzzy_udigest_is_natural_buffer(const ffuzzy_udigest *udigest)
 {
-	assert(fuzzy_udigest_is_valid_lengths(udigest));
+	assert(ffuzzy_udigest_is_valid_lengths(udigest));
 	for (size_t i = 0; i < udigest->len1 + udigest->len2; i++)
 		if (!is_base64(udigest->digest[i]))
 			return false;
@@ -118,7 +118,7 @@ int ffuzzy_udigestcmp_blocksize_n(const ffuzzy_udigest *d1, const ffuzzy_udigest
 
 bool ffuzzy_pretty_udigest(char *buf, size_t buflen, const ffuzzy_udigest *udigest)
 {
-	assert(fuzzy_udigest_is_valid_lengths(udigest));
+	assert(ffuzzy_udigest_is_valid_lengths(udigest));
 	// pretty hash contains two colons and trailing '\0'
 	if (buflen < 3)
 		return false;
@@ -0,0 +1,511 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_external.c
+	External sort and out-of-core all-pairs comparison
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\internal
+	\file  ffuzzy_external.c
+	\brief External sort and out-of-core all-pairs comparison
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_compare.h"
+#include "util.h"
+
+/** \internal \brief Maximum number of runs to merge at once **/
+#define FFUZZY_EXTERNAL_FANIN 64
+/** \internal \brief Line buffer size to read digest lists **/
+#define FFUZZY_EXTERNAL_LINELEN 512
+
+
+/**
+	\internal
+	\struct ffuzzy_external_record
+	\brief  In-memory form of a binary digest record
+**/
+typedef struct
+{
+	unsigned long long id;
+	ffuzzy_digest digest;
+} ffuzzy_external_record;
+
+
+static int ffuzzy_external_record_cmp_(const void *p1, const void *p2)
+{
+	const ffuzzy_external_record *r1 = p1, *r2 = p2;
+	int c = ffuzzy_digestcmp_blocksize(&r1->digest, &r2->digest);
+	if (c)
+		return c;
+	return r1->id < r2->id ? -1 : r1->id > r2->id ? +1 : 0;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_external_seek_(FILE*, unsigned long long)
+	\brief  Seek to the given record
+**/
+static bool ffuzzy_external_seek_(FILE *fp, unsigned long long index)
+{
+#ifdef HAVE_FSEEKO
+	off_t off = (off_t)(index * FFUZZY_RECORD_SIZE);
+	if (off < 0 || index > ((unsigned long long)-1) / FFUZZY_RECORD_SIZE || (unsigned long long)off != index * FFUZZY_RECORD_SIZE)
+		return false;
+	return !fseeko(fp, off, SEEK_SET);
+#else
+	if (index > (unsigned long long)LONG_MAX / FFUZZY_RECORD_SIZE)
+		return false;
+	return !fseek(fp, (long)(index * FFUZZY_RECORD_SIZE), SEEK_SET);
+#endif
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_external_read_text_(FILE*, ffuzzy_digest*)
+	\brief  Read the next parsable digest from the digest list
+	\details
+		Lines which cannot be parsed (such as the ssdeep header) are skipped.
+		Only the first FFUZZY_EXTERNAL_LINELEN-1 characters of each line
+		are used (which is long enough to contain any valid digest).
+	\return true if a digest is read; false on the end of file.
+**/
+static bool ffuzzy_external_read_text_(FILE *fp, ffuzzy_digest *digest)
+{
+	char line[FFUZZY_EXTERNAL_LINELEN];
+	while (fgets(line, sizeof(line), fp))
+	{
+		size_t len = strlen(line);
+		if (len && line[len - 1] != '\n')
+		{
+			// discard the rest of the line
+			int c;
+			while ((c = getc(fp)) != EOF && c != '\n');
+		}
+		while (len && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+			line[--len] = '\0';
+		if (ffuzzy_read_digest(digest, line))
+			return true;
+	}
+	return false;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_external_merge_(FILE**, size_t, FILE*)
+	\brief  Merge sorted runs into one
+	\return true if succeeds; false otherwise.
+**/
+static bool ffuzzy_external_merge_(FILE **runs, size_t nruns, FILE *out)
+{
+	ffuzzy_external_record heap[FFUZZY_EXTERNAL_FANIN];
+	size_t src[FFUZZY_EXTERNAL_FANIN];
+	size_t n = 0;
+	assert(nruns <= FFUZZY_EXTERNAL_FANIN);
+	for (size_t i = 0; i < nruns; i++)
+	{
+		rewind(runs[i]);
+		if (ffuzzy_read_digest_record(runs[i], &heap[n].id, &heap[n].digest))
+			src[n++] = i;
+		else if (ferror(runs[i]) || !feof(runs[i]))
+			return false;
+	}
+	// heapify (minimum record on the top)
+	for (size_t k = n; k-- > 0; )
+	{
+		for (size_t i = k; ; )
+		{
+			size_t c = i * 2 + 1, m = i;
+			if (c < n && ffuzzy_external_record_cmp_(&heap[c], &heap[m]) < 0)
+				m = c;
+			if (c + 1 < n && ffuzzy_external_record_cmp_(&heap[c + 1], &heap[m]) < 0)
+				m = c + 1;
+			if (m == i)
+				break;
+			ffuzzy_external_record tr = heap[i]; heap[i] = heap[m]; heap[m] = tr;
+			size_t ts = src[i]; src[i] = src[m]; src[m] = ts;
+			i = m;
+		}
+	}
+	while (n)
+	{
+		if (!ffuzzy_write_digest_record(out, heap[0].id, &heap[0].digest))
+			return false;
+		if (!ffuzzy_read_digest_record(runs[src[0]], &heap[0].id, &heap[0].digest))
+		{
+			if (ferror(runs[src[0]]) || !feof(runs[src[0]]))
+				return false;
+			n--;
+			heap[0] = heap[n];
+			src[0] = src[n];
+		}
+		for (size_t i = 0; ; )
+		{
+			size_t c = i * 2 + 1, m = i;
+			if (c < n && ffuzzy_external_record_cmp_(&heap[c], &heap[m]) < 0)
+				m = c;
+			if (c + 1 < n && ffuzzy_external_record_cmp_(&heap[c + 1], &heap[m]) < 0)
+				m = c + 1;
+			if (m == i)
+				break;
+			ffuzzy_external_record tr = heap[i]; heap[i] = heap[m]; heap[m] = tr;
+			size_t ts = src[i]; src[i] = src[m]; src[m] = ts;
+			i = m;
+		}
+	}
+	return true;
+}
+
+
+bool ffuzzy_external_sort(FILE *in, bool text, FILE *out, size_t mem_budget)
+{
+	bool ok = false, eof = false;
+	size_t cap = mem_budget / sizeof(ffuzzy_external_record);
+	ffuzzy_external_record *buf;
+	FILE **runs = NULL;
+	size_t nruns = 0, runcap = 0;
+	unsigned long long next_id = 0;
+	if (cap < 2)
+		cap = 2;
+	buf = malloc(sizeof(ffuzzy_external_record) * cap);
+	if (!buf)
+		return false;
+	// create sorted runs
+	while (!eof)
+	{
+		size_t n = 0;
+		while (n < cap)
+		{
+			if (text)
+			{
+				if (!ffuzzy_external_read_text_(in, &buf[n].digest))
+				{
+					eof = true;
+					break;
+				}
+				buf[n++].id = next_id++;
+			}
+			else
+			{
+				if (!ffuzzy_read_digest_record(in, &buf[n].id, &buf[n].digest))
+				{
+					if (!feof(in))
+						goto cleanup;
+					eof = true;
+					break;
+				}
+				n++;
+			}
+		}
+		if (ferror(in))
+			goto cleanup;
+		qsort(buf, n, sizeof(ffuzzy_external_record), ffuzzy_external_record_cmp_);
+		// everything fits in the memory: write directly
+		if (eof && nruns == 0)
+		{
+			for (size_t i = 0; i < n; i++)
+				if (!ffuzzy_write_digest_record(out, buf[i].id, &buf[i].digest))
+					goto cleanup;
+			ok = !fflush(out);
+			goto cleanup;
+		}
+		if (n == 0)
+			break;
+		if (!util_grow_array((void**)&runs, &runcap, nruns + 1, sizeof(FILE*)))
+			goto cleanup;
+		if (!(runs[nruns] = tmpfile()))
+			goto cleanup;
+		nruns++;
+		for (size_t i = 0; i < n; i++)
+			if (!ffuzzy_write_digest_record(runs[nruns - 1], buf[i].id, &buf[i].digest))
+				goto cleanup;
+	}
+	free(buf);
+	buf = NULL;
+	// merge runs (in multiple passes if there are too many runs)
+	while (nruns > FFUZZY_EXTERNAL_FANIN)
+	{
+		size_t nnew = 0;
+		for (size_t i = 0; i < nruns; i += FFUZZY_EXTERNAL_FANIN)
+		{
+			size_t m = MIN(FFUZZY_EXTERNAL_FANIN, nruns - i);
+			FILE *fp = tmpfile();
+			if (!fp)
+				goto cleanup;
+			if (!ffuzzy_external_merge_(runs + i, m, fp))
+			{
+				fclose(fp);
+				goto cleanup;
+			}
+			// closed slots are cleared so that cleanup skips them
+			for (size_t j = 0; j < m; j++)
+			{
+				fclose(runs[i + j]);
+				runs[i + j] = NULL;
+			}
+			runs[nnew++] = fp;
+		}
+		nruns = nnew;
+	}
+	ok = ffuzzy_external_merge_(runs, nruns, out) && !fflush(out);
+cleanup:
+	for (size_t i = 0; i < nruns; i++)
+		if (runs[i])
+			fclose(runs[i]);
+	free(runs);
+	free(buf);
+	return ok;
+}
+
+
+/**
+	\internal
+	\struct ffuzzy_external_group
+	\brief  Range of records with the same block size in the sorted file
+**/
+typedef struct
+{
+	unsigned long block_size;
+	unsigned long long first, count;
+} ffuzzy_external_group;
+
+
+/**
+	\internal
+	\struct ffuzzy_external_ctx
+	\brief  State of out-of-core all-pairs comparison
+**/
+typedef struct
+{
+	int threshold;
+	ffuzzy_pair_callback callback;
+	void *cbctx;
+} ffuzzy_external_ctx;
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_external_load_(FILE*, unsigned long long, size_t, ffuzzy_external_record*)
+	\brief  Load records from the sorted file
+**/
+static bool ffuzzy_external_load_(FILE *fp, unsigned long long first, size_t count, ffuzzy_external_record *buf)
+{
+	if (!ffuzzy_external_seek_(fp, first))
+		return false;
+	for (size_t i = 0; i < count; i++)
+		if (!ffuzzy_read_digest_record(fp, &buf[i].id, &buf[i].digest))
+			return false;
+	return true;
+}
+
+
+/**
+	\internal
+	\fn     void ffuzzy_external_compare_(ffuzzy_external_ctx*, const ffuzzy_external_record*, const ffuzzy_external_record*)
+	\brief  Compare two records and report if matched
+**/
+static inline void ffuzzy_external_compare_(
+	ffuzzy_external_ctx *ctx,
+	const ffuzzy_external_record *r1, const ffuzzy_external_record *r2
+)
+{
+	if (ffuzzy_compare_digest_near_max_(&r1->digest, &r2->digest) < ctx->threshold)
+		return;
+	int score = ffuzzy_compare_digest_near(&r1->digest, &r2->digest);
+	if (score >= ctx->threshold)
+		ctx->callback(ctx->cbctx, (size_t)r1->id, (size_t)r2->id, score);
+}
+
+
+static void ffuzzy_external_self_(ffuzzy_external_ctx *ctx, const ffuzzy_external_record *x, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		for (size_t j = i + 1; j < n; j++)
+			ffuzzy_external_compare_(ctx, &x[i], &x[j]);
+}
+
+
+static void ffuzzy_external_cross_(
+	ffuzzy_external_ctx *ctx,
+	const ffuzzy_external_record *x, size_t nx,
+	const ffuzzy_external_record *y, size_t ny
+)
+{
+	for (size_t i = 0; i < nx; i++)
+		for (size_t j = 0; j < ny; j++)
+			ffuzzy_external_compare_(ctx, &x[i], &y[j]);
+}
+
+
+bool ffuzzy_external_allpairs(
+	FILE *sorted, int threshold, size_t mem_budget,
+	ffuzzy_pair_callback callback, void *cbctx
+)
+{
+	bool ok = false;
+	ffuzzy_external_group *groups = NULL;
+	size_t ngroups = 0, groupcap = 0;
+	ffuzzy_external_record *bufs[2] = { NULL, NULL };
+	ffuzzy_external_ctx ctx;
+	ctx.threshold = MAX(threshold, 1);
+	ctx.callback = callback;
+	ctx.cbctx = cbctx;
+	// two buffers (each contains a group or a chunk)
+	size_t cap = mem_budget / 2 / sizeof(ffuzzy_external_record);
+	if (cap < 1)
+		cap = 1;
+	// pass 1: make block size groups (and check whether the file is sorted)
+	{
+		unsigned long long index = 0;
+		ffuzzy_digest d;
+		rewind(sorted);
+		while (ffuzzy_read_digest_record(sorted, NULL, &d))
+		{
+			if (ngroups && groups[ngroups - 1].block_size == d.block_size)
+				groups[ngroups - 1].count++;
+			else
+			{
+				if (ngroups && groups[ngroups - 1].block_size > d.block_size)
+					goto cleanup;
+				if (!util_grow_array((void**)&groups, &groupcap, ngroups + 1, sizeof(ffuzzy_external_group)))
+					goto cleanup;
+				groups[ngroups].block_size = d.block_size;
+				groups[ngroups].first = index;
+				groups[ngroups].count = 1;
+				ngroups++;
+			}
+			index++;
+		}
+		if (ferror(sorted) || !feof(sorted))
+			goto cleanup;
+	}
+	if (!(bufs[0] = malloc(sizeof(ffuzzy_external_record) * cap)))
+		goto cleanup;
+	if (!(bufs[1] = malloc(sizeof(ffuzzy_external_record) * cap)))
+		goto cleanup;
+	// pass 2: compare each group with itself and the group with half block size
+	// (only the last group is kept in the memory if it fits)
+	size_t resident = (size_t)-1;
+	int cur = 0;
+	for (size_t g = 0; g < ngroups; g++)
+	{
+		const ffuzzy_external_group *grp = &groups[g];
+		size_t half = (size_t)-1;
+		if (grp->block_size && !(grp->block_size & 1ul))
+		{
+			// half block size can only be found before this group
+			size_t lo = 0, hi = g;
+			while (lo < hi)
+			{
+				size_t mid = lo + (hi - lo) / 2;
+				if (groups[mid].block_size < grp->block_size / 2)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			if (lo < g && groups[lo].block_size == grp->block_size / 2)
+				half = lo;
+		}
+		if (grp->count <= cap)
+		{
+			// the whole group fits in a buffer
+			size_t n = (size_t)grp->count;
+			ffuzzy_external_record *x = bufs[cur], *y = bufs[1 - cur];
+			if (!ffuzzy_external_load_(sorted, grp->first, n, x))
+				goto cleanup;
+			ffuzzy_external_self_(&ctx, x, n);
+			if (half != (size_t)-1)
+			{
+				if (resident == half)
+					ffuzzy_external_cross_(&ctx, y, (size_t)groups[half].count, x, n);
+				else
+				{
+					for (unsigned long long i = 0; i < groups[half].count; i += cap)
+					{
+						size_t m = (size_t)MIN(cap, groups[half].count - i);
+						if (!ffuzzy_external_load_(sorted, groups[half].first + i, m, y))
+							goto cleanup;
+						ffuzzy_external_cross_(&ctx, y, m, x, n);
+					}
+				}
+			}
+			resident = g;
+			cur = 1 - cur;
+		}
+		else
+		{
+			// oversized group: block nested loop in chunks
+			ffuzzy_external_record *x = bufs[0], *y = bufs[1];
+			for (unsigned long long i = 0; i < grp->count; i += cap)
+			{
+				size_t nx = (size_t)MIN(cap, grp->count - i);
+				if (!ffuzzy_external_load_(sorted, grp->first + i, nx, x))
+					goto cleanup;
+				ffuzzy_external_self_(&ctx, x, nx);
+				for (unsigned long long j = i + nx; j < grp->count; j += cap)
+				{
+					size_t ny = (size_t)MIN(cap, grp->count - j);
+					if (!ffuzzy_external_load_(sorted, grp->first + j, ny, y))
+						goto cleanup;
+					ffuzzy_external_cross_(&ctx, x, nx, y, ny);
+				}
+			}
+			if (half != (size_t)-1)
+			{
+				for (unsigned long long i = 0; i < groups[half].count; i += cap)
+				{
+					size_t nx = (size_t)MIN(cap, groups[half].count - i);
+					if (!ffuzzy_external_load_(sorted, groups[half].first + i, nx, x))
+						goto cleanup;
+					for (unsigned long long j = 0; j < grp->count; j += cap)
+					{
+						size_t ny = (size_t)MIN(cap, grp->count - j);
+						if (!ffuzzy_external_load_(sorted, grp->first + j, ny, y))
+							goto cleanup;
+						ffuzzy_external_cross_(&ctx, x, nx, y, ny);
+					}
+				}
+			}
+			resident = (size_t)-1;
+		}
+	}
+	ok = true;
+cleanup:
+	free(bufs[0]);
+	free(bufs[1]);
+	free(groups);
+	return ok;
+}
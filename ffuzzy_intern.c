@@ -0,0 +1,248 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_intern.c
+	Block string interning and score memoization
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\internal
+	\file  ffuzzy_intern.c
+	\brief Block string interning and score memoization
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_intern.h"
+#include "util.h"
+
+
+ffuzzy_block_table *ffuzzy_block_table_new(void)
+{
+	return calloc(1, sizeof(ffuzzy_block_table));
+}
+
+
+void ffuzzy_block_table_free(ffuzzy_block_table *tbl)
+{
+	if (!tbl)
+		return;
+	free(tbl->blocks);
+	free(tbl->slots);
+	free(tbl);
+}
+
+
+/**
+	\internal
+	\fn     size_t ffuzzy_block_table_hash_(unsigned long, const char*, size_t)
+	\brief  Hash (FNV-1a) of effective block size and block string
+**/
+static inline size_t ffuzzy_block_table_hash_(unsigned long block_size, const char *s, size_t slen)
+{
+	uint_least64_t h = UINT64_C(0xcbf29ce484222325);
+	for (size_t i = 0; i < sizeof(block_size); i++)
+	{
+		h ^= (unsigned char)(block_size >> (i * CHAR_BIT));
+		h *= UINT64_C(0x100000001b3);
+	}
+	for (size_t i = 0; i < slen; i++)
+	{
+		h ^= (unsigned char)s[i];
+		h *= UINT64_C(0x100000001b3);
+	}
+	return (size_t)(h ^ (h >> 32));
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_block_table_rehash_(ffuzzy_block_table*, size_t)
+	\brief  Resize the hash table
+	\return true if succeeds; false otherwise (the table is left untouched).
+**/
+static bool ffuzzy_block_table_rehash_(ffuzzy_block_table *tbl, size_t nslots)
+{
+	if (nslots > ((size_t)-1) / sizeof(size_t))
+		return false;
+	size_t *slots = malloc(nslots * sizeof(size_t));
+	if (!slots)
+		return false;
+	for (size_t i = 0; i < nslots; i++)
+		slots[i] = FFUZZY_BLOCK_ID_NONE;
+	for (size_t id = 0; id < tbl->count; id++)
+	{
+		const ffuzzy_block_entry *b = &tbl->blocks[id];
+		size_t i = ffuzzy_block_table_hash_(b->block_size, b->s, b->len) & (nslots - 1);
+		while (slots[i] != FFUZZY_BLOCK_ID_NONE)
+			i = (i + 1) & (nslots - 1);
+		slots[i] = id;
+	}
+	free(tbl->slots);
+	tbl->slots = slots;
+	tbl->nslots = nslots;
+	return true;
+}
+
+
+bool ffuzzy_block_table_intern(
+	ffuzzy_block_table *tbl,
+	unsigned long block_size, const char *s, size_t slen,
+	size_t *id
+)
+{
+	assert(slen <= FFUZZY_SPAMSUM_LENGTH);
+	// keep load factor at most 1/2
+	if (tbl->count >= tbl->nslots / 2)
+	{
+		if (tbl->nslots > ((size_t)-1) / 2)
+			return false;
+		if (!ffuzzy_block_table_rehash_(tbl, tbl->nslots ? tbl->nslots * 2 : 64))
+			return false;
+	}
+	size_t mask = tbl->nslots - 1;
+	size_t i = ffuzzy_block_table_hash_(block_size, s, slen) & mask;
+	for (; tbl->slots[i] != FFUZZY_BLOCK_ID_NONE; i = (i + 1) & mask)
+	{
+		const ffuzzy_block_entry *b = &tbl->blocks[tbl->slots[i]];
+		if (b->block_size == block_size && b->len == slen && !memcmp(b->s, s, slen))
+		{
+			tbl->total++;
+			if (id)
+				*id = tbl->slots[i];
+			return true;
+		}
+	}
+	if (tbl->count == FFUZZY_BLOCK_ID_NONE)
+		return false;
+	if (!util_grow_array((void**)&tbl->blocks, &tbl->capacity, tbl->count + 1, sizeof(ffuzzy_block_entry)))
+		return false;
+	ffuzzy_block_entry *b = &tbl->blocks[tbl->count];
+	b->block_size = block_size;
+	b->len = (unsigned char)slen;
+	memcpy(b->s, s, slen);
+	tbl->slots[i] = tbl->count;
+	tbl->total++;
+	if (id)
+		*id = tbl->count;
+	tbl->count++;
+	return true;
+}
+
+
+bool ffuzzy_block_table_intern_digest(ffuzzy_block_table *tbl, const ffuzzy_digest *digest, size_t ids[2])
+{
+	assert(ffuzzy_digest_is_valid(digest));
+	if (!ffuzzy_block_table_intern(tbl, digest->block_size, digest->digest, digest->len1, &ids[0]))
+		return false;
+	// second block of digests with very large block sizes cannot be compared
+	if (digest->block_size > ULONG_MAX / 2)
+	{
+		ids[1] = FFUZZY_BLOCK_ID_NONE;
+		return true;
+	}
+	return ffuzzy_block_table_intern(tbl, digest->block_size * 2, digest->digest + digest->len1, digest->len2, &ids[1]);
+}
+
+
+size_t ffuzzy_block_table_size(const ffuzzy_block_table *tbl)
+{
+	return tbl->count;
+}
+
+
+unsigned long long ffuzzy_block_table_total(const ffuzzy_block_table *tbl)
+{
+	return tbl->total;
+}
+
+
+int ffuzzy_block_table_score(const ffuzzy_block_table *tbl, ffuzzy_score_memo *memo, size_t id1, size_t id2)
+{
+	if (id1 >= tbl->count || id2 >= tbl->count)
+		return -1;
+	if (tbl->blocks[id1].block_size != tbl->blocks[id2].block_size)
+		return -1;
+	return ffuzzy_block_table_score_(tbl, memo, id1, id2);
+}
+
+
+ffuzzy_score_memo *ffuzzy_score_memo_new(size_t capacity)
+{
+	size_t n = 1;
+	while (n < capacity)
+	{
+		if (n > ((size_t)-1) / 2 / sizeof(ffuzzy_score_memo_entry))
+			return NULL;
+		n *= 2;
+	}
+	ffuzzy_score_memo *memo = malloc(sizeof(ffuzzy_score_memo));
+	if (!memo)
+		return NULL;
+	memo->entries = malloc(n * sizeof(ffuzzy_score_memo_entry));
+	if (!memo->entries)
+	{
+		free(memo);
+		return NULL;
+	}
+	memo->mask = n - 1;
+	ffuzzy_score_memo_clear(memo);
+	return memo;
+}
+
+
+void ffuzzy_score_memo_free(ffuzzy_score_memo *memo)
+{
+	if (!memo)
+		return;
+	free(memo->entries);
+	free(memo);
+}
+
+
+void ffuzzy_score_memo_clear(ffuzzy_score_memo *memo)
+{
+	for (size_t i = 0; i <= memo->mask; i++)
+	{
+		memo->entries[i].id1 = FFUZZY_BLOCK_ID_NONE;
+		memo->entries[i].id2 = FFUZZY_BLOCK_ID_NONE;
+	}
+	memo->hits = 0;
+	memo->misses = 0;
+}
+
+
+void ffuzzy_score_memo_stats(const ffuzzy_score_memo *memo, unsigned long long *hits, unsigned long long *misses)
+{
+	if (hits)
+		*hits = memo->hits;
+	if (misses)
+		*misses = memo->misses;
+}
@@ -0,0 +1,230 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_intern.h
+	Block string interning and score memoization (internal)
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef FFUZZY_FFUZZY_INTERN_H
+#define FFUZZY_FFUZZY_INTERN_H
+
+/**
+	\internal
+	\file  ffuzzy_intern.h
+	\brief Block string interning and score memoization
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_compare.h"
+
+
+/**
+	\internal
+	\struct ffuzzy_block_entry
+	\brief  Interned block string
+
+	\internal
+	\var   ffuzzy_block_entry::block_size
+	\brief Effective block size of the block string.
+	\internal
+	\var   ffuzzy_block_entry::len
+	\brief Length of the block string.
+	\internal
+	\var   ffuzzy_block_entry::s
+	\brief The block string (not null-terminated).
+**/
+typedef struct
+{
+	unsigned long block_size;
+	unsigned char len;
+	char s[FFUZZY_SPAMSUM_LENGTH];
+} ffuzzy_block_entry;
+
+
+/**
+	\internal
+	\struct ffuzzy_block_table
+	\brief  Block string interning table
+
+	\internal
+	\var   ffuzzy_block_table::blocks
+	\brief Unique block strings (indexed by block ID).
+	\internal
+	\var   ffuzzy_block_table::count
+	\brief Number of unique block strings.
+	\internal
+	\var   ffuzzy_block_table::capacity
+	\brief Allocated number of entries for ffuzzy_block_table::blocks.
+	\internal
+	\var   ffuzzy_block_table::slots
+	\brief Hash table (open addressing) of block IDs (FFUZZY_BLOCK_ID_NONE if empty).
+	\internal
+	\var   ffuzzy_block_table::nslots
+	\brief Number of hash table slots (zero or a power of two).
+	\internal
+	\var   ffuzzy_block_table::total
+	\brief Number of interned block strings (including duplicates).
+**/
+struct ffuzzy_block_table
+{
+	ffuzzy_block_entry *blocks;
+	size_t count, capacity;
+	size_t *slots;
+	size_t nslots;
+	unsigned long long total;
+};
+
+
+/**
+	\internal
+	\struct ffuzzy_score_memo_entry
+	\brief  Memoized block comparison (id1 < id2)
+**/
+typedef struct
+{
+	size_t id1, id2;
+	int score;
+} ffuzzy_score_memo_entry;
+
+
+/**
+	\internal
+	\struct ffuzzy_score_memo
+	\brief  Bounded (direct-mapped) memo table of block comparisons
+
+	\internal
+	\var   ffuzzy_score_memo::entries
+	\brief Memo entries (empty if id1 is FFUZZY_BLOCK_ID_NONE).
+	\internal
+	\var   ffuzzy_score_memo::mask
+	\brief Number of entries minus one (the number of entries is a power of two).
+	\internal
+	\var   ffuzzy_score_memo::hits
+	\brief Number of lookups found in the memo.
+	\internal
+	\var   ffuzzy_score_memo::misses
+	\brief Number of lookups not found in the memo.
+**/
+struct ffuzzy_score_memo
+{
+	ffuzzy_score_memo_entry *entries;
+	size_t mask;
+	unsigned long long hits, misses;
+};
+
+
+/**
+	\internal
+	\fn     int ffuzzy_block_table_score_(const ffuzzy_block_table*, ffuzzy_score_memo*, size_t, size_t)
+	\brief  Compare two interned block strings (with the same effective block size)
+	\details
+		Identical block strings (same IDs) are scored without comparison.
+		Other pairs are looked up in the memo (if given) first.
+	\param  [in]     tbl   The interning table
+	\param  [in,out] memo  The memo table (may be NULL)
+	\param           id1   Block ID 1
+	\param           id2   Block ID 2
+	\return Partial similarity score (same as ffuzzy_score_strings).
+**/
+static inline int ffuzzy_block_table_score_(
+	const ffuzzy_block_table *tbl, ffuzzy_score_memo *memo,
+	size_t id1, size_t id2
+)
+{
+	assert(id1 < tbl->count && id2 < tbl->count);
+	const ffuzzy_block_entry *b1 = &tbl->blocks[id1];
+	const ffuzzy_block_entry *b2 = &tbl->blocks[id2];
+	assert(b1->block_size == b2->block_size);
+	if (id1 == id2)
+		return b1->len < FFUZZY_MIN_MATCH ? 0 : ffuzzy_score_dist_(0, b1->len, b1->len, b1->block_size);
+	if (!memo)
+		return ffuzzy_score_strings_bitpar_(b1->s, b1->len, b2->s, b2->len, b1->block_size);
+	if (id1 > id2)
+	{
+		size_t tmp = id1; id1 = id2; id2 = tmp;
+	}
+	ffuzzy_score_memo_entry *e = &memo->entries[(id1 * 0x9e3779b1u + id2) & memo->mask];
+	if (e->id1 == id1 && e->id2 == id2)
+	{
+		memo->hits++;
+		return e->score;
+	}
+	memo->misses++;
+	e->id1 = id1;
+	e->id2 = id2;
+	e->score = ffuzzy_score_strings_bitpar_(b1->s, b1->len, b2->s, b2->len, b1->block_size);
+	return e->score;
+}
+
+
+/**
+	\internal
+	\fn     int ffuzzy_block_table_compare_(const ffuzzy_block_table*, ffuzzy_score_memo*, const ffuzzy_digest*, const size_t*, const ffuzzy_digest*, const size_t*, int)
+	\brief  Compare two "near" digests by their interned block strings
+	\details
+		Block pairs whose upper bounds are less than the threshold
+		are not compared (the result is exact only if it is equal to
+		or greater than the threshold).
+	\param  [in]     tbl        The interning table
+	\param  [in,out] memo       The memo table (may be NULL)
+	\param  [in]     d1         Valid digest 1
+	\param  [in]     ids1       Block IDs of d1 (from ffuzzy_block_table_intern_digest)
+	\param  [in]     d2         Valid digest 2 (block size must be "near" to d1)
+	\param  [in]     ids2       Block IDs of d2
+	\param           threshold  Minimum score of interest
+	\return The similarity score (same as ffuzzy_compare_digest_near if the score is at least threshold).
+**/
+static inline int ffuzzy_block_table_compare_(
+	const ffuzzy_block_table *tbl, ffuzzy_score_memo *memo,
+	const ffuzzy_digest *d1, const size_t *ids1,
+	const ffuzzy_digest *d2, const size_t *ids2,
+	int threshold
+)
+{
+	unsigned long bs = d1->block_size;
+	if (bs > ULONG_MAX / 2 || d2->block_size > ULONG_MAX / 2)
+		return ffuzzy_compare_digest_near(d1, d2);
+	if (bs == d2->block_size)
+	{
+		// identical digests take the dedicated path
+		if (ids1[0] == ids2[0] && ids1[1] == ids2[1])
+			return ffuzzy_compare_digest_near(d1, d2);
+		int score1 = 0, score2 = 0;
+		if (ffuzzy_score_strings_max_(d1->len1, d2->len1, bs) >= threshold)
+			score1 = ffuzzy_block_table_score_(tbl, memo, ids1[0], ids2[0]);
+		if (ffuzzy_score_strings_max_(d1->len2, d2->len2, bs * 2) > MAX(score1, threshold - 1))
+			score2 = ffuzzy_block_table_score_(tbl, memo, ids1[1], ids2[1]);
+		return MAX(score1, score2);
+	}
+	else if (bs * 2 == d2->block_size)
+		return ffuzzy_block_table_score_(tbl, memo, ids1[1], ids2[0]);
+	else
+		return ffuzzy_block_table_score_(tbl, memo, ids1[0], ids2[1]);
+}
+
+#endif
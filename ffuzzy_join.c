@@ -0,0 +1,500 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_join.c
+	Similarity join by block size merge-join
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\internal
+	\file  ffuzzy_join.c
+	\brief Similarity join by block size merge-join
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_blocksize.h"
+#include "ffuzzy_compare.h"
+#include "ffuzzy_intern.h"
+#include "ffuzzy_parallel.h"
+#include "ffuzzy_stats.h"
+#include "util.h"
+
+/** \internal \brief Number of digests from the first set per tile **/
+#define FFUZZY_JOIN_TILE_A 64
+/** \internal \brief Number of digests from the second set per tile **/
+#define FFUZZY_JOIN_TILE_B 512
+/** \internal \brief Number of buffered pairs per worker before flushing **/
+#define FFUZZY_JOIN_BUFSIZE 1024
+/** \internal \brief Number of per-worker memo entries **/
+#define FFUZZY_JOIN_MEMO_SIZE 4096
+
+
+/**
+	\internal
+	\struct ffuzzy_join_key
+	\brief  Sort key (block size and the original index)
+**/
+typedef struct
+{
+	unsigned long block_size;
+	size_t index;
+} ffuzzy_join_key;
+
+/**
+	\internal
+	\struct ffuzzy_join_run
+	\brief  Range of sorted keys which share the same block size
+**/
+typedef struct
+{
+	unsigned long block_size;
+	size_t begin, end;
+} ffuzzy_join_run;
+
+/**
+	\internal
+	\struct ffuzzy_join_item
+	\brief  Pair of runs to compare (with compatible block sizes)
+	\internal
+	\var   ffuzzy_join_item::first_tile
+	\brief Global index of the first tile of this item.
+	\internal
+	\var   ffuzzy_join_item::self
+	\brief Whether this item compares a run with itself (only pairs i<j are compared).
+**/
+typedef struct
+{
+	const ffuzzy_join_run *ra, *rb;
+	size_t tiles_a, tiles_b;
+	size_t first_tile;
+	bool self;
+} ffuzzy_join_item;
+
+/**
+	\internal
+	\struct ffuzzy_join_pair
+	\brief  Buffered result
+**/
+typedef struct
+{
+	size_t i, j;
+	int score;
+} ffuzzy_join_pair;
+
+/**
+	\internal
+	\struct ffuzzy_join_buffer
+	\brief  Per-worker result buffer
+**/
+typedef struct
+{
+	ffuzzy_join_pair *pairs;
+	size_t count, capacity;
+	ffuzzy_score_memo *memo;
+} ffuzzy_join_buffer;
+
+/**
+	\internal
+	\struct ffuzzy_join_ctx
+	\brief  Join state shared by workers
+**/
+typedef struct
+{
+	const ffuzzy_digest *a, *b;
+	const ffuzzy_block_table *blocks;
+	const size_t *ida, *idb;
+	const ffuzzy_join_key *ka, *kb;
+	const ffuzzy_join_item *items;
+	size_t nitems;
+	int threshold;
+	bool self;
+	ffuzzy_pair_callback callback;
+	void *cbctx;
+	ffuzzy_mutex lock;
+	ffuzzy_join_buffer *buffers;
+} ffuzzy_join_ctx;
+
+
+static int ffuzzy_join_key_cmp_(const void *p1, const void *p2)
+{
+	const ffuzzy_join_key *k1 = p1, *k2 = p2;
+	int c = ffuzzy_blocksizecmp(k1->block_size, k2->block_size);
+	if (c)
+		return c;
+	return k1->index < k2->index ? -1 : k1->index > k2->index ? +1 : 0;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_join_sort_(const ffuzzy_digest*, size_t, ffuzzy_join_key**, ffuzzy_join_run**, size_t*)
+	\brief  Sort digests by block sizes and split them to runs
+	\return true if succeeds; false otherwise.
+**/
+static bool ffuzzy_join_sort_(
+	const ffuzzy_digest *digests, size_t n,
+	ffuzzy_join_key **pkeys, ffuzzy_join_run **pruns, size_t *pnruns
+)
+{
+	ffuzzy_join_key *keys = NULL;
+	ffuzzy_join_run *runs = NULL;
+	size_t nruns = 0, cap = 0;
+	if (n > ((size_t)-1) / sizeof(ffuzzy_join_key))
+		return false;
+	keys = malloc(sizeof(ffuzzy_join_key) * (n ? n : 1));
+	if (!keys)
+		return false;
+	for (size_t i = 0; i < n; i++)
+	{
+		keys[i].block_size = digests[i].block_size;
+		keys[i].index = i;
+	}
+	qsort(keys, n, sizeof(ffuzzy_join_key), ffuzzy_join_key_cmp_);
+	for (size_t i = 0; i < n; )
+	{
+		size_t j = i + 1;
+		while (j < n && keys[j].block_size == keys[i].block_size)
+			j++;
+		if (!util_grow_array((void**)&runs, &cap, nruns + 1, sizeof(ffuzzy_join_run)))
+		{
+			free(keys);
+			free(runs);
+			return false;
+		}
+		runs[nruns].block_size = keys[i].block_size;
+		runs[nruns].begin = i;
+		runs[nruns].end = j;
+		nruns++;
+		i = j;
+	}
+	*pkeys = keys;
+	*pruns = runs;
+	*pnruns = nruns;
+	return true;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_join_intern_(ffuzzy_block_table*, const ffuzzy_digest*, size_t, size_t**)
+	\brief  Intern block strings of digests (two IDs per digest)
+	\return true if succeeds; false otherwise.
+**/
+static bool ffuzzy_join_intern_(
+	ffuzzy_block_table *blocks,
+	const ffuzzy_digest *digests, size_t n,
+	size_t **pids
+)
+{
+	if (n > ((size_t)-1) / 2 / sizeof(size_t))
+		return false;
+	size_t *ids = malloc(sizeof(size_t) * 2 * (n ? n : 1));
+	if (!ids)
+		return false;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (!ffuzzy_block_table_intern_digest(blocks, &digests[i], ids + 2 * i))
+		{
+			free(ids);
+			return false;
+		}
+	}
+	*pids = ids;
+	return true;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_join_add_item_(ffuzzy_join_item**, size_t*, size_t*, size_t*, const ffuzzy_join_run*, const ffuzzy_join_run*, bool)
+	\brief  Append a pair of runs to the work list
+	\return true if succeeds; false otherwise.
+**/
+static bool ffuzzy_join_add_item_(
+	ffuzzy_join_item **items, size_t *nitems, size_t *cap, size_t *ntiles,
+	const ffuzzy_join_run *ra, const ffuzzy_join_run *rb, bool self
+)
+{
+	if (!util_grow_array((void**)items, cap, *nitems + 1, sizeof(ffuzzy_join_item)))
+		return false;
+	ffuzzy_join_item *item = &(*items)[(*nitems)++];
+	item->ra = ra;
+	item->rb = rb;
+	item->self = self;
+	item->tiles_a = (ra->end - ra->begin + FFUZZY_JOIN_TILE_A - 1) / FFUZZY_JOIN_TILE_A;
+	item->tiles_b = (rb->end - rb->begin + FFUZZY_JOIN_TILE_B - 1) / FFUZZY_JOIN_TILE_B;
+	item->first_tile = *ntiles;
+	*ntiles += item->tiles_a * item->tiles_b;
+	return true;
+}
+
+
+/**
+	\internal
+	\fn     void ffuzzy_join_flush_(ffuzzy_join_ctx*, ffuzzy_join_buffer*)
+	\brief  Pass buffered pairs to the callback
+**/
+static void ffuzzy_join_flush_(ffuzzy_join_ctx *ctx, ffuzzy_join_buffer *buf)
+{
+	if (!buf->count)
+		return;
+	ffuzzy_mutex_lock_(&ctx->lock);
+	for (size_t i = 0; i < buf->count; i++)
+		ctx->callback(ctx->cbctx, buf->pairs[i].i, buf->pairs[i].j, buf->pairs[i].score);
+	ffuzzy_mutex_unlock_(&ctx->lock);
+	buf->count = 0;
+}
+
+
+/**
+	\internal
+	\fn     void ffuzzy_join_emit_(ffuzzy_join_ctx*, ffuzzy_join_buffer*, size_t, size_t, int)
+	\brief  Buffer a pair (or pass it to the callback directly if buffering fails)
+**/
+static void ffuzzy_join_emit_(ffuzzy_join_ctx *ctx, ffuzzy_join_buffer *buf, size_t i, size_t j, int score)
+{
+	if (buf->count >= FFUZZY_JOIN_BUFSIZE)
+		ffuzzy_join_flush_(ctx, buf);
+	if (!util_grow_array((void**)&buf->pairs, &buf->capacity, buf->count + 1, sizeof(ffuzzy_join_pair)))
+	{
+		ffuzzy_join_flush_(ctx, buf);
+		ffuzzy_mutex_lock_(&ctx->lock);
+		ctx->callback(ctx->cbctx, i, j, score);
+		ffuzzy_mutex_unlock_(&ctx->lock);
+		return;
+	}
+	buf->pairs[buf->count].i = i;
+	buf->pairs[buf->count].j = j;
+	buf->pairs[buf->count].score = score;
+	buf->count++;
+}
+
+
+static void ffuzzy_join_task_(void *arg, unsigned worker, size_t begin, size_t end)
+{
+	ffuzzy_join_ctx *ctx = arg;
+	ffuzzy_join_buffer *buf = &ctx->buffers[worker];
+	for (size_t tile = begin; tile < end; tile++)
+	{
+		// find the item which contains this tile
+		size_t lo = 0, hi = ctx->nitems;
+		while (hi - lo > 1)
+		{
+			size_t mid = lo + (hi - lo) / 2;
+			if (ctx->items[mid].first_tile <= tile)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		const ffuzzy_join_item *item = &ctx->items[lo];
+		size_t t = tile - item->first_tile;
+		size_t ta = t / item->tiles_b, tb = t % item->tiles_b;
+		size_t ia0 = item->ra->begin + ta * FFUZZY_JOIN_TILE_A;
+		size_t ib0 = item->rb->begin + tb * FFUZZY_JOIN_TILE_B;
+		size_t ia1 = MIN(ia0 + FFUZZY_JOIN_TILE_A, item->ra->end);
+		size_t ib1 = MIN(ib0 + FFUZZY_JOIN_TILE_B, item->rb->end);
+		// self-join: only compare i<j
+		if (item->self && ib1 <= ia0 + 1)
+			continue;
+		for (size_t ia = ia0; ia < ia1; ia++)
+		{
+			size_t i = ctx->ka[ia].index;
+			const ffuzzy_digest *da = &ctx->a[i];
+			for (size_t ib = item->self ? MAX(ib0, ia + 1) : ib0; ib < ib1; ib++)
+			{
+				size_t j = ctx->kb[ib].index;
+				const ffuzzy_digest *db = &ctx->b[j];
+				if (ffuzzy_compare_digest_near_max_(da, db) < ctx->threshold)
+					continue;
+				int score = ffuzzy_block_table_compare_(
+					ctx->blocks, buf->memo,
+					da, ctx->ida + 2 * i, db, ctx->idb + 2 * j,
+					ctx->threshold);
+				if (score < ctx->threshold)
+					continue;
+				if (ctx->self && i > j)
+					ffuzzy_join_emit_(ctx, buf, j, i, score);
+				else
+					ffuzzy_join_emit_(ctx, buf, i, j, score);
+			}
+		}
+	}
+	ffuzzy_join_flush_(ctx, buf);
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_join_(const ffuzzy_digest*, size_t, const ffuzzy_digest*, size_t, bool, int, unsigned, ffuzzy_pair_callback, void*)
+	\brief  Common implementation of ffuzzy_join and ffuzzy_join_self
+**/
+static bool ffuzzy_join_(
+	const ffuzzy_digest *a, size_t na,
+	const ffuzzy_digest *b, size_t nb, bool self,
+	int threshold, unsigned nthreads,
+	ffuzzy_pair_callback callback, void *cbctx
+)
+{
+	bool ok = false;
+	ffuzzy_join_key *ka = NULL, *kb = NULL;
+	ffuzzy_join_run *ra = NULL, *rb = NULL;
+	size_t nra = 0, nrb = 0;
+	ffuzzy_join_item *items = NULL;
+	size_t nitems = 0, itemcap = 0, ntiles = 0;
+	ffuzzy_block_table *blocks = NULL;
+	size_t *ida = NULL, *idb = NULL;
+	ffuzzy_join_ctx ctx;
+	ctx.buffers = NULL;
+	if (!ffuzzy_join_sort_(a, na, &ka, &ra, &nra))
+		goto cleanup;
+	// intern block strings (duplicate blocks in both sets share IDs)
+	if (!(blocks = ffuzzy_block_table_new()))
+		goto cleanup;
+	if (!ffuzzy_join_intern_(blocks, a, na, &ida))
+		goto cleanup;
+	if (self)
+		idb = ida;
+	else if (!ffuzzy_join_intern_(blocks, b, nb, &idb))
+		goto cleanup;
+	if (self)
+	{
+		kb = ka;
+		rb = ra;
+		nrb = nra;
+	}
+	else if (!ffuzzy_join_sort_(b, nb, &kb, &rb, &nrb))
+		goto cleanup;
+	// merge-join: for each run of a, visit runs of b
+	// with block sizes (half, same and double)
+	for (size_t i = 0, j = 0; i < nra; i++)
+	{
+		unsigned long bs = ra[i].block_size;
+		// (bs / 2) is non-decreasing as we advance i
+		while (j < nrb && rb[j].block_size < bs / 2)
+			j++;
+		for (size_t k = j; k < nrb; k++)
+		{
+			unsigned long bsb = rb[k].block_size;
+			if (bsb > bs && ffuzzy_blocksize_is_far_le(bs, bsb))
+				break;
+			if (!ffuzzy_blocksize_is_near_(bs, bsb))
+				continue;
+			if (self)
+			{
+				// each unordered pair of runs is visited once
+				if (bsb < bs)
+					continue;
+				if (!ffuzzy_join_add_item_(&items, &nitems, &itemcap, &ntiles, &ra[i], &rb[k], bsb == bs))
+					goto cleanup;
+			}
+			else if (!ffuzzy_join_add_item_(&items, &nitems, &itemcap, &ntiles, &ra[i], &rb[k], false))
+				goto cleanup;
+		}
+	}
+	nthreads = ffuzzy_parallel_nthreads_(nthreads);
+	ctx.buffers = calloc(nthreads, sizeof(ffuzzy_join_buffer));
+	if (!ctx.buffers)
+		goto cleanup;
+	// memoize block comparisons only if the corpus has enough duplicate blocks
+	// (identical blocks are handled by IDs without the memo)
+	if (ffuzzy_block_table_size(blocks) < ffuzzy_block_table_total(blocks) / 8 * 7)
+	{
+		for (unsigned i = 0; i < nthreads; i++)
+			if (!(ctx.buffers[i].memo = ffuzzy_score_memo_new(FFUZZY_JOIN_MEMO_SIZE)))
+				goto cleanup;
+	}
+	if (!ffuzzy_mutex_init_(&ctx.lock))
+		goto cleanup;
+	ctx.a = a;
+	ctx.b = self ? a : b;
+	ctx.blocks = blocks;
+	ctx.ida = ida;
+	ctx.idb = idb;
+	ctx.ka = ka;
+	ctx.kb = kb;
+	ctx.items = items;
+	ctx.nitems = nitems;
+	ctx.threshold = MAX(threshold, 1);
+	ctx.self = self;
+	ctx.callback = callback;
+	ctx.cbctx = cbctx;
+	ffuzzy_parallel_for_(ntiles, 1, nthreads, ffuzzy_join_task_, &ctx);
+	ffuzzy_mutex_destroy_(&ctx.lock);
+	ok = true;
+cleanup:
+	if (ctx.buffers)
+	{
+		for (unsigned i = 0; i < nthreads; i++)
+		{
+			free(ctx.buffers[i].pairs);
+			ffuzzy_score_memo_free(ctx.buffers[i].memo);
+		}
+	}
+	free(ctx.buffers);
+	if (!self)
+		free(idb);
+	free(ida);
+	ffuzzy_block_table_free(blocks);
+	free(items);
+	if (!self)
+	{
+		free(kb);
+		free(rb);
+	}
+	free(ka);
+	free(ra);
+	return ok;
+}
+
+
+bool ffuzzy_join(
+	const ffuzzy_digest *a, size_t na,
+	const ffuzzy_digest *b, size_t nb,
+	int threshold, unsigned nthreads,
+	ffuzzy_pair_callback callback, void *ctx
+)
+{
+	FFUZZY_LATENCY_BEGIN_(FFUZZY_TIMER_JOIN);
+	bool ok = ffuzzy_join_(a, na, b, nb, false, threshold, nthreads, callback, ctx);
+	FFUZZY_LATENCY_END_(FFUZZY_TIMER_JOIN);
+	return ok;
+}
+
+
+bool ffuzzy_join_self(
+	const ffuzzy_digest *digests, size_t n,
+	int threshold, unsigned nthreads,
+	ffuzzy_pair_callback callback, void *ctx
+)
+{
+	FFUZZY_LATENCY_BEGIN_(FFUZZY_TIMER_JOIN);
+	bool ok = ffuzzy_join_(digests, n, NULL, 0, true, threshold, nthreads, callback, ctx);
+	FFUZZY_LATENCY_END_(FFUZZY_TIMER_JOIN);
+	return ok;
+}
@@ -0,0 +1,626 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_join_qgram.c
+	Similarity join by q-gram count filtering
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\internal
+	\file  ffuzzy_join_qgram.c
+	\brief Similarity join by q-gram count filtering
+	\details
+		Each block string of length l has (l - FFUZZY_MIN_MATCH + 1)
+		q-grams (q = FFUZZY_MIN_MATCH). One insertion or removal destroys
+		at most q q-grams, so two blocks within edit distance k share at least
+		max(l1, l2) - q + 1 - k * q q-grams (as multisets) and
+		a positive score requires at least one common q-gram anyway.
+		The maximum edit distance k is derived from the threshold.
+
+		q-grams are made unique by their occurrence numbers
+		(so that set operations count multiset intersections) and ordered
+		by document frequency (rare first). If two blocks share
+		at least t tokens, their prefixes of length (n - t + 1)
+		share at least one token (prefix filtering). Only prefixes
+		are indexed, candidates are counted exactly and the remaining
+		candidates are verified by ffuzzy_compare_digest.
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_blocksize.h"
+#include "ffuzzy_compare.h"
+#include "ffuzzy_stats.h"
+#include "util.h"
+
+/** \internal \brief Number of q-grams in a block of given length **/
+#define FFUZZY_QGRAM_COUNT(len) ((len) - FFUZZY_MIN_MATCH + 1)
+/** \internal \brief Maximum number of q-grams in a block **/
+#define FFUZZY_QGRAM_MAX FFUZZY_QGRAM_COUNT(FFUZZY_SPAMSUM_LENGTH)
+/** \internal \brief Required overlap which cannot be satisfied **/
+#define FFUZZY_QGRAM_NEVER INT_MAX
+
+#if FFUZZY_MIN_MATCH > 7
+#error q-grams must fit in 56 bits on current implementation.
+#endif
+
+
+/**
+	\internal
+	\struct ffuzzy_qgram_rec
+	\brief  Block record (a block string of a digest)
+	\internal
+	\var   ffuzzy_qgram_rec::tok
+	\brief Offset of the first token (in the token array of the group).
+	\internal
+	\var   ffuzzy_qgram_rec::prefix
+	\brief Length of the indexed/probed prefix.
+**/
+typedef struct
+{
+	unsigned long block_size;
+	size_t owner;
+	const char *s;
+	size_t len;
+	size_t tok;
+	size_t prefix;
+} ffuzzy_qgram_rec;
+
+/**
+	\internal
+	\struct ffuzzy_qgram_pair
+	\brief  Candidate pair of digests
+**/
+typedef struct
+{
+	size_t i, j;
+} ffuzzy_qgram_pair;
+
+/**
+	\internal
+	\struct ffuzzy_qgram_ctx
+	\brief  Join state
+**/
+typedef struct
+{
+	int threshold;
+	bool self;
+	ffuzzy_qgram_pair *pairs;
+	size_t npairs, paircap;
+	/* per-group work area */
+	uint_least64_t *tokens;
+	size_t ntokens, tokcap;
+	uint_least32_t *ranks;
+	size_t rankcap;
+	int tau[FFUZZY_SPAMSUM_LENGTH + 1][FFUZZY_SPAMSUM_LENGTH + 1];
+} ffuzzy_qgram_ctx;
+
+
+static int ffuzzy_qgram_rec_cmp_(const void *p1, const void *p2)
+{
+	const ffuzzy_qgram_rec *r1 = p1, *r2 = p2;
+	int c = ffuzzy_blocksizecmp(r1->block_size, r2->block_size);
+	if (c)
+		return c;
+	return r1->owner < r2->owner ? -1 : r1->owner > r2->owner ? +1 : 0;
+}
+
+static int ffuzzy_qgram_u64_cmp_(const void *p1, const void *p2)
+{
+	uint_least64_t x1 = *(const uint_least64_t*)p1, x2 = *(const uint_least64_t*)p2;
+	return x1 < x2 ? -1 : x1 > x2 ? +1 : 0;
+}
+
+static int ffuzzy_qgram_u32_cmp_(const void *p1, const void *p2)
+{
+	uint_least32_t x1 = *(const uint_least32_t*)p1, x2 = *(const uint_least32_t*)p2;
+	return x1 < x2 ? -1 : x1 > x2 ? +1 : 0;
+}
+
+static int ffuzzy_qgram_pair_cmp_(const void *p1, const void *p2)
+{
+	const ffuzzy_qgram_pair *q1 = p1, *q2 = p2;
+	if (q1->i != q2->i)
+		return q1->i < q2->i ? -1 : +1;
+	return q1->j < q2->j ? -1 : q1->j > q2->j ? +1 : 0;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_qgram_records_(const ffuzzy_digest*, size_t, ffuzzy_qgram_rec**, size_t*)
+	\brief  Split digests into block records (sorted by effective block sizes)
+	\details
+		Blocks shorter than FFUZZY_MIN_MATCH have no q-grams and never match.
+	\return true if succeeds; false otherwise.
+**/
+static bool ffuzzy_qgram_records_(const ffuzzy_digest *digests, size_t n, ffuzzy_qgram_rec **precs, size_t *pnrecs)
+{
+	if (n > ((size_t)-1) / 2 / sizeof(ffuzzy_qgram_rec))
+		return false;
+	ffuzzy_qgram_rec *recs = malloc(sizeof(ffuzzy_qgram_rec) * 2 * (n ? n : 1));
+	if (!recs)
+		return false;
+	size_t nrecs = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		const ffuzzy_digest *d = &digests[i];
+		assert(ffuzzy_digest_is_valid(d));
+		if (d->len1 >= FFUZZY_MIN_MATCH)
+		{
+			ffuzzy_qgram_rec *r = &recs[nrecs++];
+			r->block_size = d->block_size;
+			r->owner = i;
+			r->s = d->digest;
+			r->len = d->len1;
+		}
+		if (d->len2 >= FFUZZY_MIN_MATCH && d->block_size <= ULONG_MAX / 2)
+		{
+			ffuzzy_qgram_rec *r = &recs[nrecs++];
+			r->block_size = d->block_size * 2;
+			r->owner = i;
+			r->s = d->digest + d->len1;
+			r->len = d->len2;
+		}
+	}
+	qsort(recs, nrecs, sizeof(ffuzzy_qgram_rec), ffuzzy_qgram_rec_cmp_);
+	*precs = recs;
+	*pnrecs = nrecs;
+	return true;
+}
+
+
+/**
+	\internal
+	\fn     void ffuzzy_qgram_tau_(ffuzzy_qgram_ctx*, unsigned long)
+	\brief  Compute required number of common q-grams for each pair of block lengths
+**/
+static void ffuzzy_qgram_tau_(ffuzzy_qgram_ctx *ctx, unsigned long block_size)
+{
+	for (size_t l1 = FFUZZY_MIN_MATCH; l1 <= FFUZZY_SPAMSUM_LENGTH; l1++)
+	{
+		for (size_t l2 = FFUZZY_MIN_MATCH; l2 <= FFUZZY_SPAMSUM_LENGTH; l2++)
+		{
+			if (ffuzzy_score_strings_max_(l1, l2, block_size) < ctx->threshold)
+			{
+				ctx->tau[l1][l2] = FFUZZY_QGRAM_NEVER;
+				continue;
+			}
+			// maximum edit distance which keeps the score
+			int k = l1 < l2 ? (int)(l2 - l1) : (int)(l1 - l2);
+			while (k + 1 <= (int)(l1 + l2) && ffuzzy_score_dist_(k + 1, l1, l2, block_size) >= ctx->threshold)
+				k++;
+			int t = (int)FFUZZY_QGRAM_COUNT(MAX(l1, l2)) - k * FFUZZY_MIN_MATCH;
+			ctx->tau[l1][l2] = MAX(t, 1);
+		}
+	}
+}
+
+
+/**
+	\internal
+	\fn     size_t ffuzzy_qgram_min_tau_(const ffuzzy_qgram_ctx*, size_t)
+	\brief  Minimum required overlap of a record over all possible partners
+	\return Minimum overlap or FFUZZY_QGRAM_NEVER if no partner can match.
+**/
+static int ffuzzy_qgram_min_tau_(const ffuzzy_qgram_ctx *ctx, size_t len)
+{
+	int t = FFUZZY_QGRAM_NEVER;
+	for (size_t l2 = FFUZZY_MIN_MATCH; l2 <= FFUZZY_SPAMSUM_LENGTH; l2++)
+		t = MIN(t, ctx->tau[len][l2]);
+	return t;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_qgram_tokenize_(ffuzzy_qgram_ctx*, ffuzzy_qgram_rec*, size_t)
+	\brief  Append sorted tokens (q-gram and its occurrence number) of records
+	\return true if succeeds; false otherwise.
+**/
+static bool ffuzzy_qgram_tokenize_(ffuzzy_qgram_ctx *ctx, ffuzzy_qgram_rec *recs, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		ffuzzy_qgram_rec *r = &recs[i];
+		size_t m = FFUZZY_QGRAM_COUNT(r->len);
+		if (!util_grow_array((void**)&ctx->tokens, &ctx->tokcap, ctx->ntokens + m, sizeof(uint_least64_t)))
+			return false;
+		uint_least64_t *tok = ctx->tokens + ctx->ntokens;
+		for (size_t p = 0; p < m; p++)
+		{
+			uint_least64_t g = 0;
+			for (size_t q = 0; q < FFUZZY_MIN_MATCH; q++)
+				g = (g << 8) | (unsigned char)r->s[p + q];
+			tok[p] = g << 8;
+		}
+		qsort(tok, m, sizeof(uint_least64_t), ffuzzy_qgram_u64_cmp_);
+		// number duplicate q-grams (multiset to set)
+		for (size_t p = 1; p < m; p++)
+			if ((tok[p] >> 8) == (tok[p-1] >> 8))
+				tok[p] = tok[p-1] + 1;
+		r->tok = ctx->ntokens;
+		ctx->ntokens += m;
+	}
+	return true;
+}
+
+
+/**
+	\internal
+	\struct ffuzzy_qgram_df
+	\brief  Distinct token and its document frequency
+**/
+typedef struct
+{
+	uint_least64_t token;
+	size_t df;
+} ffuzzy_qgram_df;
+
+static int ffuzzy_qgram_df_cmp_(const void *p1, const void *p2)
+{
+	const ffuzzy_qgram_df *d1 = p1, *d2 = p2;
+	if (d1->df != d2->df)
+		return d1->df < d2->df ? -1 : +1;
+	return d1->token < d2->token ? -1 : d1->token > d2->token ? +1 : 0;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_qgram_rank_(ffuzzy_qgram_ctx*, size_t*)
+	\brief  Replace tokens with ranks (rare tokens first)
+	\param  [in,out] ctx     The context (tokens are converted to ctx->ranks)
+	\param  [out]    nranks  Number of distinct tokens
+	\return true if succeeds; false otherwise.
+**/
+static bool ffuzzy_qgram_rank_(ffuzzy_qgram_ctx *ctx, size_t *nranks)
+{
+	size_t n = ctx->ntokens;
+	bool ok = false;
+	uint_least64_t *sorted = NULL;
+	ffuzzy_qgram_df *dfs = NULL;
+	uint_least32_t *rankof = NULL;
+	if (!util_grow_array((void**)&ctx->ranks, &ctx->rankcap, n, sizeof(uint_least32_t)))
+		return false;
+	sorted = malloc(sizeof(uint_least64_t) * (n ? n : 1));
+	dfs = malloc(sizeof(ffuzzy_qgram_df) * (n ? n : 1));
+	if (!sorted || !dfs)
+		goto cleanup;
+	memcpy(sorted, ctx->tokens, sizeof(uint_least64_t) * n);
+	qsort(sorted, n, sizeof(uint_least64_t), ffuzzy_qgram_u64_cmp_);
+	size_t u = 0;
+	for (size_t i = 0; i < n; )
+	{
+		size_t j = i + 1;
+		while (j < n && sorted[j] == sorted[i])
+			j++;
+		dfs[u].token = sorted[i];
+		dfs[u].df = j - i;
+		sorted[u] = sorted[i];
+		u++;
+		i = j;
+	}
+	if (u > UINT32_MAX)
+		goto cleanup;
+	// rank of each distinct token (sorted by token) by frequency order
+	rankof = malloc(sizeof(uint_least32_t) * (u ? u : 1));
+	if (!rankof)
+		goto cleanup;
+	qsort(dfs, u, sizeof(ffuzzy_qgram_df), ffuzzy_qgram_df_cmp_);
+	for (size_t r = 0; r < u; r++)
+	{
+		size_t lo = 0, hi = u;
+		while (lo < hi)
+		{
+			size_t mid = lo + (hi - lo) / 2;
+			if (sorted[mid] < dfs[r].token)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		rankof[lo] = (uint_least32_t)r;
+	}
+	for (size_t i = 0; i < n; i++)
+	{
+		size_t lo = 0, hi = u;
+		while (lo < hi)
+		{
+			size_t mid = lo + (hi - lo) / 2;
+			if (sorted[mid] < ctx->tokens[i])
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		ctx->ranks[i] = rankof[lo];
+	}
+	*nranks = u;
+	ok = true;
+cleanup:
+	free(rankof);
+	free(dfs);
+	free(sorted);
+	return ok;
+}
+
+
+/**
+	\internal
+	\fn     int ffuzzy_qgram_overlap_(const uint_least32_t*, size_t, const uint_least32_t*, size_t, int)
+	\brief  Count common tokens of two sorted token arrays (stops if it cannot reach required one)
+	\return Number of common tokens (or a value less than required).
+**/
+static int ffuzzy_qgram_overlap_(const uint_least32_t *x, size_t nx, const uint_least32_t *y, size_t ny, int required)
+{
+	size_t i = 0, j = 0;
+	int count = 0;
+	while (i < nx && j < ny)
+	{
+		// remaining tokens cannot make enough overlap
+		if (count + (int)MIN(nx - i, ny - j) < required)
+			return count;
+		if (x[i] == y[j])
+		{
+			count++;
+			i++;
+			j++;
+		}
+		else if (x[i] < y[j])
+			i++;
+		else
+			j++;
+	}
+	return count;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_qgram_group_(ffuzzy_qgram_ctx*, ffuzzy_qgram_rec*, size_t, ffuzzy_qgram_rec*, size_t)
+	\brief  Find candidate pairs between two groups of records (with the same effective block size)
+	\details
+		In self-join mode, ra and rb must be the same group.
+	\return true if succeeds; false otherwise.
+**/
+static bool ffuzzy_qgram_group_(
+	ffuzzy_qgram_ctx *ctx,
+	ffuzzy_qgram_rec *ra, size_t na,
+	ffuzzy_qgram_rec *rb, size_t nb
+)
+{
+	bool ok = false;
+	size_t nranks = 0;
+	size_t *heads = NULL, *postings = NULL, *stamp = NULL;
+	unsigned long bs = ra[0].block_size;
+	ffuzzy_qgram_tau_(ctx, bs);
+	ctx->ntokens = 0;
+	if (!ffuzzy_qgram_tokenize_(ctx, ra, na))
+		return false;
+	if (!ctx->self && !ffuzzy_qgram_tokenize_(ctx, rb, nb))
+		return false;
+	if (!ffuzzy_qgram_rank_(ctx, &nranks))
+		return false;
+	// sort tokens of each record by rank and decide prefix lengths
+	for (int side = 0; side < (ctx->self ? 1 : 2); side++)
+	{
+		ffuzzy_qgram_rec *recs = side ? rb : ra;
+		size_t n = side ? nb : na;
+		for (size_t i = 0; i < n; i++)
+		{
+			ffuzzy_qgram_rec *r = &recs[i];
+			size_t m = FFUZZY_QGRAM_COUNT(r->len);
+			qsort(ctx->ranks + r->tok, m, sizeof(uint_least32_t), ffuzzy_qgram_u32_cmp_);
+			int t = ffuzzy_qgram_min_tau_(ctx, r->len);
+			r->prefix = t == FFUZZY_QGRAM_NEVER ? 0 : m - (size_t)t + 1;
+		}
+	}
+	// inverted index of prefixes of rb (CSR)
+	heads = calloc(nranks + 1, sizeof(size_t));
+	stamp = malloc(sizeof(size_t) * (nb ? nb : 1));
+	if (!heads || !stamp)
+		goto cleanup;
+	size_t npostings = 0;
+	for (size_t j = 0; j < nb; j++)
+	{
+		for (size_t p = 0; p < rb[j].prefix; p++)
+			heads[ctx->ranks[rb[j].tok + p] + 1]++;
+		npostings += rb[j].prefix;
+		stamp[j] = (size_t)-1;
+	}
+	for (size_t r = 0; r < nranks; r++)
+		heads[r+1] += heads[r];
+	postings = malloc(sizeof(size_t) * (npostings ? npostings : 1));
+	if (!postings)
+		goto cleanup;
+	for (size_t j = 0; j < nb; j++)
+		for (size_t p = 0; p < rb[j].prefix; p++)
+			postings[heads[ctx->ranks[rb[j].tok + p]]++] = j;
+	for (size_t r = nranks; r > 0; r--)
+		heads[r] = heads[r-1];
+	heads[0] = 0;
+	// probe
+	for (size_t i = 0; i < na; i++)
+	{
+		const ffuzzy_qgram_rec *x = &ra[i];
+		const uint_least32_t *xt = ctx->ranks + x->tok;
+		size_t xm = FFUZZY_QGRAM_COUNT(x->len);
+		for (size_t p = 0; p < x->prefix; p++)
+		{
+			uint_least32_t r = xt[p];
+			for (size_t q = heads[r]; q < heads[r+1]; q++)
+			{
+				size_t j = postings[q];
+				// in self-join mode, each unordered pair is visited once
+				if (stamp[j] == i || (ctx->self && j <= i))
+					continue;
+				stamp[j] = i;
+				const ffuzzy_qgram_rec *y = &rb[j];
+				int t = ctx->tau[x->len][y->len];
+				if (t == FFUZZY_QGRAM_NEVER)
+					continue;
+				if (ffuzzy_qgram_overlap_(xt, xm, ctx->ranks + y->tok, FFUZZY_QGRAM_COUNT(y->len), t) < t)
+					continue;
+				if (ctx->self && x->owner == y->owner)
+					continue;
+				if (!util_grow_array((void**)&ctx->pairs, &ctx->paircap, ctx->npairs + 1, sizeof(ffuzzy_qgram_pair)))
+					goto cleanup;
+				ffuzzy_qgram_pair *pair = &ctx->pairs[ctx->npairs++];
+				pair->i = x->owner;
+				pair->j = y->owner;
+				if (ctx->self && pair->i > pair->j)
+				{
+					pair->i = y->owner;
+					pair->j = x->owner;
+				}
+			}
+		}
+	}
+	ok = true;
+cleanup:
+	free(postings);
+	free(stamp);
+	free(heads);
+	return ok;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_join_qgram_(const ffuzzy_digest*, size_t, const ffuzzy_digest*, size_t, bool, int, ffuzzy_pair_callback, void*)
+	\brief  Common implementation of ffuzzy_join_qgram and ffuzzy_join_self_qgram
+**/
+static bool ffuzzy_join_qgram_(
+	const ffuzzy_digest *a, size_t na,
+	const ffuzzy_digest *b, size_t nb, bool self,
+	int threshold,
+	ffuzzy_pair_callback callback, void *cbctx
+)
+{
+	bool ok = false;
+	ffuzzy_qgram_rec *ra = NULL, *rb = NULL;
+	size_t nra = 0, nrb = 0;
+	ffuzzy_qgram_ctx *ctx = calloc(1, sizeof(ffuzzy_qgram_ctx));
+	if (!ctx)
+		return false;
+	ctx->threshold = MAX(threshold, 1);
+	ctx->self = self;
+	if (!ffuzzy_qgram_records_(a, na, &ra, &nra))
+		goto cleanup;
+	if (self)
+	{
+		b = a;
+		nb = na;
+		rb = ra;
+		nrb = nra;
+	}
+	else if (!ffuzzy_qgram_records_(b, nb, &rb, &nrb))
+		goto cleanup;
+	// merge groups with the same effective block size
+	for (size_t i = 0, j = 0; i < nra; )
+	{
+		unsigned long bs = ra[i].block_size;
+		size_t i1 = i + 1;
+		while (i1 < nra && ra[i1].block_size == bs)
+			i1++;
+		while (j < nrb && rb[j].block_size < bs)
+			j++;
+		size_t j1 = j;
+		while (j1 < nrb && rb[j1].block_size == bs)
+			j1++;
+		if (j1 > j && !ffuzzy_qgram_group_(ctx, ra + i, i1 - i, rb + j, j1 - j))
+			goto cleanup;
+		i = i1;
+	}
+	// identical digests with block sizes too large to have the second block
+	// indexed may still match by the second block (see ffuzzy_compare_digest_near)
+	for (size_t i = 0; i < na; i++)
+	{
+		if (a[i].block_size <= ULONG_MAX / 2)
+			continue;
+		for (size_t j = self ? i + 1 : 0; j < nb; j++)
+		{
+			if (b[j].block_size != a[i].block_size)
+				continue;
+			if (!util_grow_array((void**)&ctx->pairs, &ctx->paircap, ctx->npairs + 1, sizeof(ffuzzy_qgram_pair)))
+				goto cleanup;
+			ctx->pairs[ctx->npairs].i = i;
+			ctx->pairs[ctx->npairs].j = j;
+			ctx->npairs++;
+		}
+	}
+	// verify unique candidates
+	qsort(ctx->pairs, ctx->npairs, sizeof(ffuzzy_qgram_pair), ffuzzy_qgram_pair_cmp_);
+	for (size_t k = 0; k < ctx->npairs; k++)
+	{
+		if (k && !ffuzzy_qgram_pair_cmp_(&ctx->pairs[k-1], &ctx->pairs[k]))
+			continue;
+		size_t i = ctx->pairs[k].i, j = ctx->pairs[k].j;
+		int score = ffuzzy_compare_digest(&a[i], &b[j]);
+		if (score >= ctx->threshold)
+			callback(cbctx, i, j, score);
+	}
+	ok = true;
+cleanup:
+	if (!self)
+		free(rb);
+	free(ra);
+	free(ctx->pairs);
+	free(ctx->tokens);
+	free(ctx->ranks);
+	free(ctx);
+	return ok;
+}
+
+
+bool ffuzzy_join_qgram(
+	const ffuzzy_digest *a, size_t na,
+	const ffuzzy_digest *b, size_t nb,
+	int threshold,
+	ffuzzy_pair_callback callback, void *ctx
+)
+{
+	FFUZZY_LATENCY_BEGIN_(FFUZZY_TIMER_JOIN);
+	bool ok = ffuzzy_join_qgram_(a, na, b, nb, false, threshold, callback, ctx);
+	FFUZZY_LATENCY_END_(FFUZZY_TIMER_JOIN);
+	return ok;
+}
+
+
+bool ffuzzy_join_self_qgram(
+	const ffuzzy_digest *digests, size_t n,
+	int threshold,
+	ffuzzy_pair_callback callback, void *ctx
+)
+{
+	FFUZZY_LATENCY_BEGIN_(FFUZZY_TIMER_JOIN);
+	bool ok = ffuzzy_join_qgram_(digests, n, NULL, 0, true, threshold, callback, ctx);
+	FFUZZY_LATENCY_END_(FFUZZY_TIMER_JOIN);
+	return ok;
+}
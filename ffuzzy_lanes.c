@@ -0,0 +1,132 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_lanes.c
+	Inter-sequence (lane-parallel) block comparison
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\internal
+	\file  ffuzzy_lanes.c
+	\brief Inter-sequence (lane-parallel) block comparison
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_compare.h"
+#include "ffuzzy_lanes.h"
+
+#if FFUZZY_SPAMSUM_LENGTH > 127
+#error FFUZZY_SPAMSUM_LENGTH must fit in 8-bit signed lanes on current implementation.
+#endif
+
+
+#ifdef FFUZZY_ENABLE_SIMD
+
+/**
+	\internal
+	\brief  8-bit lanes (GCC vector extension)
+	\details
+		All DP values are at most FFUZZY_SPAMSUM_LENGTH and
+		digest characters are ASCII so signed lanes are sufficient
+		(and signed comparison is cheap on most instruction sets).
+**/
+typedef signed char ffuzzy_lanes_v __attribute__((vector_size(FFUZZY_LANES)));
+
+#define FFUZZY_LANES_MAX(a,b) (((a) & ((a) > (b))) | ((b) & ~((a) > (b))))
+
+void ffuzzy_lane_block_score_(
+	const ffuzzy_lane_block *blk,
+	const char *s, size_t slen,
+	unsigned long block_size,
+	int *scores
+)
+{
+	// h[j]: LCS length of s[0..i) and targets[0..j)
+	// c[j]: length of common suffix of s[0..i) and targets[0..j)
+	ffuzzy_lanes_v h[FFUZZY_SPAMSUM_LENGTH + 1];
+	ffuzzy_lanes_v c[FFUZZY_SPAMSUM_LENGTH + 1];
+	ffuzzy_lanes_v hit = {0};
+	const ffuzzy_lanes_v zero = {0};
+	const ffuzzy_lanes_v one = zero + 1;
+	const ffuzzy_lanes_v minmatch = zero + (FFUZZY_MIN_MATCH - 1);
+	size_t n = blk->maxlen;
+	assert(slen <= FFUZZY_SPAMSUM_LENGTH);
+	for (size_t j = 0; j <= n; j++)
+		h[j] = c[j] = zero;
+	if (slen >= FFUZZY_MIN_MATCH)
+	{
+		for (size_t i = 0; i < slen; i++)
+		{
+			const ffuzzy_lanes_v q = zero + (signed char)s[i];
+			ffuzzy_lanes_v diag_h = zero, diag_c = zero, left = zero;
+			for (size_t j = 1; j <= n; j++)
+			{
+				ffuzzy_lanes_v up_h = h[j], up_c = c[j];
+				ffuzzy_lanes_v t;
+				memcpy(&t, blk->chars[j-1], sizeof(t));
+				ffuzzy_lanes_v eq = t == q;
+				ffuzzy_lanes_v cc = (diag_c + one) & eq;
+				ffuzzy_lanes_v mx = FFUZZY_LANES_MAX(up_h, left);
+				ffuzzy_lanes_v hh = ((diag_h + one) & eq) | (mx & ~eq);
+				hit |= cc > minmatch;
+				h[j] = left = hh;
+				c[j] = cc;
+				diag_h = up_h;
+				diag_c = up_c;
+			}
+		}
+	}
+	signed char lcs[FFUZZY_LANES], found[FFUZZY_LANES];
+	unsigned nshort = 0, nfound = 0;
+	memcpy(lcs, &h[n], sizeof(lcs));
+	memcpy(found, &hit, sizeof(found));
+	for (size_t k = 0; k < blk->count; k++)
+	{
+		size_t tlen = blk->len[k];
+		if (slen < FFUZZY_MIN_MATCH || tlen < FFUZZY_MIN_MATCH)
+		{
+			nshort++;
+			scores[k] = 0;
+			continue;
+		}
+		if (!found[k])
+		{
+			scores[k] = 0;
+			continue;
+		}
+		nfound++;
+		// padding never matches: LCS up to maxlen equals LCS up to tlen
+		int dist = (int)slen + (int)tlen - 2 * lcs[k];
+		scores[k] = ffuzzy_score_dist_(dist, slen, tlen, block_size);
+	}
+	FFUZZY_STATS_ADD_(FFUZZY_STAT_LENGTH_REJECTS, nshort);
+	FFUZZY_STATS_ADD_(FFUZZY_STAT_SUBSTRING_REJECTS, blk->count - nshort - nfound);
+	FFUZZY_STATS_ADD_(FFUZZY_STAT_EDIT_DISTANCES, nfound);
+}
+
+#endif
@@ -0,0 +1,156 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_lanes.h
+	Inter-sequence (lane-parallel) block comparison (internal)
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef FFUZZY_FFUZZY_LANES_H
+#define FFUZZY_FFUZZY_LANES_H
+
+/**
+	\internal
+	\file  ffuzzy_lanes.h
+	\brief Inter-sequence (lane-parallel) block comparison
+	\details
+		Digest blocks of many targets are stored transposed
+		(character position major, target minor) so that one query block
+		can be compared against FFUZZY_LANES targets at once,
+		one 8-bit lane per target.
+
+		The kernel is only available with FFUZZY_ENABLE_SIMD.
+		Otherwise, searches compare original digests one pair at a time
+		(with bit-parallel kernels) since transposing without vectors
+		costs more than it saves.
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "ffuzzy.h"
+
+/**
+	\internal
+	\brief Number of targets compared at once
+	\details
+		This is the number of 8-bit lanes in a native vector register
+		(wider vectors are split into scalar operations by the compiler
+		if the instruction set does not support them).
+**/
+#if defined(__AVX2__)
+#define FFUZZY_LANES 32
+#else
+#define FFUZZY_LANES 16
+#endif
+
+
+/**
+	\internal
+	\struct ffuzzy_lane_block
+	\brief  Transposed digest blocks of (up to FFUZZY_LANES) targets
+
+	\internal
+	\var   ffuzzy_lane_block::chars
+	\brief Characters (chars[i][lane] is i-th character of the target, zero if out of range).
+	\internal
+	\var   ffuzzy_lane_block::len
+	\brief Lengths of target blocks.
+	\internal
+	\var   ffuzzy_lane_block::count
+	\brief Number of targets.
+	\internal
+	\var   ffuzzy_lane_block::maxlen
+	\brief Maximum length of target blocks.
+**/
+typedef struct
+{
+	signed char chars[FFUZZY_SPAMSUM_LENGTH][FFUZZY_LANES];
+	unsigned char len[FFUZZY_LANES];
+	size_t count;
+	size_t maxlen;
+} ffuzzy_lane_block;
+
+
+/**
+	\internal
+	\fn     void ffuzzy_lane_block_init_(ffuzzy_lane_block*)
+	\brief  Initialize an empty lane block
+**/
+static inline void ffuzzy_lane_block_init_(ffuzzy_lane_block *blk)
+{
+	// zero never appears in digests (so that padding never matches)
+	memset(blk->chars, 0, sizeof(blk->chars));
+	memset(blk->len, 0, sizeof(blk->len));
+	blk->count = 0;
+	blk->maxlen = 0;
+}
+
+
+/**
+	\internal
+	\fn     void ffuzzy_lane_block_push_(ffuzzy_lane_block*, const char*, size_t)
+	\brief  Append a target block to the lane block
+	\param  [in,out] blk   The lane block (must not be full)
+	\param  [in]     s     Target digest block
+	\param           slen  Length of s
+**/
+static inline void ffuzzy_lane_block_push_(ffuzzy_lane_block *blk, const char *s, size_t slen)
+{
+	assert(blk->count < FFUZZY_LANES);
+	assert(slen <= FFUZZY_SPAMSUM_LENGTH);
+	size_t lane = blk->count++;
+	for (size_t i = 0; i < slen; i++)
+		blk->chars[i][lane] = (signed char)s[i];
+	blk->len[lane] = (unsigned char)slen;
+	if (blk->maxlen < slen)
+		blk->maxlen = slen;
+}
+
+
+/**
+	\internal
+	\fn     void ffuzzy_lane_block_score_(const ffuzzy_lane_block*, const char*, size_t, unsigned long, int*)
+	\brief  Compute partial similarity scores between a query block and all targets
+	\details
+		The result for each lane is the same as
+		ffuzzy_score_strings_unsafe(s, slen, target, target_len, block_size).
+		The edit distance (insertion and removal only) is computed from
+		the longest common subsequence and the common substring check
+		shares the same dynamic programming pass.
+	\param  [in]  blk         Target blocks
+	\param  [in]  s           Query digest block
+	\param        slen        Length of s
+	\param        block_size  Block size for the digest blocks
+	\param  [out] scores      Buffer to store scores (FFUZZY_LANES entries; only first blk->count are meaningful)
+**/
+#ifdef FFUZZY_ENABLE_SIMD
+void ffuzzy_lane_block_score_(
+	const ffuzzy_lane_block *blk,
+	const char *s, size_t slen,
+	unsigned long block_size,
+	int *scores
+);
+#endif
+
+#endif
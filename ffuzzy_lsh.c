@@ -0,0 +1,429 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_lsh.c
+	MinHash/LSH approximate index
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\internal
+	\file  ffuzzy_lsh.c
+	\brief MinHash/LSH approximate index
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_blocksize.h"
+#include "ffuzzy_match.h"
+#include "str_hash_rolling.h"
+#include "util.h"
+
+#if ROLLING_WINDOW != FFUZZY_MIN_MATCH
+#error rolling hash window must be equal to FFUZZY_MIN_MATCH on current implementation.
+#endif
+
+/** \internal \brief "No entry" value for hash chains **/
+#define FFUZZY_LSH_NONE ((size_t)-1)
+/** \internal \brief Initial number of hash slots (must be a power of 2) **/
+#define FFUZZY_LSH_INITIAL_SLOTS 1024
+
+
+/**
+	\internal
+	\struct ffuzzy_lsh_entry
+	\brief  LSH table entry (a band of a block signature)
+	\internal
+	\var   ffuzzy_lsh_entry::key
+	\brief Hash of the band values, the band number and the effective block size.
+	\internal
+	\var   ffuzzy_lsh_entry::next
+	\brief Next entry in the same hash slot (or FFUZZY_LSH_NONE).
+**/
+typedef struct
+{
+	uint_least64_t key;
+	size_t owner;
+	size_t next;
+} ffuzzy_lsh_entry;
+
+
+/**
+	\internal
+	\struct ffuzzy_lsh_index
+	\brief  MinHash/LSH index
+
+	\internal
+	\var   ffuzzy_lsh_index::mul
+	\brief Multipliers (odd) of multiply-shift hash functions (one per signature value).
+	\internal
+	\var   ffuzzy_lsh_index::add
+	\brief Addends of multiply-shift hash functions.
+	\internal
+	\var   ffuzzy_lsh_index::slots
+	\brief Heads of hash chains (number of slots is a power of 2).
+**/
+struct ffuzzy_lsh_index
+{
+	unsigned bands, rows;
+	uint_least64_t mul[FFUZZY_LSH_MAX_HASHES];
+	uint_least64_t add[FFUZZY_LSH_MAX_HASHES];
+	ffuzzy_lsh_entry *entries;
+	size_t nentries, entrycap;
+	size_t *slots;
+	size_t nslots;
+	ffuzzy_digest *digests;
+	size_t count, capacity;
+};
+
+
+/**
+	\internal
+	\fn     uint_least64_t ffuzzy_lsh_mix_(uint_least64_t)
+	\brief  Mix bits of 64-bit value (the finalizer of SplitMix64)
+**/
+static inline uint_least64_t ffuzzy_lsh_mix_(uint_least64_t x)
+{
+	x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+	x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+	return (x ^ (x >> 31)) & UINT64_C(0xffffffffffffffff);
+}
+
+
+ffuzzy_lsh_index *ffuzzy_lsh_index_new(unsigned bands, unsigned rows)
+{
+	if (!bands || !rows || bands > FFUZZY_LSH_MAX_HASHES / rows)
+		return NULL;
+	ffuzzy_lsh_index *idx = calloc(1, sizeof(ffuzzy_lsh_index));
+	if (!idx)
+		return NULL;
+	idx->slots = malloc(sizeof(size_t) * FFUZZY_LSH_INITIAL_SLOTS);
+	if (!idx->slots)
+	{
+		free(idx);
+		return NULL;
+	}
+	idx->nslots = FFUZZY_LSH_INITIAL_SLOTS;
+	for (size_t i = 0; i < idx->nslots; i++)
+		idx->slots[i] = FFUZZY_LSH_NONE;
+	idx->bands = bands;
+	idx->rows  = rows;
+	// fixed seeds (signatures are reproducible across indices)
+	uint_least64_t seed = 0;
+	for (unsigned k = 0; k < bands * rows; k++)
+	{
+		seed += UINT64_C(0x9e3779b97f4a7c15);
+		idx->mul[k] = ffuzzy_lsh_mix_(seed) | 1;
+		seed += UINT64_C(0x9e3779b97f4a7c15);
+		idx->add[k] = ffuzzy_lsh_mix_(seed);
+	}
+	return idx;
+}
+
+
+void ffuzzy_lsh_index_free(ffuzzy_lsh_index *idx)
+{
+	if (!idx)
+		return;
+	free(idx->entries);
+	free(idx->slots);
+	free(idx->digests);
+	free(idx);
+}
+
+
+/**
+	\internal
+	\fn     void ffuzzy_lsh_signature_(const ffuzzy_lsh_index*, const char*, size_t, uint_least32_t*)
+	\brief  Compute MinHash signature of a block (over its q-grams)
+	\details
+		Each q-gram is represented by the rolling hash used by ssdeep
+		(which only depends on the last ROLLING_WINDOW characters).
+	\param  [in]  idx  The index (which has hash functions)
+	\param  [in]  s    Block string
+	\param        len  Length of s (not less than FFUZZY_MIN_MATCH)
+	\param  [out] sig  Signature (bands * rows values)
+**/
+static void ffuzzy_lsh_signature_(const ffuzzy_lsh_index *idx, const char *s, size_t len, uint_least32_t *sig)
+{
+	uint_least32_t grams[FFUZZY_SPAMSUM_LENGTH];
+	size_t ngrams = 0;
+	roll_state r;
+	roll_init(&r);
+	for (size_t i = 0; i < len; i++)
+	{
+		roll_hash(&r, (unsigned char)s[i]);
+		if (i + 1 >= ROLLING_WINDOW)
+			grams[ngrams++] = roll_sum(&r);
+	}
+	unsigned nhashes = idx->bands * idx->rows;
+	for (unsigned k = 0; k < nhashes; k++)
+	{
+		uint_least64_t m = idx->mul[k], a = idx->add[k];
+		uint_least32_t v = UINT32_C(0xffffffff);
+		for (size_t i = 0; i < ngrams; i++)
+		{
+			uint_least32_t h = (uint_least32_t)(((m * grams[i] + a) & UINT64_C(0xffffffffffffffff)) >> 32);
+			v = MIN(v, h);
+		}
+		sig[k] = v;
+	}
+}
+
+
+/**
+	\internal
+	\fn     uint_least64_t ffuzzy_lsh_band_key_(const uint_least32_t*, unsigned, unsigned, unsigned long)
+	\brief  Compute the key of a band (including the effective block size)
+**/
+static uint_least64_t ffuzzy_lsh_band_key_(const uint_least32_t *sig, unsigned rows, unsigned band, unsigned long block_size)
+{
+	uint_least64_t key = ffuzzy_lsh_mix_((uint_least64_t)block_size ^ ((uint_least64_t)band << 56));
+	for (unsigned i = 0; i < rows; i++)
+		key = ffuzzy_lsh_mix_(key ^ sig[band * rows + i]);
+	return key;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_lsh_rehash_(ffuzzy_lsh_index*)
+	\brief  Double the number of hash slots
+	\return true if succeeds; false otherwise.
+**/
+static bool ffuzzy_lsh_rehash_(ffuzzy_lsh_index *idx)
+{
+	if (idx->nslots > ((size_t)-1) / 2 / sizeof(size_t))
+		return false;
+	size_t nslots = idx->nslots * 2;
+	size_t *slots = malloc(sizeof(size_t) * nslots);
+	if (!slots)
+		return false;
+	for (size_t i = 0; i < nslots; i++)
+		slots[i] = FFUZZY_LSH_NONE;
+	// relink in insertion order (so that the newest entry is the head of its chain)
+	for (size_t i = 0; i < idx->nentries; i++)
+	{
+		ffuzzy_lsh_entry *e = &idx->entries[i];
+		size_t h = (size_t)e->key & (nslots - 1);
+		e->next = slots[h];
+		slots[h] = i;
+	}
+	free(idx->slots);
+	idx->slots = slots;
+	idx->nslots = nslots;
+	return true;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_lsh_put_(ffuzzy_lsh_index*, unsigned long, size_t, const char*, size_t)
+	\brief  Insert all bands of a block to LSH tables
+	\return true if succeeds; false otherwise (entries of the block may be partially inserted).
+**/
+static bool ffuzzy_lsh_put_(
+	ffuzzy_lsh_index *idx,
+	unsigned long block_size, size_t owner,
+	const char *s, size_t slen
+)
+{
+	uint_least32_t sig[FFUZZY_LSH_MAX_HASHES];
+	ffuzzy_lsh_signature_(idx, s, slen, sig);
+	if (!util_grow_array((void**)&idx->entries, &idx->entrycap, idx->nentries + idx->bands, sizeof(ffuzzy_lsh_entry)))
+		return false;
+	if (idx->nentries + idx->bands > idx->nslots && !ffuzzy_lsh_rehash_(idx))
+		return false;
+	for (unsigned b = 0; b < idx->bands; b++)
+	{
+		ffuzzy_lsh_entry *e = &idx->entries[idx->nentries];
+		e->key = ffuzzy_lsh_band_key_(sig, idx->rows, b, block_size);
+		e->owner = owner;
+		size_t h = (size_t)e->key & (idx->nslots - 1);
+		e->next = idx->slots[h];
+		idx->slots[h] = idx->nentries++;
+	}
+	return true;
+}
+
+
+/**
+	\internal
+	\fn     void ffuzzy_lsh_unput_(ffuzzy_lsh_index*, size_t)
+	\brief  Remove entries inserted after given number of entries
+**/
+/**
+	\internal
+	\fn     unsigned long ffuzzy_lsh_block2_size_(unsigned long)
+	\brief  Block size to compute band keys of block 2 with
+	\details
+		If block_size * 2 overflows, block 2 is only compared if two digests
+		are identical (see ffuzzy_compare_digest_near). Such blocks are keyed
+		with block_size itself (the same as block 1) so that identical
+		digests are still found; extra candidates are rejected by verification.
+**/
+static inline unsigned long ffuzzy_lsh_block2_size_(unsigned long block_size)
+{
+	return block_size <= ULONG_MAX / 2 ? block_size * 2 : block_size;
+}
+
+
+static void ffuzzy_lsh_unput_(ffuzzy_lsh_index *idx, size_t nentries)
+{
+	// entries are unlinked in the reverse order (each is the head of its chain)
+	while (idx->nentries > nentries)
+	{
+		ffuzzy_lsh_entry *e = &idx->entries[--idx->nentries];
+		idx->slots[(size_t)e->key & (idx->nslots - 1)] = e->next;
+	}
+}
+
+
+bool ffuzzy_lsh_index_add(ffuzzy_lsh_index *idx, const ffuzzy_digest *digest, size_t *id)
+{
+	assert(ffuzzy_digest_is_valid(digest));
+	if (!util_grow_array((void**)&idx->digests, &idx->capacity, idx->count + 1, sizeof(ffuzzy_digest)))
+		return false;
+	size_t owner = idx->count;
+	size_t nentries = idx->nentries;
+	// blocks shorter than FFUZZY_MIN_MATCH never match (and are not indexed)
+	if (digest->len1 >= FFUZZY_MIN_MATCH)
+	{
+		if (!ffuzzy_lsh_put_(idx, digest->block_size, owner, digest->digest, digest->len1))
+		{
+			ffuzzy_lsh_unput_(idx, nentries);
+			return false;
+		}
+	}
+	if (digest->len2 >= FFUZZY_MIN_MATCH)
+	{
+		if (!ffuzzy_lsh_put_(idx, ffuzzy_lsh_block2_size_(digest->block_size), owner, digest->digest + digest->len1, digest->len2))
+		{
+			ffuzzy_lsh_unput_(idx, nentries);
+			return false;
+		}
+	}
+	idx->digests[owner] = *digest;
+	idx->count++;
+	if (id)
+		*id = owner;
+	return true;
+}
+
+
+size_t ffuzzy_lsh_index_size(const ffuzzy_lsh_index *idx)
+{
+	return idx->count;
+}
+
+
+const ffuzzy_digest *ffuzzy_lsh_index_get(const ffuzzy_lsh_index *idx, size_t id)
+{
+	if (id >= idx->count)
+		return NULL;
+	return &idx->digests[id];
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_lsh_probe_(const ffuzzy_lsh_index*, unsigned long, const char*, size_t, ffuzzy_match_list*)
+	\brief  Append owners which share at least one band with the query block
+	\return true if succeeds; false otherwise.
+**/
+static bool ffuzzy_lsh_probe_(
+	const ffuzzy_lsh_index *idx,
+	unsigned long block_size,
+	const char *s, size_t slen,
+	ffuzzy_match_list *candidates
+)
+{
+	uint_least32_t sig[FFUZZY_LSH_MAX_HASHES];
+	ffuzzy_lsh_signature_(idx, s, slen, sig);
+	for (unsigned b = 0; b < idx->bands; b++)
+	{
+		uint_least64_t key = ffuzzy_lsh_band_key_(sig, idx->rows, b, block_size);
+		for (size_t i = idx->slots[(size_t)key & (idx->nslots - 1)]; i != FFUZZY_LSH_NONE; i = idx->entries[i].next)
+		{
+			const ffuzzy_lsh_entry *e = &idx->entries[i];
+			if (e->key == key && !ffuzzy_match_list_push_(candidates, e->owner, 0))
+				return false;
+		}
+	}
+	return true;
+}
+
+
+static int ffuzzy_lsh_id_cmp_(const void *p1, const void *p2)
+{
+	const ffuzzy_match *m1 = p1, *m2 = p2;
+	return m1->id < m2->id ? -1 : m1->id > m2->id ? +1 : 0;
+}
+
+
+bool ffuzzy_lsh_index_search(
+	const ffuzzy_lsh_index *idx, const ffuzzy_digest *query,
+	int threshold, ffuzzy_match_list *results, size_t *ncandidates
+)
+{
+	assert(ffuzzy_digest_is_valid(query));
+	bool ok = true;
+	unsigned long bs = query->block_size;
+	results->count = 0;
+	threshold = MAX(threshold, 1);
+	// candidates share a band with block 1 (bs) or block 2 (bs*2 if not overflowed)
+	if (query->len1 >= FFUZZY_MIN_MATCH)
+		ok &= ffuzzy_lsh_probe_(idx, bs, query->digest, query->len1, results);
+	if (query->len2 >= FFUZZY_MIN_MATCH)
+		ok &= ffuzzy_lsh_probe_(idx, ffuzzy_lsh_block2_size_(bs), query->digest + query->len1, query->len2, results);
+	// verify each unique candidate
+	qsort(results->matches, results->count, sizeof(ffuzzy_match), ffuzzy_lsh_id_cmp_);
+	size_t n = 0, nc = 0, last = 0;
+	for (size_t i = 0; i < results->count; i++)
+	{
+		size_t id = results->matches[i].id;
+		if (nc && last == id)
+			continue;
+		last = id;
+		nc++;
+		// keys are hashed: reject (unlikely) collisions of effective block sizes
+		if (!ffuzzy_blocksize_is_near_(bs, idx->digests[id].block_size))
+			continue;
+		int score = ffuzzy_compare_digest_near(query, &idx->digests[id]);
+		if (score < threshold)
+			continue;
+		results->matches[n].id = id;
+		results->matches[n].score = score;
+		n++;
+	}
+	results->count = n;
+	ffuzzy_match_sort_(results->matches, results->count);
+	if (ncandidates)
+		*ncandidates = nc;
+	return ok;
+}
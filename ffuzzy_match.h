@@ -0,0 +1,104 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_match.h
+	Ordering of search results (internal)
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef FFUZZY_FFUZZY_MATCH_H
+#define FFUZZY_FFUZZY_MATCH_H
+
+/**
+	\internal
+	\file  ffuzzy_match.h
+	\brief Ordering of search results
+**/
+
+#include "ffuzzy_config.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "ffuzzy.h"
+#include "util.h"
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_match_worse_(const ffuzzy_match*, const ffuzzy_match*)
+	\brief  Determines whether m1 is ranked after m2
+	\details
+		Matches are ranked by scores (descending) and then IDs (ascending).
+		This makes results deterministic regardless of the scan order.
+	\param  [in] m1  Match 1
+	\param  [in] m2  Match 2
+	\return true if m1 is worse than m2; false otherwise.
+**/
+static inline bool ffuzzy_match_worse_(const ffuzzy_match *m1, const ffuzzy_match *m2)
+{
+	return m1->score < m2->score || (m1->score == m2->score && m1->id > m2->id);
+}
+
+
+/**
+	\internal
+	\fn     int ffuzzy_match_cmp_(const void*, const void*)
+	\brief  qsort comparator for ffuzzy_match (best match first)
+**/
+static inline int ffuzzy_match_cmp_(const void *p1, const void *p2)
+{
+	const ffuzzy_match *m1 = p1, *m2 = p2;
+	if (ffuzzy_match_worse_(m1, m2))
+		return +1;
+	if (ffuzzy_match_worse_(m2, m1))
+		return -1;
+	return 0;
+}
+
+
+/**
+	\internal
+	\fn     void ffuzzy_match_sort_(ffuzzy_match*, size_t)
+	\brief  Sort matches (best match first)
+**/
+static inline void ffuzzy_match_sort_(ffuzzy_match *matches, size_t n)
+{
+	qsort(matches, n, sizeof(ffuzzy_match), ffuzzy_match_cmp_);
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_match_list_push_(ffuzzy_match_list*, size_t, int)
+	\brief  Append a match to the list
+	\return true if succeeds; false otherwise.
+**/
+static inline bool ffuzzy_match_list_push_(ffuzzy_match_list *list, size_t id, int score)
+{
+	if (!util_grow_array((void**)&list->matches, &list->capacity, list->count + 1, sizeof(ffuzzy_match)))
+		return false;
+	list->matches[list->count].id = id;
+	list->matches[list->count].score = score;
+	list->count++;
+	return true;
+}
+
+#endif
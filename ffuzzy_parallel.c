@@ -0,0 +1,152 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_parallel.c
+	Simple parallel loop
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\internal
+	\file  ffuzzy_parallel.c
+	\brief Simple parallel loop
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#ifdef FFUZZY_ENABLE_THREADS
+#include <unistd.h>
+#endif
+
+#include "ffuzzy_parallel.h"
+
+
+unsigned ffuzzy_parallel_nthreads_(unsigned nthreads)
+{
+#ifdef FFUZZY_ENABLE_THREADS
+	if (nthreads == 0)
+	{
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = n > 0 ? (unsigned)n : 1;
+	}
+	return nthreads;
+#else
+	(void)nthreads;
+	return 1;
+#endif
+}
+
+
+#ifdef FFUZZY_ENABLE_THREADS
+
+/**
+	\internal
+	\struct ffuzzy_parallel_state
+	\brief  Shared state for worker threads
+**/
+typedef struct
+{
+	pthread_mutex_t lock;
+	size_t next, n, chunk;
+	ffuzzy_parallel_fn fn;
+	void *ctx;
+} ffuzzy_parallel_state;
+
+/**
+	\internal
+	\struct ffuzzy_parallel_worker
+	\brief  Per-worker argument
+**/
+typedef struct
+{
+	ffuzzy_parallel_state *state;
+	unsigned index;
+} ffuzzy_parallel_worker;
+
+
+static void *ffuzzy_parallel_run_(void *arg)
+{
+	ffuzzy_parallel_worker *w = arg;
+	ffuzzy_parallel_state *st = w->state;
+	while (true)
+	{
+		size_t begin, end;
+		pthread_mutex_lock(&st->lock);
+		begin = st->next;
+		end = st->n - begin > st->chunk ? begin + st->chunk : st->n;
+		st->next = end;
+		pthread_mutex_unlock(&st->lock);
+		if (begin == end)
+			break;
+		st->fn(st->ctx, w->index, begin, end);
+	}
+	return NULL;
+}
+
+#endif
+
+
+void ffuzzy_parallel_for_(size_t n, size_t chunk, unsigned nthreads, ffuzzy_parallel_fn fn, void *ctx)
+{
+	assert(chunk != 0);
+#ifdef FFUZZY_ENABLE_THREADS
+	if (nthreads > 1 && n > chunk)
+	{
+		ffuzzy_parallel_state st;
+		st.next = 0;
+		st.n = n;
+		st.chunk = chunk;
+		st.fn = fn;
+		st.ctx = ctx;
+		pthread_t *threads = malloc(sizeof(pthread_t) * nthreads);
+		ffuzzy_parallel_worker *workers = malloc(sizeof(ffuzzy_parallel_worker) * nthreads);
+		if (threads && workers && !pthread_mutex_init(&st.lock, NULL))
+		{
+			unsigned started = 0;
+			for (unsigned i = 0; i < nthreads; i++)
+			{
+				workers[i].state = &st;
+				workers[i].index = i;
+			}
+			// worker 0 is the calling thread
+			for (unsigned i = 1; i < nthreads; i++, started++)
+				if (pthread_create(&threads[i], NULL, ffuzzy_parallel_run_, &workers[i]))
+					break;
+			ffuzzy_parallel_run_(&workers[0]);
+			for (unsigned i = 1; i <= started; i++)
+				pthread_join(threads[i], NULL);
+			pthread_mutex_destroy(&st.lock);
+			free(threads);
+			free(workers);
+			return;
+		}
+		free(threads);
+		free(workers);
+	}
+#else
+	(void)nthreads;
+#endif
+	for (size_t begin = 0; begin < n; begin += chunk)
+		fn(ctx, 0, begin, n - begin > chunk ? begin + chunk : n);
+}
@@ -0,0 +1,156 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_parallel.h
+	Simple parallel loop (internal)
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef FFUZZY_FFUZZY_PARALLEL_H
+#define FFUZZY_FFUZZY_PARALLEL_H
+
+/**
+	\internal
+	\file  ffuzzy_parallel.h
+	\brief Simple parallel loop
+**/
+
+#include "ffuzzy_config.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#ifdef FFUZZY_ENABLE_THREADS
+#include <pthread.h>
+#endif
+
+
+/**
+	\internal
+	\brief  Task function type for ffuzzy_parallel_for_
+	\param  ctx     User-supplied context
+	\param  worker  Worker index [0,nthreads)
+	\param  begin   The first index of the chunk
+	\param  end     The index after the last index of the chunk
+**/
+typedef void (*ffuzzy_parallel_fn)(void *ctx, unsigned worker, size_t begin, size_t end);
+
+
+/**
+	\internal
+	\fn     unsigned ffuzzy_parallel_nthreads_(unsigned)
+	\brief  Resolve the number of threads to use
+	\param  nthreads  Requested number of threads (0 to use all online processors)
+	\return Number of threads (always 1 if threads are disabled).
+**/
+unsigned ffuzzy_parallel_nthreads_(unsigned nthreads);
+
+
+/**
+	\internal
+	\fn     void ffuzzy_parallel_for_(size_t, size_t, unsigned, ffuzzy_parallel_fn, void*)
+	\brief  Run the loop [0,n) in chunks on worker threads
+	\details
+		Chunks are dynamically assigned to workers.
+		Calls with same worker index never run concurrently
+		so that per-worker state can be indexed by the worker index.
+		If threads cannot be created, remaining chunks are
+		processed by the calling thread.
+	\param  n         Number of iterations
+	\param  chunk     Number of iterations per chunk (non-zero)
+	\param  nthreads  Number of threads (resolved by ffuzzy_parallel_nthreads_)
+	\param  fn        Task function
+	\param  ctx       User-supplied context for fn
+**/
+void ffuzzy_parallel_for_(size_t n, size_t chunk, unsigned nthreads, ffuzzy_parallel_fn fn, void *ctx);
+
+
+/**
+	\internal
+	\struct ffuzzy_mutex
+	\brief  Mutex (which does nothing if threads are disabled)
+**/
+typedef struct
+{
+#ifdef FFUZZY_ENABLE_THREADS
+	pthread_mutex_t m;
+#else
+	char dummy;
+#endif
+} ffuzzy_mutex;
+
+/**
+	\internal
+	\fn     bool ffuzzy_mutex_init_(ffuzzy_mutex*)
+	\brief  Initialize the mutex
+	\return true if succeeds; false otherwise.
+**/
+static inline bool ffuzzy_mutex_init_(ffuzzy_mutex *mutex)
+{
+#ifdef FFUZZY_ENABLE_THREADS
+	return !pthread_mutex_init(&mutex->m, NULL);
+#else
+	(void)mutex;
+	return true;
+#endif
+}
+
+/**
+	\internal
+	\fn     void ffuzzy_mutex_destroy_(ffuzzy_mutex*)
+	\brief  Destroy the mutex
+**/
+static inline void ffuzzy_mutex_destroy_(ffuzzy_mutex *mutex)
+{
+#ifdef FFUZZY_ENABLE_THREADS
+	pthread_mutex_destroy(&mutex->m);
+#else
+	(void)mutex;
+#endif
+}
+
+/**
+	\internal
+	\fn     void ffuzzy_mutex_lock_(ffuzzy_mutex*)
+	\brief  Lock the mutex
+**/
+static inline void ffuzzy_mutex_lock_(ffuzzy_mutex *mutex)
+{
+#ifdef FFUZZY_ENABLE_THREADS
+	pthread_mutex_lock(&mutex->m);
+#else
+	(void)mutex;
+#endif
+}
+
+/**
+	\internal
+	\fn     void ffuzzy_mutex_unlock_(ffuzzy_mutex*)
+	\brief  Unlock the mutex
+**/
+static inline void ffuzzy_mutex_unlock_(ffuzzy_mutex *mutex)
+{
+#ifdef FFUZZY_ENABLE_THREADS
+	pthread_mutex_unlock(&mutex->m);
+#else
+	(void)mutex;
+#endif
+}
+
+#endif
@@ -42,11 +42,20 @@
 #include "ffuzzy_config.h"
 
 #include "ffuzzy_parse.h"
+#include "ffuzzy_stats.h"
 
-bool ffuzzy_read_digest(ffuzzy_digest *digest, const char *s)
+static inline bool ffuzzy_read_digest_(ffuzzy_digest *digest, const char *s)
 {
 	char *p;
 	if (!ffuzzy_read_digests_blocksize(&(digest->block_size), &p, s))
 		return false;
 	return ffuzzy_read_digest_after_blocksize(digest, p);
 }
+
+bool ffuzzy_read_digest(ffuzzy_digest *digest, const char *s)
+{
+	FFUZZY_LATENCY_BEGIN_(FFUZZY_TIMER_READ_DIGEST);
+	bool ok = ffuzzy_read_digest_(digest, s);
+	FFUZZY_LATENCY_END_(FFUZZY_TIMER_READ_DIGEST);
+	return ok;
+}
@@ -0,0 +1,786 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_plan.c
+	Partition statistics and cost-based query planning
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\internal
+	\file  ffuzzy_plan.c
+	\brief Partition statistics and cost-based query planning
+	\details
+		Each partition keeps histograms of block lengths. Because
+		ffuzzy_score_strings_max_ only depends on lengths (and the block size),
+		the histograms give the exact number of digests which pass
+		the length filter for each block and thus a close estimate of
+		comparisons a linear scan needs.
+
+		An n-gram index (built on request) maps every n-gram
+		(FFUZZY_MIN_MATCH characters) of a block to digests containing it.
+		Probing costs one lookup per n-gram of the query and the lengths of
+		the posting lists are known exactly before reading them.
+
+		Costs are measured in units of one full digest comparison.
+		Linear scans use the tile kernels of batch searches. With SIMD,
+		they compare whole lane blocks, so their costs depend on both the
+		number of digests and candidates (constants are measured against
+		one-by-one comparisons on generated corpora).
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_collection.h"
+#include "ffuzzy_compare.h"
+#include "ffuzzy_match.h"
+#include "util.h"
+
+#if FFUZZY_MIN_MATCH > 7
+#error n-grams must fit in 56 bits on current implementation.
+#endif
+
+/** \internal \brief Cost of the length filter for one digest **/
+#define FFUZZY_PLAN_COST_BOUND   0.02
+/** \internal \brief Cost of looking up one n-gram in the index **/
+#define FFUZZY_PLAN_COST_PROBE   0.1
+/** \internal \brief Cost of reading one posting (and merging candidates) **/
+#define FFUZZY_PLAN_COST_POSTING 0.01
+/** \internal \brief Number of index candidates compared between budget checks **/
+#define FFUZZY_PLAN_TILE 256
+#ifdef FFUZZY_ENABLE_SIMD
+/** \internal \brief Cost of a lane-parallel tile scan for one digest **/
+#define FFUZZY_PLAN_COST_LANE      0.3
+/** \internal \brief Additional cost of a lane-parallel tile scan for one candidate **/
+#define FFUZZY_PLAN_COST_LANE_CAND 0.6
+#endif
+
+
+size_t ffuzzy_collection_num_partitions(const ffuzzy_collection *coll)
+{
+	return coll->nparts;
+}
+
+
+bool ffuzzy_collection_partition_stats(const ffuzzy_collection *coll, size_t i, ffuzzy_partition_stats *stats)
+{
+	if (i >= coll->nparts)
+		return false;
+	const ffuzzy_partition *part = coll->parts[i];
+	stats->block_size = part->block_size;
+	stats->count = part->count;
+	stats->indexed = part->index ? part->index->count : 0;
+	for (size_t l = 0; l <= FFUZZY_SPAMSUM_LENGTH; l++)
+	{
+		stats->len1[l] = part->hist1[l];
+		stats->len2[l] = part->hist2[l];
+	}
+	return true;
+}
+
+
+/**
+	\internal
+	\fn     uint_least64_t ffuzzy_plan_gram_(const char*)
+	\brief  Pack an n-gram into an integer
+**/
+static inline uint_least64_t ffuzzy_plan_gram_(const char *s)
+{
+	uint_least64_t key = 0;
+	for (size_t k = 0; k < FFUZZY_MIN_MATCH; k++)
+		key = key << 8 | (unsigned char)s[k];
+	return key;
+}
+
+
+/**
+	\internal
+	\struct ffuzzy_plan_entry
+	\brief  Pair of an n-gram and a digest (while building postings)
+**/
+typedef struct
+{
+	uint_least64_t key;
+	size_t index;
+} ffuzzy_plan_entry;
+
+static int ffuzzy_plan_entry_cmp_(const void *p1, const void *p2)
+{
+	const ffuzzy_plan_entry *e1 = p1, *e2 = p2;
+	if (e1->key != e2->key)
+		return e1->key < e2->key ? -1 : +1;
+	return e1->index < e2->index ? -1 : e1->index > e2->index ? +1 : 0;
+}
+
+static int ffuzzy_plan_size_cmp_(const void *p1, const void *p2)
+{
+	size_t x1 = *(const size_t*)p1, x2 = *(const size_t*)p2;
+	return x1 < x2 ? -1 : x1 > x2 ? +1 : 0;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_plan_build_postings_(ffuzzy_gram_postings*, const ffuzzy_partition*, int)
+	\brief  Build postings of the first (b = 0) or the second (b = 1) blocks
+**/
+static bool ffuzzy_plan_build_postings_(ffuzzy_gram_postings *post, const ffuzzy_partition *part, int b)
+{
+	size_t n = 0;
+	for (size_t l = FFUZZY_MIN_MATCH; l <= FFUZZY_SPAMSUM_LENGTH; l++)
+		n += (b ? part->hist2[l] : part->hist1[l]) * (l - FFUZZY_MIN_MATCH + 1);
+	ffuzzy_plan_entry *entries = malloc(sizeof(ffuzzy_plan_entry) * (n ? n : 1));
+	if (!entries)
+		return false;
+	n = 0;
+	for (size_t j = 0; j < part->count; j++)
+	{
+		const ffuzzy_digest *d = &part->digests[j];
+		const char *s = b ? d->digest + d->len1 : d->digest;
+		size_t len = b ? d->len2 : d->len1;
+		for (size_t k = 0; k + FFUZZY_MIN_MATCH <= len; k++)
+		{
+			entries[n].key = ffuzzy_plan_gram_(s + k);
+			entries[n].index = j;
+			n++;
+		}
+	}
+	qsort(entries, n, sizeof(ffuzzy_plan_entry), ffuzzy_plan_entry_cmp_);
+	// count distinct keys and postings (one posting per key and digest)
+	size_t nkeys = 0, npostings = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (!i || entries[i].key != entries[i-1].key)
+			nkeys++;
+		if (!i || entries[i].key != entries[i-1].key || entries[i].index != entries[i-1].index)
+			npostings++;
+	}
+	post->keys = malloc(sizeof(uint_least64_t) * (nkeys ? nkeys : 1));
+	post->offsets = malloc(sizeof(size_t) * (nkeys + 1));
+	post->postings = malloc(sizeof(size_t) * (npostings ? npostings : 1));
+	if (!post->keys || !post->offsets || !post->postings)
+	{
+		free(entries);
+		return false;
+	}
+	post->nkeys = 0;
+	npostings = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (!i || entries[i].key != entries[i-1].key)
+		{
+			post->keys[post->nkeys] = entries[i].key;
+			post->offsets[post->nkeys] = npostings;
+			post->nkeys++;
+		}
+		else if (entries[i].index == entries[i-1].index)
+			continue;
+		post->postings[npostings++] = entries[i].index;
+	}
+	post->offsets[post->nkeys] = npostings;
+	free(entries);
+	return true;
+}
+
+
+bool ffuzzy_collection_build_index(ffuzzy_collection *coll, size_t min_count)
+{
+	for (size_t p = 0; p < coll->nparts; p++)
+	{
+		ffuzzy_partition *part = coll->parts[p];
+		if (part->count < min_count || !part->count)
+		{
+			ffuzzy_gram_index_free_(part->index);
+			part->index = NULL;
+			continue;
+		}
+		if (part->index && part->index->count == part->count)
+			continue;
+		ffuzzy_gram_index *index = calloc(1, sizeof(ffuzzy_gram_index));
+		if (!index)
+			return false;
+		index->count = part->count;
+		if (!ffuzzy_plan_build_postings_(&index->blocks[0], part, 0)
+			|| !ffuzzy_plan_build_postings_(&index->blocks[1], part, 1))
+		{
+			ffuzzy_gram_index_free_(index);
+			return false;
+		}
+		ffuzzy_gram_index_free_(part->index);
+		part->index = index;
+	}
+	return true;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_plan_lookup_(const ffuzzy_gram_postings*, uint_least64_t, size_t*, size_t*)
+	\brief  Find the posting list of the n-gram
+	\return true if found (the range is stored to begin and end); false otherwise.
+**/
+static inline bool ffuzzy_plan_lookup_(const ffuzzy_gram_postings *post, uint_least64_t key, size_t *begin, size_t *end)
+{
+	size_t lo = 0, hi = post->nkeys;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if (post->keys[mid] < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == post->nkeys || post->keys[lo] != key)
+		return false;
+	*begin = post->offsets[lo];
+	*end = post->offsets[lo + 1];
+	return true;
+}
+
+
+/**
+	\internal
+	\struct ffuzzy_plan_probe
+	\brief  Query block and the postings to look it up (one compared pair of blocks)
+**/
+typedef struct
+{
+	const char *s;
+	size_t len;
+	const ffuzzy_gram_postings *post;
+} ffuzzy_plan_probe;
+
+/**
+	\internal
+	\fn     size_t ffuzzy_plan_probes_(const ffuzzy_digest*, const ffuzzy_partition*, ffuzzy_plan_probe*)
+	\brief  Enumerate pairs of blocks compared between the query and the partition
+	\return Number of probes (the index of the partition must exist).
+**/
+static size_t ffuzzy_plan_probes_(const ffuzzy_digest *query, const ffuzzy_partition *part, ffuzzy_plan_probe probes[2])
+{
+	const ffuzzy_gram_index *index = part->index;
+	size_t n = 0;
+	if (query->block_size == part->block_size)
+	{
+		probes[n].s = query->digest;
+		probes[n].len = query->len1;
+		probes[n++].post = &index->blocks[0];
+		probes[n].s = query->digest + query->len1;
+		probes[n].len = query->len2;
+		probes[n++].post = &index->blocks[1];
+	}
+	else if (query->block_size <= (ULONG_MAX / 2) && query->block_size * 2 == part->block_size)
+	{
+		probes[n].s = query->digest + query->len1;
+		probes[n].len = query->len2;
+		probes[n++].post = &index->blocks[0];
+	}
+	else
+	{
+		probes[n].s = query->digest;
+		probes[n].len = query->len1;
+		probes[n++].post = &index->blocks[1];
+	}
+	return n;
+}
+
+
+/**
+	\internal
+	\fn     size_t ffuzzy_plan_passing_(const size_t*, size_t, unsigned long, int)
+	\brief  Count digests whose block may reach the threshold against the query block (by the histogram)
+**/
+static size_t ffuzzy_plan_passing_(const size_t hist[FFUZZY_SPAMSUM_LENGTH + 1], size_t qlen, unsigned long block_size, int threshold)
+{
+	size_t n = 0;
+	for (size_t l = FFUZZY_MIN_MATCH; l <= FFUZZY_SPAMSUM_LENGTH; l++)
+		if (hist[l] && ffuzzy_score_strings_max_(qlen, l, block_size) >= threshold)
+			n += hist[l];
+	return n;
+}
+
+
+/**
+	\internal
+	\fn     void ffuzzy_plan_step_(ffuzzy_plan_step*, const ffuzzy_partition*, const ffuzzy_digest*, int)
+	\brief  Estimate costs of strategies for one partition and choose the cheapest one
+**/
+static void ffuzzy_plan_step_(ffuzzy_plan_step *step, const ffuzzy_partition *part, const ffuzzy_digest *query, int threshold)
+{
+	unsigned long bs = part->block_size;
+	size_t candidates;
+	if (query->block_size == bs)
+	{
+		candidates = ffuzzy_plan_passing_(part->hist1, query->len1, bs, threshold);
+		if (bs <= (ULONG_MAX / 2))
+			candidates += ffuzzy_plan_passing_(part->hist2, query->len2, bs * 2, threshold);
+		else if (query->len2 >= FFUZZY_MIN_MATCH)
+		{
+			// block 2 only matters for identical digests
+			// (see ffuzzy_compare_digest_near_max_)
+			candidates += part->hist2[query->len2];
+		}
+		candidates = MIN(candidates, part->count);
+	}
+	else if (query->block_size <= (ULONG_MAX / 2) && query->block_size * 2 == bs)
+		candidates = ffuzzy_plan_passing_(part->hist1, query->len2, bs, threshold);
+	else
+		candidates = ffuzzy_plan_passing_(part->hist2, query->len1, query->block_size, threshold);
+	step->block_size = bs;
+	step->count = part->count;
+	step->candidates = candidates;
+#ifdef FFUZZY_ENABLE_SIMD
+	// same condition as ffuzzy_search_tile_
+	if (bs <= ULONG_MAX / 4)
+		step->scan_cost = part->count * FFUZZY_PLAN_COST_LANE + candidates * FFUZZY_PLAN_COST_LANE_CAND;
+	else
+#endif
+		step->scan_cost = part->count * FFUZZY_PLAN_COST_BOUND + candidates;
+	step->index_cost = -1.0;
+	if (!candidates)
+	{
+		step->strategy = FFUZZY_PLAN_EMPTY;
+		step->cost = 0.0;
+		return;
+	}
+	step->strategy = FFUZZY_PLAN_SCAN;
+	step->cost = step->scan_cost;
+	if (!part->index)
+		return;
+	// lengths of posting lists are exact; candidates also pass the length filter
+	ffuzzy_plan_probe probes[2];
+	size_t nprobes = ffuzzy_plan_probes_(query, part, probes);
+	size_t ngrams = 0, npostings = 0;
+	for (size_t i = 0; i < nprobes; i++)
+	{
+		for (size_t k = 0; k + FFUZZY_MIN_MATCH <= probes[i].len; k++)
+		{
+			size_t begin, end;
+			ngrams++;
+			if (ffuzzy_plan_lookup_(probes[i].post, ffuzzy_plan_gram_(probes[i].s + k), &begin, &end))
+				npostings += end - begin;
+		}
+	}
+	size_t tail = part->count - part->index->count;
+	step->index_cost = ngrams * FFUZZY_PLAN_COST_PROBE
+		+ npostings * (FFUZZY_PLAN_COST_POSTING + FFUZZY_PLAN_COST_BOUND)
+		+ MIN(npostings, candidates)
+		+ tail * FFUZZY_PLAN_COST_BOUND + MIN(tail, candidates);
+	if (step->index_cost < step->scan_cost)
+	{
+		step->strategy = FFUZZY_PLAN_INDEX;
+		step->cost = step->index_cost;
+	}
+}
+
+
+bool ffuzzy_collection_plan(const ffuzzy_collection *coll, const ffuzzy_digest *query, int threshold, ffuzzy_plan *plan)
+{
+	assert(ffuzzy_digest_is_valid(query));
+	ffuzzy_partition *parts[3];
+	size_t nparts = ffuzzy_collection_near_partitions_(coll, query->block_size, parts);
+	plan->block_size = query->block_size;
+	plan->threshold = MAX(threshold, 1);
+	plan->nsteps = 0;
+	plan->cost = 0.0;
+	for (size_t i = 0; i < nparts; i++)
+	{
+		if (!parts[i]->count)
+			continue;
+		ffuzzy_plan_step *step = &plan->steps[plan->nsteps++];
+		ffuzzy_plan_step_(step, parts[i], query, plan->threshold);
+		plan->cost += step->cost;
+	}
+	return true;
+}
+
+
+/**
+	\internal
+	\struct ffuzzy_plan_budget
+	\brief  Remaining budget of a bounded search
+	\internal
+	\var   ffuzzy_plan_budget::deadline
+	\brief Deadline (by util_now_usec; 0 if none).
+	\internal
+	\var   ffuzzy_plan_budget::max_comparisons
+	\brief Maximum number of comparisons (0 if unlimited).
+	\internal
+	\var   ffuzzy_plan_budget::comparisons
+	\brief Number of comparisons done (digests passing the length filter).
+	\internal
+	\var   ffuzzy_plan_budget::exhausted
+	\brief Whether the budget ran out (sticky).
+**/
+typedef struct
+{
+	unsigned long long deadline;
+	unsigned long long max_comparisons;
+	unsigned long long comparisons;
+	bool exhausted;
+} ffuzzy_plan_budget;
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_plan_exhausted_(ffuzzy_plan_budget*)
+	\brief  Check the budget (called once per tile)
+	\param  [in,out] budget  The budget (may be NULL if unlimited)
+	\return true if the search must stop; false otherwise.
+**/
+static inline bool ffuzzy_plan_exhausted_(ffuzzy_plan_budget *budget)
+{
+	if (!budget)
+		return false;
+	if (!budget->exhausted)
+	{
+		if (budget->max_comparisons && budget->comparisons >= budget->max_comparisons)
+			budget->exhausted = true;
+		else if (budget->deadline && util_now_usec() >= budget->deadline)
+			budget->exhausted = true;
+	}
+	return budget->exhausted;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_plan_verify_(const ffuzzy_partition*, const ffuzzy_digest*, int, size_t, ffuzzy_plan_budget*, ffuzzy_match_list*)
+	\brief  Compare a candidate and append it to results if matched
+**/
+static inline bool ffuzzy_plan_verify_(
+	const ffuzzy_partition *part, const ffuzzy_digest *query,
+	int threshold, size_t j, ffuzzy_plan_budget *budget, ffuzzy_match_list *results
+)
+{
+	if (ffuzzy_compare_digest_near_max_(query, &part->digests[j]) < threshold)
+		return true;
+	if (budget)
+		budget->comparisons++;
+	int score = ffuzzy_compare_digest_near(query, &part->digests[j]);
+	if (score < threshold)
+		return true;
+	return ffuzzy_match_list_push_(results, part->ids[j], score);
+}
+
+
+/**
+	\internal
+	\struct ffuzzy_plan_scan_state
+	\brief  State of a linear scan with the budget
+**/
+typedef struct
+{
+	const ffuzzy_partition *part;
+	const ffuzzy_digest *query;
+	int threshold;
+	ffuzzy_plan_budget *budget;
+} ffuzzy_plan_scan_state;
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_plan_next_tile_(void*, size_t, size_t)
+	\brief  Check the budget and count comparisons of the next tile (as ffuzzy_plan_verify_)
+**/
+static bool ffuzzy_plan_next_tile_(void *arg, size_t j0, size_t j1)
+{
+	ffuzzy_plan_scan_state *st = arg;
+	if (ffuzzy_plan_exhausted_(st->budget))
+		return false;
+	for (size_t j = j0; j < j1; j++)
+		if (ffuzzy_compare_digest_near_max_(st->query, &st->part->digests[j]) >= st->threshold)
+			st->budget->comparisons++;
+	return true;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_plan_scan_(const ffuzzy_partition*, const ffuzzy_digest*, int, size_t, ffuzzy_plan_budget*, ffuzzy_match_list*, size_t*)
+	\brief  Compare digests from j0 to the end of the partition (checking the budget per tile)
+	\details
+		Digests are compared by the tile kernels of batch searches.
+	\param  [out] covered  Digests [0, *covered) are compared (or cannot match)
+**/
+static bool ffuzzy_plan_scan_(
+	const ffuzzy_partition *part, const ffuzzy_digest *query,
+	int threshold, size_t j0, ffuzzy_plan_budget *budget,
+	ffuzzy_match_list *results, size_t *covered
+)
+{
+	if (!budget)
+		return ffuzzy_search_partition_(part, query, threshold, j0, NULL, NULL, results, covered);
+	ffuzzy_plan_scan_state st;
+	st.part = part;
+	st.query = query;
+	st.threshold = threshold;
+	st.budget = budget;
+	return ffuzzy_search_partition_(part, query, threshold, j0, ffuzzy_plan_next_tile_, &st, results, covered);
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_plan_probe_(const ffuzzy_partition*, const ffuzzy_digest*, int, ffuzzy_plan_budget*, ffuzzy_match_list*, size_t*)
+	\brief  Search a partition using its n-gram index (and scan digests added after indexing)
+	\details
+		Candidates are verified in the order of partition indices so that
+		digests before the last verified candidate are also covered
+		(other digests do not share an n-gram with the query).
+	\param  [out] covered  Digests [0, *covered) are compared (or cannot match)
+**/
+static bool ffuzzy_plan_probe_(
+	const ffuzzy_partition *part, const ffuzzy_digest *query,
+	int threshold, ffuzzy_plan_budget *budget,
+	ffuzzy_match_list *results, size_t *covered
+)
+{
+	ffuzzy_plan_probe probes[2];
+	size_t nprobes = ffuzzy_plan_probes_(query, part, probes);
+	size_t *cands = NULL, ncands = 0, candcap = 0;
+	*covered = 0;
+	for (size_t i = 0; i < nprobes; i++)
+	{
+		for (size_t k = 0; k + FFUZZY_MIN_MATCH <= probes[i].len; k++)
+		{
+			size_t begin, end;
+			if (!ffuzzy_plan_lookup_(probes[i].post, ffuzzy_plan_gram_(probes[i].s + k), &begin, &end))
+				continue;
+			if (!util_grow_array((void**)&cands, &candcap, ncands + (end - begin), sizeof(size_t)))
+			{
+				free(cands);
+				return false;
+			}
+			for (size_t t = begin; t < end; t++)
+				cands[ncands++] = probes[i].post->postings[t];
+		}
+	}
+	qsort(cands, ncands, sizeof(size_t), ffuzzy_plan_size_cmp_);
+	for (size_t i = 0; i < ncands; i++)
+	{
+		if (i % FFUZZY_PLAN_TILE == 0 && ffuzzy_plan_exhausted_(budget))
+		{
+			free(cands);
+			return true;
+		}
+		if (i && cands[i] == cands[i-1])
+			continue;
+		if (!ffuzzy_plan_verify_(part, query, threshold, cands[i], budget, results))
+		{
+			free(cands);
+			return false;
+		}
+		*covered = cands[i] + 1;
+	}
+	free(cands);
+	return ffuzzy_plan_scan_(part, query, threshold, part->index->count, budget, results, covered);
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_plan_run_(const ffuzzy_collection*, const ffuzzy_digest*, int, const ffuzzy_plan_step*, ffuzzy_plan_budget*, ffuzzy_match_list*, ffuzzy_partition_coverage*)
+	\brief  Execute one step of the plan
+**/
+static bool ffuzzy_plan_run_(
+	const ffuzzy_collection *coll, const ffuzzy_digest *query,
+	int threshold, const ffuzzy_plan_step *step, ffuzzy_plan_budget *budget,
+	ffuzzy_match_list *results, ffuzzy_partition_coverage *coverage
+)
+{
+	const ffuzzy_partition *part = ffuzzy_collection_find_partition_(coll, step->block_size);
+	size_t covered = 0;
+	bool ok = true;
+	coverage->block_size = step->block_size;
+	coverage->count = part ? part->count : 0;
+	if (!part)
+		return true;
+	switch (step->strategy)
+	{
+		case FFUZZY_PLAN_EMPTY:
+			covered = part->count;
+			break;
+		case FFUZZY_PLAN_INDEX:
+			// the index may be rebuilt or dropped after planning
+			if (part->index)
+			{
+				ok = ffuzzy_plan_probe_(part, query, threshold, budget, results, &covered);
+				break;
+			}
+			/* fallthrough */
+		case FFUZZY_PLAN_SCAN:
+			ok = ffuzzy_plan_scan_(part, query, threshold, 0, budget, results, &covered);
+			break;
+	}
+	coverage->covered = covered;
+	return ok;
+}
+
+
+bool ffuzzy_collection_search_planned(
+	const ffuzzy_collection *coll, const ffuzzy_digest *query,
+	int threshold, const ffuzzy_plan *plan, ffuzzy_match_list *results
+)
+{
+	assert(ffuzzy_digest_is_valid(query));
+	ffuzzy_plan local;
+	results->count = 0;
+	if (!plan)
+	{
+		ffuzzy_collection_plan(coll, query, threshold, &local);
+		plan = &local;
+	}
+	assert(plan->block_size == query->block_size && plan->threshold == MAX(threshold, 1));
+	bool ok = true;
+	for (size_t i = 0; ok && i < plan->nsteps; i++)
+	{
+		ffuzzy_partition_coverage coverage;
+		ok = ffuzzy_plan_run_(coll, query, plan->threshold, &plan->steps[i], NULL, results, &coverage);
+	}
+	ffuzzy_match_sort_(results->matches, results->count);
+	return ok;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_plan_before_(const ffuzzy_plan_step*, const ffuzzy_plan_step*, unsigned long)
+	\brief  Determines whether step s1 runs before s2 in bounded searches
+	\details
+		Partitions without candidates finish immediately. The equal block
+		size (where both blocks are compared) is the most promising.
+		Other partitions run in the order of estimated costs
+		(so that more partitions are completed).
+**/
+static inline bool ffuzzy_plan_before_(const ffuzzy_plan_step *s1, const ffuzzy_plan_step *s2, unsigned long block_size)
+{
+	bool e1 = s1->strategy == FFUZZY_PLAN_EMPTY, e2 = s2->strategy == FFUZZY_PLAN_EMPTY;
+	if (e1 != e2)
+		return e1;
+	bool q1 = s1->block_size == block_size, q2 = s2->block_size == block_size;
+	if (q1 != q2)
+		return q1;
+	return s1->cost < s2->cost;
+}
+
+
+bool ffuzzy_collection_search_bounded(
+	const ffuzzy_collection *coll, const ffuzzy_digest *query,
+	int threshold, const ffuzzy_search_budget *budget,
+	ffuzzy_match_list *results, ffuzzy_search_coverage *coverage
+)
+{
+	assert(ffuzzy_digest_is_valid(query));
+	ffuzzy_plan_budget remaining;
+	ffuzzy_plan plan;
+	unsigned long long start = util_now_usec();
+	remaining.deadline = budget && budget->timeout_usec ? start + budget->timeout_usec : 0;
+	remaining.max_comparisons = budget ? budget->max_comparisons : 0;
+	remaining.comparisons = 0;
+	remaining.exhausted = false;
+	results->count = 0;
+	ffuzzy_collection_plan(coll, query, threshold, &plan);
+	// order steps (at most three)
+	const ffuzzy_plan_step *order[3];
+	for (size_t i = 0; i < plan.nsteps; i++)
+	{
+		size_t k = i;
+		for (; k && ffuzzy_plan_before_(&plan.steps[i], order[k-1], query->block_size); k--)
+			order[k] = order[k-1];
+		order[k] = &plan.steps[i];
+	}
+	bool ok = true;
+	coverage->nparts = plan.nsteps;
+	coverage->count = 0;
+	coverage->covered = 0;
+	for (size_t i = 0; i < plan.nsteps; i++)
+	{
+		ffuzzy_partition_coverage *pc = &coverage->parts[i];
+		if (ok)
+			ok = ffuzzy_plan_run_(coll, query, plan.threshold, order[i], &remaining, results, pc);
+		else
+		{
+			pc->block_size = order[i]->block_size;
+			pc->count = order[i]->count;
+			pc->covered = 0;
+		}
+		coverage->count += pc->count;
+		coverage->covered += pc->covered;
+	}
+	coverage->complete = ok && coverage->covered == coverage->count;
+	coverage->comparisons = remaining.comparisons;
+	coverage->elapsed_usec = util_now_usec() - start;
+	ffuzzy_match_sort_(results->matches, results->count);
+	return ok;
+}
+
+
+const char *ffuzzy_plan_strategy_name(ffuzzy_plan_strategy strategy)
+{
+	switch (strategy)
+	{
+		case FFUZZY_PLAN_EMPTY: return "empty";
+		case FFUZZY_PLAN_SCAN:  return "scan";
+		case FFUZZY_PLAN_INDEX: return "index";
+	}
+	return "unknown";
+}
+
+
+int ffuzzy_plan_explain(const ffuzzy_plan *plan, char *buf, size_t size)
+{
+	size_t len = 0;
+	int n;
+#define FFUZZY_PLAN_PRINT(...) \
+	do { \
+		n = snprintf(len < size ? buf + len : NULL, len < size ? size - len : 0, __VA_ARGS__); \
+		if (n < 0) \
+			return n; \
+		len += (size_t)n; \
+	} while (0)
+	FFUZZY_PLAN_PRINT("query block size %lu, threshold %d: estimated cost %.1f\n",
+		plan->block_size, plan->threshold, plan->cost);
+	if (!plan->nsteps)
+		FFUZZY_PLAN_PRINT("  no partitions with near block sizes\n");
+	for (size_t i = 0; i < plan->nsteps; i++)
+	{
+		const ffuzzy_plan_step *step = &plan->steps[i];
+		FFUZZY_PLAN_PRINT("  block size %lu: %s (%zu digests, %zu pass length filter; scan %.1f",
+			step->block_size, ffuzzy_plan_strategy_name(step->strategy),
+			step->count, step->candidates, step->scan_cost);
+		if (step->index_cost >= 0)
+			FFUZZY_PLAN_PRINT(", index %.1f", step->index_cost);
+		else
+			FFUZZY_PLAN_PRINT(", no index");
+		FFUZZY_PLAN_PRINT(")\n");
+	}
+#undef FFUZZY_PLAN_PRINT
+	return len > INT_MAX ? -1 : (int)len;
+}
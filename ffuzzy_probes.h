@@ -0,0 +1,73 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_probes.h
+	Static tracepoints (USDT probes)
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef FFUZZY_FFUZZY_PROBES_H
+#define FFUZZY_FFUZZY_PROBES_H
+
+/**
+	\internal
+	\file  ffuzzy_probes.h
+	\brief Static tracepoints (USDT probes)
+	\details
+		If configured with --enable-sdt, FFUZZY_PROBEn_ macros expand to
+		SystemTap-compatible SDT probes of the provider "libffuzzy".
+		Each probe is a single NOP instruction (plus an ELF note) until
+		a tracer such as perf or bpftrace attaches to it.
+		Otherwise, the macros expand to nothing.
+
+		Probes (and their arguments):
+		-  blocksize_reject (block_size1, block_size2)
+		-  identical (block_size, len1, len2)
+		-  length_reject (s1len, s2len, block_size)
+		-  substring_reject (s1len, s2len, block_size)
+		-  bound_skip (s1len, s2len, block_size)
+		-  distance (s1len, s2len, block_size, edit_distance)
+		-  score (block_size1, block_size2, score)
+
+		Block pairs are probed at the same points as statistics
+		(see ffuzzy_stat_counter) except in lane-parallel kernels.
+		The score probe fires once per "near" comparison.
+		See examples/bpftrace for scripts using them.
+**/
+
+#include "ffuzzy_config.h"
+
+#ifdef FFUZZY_ENABLE_SDT
+
+#include <sys/sdt.h>
+
+#define FFUZZY_PROBE2_(name, a1, a2)          DTRACE_PROBE2(libffuzzy, name, a1, a2)
+#define FFUZZY_PROBE3_(name, a1, a2, a3)      DTRACE_PROBE3(libffuzzy, name, a1, a2, a3)
+#define FFUZZY_PROBE4_(name, a1, a2, a3, a4)  DTRACE_PROBE4(libffuzzy, name, a1, a2, a3, a4)
+
+#else
+
+#define FFUZZY_PROBE2_(name, a1, a2)          ((void)0)
+#define FFUZZY_PROBE3_(name, a1, a2, a3)      ((void)0)
+#define FFUZZY_PROBE4_(name, a1, a2, a3, a4)  ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,90 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_record.c
+	Binary digest records
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\internal
+	\file  ffuzzy_record.c
+	\brief Binary digest records
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_record.h"
+
+
+void ffuzzy_encode_digest_record(unsigned char *buf, unsigned long long id, const ffuzzy_digest *digest)
+{
+	assert(ffuzzy_digest_is_valid(digest));
+	ffuzzy_record_put64_(buf + FFUZZY_RECORD_OFFSET_ID, id);
+	ffuzzy_record_put64_(buf + FFUZZY_RECORD_OFFSET_BLOCKSIZE, digest->block_size);
+	buf[FFUZZY_RECORD_OFFSET_LEN1] = (unsigned char)digest->len1;
+	buf[FFUZZY_RECORD_OFFSET_LEN2] = (unsigned char)digest->len2;
+	memcpy(buf + FFUZZY_RECORD_OFFSET_DIGEST, digest->digest, digest->len1 + digest->len2);
+	memset(buf + FFUZZY_RECORD_OFFSET_DIGEST + digest->len1 + digest->len2, 0, FFUZZY_SPAMSUM_LENGTH * 2 - (digest->len1 + digest->len2));
+}
+
+
+bool ffuzzy_decode_digest_record(unsigned long long *id, ffuzzy_digest *digest, const unsigned char *buf)
+{
+	unsigned long long bs = ffuzzy_record_get64_(buf + FFUZZY_RECORD_OFFSET_BLOCKSIZE);
+	if (bs > ULONG_MAX)
+		return false;
+	digest->block_size = (unsigned long)bs;
+	digest->len1 = buf[FFUZZY_RECORD_OFFSET_LEN1];
+	digest->len2 = buf[FFUZZY_RECORD_OFFSET_LEN2];
+	if (!ffuzzy_digest_is_valid_lengths(digest))
+		return false;
+	memcpy(digest->digest, buf + FFUZZY_RECORD_OFFSET_DIGEST, digest->len1 + digest->len2);
+	if (!ffuzzy_digest_is_valid_buffer(digest))
+		return false;
+	if (id)
+		*id = ffuzzy_record_get64_(buf + FFUZZY_RECORD_OFFSET_ID);
+	return true;
+}
+
+
+bool ffuzzy_write_digest_record(FILE *fp, unsigned long long id, const ffuzzy_digest *digest)
+{
+	unsigned char buf[FFUZZY_RECORD_SIZE];
+	ffuzzy_encode_digest_record(buf, id, digest);
+	return fwrite(buf, FFUZZY_RECORD_SIZE, 1, fp) == 1;
+}
+
+
+bool ffuzzy_read_digest_record(FILE *fp, unsigned long long *id, ffuzzy_digest *digest)
+{
+	unsigned char buf[FFUZZY_RECORD_SIZE];
+	if (fread(buf, FFUZZY_RECORD_SIZE, 1, fp) != 1)
+		return false;
+	return ffuzzy_decode_digest_record(id, digest, buf);
+}
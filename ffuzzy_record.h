@@ -0,0 +1,85 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_record.h
+	Binary digest records (internal)
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef FFUZZY_FFUZZY_RECORD_H
+#define FFUZZY_FFUZZY_RECORD_H
+
+/**
+	\internal
+	\file  ffuzzy_record.h
+	\brief Binary digest records
+**/
+
+#include "ffuzzy_config.h"
+
+
+/**
+	\internal
+	\name Layout of binary digest records
+	\{
+**/
+/** \internal \brief Offset of the digest ID (64-bit little endian) **/
+#define FFUZZY_RECORD_OFFSET_ID         0
+/** \internal \brief Offset of the block size (64-bit little endian) **/
+#define FFUZZY_RECORD_OFFSET_BLOCKSIZE  8
+/** \internal \brief Offset of the length of block 1 (8-bit) **/
+#define FFUZZY_RECORD_OFFSET_LEN1       16
+/** \internal \brief Offset of the length of block 2 (8-bit) **/
+#define FFUZZY_RECORD_OFFSET_LEN2       17
+/** \internal \brief Offset of digest blocks (FFUZZY_SPAMSUM_LENGTH * 2 bytes, zero-padded) **/
+#define FFUZZY_RECORD_OFFSET_DIGEST     18
+/** \} **/
+
+#if FFUZZY_RECORD_OFFSET_DIGEST + FFUZZY_SPAMSUM_LENGTH * 2 != FFUZZY_RECORD_SIZE
+#error FFUZZY_RECORD_SIZE does not match the record layout.
+#endif
+
+
+/**
+	\internal
+	\fn     void ffuzzy_record_put64_(unsigned char*, unsigned long long)
+	\brief  Store 64-bit unsigned integer (in little endian)
+**/
+static inline void ffuzzy_record_put64_(unsigned char *buf, unsigned long long value)
+{
+	for (int i = 0; i < 8; i++, value >>= 8)
+		buf[i] = (unsigned char)(value & 0xffu);
+}
+
+
+/**
+	\internal
+	\fn     unsigned long long ffuzzy_record_get64_(const unsigned char*)
+	\brief  Load 64-bit unsigned integer (in little endian)
+**/
+static inline unsigned long long ffuzzy_record_get64_(const unsigned char *buf)
+{
+	unsigned long long value = 0;
+	for (int i = 7; i >= 0; i--)
+		value = (value << 8) | buf[i];
+	return value;
+}
+
+#endif
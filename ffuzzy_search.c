@@ -0,0 +1,580 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_search.c
+	Threshold search (single and batch queries)
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\internal
+	\file  ffuzzy_search.c
+	\brief Threshold search (single and batch queries)
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_blocksize.h"
+#include "ffuzzy_collection.h"
+#include "ffuzzy_compare.h"
+#include "ffuzzy_lanes.h"
+#include "ffuzzy_match.h"
+#include "ffuzzy_parallel.h"
+#include "ffuzzy_stats.h"
+#include "util.h"
+
+/** \internal \brief Number of corpus digests per tile (shared by all queries) **/
+#define FFUZZY_SEARCH_TILE 256
+/** \internal \brief Number of lane blocks per tile **/
+#define FFUZZY_SEARCH_TILE_BLOCKS (FFUZZY_SEARCH_TILE / FFUZZY_LANES)
+
+#if FFUZZY_SEARCH_TILE % FFUZZY_LANES != 0
+#error FFUZZY_SEARCH_TILE must be a multiple of FFUZZY_LANES.
+#endif
+
+
+void ffuzzy_match_list_init(ffuzzy_match_list *list)
+{
+	list->matches = NULL;
+	list->count = 0;
+	list->capacity = 0;
+}
+
+
+void ffuzzy_match_list_free(ffuzzy_match_list *list)
+{
+	free(list->matches);
+	ffuzzy_match_list_init(list);
+}
+
+
+bool ffuzzy_collection_search(
+	const ffuzzy_collection *coll, const ffuzzy_digest *query,
+	int threshold, ffuzzy_match_list *results
+)
+{
+	return ffuzzy_collection_search_batch(coll, query, 1, threshold, 1, results);
+}
+
+
+/**
+	\internal
+	\struct ffuzzy_search_qkey
+	\brief  Query sort key (block size and the query index)
+**/
+typedef struct
+{
+	unsigned long block_size;
+	size_t index;
+} ffuzzy_search_qkey;
+
+/**
+	\internal
+	\struct ffuzzy_search_qrange
+	\brief  Range of sorted queries
+**/
+typedef struct
+{
+	size_t begin, end;
+} ffuzzy_search_qrange;
+
+/**
+	\internal
+	\struct ffuzzy_search_item
+	\brief  Corpus partition and queries which need it
+**/
+typedef struct
+{
+	const ffuzzy_partition *part;
+	ffuzzy_search_qrange ranges[3];
+	size_t nranges;
+	size_t first_tile;
+} ffuzzy_search_item;
+
+/**
+	\internal
+	\struct ffuzzy_search_result
+	\brief  Buffered result (query index, digest ID and the score)
+**/
+typedef struct
+{
+	size_t query;
+	size_t id;
+	int score;
+} ffuzzy_search_result;
+
+/**
+	\internal
+	\struct ffuzzy_search_buffer
+	\brief  Per-worker result buffer and the transposed tile
+	\details
+		blocks1 and blocks2 contain first and second blocks of
+		the current tile (for lane-parallel comparison).
+**/
+typedef struct
+{
+	ffuzzy_search_result *results;
+	size_t count, capacity;
+#ifdef FFUZZY_ENABLE_SIMD
+	ffuzzy_lane_block blocks1[FFUZZY_SEARCH_TILE_BLOCKS];
+	ffuzzy_lane_block blocks2[FFUZZY_SEARCH_TILE_BLOCKS];
+#endif
+} ffuzzy_search_buffer;
+
+/**
+	\internal
+	\struct ffuzzy_search_ctx
+	\brief  Batch search state shared by workers
+**/
+typedef struct
+{
+	const ffuzzy_digest *queries;
+	const ffuzzy_search_qkey *qkeys;
+	const ffuzzy_search_item *items;
+	size_t nitems;
+	int threshold;
+	ffuzzy_search_buffer *buffers;
+	bool ok;
+} ffuzzy_search_ctx;
+
+
+static int ffuzzy_search_qkey_cmp_(const void *p1, const void *p2)
+{
+	const ffuzzy_search_qkey *k1 = p1, *k2 = p2;
+	int c = ffuzzy_blocksizecmp(k1->block_size, k2->block_size);
+	if (c)
+		return c;
+	return k1->index < k2->index ? -1 : k1->index > k2->index ? +1 : 0;
+}
+
+
+/**
+	\internal
+	\fn     ffuzzy_search_qrange ffuzzy_search_find_(const ffuzzy_search_qkey*, size_t, unsigned long)
+	\brief  Find sorted queries with given block size
+**/
+static ffuzzy_search_qrange ffuzzy_search_find_(const ffuzzy_search_qkey *qkeys, size_t n, unsigned long block_size)
+{
+	ffuzzy_search_qrange r;
+	size_t lo = 0, hi = n;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if (qkeys[mid].block_size < block_size)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	r.begin = lo;
+	hi = n;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if (qkeys[mid].block_size <= block_size)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	r.end = lo;
+	return r;
+}
+
+
+/**
+	\internal
+	\fn     void ffuzzy_search_emit_(ffuzzy_search_ctx*, ffuzzy_search_buffer*, size_t, size_t, int)
+	\brief  Buffer a match (if the score is high enough)
+**/
+static inline void ffuzzy_search_emit_(ffuzzy_search_ctx *ctx, ffuzzy_search_buffer *buf, size_t query, size_t id, int score)
+{
+	if (score < ctx->threshold)
+		return;
+	if (!util_grow_array((void**)&buf->results, &buf->capacity, buf->count + 1, sizeof(ffuzzy_search_result)))
+	{
+		ctx->ok = false;
+		return;
+	}
+	buf->results[buf->count].query = query;
+	buf->results[buf->count].id = id;
+	buf->results[buf->count].score = score;
+	buf->count++;
+}
+
+
+/**
+	\internal
+	\fn     void ffuzzy_search_tile_scalar_(ffuzzy_search_ctx*, ffuzzy_search_buffer*, const ffuzzy_search_item*, size_t, size_t)
+	\brief  Compare a tile against all queries which need it (one pair at a time)
+**/
+static void ffuzzy_search_tile_scalar_(
+	ffuzzy_search_ctx *ctx, ffuzzy_search_buffer *buf,
+	const ffuzzy_search_item *item, size_t j0, size_t j1
+)
+{
+	const ffuzzy_partition *part = item->part;
+	for (size_t r = 0; r < item->nranges; r++)
+	{
+		for (size_t qi = item->ranges[r].begin; qi < item->ranges[r].end; qi++)
+		{
+			size_t q = ctx->qkeys[qi].index;
+			const ffuzzy_digest *query = &ctx->queries[q];
+			for (size_t j = j0; j < j1; j++)
+			{
+				if (ffuzzy_compare_digest_near_max_(query, &part->digests[j]) < ctx->threshold)
+					continue;
+				ffuzzy_search_emit_(ctx, buf, q, part->ids[j], ffuzzy_compare_digest_near(query, &part->digests[j]));
+			}
+		}
+	}
+}
+
+
+#ifdef FFUZZY_ENABLE_SIMD
+#ifdef FFUZZY_ENABLE_STATS
+/**
+	\internal
+	\fn     void ffuzzy_search_count_lanes_(const ffuzzy_digest*, const ffuzzy_digest*, size_t, int)
+	\brief  Count digest comparisons in a lane block
+	\details
+		Digests are counted as ffuzzy_search_tile_scalar_ compares them
+		(with ffuzzy_compare_digest_near after the upper bound check).
+**/
+static void ffuzzy_search_count_lanes_(const ffuzzy_digest *query, const ffuzzy_digest *t, size_t n, int threshold)
+{
+	for (size_t k = 0; k < n; k++)
+	{
+		if (ffuzzy_compare_digest_near_max_(query, &t[k]) < threshold)
+			continue;
+		FFUZZY_STATS_COUNT_(FFUZZY_STAT_NEAR_COMPARISONS);
+		if (
+			query->block_size == t[k].block_size &&
+			query->len1 == t[k].len1 &&
+			query->len2 == t[k].len2 &&
+			!memcmp(query->digest, t[k].digest, query->len1 + query->len2)
+		)
+			FFUZZY_STATS_COUNT_(FFUZZY_STAT_IDENTICAL);
+	}
+}
+#endif
+
+
+/**
+	\internal
+	\fn     void ffuzzy_search_tile_lanes_(ffuzzy_search_ctx*, ffuzzy_search_buffer*, const ffuzzy_search_item*, size_t, size_t)
+	\brief  Compare a tile against all queries which need it (FFUZZY_LANES digests at a time)
+	\details
+		The tile is transposed once and then shared by all queries.
+		A lane block is skipped if no digest in it can reach the threshold.
+**/
+static void ffuzzy_search_tile_lanes_(
+	ffuzzy_search_ctx *ctx, ffuzzy_search_buffer *buf,
+	const ffuzzy_search_item *item, size_t j0, size_t j1
+)
+{
+	const ffuzzy_partition *part = item->part;
+	unsigned long bs = part->block_size;
+	size_t nblocks = (j1 - j0 + FFUZZY_LANES - 1) / FFUZZY_LANES;
+	for (size_t b = 0; b < nblocks; b++)
+	{
+		ffuzzy_lane_block_init_(&buf->blocks1[b]);
+		ffuzzy_lane_block_init_(&buf->blocks2[b]);
+		size_t k1 = MIN(j0 + (b + 1) * FFUZZY_LANES, j1);
+		for (size_t j = j0 + b * FFUZZY_LANES; j < k1; j++)
+		{
+			const ffuzzy_digest *d = &part->digests[j];
+			ffuzzy_lane_block_push_(&buf->blocks1[b], d->digest, d->len1);
+			ffuzzy_lane_block_push_(&buf->blocks2[b], d->digest + d->len1, d->len2);
+		}
+	}
+	for (size_t r = 0; r < item->nranges; r++)
+	{
+		for (size_t qi = item->ranges[r].begin; qi < item->ranges[r].end; qi++)
+		{
+			size_t q = ctx->qkeys[qi].index;
+			const ffuzzy_digest *query = &ctx->queries[q];
+			const char *qs1 = query->digest, *qs2 = query->digest + query->len1;
+			for (size_t b = 0; b < nblocks; b++)
+			{
+				size_t jb = j0 + b * FFUZZY_LANES;
+				const ffuzzy_digest *t = &part->digests[jb];
+				size_t n = buf->blocks1[b].count;
+				int best[FFUZZY_LANES], scores[FFUZZY_LANES];
+				bool need1 = false, need2 = false;
+				for (size_t k = 0; k < n; k++)
+					best[k] = 0;
+#ifdef FFUZZY_ENABLE_STATS
+				ffuzzy_search_count_lanes_(query, t, n, ctx->threshold);
+#endif
+				if (query->block_size == bs)
+				{
+					for (size_t k = 0; k < n && !(need1 && need2); k++)
+					{
+						if (ffuzzy_score_strings_max_(query->len1, t[k].len1, bs) >= ctx->threshold)
+							need1 = true;
+						if (ffuzzy_score_strings_max_(query->len2, t[k].len2, bs * 2) >= ctx->threshold)
+							need2 = true;
+					}
+					if (need1)
+					{
+						ffuzzy_lane_block_score_(&buf->blocks1[b], qs1, query->len1, bs, scores);
+						for (size_t k = 0; k < n; k++)
+							best[k] = MAX(best[k], scores[k]);
+					}
+					if (need2)
+					{
+						ffuzzy_lane_block_score_(&buf->blocks2[b], qs2, query->len2, bs * 2, scores);
+						for (size_t k = 0; k < n; k++)
+							best[k] = MAX(best[k], scores[k]);
+					}
+				}
+				else if (query->block_size * 2 == bs)
+				{
+					for (size_t k = 0; k < n && !need1; k++)
+						if (ffuzzy_score_strings_max_(query->len2, t[k].len1, bs) >= ctx->threshold)
+							need1 = true;
+					if (need1)
+						ffuzzy_lane_block_score_(&buf->blocks1[b], qs2, query->len2, bs, best);
+				}
+				else
+				{
+					assert(query->block_size == bs * 2);
+					for (size_t k = 0; k < n && !need2; k++)
+						if (ffuzzy_score_strings_max_(query->len1, t[k].len2, query->block_size) >= ctx->threshold)
+							need2 = true;
+					if (need2)
+						ffuzzy_lane_block_score_(&buf->blocks2[b], qs1, query->len1, query->block_size, best);
+				}
+				for (size_t k = 0; k < n; k++)
+				{
+					// identical digests get the same scores as the dedicated path
+					// in ffuzzy_compare_digest_near (for block sizes handled here)
+					ffuzzy_search_emit_(ctx, buf, q, part->ids[jb + k], best[k]);
+				}
+			}
+		}
+	}
+}
+#endif
+
+
+/**
+	\internal
+	\fn     void ffuzzy_search_tile_(ffuzzy_search_ctx*, ffuzzy_search_buffer*, const ffuzzy_search_item*, size_t, size_t)
+	\brief  Compare a tile against all queries which need it (choosing the kernel)
+**/
+static inline void ffuzzy_search_tile_(
+	ffuzzy_search_ctx *ctx, ffuzzy_search_buffer *buf,
+	const ffuzzy_search_item *item, size_t j0, size_t j1
+)
+{
+#ifdef FFUZZY_ENABLE_SIMD
+	// block sizes near ULONG_MAX need special handling (see ffuzzy_compare_digest_near)
+	if (item->part->block_size <= ULONG_MAX / 4)
+	{
+		ffuzzy_search_tile_lanes_(ctx, buf, item, j0, j1);
+		return;
+	}
+#endif
+	ffuzzy_search_tile_scalar_(ctx, buf, item, j0, j1);
+}
+
+
+static void ffuzzy_search_task_(void *arg, unsigned worker, size_t begin, size_t end)
+{
+	ffuzzy_search_ctx *ctx = arg;
+	ffuzzy_search_buffer *buf = &ctx->buffers[worker];
+	for (size_t tile = begin; tile < end; tile++)
+	{
+		size_t lo = 0, hi = ctx->nitems;
+		while (hi - lo > 1)
+		{
+			size_t mid = lo + (hi - lo) / 2;
+			if (ctx->items[mid].first_tile <= tile)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		const ffuzzy_search_item *item = &ctx->items[lo];
+		size_t j0 = (tile - item->first_tile) * FFUZZY_SEARCH_TILE;
+		size_t j1 = MIN(j0 + FFUZZY_SEARCH_TILE, item->part->count);
+		ffuzzy_search_tile_(ctx, buf, item, j0, j1);
+	}
+}
+
+
+bool ffuzzy_search_partition_(
+	const ffuzzy_partition *part, const ffuzzy_digest *query,
+	int threshold, size_t j0, ffuzzy_search_tile_fn next_tile, void *arg,
+	ffuzzy_match_list *results, size_t *covered
+)
+{
+	ffuzzy_search_qkey qkey;
+	ffuzzy_search_item item;
+	ffuzzy_search_ctx ctx;
+	*covered = j0;
+	if (j0 >= part->count)
+		return true;
+	ffuzzy_search_buffer *buf = malloc(sizeof(ffuzzy_search_buffer));
+	if (!buf)
+		return false;
+	buf->results = NULL;
+	buf->count = 0;
+	buf->capacity = 0;
+	qkey.block_size = query->block_size;
+	qkey.index = 0;
+	item.part = part;
+	item.ranges[0].begin = 0;
+	item.ranges[0].end = 1;
+	item.nranges = 1;
+	item.first_tile = 0;
+	ctx.queries = query;
+	ctx.qkeys = &qkey;
+	ctx.items = &item;
+	ctx.nitems = 1;
+	ctx.threshold = MAX(threshold, 1);
+	ctx.buffers = buf;
+	ctx.ok = true;
+	for (; ctx.ok && j0 < part->count; j0 += FFUZZY_SEARCH_TILE)
+	{
+		size_t j1 = MIN(j0 + FFUZZY_SEARCH_TILE, part->count);
+		if (next_tile && !next_tile(arg, j0, j1))
+			break;
+		ffuzzy_search_tile_(&ctx, buf, &item, j0, j1);
+		for (size_t i = 0; i < buf->count; i++)
+			if (!ffuzzy_match_list_push_(results, buf->results[i].id, buf->results[i].score))
+				ctx.ok = false;
+		buf->count = 0;
+		if (ctx.ok)
+			*covered = j1;
+	}
+	free(buf->results);
+	free(buf);
+	return ctx.ok;
+}
+
+
+static bool ffuzzy_collection_search_batch_(
+	const ffuzzy_collection *coll,
+	const ffuzzy_digest *queries, size_t nqueries,
+	int threshold, unsigned nthreads,
+	ffuzzy_match_list *results
+)
+{
+	bool ok = false;
+	ffuzzy_search_qkey *qkeys = NULL;
+	ffuzzy_search_item *items = NULL;
+	size_t nitems = 0, ntiles = 0;
+	ffuzzy_search_ctx ctx;
+	ctx.buffers = NULL;
+	for (size_t i = 0; i < nqueries; i++)
+		results[i].count = 0;
+	if (nqueries > ((size_t)-1) / sizeof(ffuzzy_search_qkey))
+		return false;
+	// group queries by block sizes
+	qkeys = malloc(sizeof(ffuzzy_search_qkey) * (nqueries ? nqueries : 1));
+	if (!qkeys)
+		goto cleanup;
+	for (size_t i = 0; i < nqueries; i++)
+	{
+		assert(ffuzzy_digest_is_valid(&queries[i]));
+		qkeys[i].block_size = queries[i].block_size;
+		qkeys[i].index = i;
+	}
+	qsort(qkeys, nqueries, sizeof(ffuzzy_search_qkey), ffuzzy_search_qkey_cmp_);
+	// for each corpus partition, find queries with "near" block sizes
+	items = malloc(sizeof(ffuzzy_search_item) * (coll->nparts ? coll->nparts : 1));
+	if (!items)
+		goto cleanup;
+	for (size_t p = 0; p < coll->nparts; p++)
+	{
+		const ffuzzy_partition *part = coll->parts[p];
+		unsigned long bs = part->block_size;
+		ffuzzy_search_item *item = &items[nitems];
+		item->part = part;
+		item->nranges = 0;
+		if (bs && !(bs & 1ul))
+			item->ranges[item->nranges++] = ffuzzy_search_find_(qkeys, nqueries, bs / 2);
+		item->ranges[item->nranges++] = ffuzzy_search_find_(qkeys, nqueries, bs);
+		if (bs && bs <= (ULONG_MAX / 2))
+			item->ranges[item->nranges++] = ffuzzy_search_find_(qkeys, nqueries, bs * 2);
+		bool needed = false;
+		for (size_t r = 0; r < item->nranges; r++)
+			if (item->ranges[r].begin != item->ranges[r].end)
+				needed = true;
+		if (!needed || !part->count)
+			continue;
+		item->first_tile = ntiles;
+		ntiles += (part->count + FFUZZY_SEARCH_TILE - 1) / FFUZZY_SEARCH_TILE;
+		nitems++;
+	}
+	nthreads = ffuzzy_parallel_nthreads_(nthreads);
+	ctx.buffers = calloc(nthreads, sizeof(ffuzzy_search_buffer));
+	if (!ctx.buffers)
+		goto cleanup;
+	ctx.queries = queries;
+	ctx.qkeys = qkeys;
+	ctx.items = items;
+	ctx.nitems = nitems;
+	ctx.threshold = MAX(threshold, 1);
+	ctx.ok = true;
+	ffuzzy_parallel_for_(ntiles, 1, nthreads, ffuzzy_search_task_, &ctx);
+	ok = ctx.ok;
+	// distribute results to per-query lists
+	for (unsigned w = 0; w < nthreads; w++)
+	{
+		const ffuzzy_search_buffer *buf = &ctx.buffers[w];
+		for (size_t i = 0; i < buf->count; i++)
+			if (!ffuzzy_match_list_push_(&results[buf->results[i].query], buf->results[i].id, buf->results[i].score))
+				ok = false;
+	}
+	for (size_t i = 0; i < nqueries; i++)
+		ffuzzy_match_sort_(results[i].matches, results[i].count);
+cleanup:
+	if (ctx.buffers)
+	{
+		for (unsigned w = 0; w < nthreads; w++)
+			free(ctx.buffers[w].results);
+		free(ctx.buffers);
+	}
+	free(items);
+	free(qkeys);
+	return ok;
+}
+
+bool ffuzzy_collection_search_batch(
+	const ffuzzy_collection *coll,
+	const ffuzzy_digest *queries, size_t nqueries,
+	int threshold, unsigned nthreads,
+	ffuzzy_match_list *results
+)
+{
+	FFUZZY_LATENCY_BEGIN_(FFUZZY_TIMER_SEARCH);
+	bool ok = ffuzzy_collection_search_batch_(coll, queries, nqueries, threshold, nthreads, results);
+	FFUZZY_LATENCY_END_(FFUZZY_TIMER_SEARCH);
+	return ok;
+}
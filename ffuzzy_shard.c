@@ -0,0 +1,281 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_shard.c
+	Partitioning digest collections into shards
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\internal
+	\file  ffuzzy_shard.c
+	\brief Partitioning digest collections into shards
+	\details
+		Block size range partitioning assigns contiguous ranges of block
+		sizes to shards. All digests with the same block size are placed
+		in one shard and a query is only sent to shards which own
+		its near block sizes (at most three, usually one or two).
+		Ranges are balanced by the number of digests of the initial corpus.
+
+		Hash partitioning balances shards regardless of block sizes
+		but every query is sent to all shards.
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_match.h"
+#include "util.h"
+
+
+/**
+	\internal
+	\struct ffuzzy_shard_map
+	\brief  Rule to assign digests to shards
+
+	\internal
+	\var   ffuzzy_shard_map::bounds
+	\brief Smallest block size of shards [1,nshards) (NULL for hash partitioning).
+	\details
+		Bounds are non-decreasing. Shards between equal bounds are empty.
+**/
+struct ffuzzy_shard_map
+{
+	unsigned nshards;
+	unsigned long *bounds;
+};
+
+
+/**
+	\internal
+	\fn     uint_least64_t ffuzzy_shard_hash_(const ffuzzy_digest*)
+	\brief  Hash (FNV-1a) of the digest
+**/
+static inline uint_least64_t ffuzzy_shard_hash_(const ffuzzy_digest *digest)
+{
+	uint_least64_t h = UINT64_C(0xcbf29ce484222325);
+	for (size_t i = 0; i < sizeof(digest->block_size); i++)
+	{
+		h ^= (unsigned char)(digest->block_size >> (i * CHAR_BIT));
+		h *= UINT64_C(0x100000001b3);
+	}
+	// block length is mixed to separate two blocks
+	h ^= (unsigned char)digest->len1;
+	h *= UINT64_C(0x100000001b3);
+	for (size_t i = 0; i < digest->len1 + digest->len2; i++)
+	{
+		h ^= (unsigned char)digest->digest[i];
+		h *= UINT64_C(0x100000001b3);
+	}
+	return h ^ (h >> 32);
+}
+
+
+/**
+	\internal
+	\fn     unsigned ffuzzy_shard_of_blocksize_(const ffuzzy_shard_map*, unsigned long)
+	\brief  Find the shard which owns the block size (range partitioning)
+**/
+static inline unsigned ffuzzy_shard_of_blocksize_(const ffuzzy_shard_map *map, unsigned long block_size)
+{
+	// number of bounds less than or equal to the block size
+	unsigned lo = 0, hi = map->nshards - 1;
+	while (lo < hi)
+	{
+		unsigned mid = lo + (hi - lo) / 2;
+		if (map->bounds[mid] <= block_size)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+
+static int ffuzzy_shard_bs_cmp_(const void *p1, const void *p2)
+{
+	unsigned long b1 = *(const unsigned long*)p1, b2 = *(const unsigned long*)p2;
+	return b1 < b2 ? -1 : b1 > b2 ? +1 : 0;
+}
+
+
+ffuzzy_shard_map *ffuzzy_shard_map_new_range(const ffuzzy_digest *digests, size_t n, unsigned nshards)
+{
+	if (!nshards)
+		return NULL;
+	ffuzzy_shard_map *map = malloc(sizeof(ffuzzy_shard_map));
+	if (!map)
+		return NULL;
+	map->nshards = nshards;
+	map->bounds = malloc(sizeof(unsigned long) * (nshards > 1 ? nshards - 1 : 1));
+	unsigned long *bs = n ? malloc(sizeof(unsigned long) * n) : NULL;
+	if (!map->bounds || (n && !bs))
+	{
+		free(bs);
+		free(map->bounds);
+		free(map);
+		return NULL;
+	}
+	if (!n)
+	{
+		// no corpus: spread natural block sizes evenly
+		for (unsigned s = 1; s < nshards; s++)
+			map->bounds[s-1] = FFUZZY_MIN_BLOCKSIZE << ((unsigned long long)s * FFUZZY_NUM_BLOCKHASHES / nshards);
+		return map;
+	}
+	for (size_t i = 0; i < n; i++)
+		bs[i] = digests[i].block_size;
+	qsort(bs, n, sizeof(unsigned long), ffuzzy_shard_bs_cmp_);
+	for (unsigned s = 1; s < nshards; s++)
+	{
+		/*
+			Cut at the quantile but never inside a run of the same block size.
+			Take the run boundary (before or after the run) closest to the quantile.
+		*/
+		size_t t = (size_t)((unsigned long long)n * s / nshards);
+		size_t before = t, after = t;
+		while (before && bs[before-1] == bs[t])
+			before--;
+		while (after < n && bs[after] == bs[t])
+			after++;
+		unsigned long bound;
+		if (t - before <= after - t || after == n)
+			bound = bs[before];
+		else
+			bound = bs[after];
+		if (s > 1 && bound < map->bounds[s-2])
+			bound = map->bounds[s-2];
+		map->bounds[s-1] = bound;
+	}
+	free(bs);
+	return map;
+}
+
+
+ffuzzy_shard_map *ffuzzy_shard_map_new_hash(unsigned nshards)
+{
+	if (!nshards)
+		return NULL;
+	ffuzzy_shard_map *map = malloc(sizeof(ffuzzy_shard_map));
+	if (!map)
+		return NULL;
+	map->nshards = nshards;
+	map->bounds = NULL;
+	return map;
+}
+
+
+void ffuzzy_shard_map_free(ffuzzy_shard_map *map)
+{
+	if (!map)
+		return;
+	free(map->bounds);
+	free(map);
+}
+
+
+unsigned ffuzzy_shard_map_count(const ffuzzy_shard_map *map)
+{
+	return map->nshards;
+}
+
+
+unsigned ffuzzy_shard_map_owner(const ffuzzy_shard_map *map, const ffuzzy_digest *digest)
+{
+	assert(ffuzzy_digest_is_valid(digest));
+	if (!map->bounds)
+		return (unsigned)(ffuzzy_shard_hash_(digest) % map->nshards);
+	return ffuzzy_shard_of_blocksize_(map, digest->block_size);
+}
+
+
+unsigned ffuzzy_shard_map_targets(const ffuzzy_shard_map *map, const ffuzzy_digest *query, unsigned *shards)
+{
+	assert(ffuzzy_digest_is_valid(query));
+	if (!map->bounds)
+	{
+		for (unsigned s = 0; s < map->nshards; s++)
+			shards[s] = s;
+		return map->nshards;
+	}
+	// owners of near block sizes (in ascending order; shards own ascending ranges)
+	unsigned long bs = query->block_size;
+	unsigned n = 0;
+	if (bs && !(bs & 1ul))
+		shards[n++] = ffuzzy_shard_of_blocksize_(map, bs / 2);
+	unsigned s = ffuzzy_shard_of_blocksize_(map, bs);
+	if (!n || shards[n-1] != s)
+		shards[n++] = s;
+	if (bs && bs <= ULONG_MAX / 2)
+	{
+		s = ffuzzy_shard_of_blocksize_(map, bs * 2);
+		if (shards[n-1] != s)
+			shards[n++] = s;
+	}
+	return n;
+}
+
+
+bool ffuzzy_match_list_merge(
+	ffuzzy_match_list *results,
+	const ffuzzy_match_list *lists, size_t nlists,
+	size_t limit
+)
+{
+	size_t total = 0;
+	for (size_t i = 0; i < nlists; i++)
+		total += lists[i].count;
+	if (limit && total > limit)
+		total = limit;
+	results->count = 0;
+	if (!util_grow_array((void**)&results->matches, &results->capacity, total, sizeof(ffuzzy_match)))
+		return false;
+	size_t *pos = calloc(nlists ? nlists : 1, sizeof(size_t));
+	if (!pos)
+		return false;
+	// lists are short in number; select the best head linearly
+	while (results->count < total)
+	{
+		const ffuzzy_match *best = NULL;
+		size_t bi = 0;
+		for (size_t i = 0; i < nlists; i++)
+		{
+			if (pos[i] == lists[i].count)
+				continue;
+			const ffuzzy_match *m = &lists[i].matches[pos[i]];
+			if (!best || ffuzzy_match_worse_(best, m))
+			{
+				best = m;
+				bi = i;
+			}
+		}
+		results->matches[results->count++] = *best;
+		pos[bi]++;
+	}
+	free(pos);
+	return true;
+}
@@ -0,0 +1,369 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_stats.c
+	Comparison statistics (per-thread counters and latency histograms)
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\internal
+	\file  ffuzzy_stats.c
+	\brief Comparison statistics (per-thread counters and latency histograms)
+**/
+
+#include "ffuzzy_config.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef FFUZZY_ENABLE_THREADS
+#include <pthread.h>
+#endif
+
+#include "ffuzzy.h"
+#include "ffuzzy_atomic.h"
+#include "ffuzzy_stats.h"
+
+
+#ifdef FFUZZY_ENABLE_STATS
+
+bool ffuzzy_stats_enabled_ = false;
+bool ffuzzy_latency_enabled_ = false;
+unsigned ffuzzy_latency_periods_[FFUZZY_TIMER_NUM_TIMERS] =
+{
+	[FFUZZY_TIMER_READ_DIGEST] = 16,
+	[FFUZZY_TIMER_COMPARE]     = 16,
+	[FFUZZY_TIMER_SEARCH]      = 1,
+	[FFUZZY_TIMER_TOPK]        = 1,
+	[FFUZZY_TIMER_JOIN]        = 1,
+};
+__thread ffuzzy_stats_thread *ffuzzy_stats_current_ = NULL;
+
+/** \internal \brief All counter records (new records are pushed to the head) **/
+static ffuzzy_stats_thread *ffuzzy_stats_threads_ = NULL;
+
+#ifdef FFUZZY_ENABLE_THREADS
+
+static pthread_mutex_t ffuzzy_stats_mutex_ = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t ffuzzy_stats_once_ = PTHREAD_ONCE_INIT;
+static pthread_key_t ffuzzy_stats_key_;
+static bool ffuzzy_stats_key_ok_ = false;
+
+/** \internal \brief Release the record of an exiting thread **/
+static void ffuzzy_stats_release_(void *arg)
+{
+	ffuzzy_stats_thread *t = arg;
+	pthread_mutex_lock(&ffuzzy_stats_mutex_);
+	t->in_use = false;
+	pthread_mutex_unlock(&ffuzzy_stats_mutex_);
+}
+
+static void ffuzzy_stats_init_key_(void)
+{
+	ffuzzy_stats_key_ok_ = !pthread_key_create(&ffuzzy_stats_key_, ffuzzy_stats_release_);
+}
+
+#define FFUZZY_STATS_LOCK_()   pthread_mutex_lock(&ffuzzy_stats_mutex_)
+#define FFUZZY_STATS_UNLOCK_() pthread_mutex_unlock(&ffuzzy_stats_mutex_)
+
+#else
+
+#define FFUZZY_STATS_LOCK_()   ((void)0)
+#define FFUZZY_STATS_UNLOCK_() ((void)0)
+
+#endif
+
+
+ffuzzy_stats_thread *ffuzzy_stats_attach_(void)
+{
+	ffuzzy_stats_thread *t;
+#ifdef FFUZZY_ENABLE_THREADS
+	pthread_once(&ffuzzy_stats_once_, ffuzzy_stats_init_key_);
+#endif
+	FFUZZY_STATS_LOCK_();
+	for (t = ffuzzy_stats_threads_; t; t = t->next)
+		if (!t->in_use)
+			break;
+	if (!t)
+	{
+		t = calloc(1, sizeof(ffuzzy_stats_thread));
+		if (!t)
+		{
+			FFUZZY_STATS_UNLOCK_();
+			return NULL;
+		}
+		t->next = ffuzzy_stats_threads_;
+		ffuzzy_stats_threads_ = t;
+	}
+	t->in_use = true;
+	FFUZZY_STATS_UNLOCK_();
+#ifdef FFUZZY_ENABLE_THREADS
+	// without the key, the record is kept by the exiting thread (and leaked)
+	if (ffuzzy_stats_key_ok_)
+		pthread_setspecific(ffuzzy_stats_key_, t);
+#endif
+	ffuzzy_stats_current_ = t;
+	return t;
+}
+
+#endif
+
+
+bool ffuzzy_stats_available(void)
+{
+#ifdef FFUZZY_ENABLE_STATS
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+void ffuzzy_stats_enable(bool enable)
+{
+#ifdef FFUZZY_ENABLE_STATS
+	ffuzzy_atomic_store_relaxed_(&ffuzzy_stats_enabled_, enable);
+#else
+	(void)enable;
+#endif
+}
+
+
+void ffuzzy_stats_get(ffuzzy_stats *stats)
+{
+	for (int c = 0; c < FFUZZY_STAT_NUM_COUNTERS; c++)
+		stats->counters[c] = 0;
+#ifdef FFUZZY_ENABLE_STATS
+	FFUZZY_STATS_LOCK_();
+	for (const ffuzzy_stats_thread *t = ffuzzy_stats_threads_; t; t = t->next)
+		for (int c = 0; c < FFUZZY_STAT_NUM_COUNTERS; c++)
+			stats->counters[c] += ffuzzy_atomic_load_relaxed_(&t->counters[c]) - t->base[c];
+	FFUZZY_STATS_UNLOCK_();
+#endif
+}
+
+
+void ffuzzy_stats_reset(void)
+{
+#ifdef FFUZZY_ENABLE_STATS
+	// counters are owned by threads; only move the base
+	FFUZZY_STATS_LOCK_();
+	for (ffuzzy_stats_thread *t = ffuzzy_stats_threads_; t; t = t->next)
+		for (int c = 0; c < FFUZZY_STAT_NUM_COUNTERS; c++)
+			t->base[c] = ffuzzy_atomic_load_relaxed_(&t->counters[c]);
+	FFUZZY_STATS_UNLOCK_();
+#endif
+}
+
+
+const char *ffuzzy_stat_name(ffuzzy_stat_counter counter)
+{
+	switch (counter)
+	{
+		case FFUZZY_STAT_BLOCKSIZE_REJECTS: return "blocksize_rejects";
+		case FFUZZY_STAT_NEAR_COMPARISONS:  return "near_comparisons";
+		case FFUZZY_STAT_IDENTICAL:         return "identical";
+		case FFUZZY_STAT_LENGTH_REJECTS:    return "length_rejects";
+		case FFUZZY_STAT_SUBSTRING_REJECTS: return "substring_rejects";
+		case FFUZZY_STAT_EDIT_DISTANCES:    return "edit_distances";
+		case FFUZZY_STAT_BOUND_SKIPS:       return "bound_skips";
+		case FFUZZY_STAT_NUM_COUNTERS:      break;
+	}
+	return NULL;
+}
+
+
+void ffuzzy_latency_enable(bool enable)
+{
+#ifdef FFUZZY_ENABLE_STATS
+	ffuzzy_atomic_store_relaxed_(&ffuzzy_latency_enabled_, enable);
+#else
+	(void)enable;
+#endif
+}
+
+
+bool ffuzzy_latency_set_sampling(ffuzzy_timer timer, unsigned period)
+{
+	if ((unsigned)timer >= FFUZZY_TIMER_NUM_TIMERS || !period)
+		return false;
+#ifdef FFUZZY_ENABLE_STATS
+	ffuzzy_atomic_store_relaxed_(&ffuzzy_latency_periods_[timer], period);
+#endif
+	return true;
+}
+
+
+void ffuzzy_latency_snapshot(ffuzzy_timer timer, ffuzzy_latency_histogram *hist)
+{
+	for (size_t i = 0; i < FFUZZY_LATENCY_BUCKETS; i++)
+		hist->counts[i] = 0;
+	hist->total = hist->sum_nsec = 0;
+#ifdef FFUZZY_ENABLE_STATS
+	if ((unsigned)timer >= FFUZZY_TIMER_NUM_TIMERS)
+		return;
+	FFUZZY_STATS_LOCK_();
+	for (const ffuzzy_stats_thread *t = ffuzzy_stats_threads_; t; t = t->next)
+	{
+		const ffuzzy_latency_histogram *h = &t->latency[timer], *b = &t->latency_base[timer];
+		for (size_t i = 0; i < FFUZZY_LATENCY_BUCKETS; i++)
+			hist->counts[i] += ffuzzy_atomic_load_relaxed_(&h->counts[i]) - b->counts[i];
+		hist->sum_nsec += ffuzzy_atomic_load_relaxed_(&h->sum_nsec) - b->sum_nsec;
+	}
+	FFUZZY_STATS_UNLOCK_();
+	// recount so that the total is consistent with buckets
+	for (size_t i = 0; i < FFUZZY_LATENCY_BUCKETS; i++)
+		hist->total += hist->counts[i];
+#else
+	(void)timer;
+#endif
+}
+
+
+void ffuzzy_latency_reset(void)
+{
+#ifdef FFUZZY_ENABLE_STATS
+	FFUZZY_STATS_LOCK_();
+	for (ffuzzy_stats_thread *t = ffuzzy_stats_threads_; t; t = t->next)
+	{
+		for (int c = 0; c < FFUZZY_TIMER_NUM_TIMERS; c++)
+		{
+			const ffuzzy_latency_histogram *h = &t->latency[c];
+			ffuzzy_latency_histogram *b = &t->latency_base[c];
+			for (size_t i = 0; i < FFUZZY_LATENCY_BUCKETS; i++)
+				b->counts[i] = ffuzzy_atomic_load_relaxed_(&h->counts[i]);
+			b->sum_nsec = ffuzzy_atomic_load_relaxed_(&h->sum_nsec);
+			b->total = ffuzzy_atomic_load_relaxed_(&h->total);
+		}
+	}
+	FFUZZY_STATS_UNLOCK_();
+#endif
+}
+
+
+void ffuzzy_latency_merge(ffuzzy_latency_histogram *dst, const ffuzzy_latency_histogram *src)
+{
+	for (size_t i = 0; i < FFUZZY_LATENCY_BUCKETS; i++)
+		dst->counts[i] += src->counts[i];
+	dst->total += src->total;
+	dst->sum_nsec += src->sum_nsec;
+}
+
+
+unsigned long long ffuzzy_latency_bucket_lower(size_t i)
+{
+	const size_t sub = (size_t)1 << FFUZZY_LATENCY_SUB_BITS;
+	if (i < sub)
+		return i;
+	int e = (int)(i >> FFUZZY_LATENCY_SUB_BITS) + FFUZZY_LATENCY_SUB_BITS - 1;
+	return (unsigned long long)(sub + (i & (sub - 1))) << (e - FFUZZY_LATENCY_SUB_BITS);
+}
+
+
+unsigned long long ffuzzy_latency_percentile(const ffuzzy_latency_histogram *hist, double p)
+{
+	if (!hist->total)
+		return 0;
+	if (p < 0)
+		p = 0;
+	if (p > 100)
+		p = 100;
+	// rank of the sample (1-origin)
+	unsigned long long rank = (unsigned long long)(p / 100 * (double)hist->total + 0.5);
+	if (rank < 1)
+		rank = 1;
+	unsigned long long seen = 0;
+	size_t i;
+	for (i = 0; i < FFUZZY_LATENCY_BUCKETS - 1; i++)
+	{
+		seen += hist->counts[i];
+		if (seen >= rank)
+			break;
+	}
+	return ffuzzy_latency_bucket_lower(i + 1);
+}
+
+
+const char *ffuzzy_timer_name(ffuzzy_timer timer)
+{
+	switch (timer)
+	{
+		case FFUZZY_TIMER_READ_DIGEST: return "read_digest";
+		case FFUZZY_TIMER_COMPARE:     return "compare";
+		case FFUZZY_TIMER_SEARCH:      return "search";
+		case FFUZZY_TIMER_TOPK:        return "topk";
+		case FFUZZY_TIMER_JOIN:        return "join";
+		case FFUZZY_TIMER_NUM_TIMERS:  break;
+	}
+	return NULL;
+}
+
+
+/** \internal \brief Percentiles written by ffuzzy_latency_export **/
+static const double ffuzzy_latency_export_p_[] = { 50, 90, 99, 99.9 };
+#define FFUZZY_LATENCY_EXPORT_P_NUM_ (sizeof(ffuzzy_latency_export_p_) / sizeof(ffuzzy_latency_export_p_[0]))
+
+bool ffuzzy_latency_export(FILE *fp, ffuzzy_latency_format format)
+{
+	ffuzzy_latency_histogram *hist = malloc(sizeof(ffuzzy_latency_histogram));
+	if (!hist)
+		return false;
+	if (format == FFUZZY_LATENCY_JSON)
+		fputs("{", fp);
+	for (int c = 0; c < FFUZZY_TIMER_NUM_TIMERS; c++)
+	{
+		ffuzzy_latency_snapshot(c, hist);
+		double mean = hist->total ? (double)hist->sum_nsec / (double)hist->total : 0;
+		if (format == FFUZZY_LATENCY_JSON)
+		{
+			fprintf(fp, "%s\"%s\":{\"count\":%llu,\"sum_ns\":%llu,\"mean_ns\":%.1f",
+				c ? "," : "", ffuzzy_timer_name(c), hist->total, hist->sum_nsec, mean);
+			for (size_t k = 0; k < FFUZZY_LATENCY_EXPORT_P_NUM_; k++)
+				fprintf(fp, ",\"p%g_ns\":%llu", ffuzzy_latency_export_p_[k],
+					ffuzzy_latency_percentile(hist, ffuzzy_latency_export_p_[k]));
+			// non-empty buckets as [lower bound, count]
+			fputs(",\"buckets\":[", fp);
+			bool first = true;
+			for (size_t i = 0; i < FFUZZY_LATENCY_BUCKETS; i++)
+			{
+				if (!hist->counts[i])
+					continue;
+				fprintf(fp, "%s[%llu,%llu]", first ? "" : ",",
+					ffuzzy_latency_bucket_lower(i), hist->counts[i]);
+				first = false;
+			}
+			fputs("]}", fp);
+		}
+		else
+		{
+			fprintf(fp, "%-12s count=%llu mean_ns=%.1f", ffuzzy_timer_name(c), hist->total, mean);
+			for (size_t k = 0; k < FFUZZY_LATENCY_EXPORT_P_NUM_; k++)
+				fprintf(fp, " p%g_ns=%llu", ffuzzy_latency_export_p_[k],
+					ffuzzy_latency_percentile(hist, ffuzzy_latency_export_p_[k]));
+			fputc('\n', fp);
+		}
+	}
+	if (format == FFUZZY_LATENCY_JSON)
+		fputs("}\n", fp);
+	free(hist);
+	return !ferror(fp);
+}
@@ -0,0 +1,193 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_stats.h
+	Comparison statistics (per-thread counters)
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef FFUZZY_FFUZZY_STATS_H
+#define FFUZZY_FFUZZY_STATS_H
+
+/**
+	\internal
+	\file  ffuzzy_stats.h
+	\brief Comparison statistics (per-thread counters)
+	\details
+		Unless configured with --enable-stats, FFUZZY_STATS_COUNT_ and
+		FFUZZY_STATS_ADD_ expand to nothing. Otherwise, they cost
+		one relaxed load and a branch while statistics are disabled
+		at run time. Each thread increments its own counters
+		(without atomic read-modify-write operations) and
+		ffuzzy_stats_get sums counters of all threads.
+
+		Latency histograms (FFUZZY_LATENCY_BEGIN_ and FFUZZY_LATENCY_END_)
+		are kept in the same per-thread records.
+**/
+
+#include "ffuzzy_config.h"
+
+#include <stdbool.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_atomic.h"
+#include "util.h"
+
+#ifdef FFUZZY_ENABLE_STATS
+
+/**
+	\internal
+	\struct ffuzzy_stats_thread
+	\brief  Counters of one thread
+	\details
+		Records are never freed. When a thread exits, its record is
+		released (keeping counters) and reused by a new thread.
+	\internal
+	\var   ffuzzy_stats_thread::counters
+	\brief Counters (written only by the owner thread).
+	\internal
+	\var   ffuzzy_stats_thread::base
+	\brief Counters at the last reset.
+	\internal
+	\var   ffuzzy_stats_thread::latency
+	\brief Latency histograms (written only by the owner thread).
+	\internal
+	\var   ffuzzy_stats_thread::latency_base
+	\brief Latency histograms at the last reset.
+	\internal
+	\var   ffuzzy_stats_thread::ticks
+	\brief Number of calls to each entry point (for sampling).
+**/
+typedef struct ffuzzy_stats_thread
+{
+	unsigned long long counters[FFUZZY_STAT_NUM_COUNTERS];
+	unsigned long long base[FFUZZY_STAT_NUM_COUNTERS];
+	ffuzzy_latency_histogram latency[FFUZZY_TIMER_NUM_TIMERS];
+	ffuzzy_latency_histogram latency_base[FFUZZY_TIMER_NUM_TIMERS];
+	unsigned ticks[FFUZZY_TIMER_NUM_TIMERS];
+	struct ffuzzy_stats_thread *next;
+	bool in_use;
+} ffuzzy_stats_thread;
+
+/** \internal \brief Whether statistics are collected **/
+extern bool ffuzzy_stats_enabled_;
+/** \internal \brief Whether latencies are measured **/
+extern bool ffuzzy_latency_enabled_;
+/** \internal \brief Sampling period of each timer **/
+extern unsigned ffuzzy_latency_periods_[FFUZZY_TIMER_NUM_TIMERS];
+/** \internal \brief Counters of the current thread (NULL until the first event) **/
+extern __thread ffuzzy_stats_thread *ffuzzy_stats_current_;
+
+/**
+	\internal
+	\fn     ffuzzy_stats_thread* ffuzzy_stats_attach_(void)
+	\brief  Assign a counter record to the current thread
+	\return The record if succeeds; NULL otherwise.
+**/
+ffuzzy_stats_thread *ffuzzy_stats_attach_(void);
+
+/**
+	\internal
+	\fn     void ffuzzy_stats_add_(ffuzzy_stat_counter, unsigned long long)
+	\brief  Add a value to the counter of the current thread (if enabled)
+**/
+static inline void ffuzzy_stats_add_(ffuzzy_stat_counter counter, unsigned long long n)
+{
+	if (!ffuzzy_atomic_load_relaxed_(&ffuzzy_stats_enabled_))
+		return;
+	ffuzzy_stats_thread *t = ffuzzy_stats_current_;
+	if (!t && !(t = ffuzzy_stats_attach_()))
+		return;
+	ffuzzy_atomic_store_relaxed_(&t->counters[counter], t->counters[counter] + n);
+}
+
+/** \internal \brief Count an event **/
+#define FFUZZY_STATS_COUNT_(counter)  ffuzzy_stats_add_((counter), 1)
+/** \internal \brief Count n events **/
+#define FFUZZY_STATS_ADD_(counter, n) ffuzzy_stats_add_((counter), (n))
+
+/**
+	\internal
+	\fn     size_t ffuzzy_latency_bucket_(unsigned long long)
+	\brief  Retrieve the histogram bucket for a latency
+**/
+static inline size_t ffuzzy_latency_bucket_(unsigned long long nsec)
+{
+	if (nsec < (1u << FFUZZY_LATENCY_SUB_BITS))
+		return (size_t)nsec;
+	int e = util_log2_64(nsec);
+	size_t i = ((size_t)(e - FFUZZY_LATENCY_SUB_BITS + 1) << FFUZZY_LATENCY_SUB_BITS)
+		+ (size_t)((nsec >> (e - FFUZZY_LATENCY_SUB_BITS)) & ((1u << FFUZZY_LATENCY_SUB_BITS) - 1));
+	return MIN(i, (size_t)FFUZZY_LATENCY_BUCKETS - 1);
+}
+
+/**
+	\internal
+	\fn     unsigned long long ffuzzy_latency_begin_(ffuzzy_timer)
+	\brief  Start measuring a call (if enabled and sampled)
+	\return Start time or 0 if this call is not measured.
+**/
+static inline unsigned long long ffuzzy_latency_begin_(ffuzzy_timer timer)
+{
+	if (!ffuzzy_atomic_load_relaxed_(&ffuzzy_latency_enabled_))
+		return 0;
+	ffuzzy_stats_thread *t = ffuzzy_stats_current_;
+	if (!t && !(t = ffuzzy_stats_attach_()))
+		return 0;
+	if (t->ticks[timer]++ % ffuzzy_atomic_load_relaxed_(&ffuzzy_latency_periods_[timer]))
+		return 0;
+	unsigned long long start = util_now_nsec();
+	return start ? start : 1;
+}
+
+/**
+	\internal
+	\fn     void ffuzzy_latency_end_(ffuzzy_timer, unsigned long long)
+	\brief  Record the latency of a call started by ffuzzy_latency_begin_
+**/
+static inline void ffuzzy_latency_end_(ffuzzy_timer timer, unsigned long long start)
+{
+	if (!start)
+		return;
+	unsigned long long nsec = util_now_nsec() - start;
+	ffuzzy_latency_histogram *h = &ffuzzy_stats_current_->latency[timer];
+	size_t i = ffuzzy_latency_bucket_(nsec);
+	ffuzzy_atomic_store_relaxed_(&h->counts[i], h->counts[i] + 1);
+	ffuzzy_atomic_store_relaxed_(&h->sum_nsec, h->sum_nsec + nsec);
+	ffuzzy_atomic_store_relaxed_(&h->total, h->total + 1);
+}
+
+/** \internal \brief Start measuring the current call (declares a variable) **/
+#define FFUZZY_LATENCY_BEGIN_(timer) \
+	unsigned long long ffuzzy_latency_start_ = ffuzzy_latency_begin_(timer)
+/** \internal \brief Finish measuring the current call **/
+#define FFUZZY_LATENCY_END_(timer) \
+	ffuzzy_latency_end_((timer), ffuzzy_latency_start_)
+
+#else
+
+#define FFUZZY_STATS_COUNT_(counter)  ((void)0)
+#define FFUZZY_STATS_ADD_(counter, n) ((void)0)
+#define FFUZZY_LATENCY_BEGIN_(timer)  ((void)0)
+#define FFUZZY_LATENCY_END_(timer)    ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,1007 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_store.c
+	Persistent incremental digest store
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\internal
+	\file  ffuzzy_store.c
+	\brief Persistent incremental digest store
+	\details
+		A store is a directory which contains:
+
+		- MANIFEST : the list of live files (with CRC-32)
+		- base-GEN.db : the base segment (binary digest records sorted by block sizes)
+		- delta-GEN.log : delta segments (binary digest records followed by CRC-32)
+
+		The manifest is replaced atomically (write, fsync, rename and
+		fsync of the directory) and it is the commit point of
+		all structural changes. Files are made durable before the manifest
+		refers to them and they are removed only after the manifest stops
+		referring to them. Files which are not referred from the manifest
+		(left by interrupted compaction) are removed on opening.
+		A torn tail of a delta segment (a short entry or a CRC mismatch)
+		is truncated on opening.
+
+		Because entries after a torn one are lost on opening, the last
+		delta segment is repaired after a failed write (truncated back to
+		the last flushed entry and rewritten from memory) before
+		any other entry is appended.
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_atomic.h"
+#include "ffuzzy_blocksize.h"
+#include "ffuzzy_compare.h"
+#include "ffuzzy_match.h"
+#include "ffuzzy_parallel.h"
+#include "ffuzzy_record.h"
+#include "util.h"
+
+/** \internal \brief Size of a delta segment entry (a record and its CRC-32) **/
+#define FFUZZY_STORE_ENTRY_SIZE (FFUZZY_RECORD_SIZE + 4)
+/** \internal \brief Maximum length of file names in the store directory **/
+#define FFUZZY_STORE_NAME_MAX 64
+/** \internal \brief Maximum number of delta segments in the manifest **/
+#define FFUZZY_STORE_DELTA_MAX 64
+
+
+/**
+	\internal
+	\struct ffuzzy_store_manifest
+	\brief  Contents of the manifest
+**/
+typedef struct
+{
+	unsigned long long base;
+	unsigned long long next_id;
+	unsigned long long deltas[FFUZZY_STORE_DELTA_MAX];
+	size_t ndeltas;
+} ffuzzy_store_manifest;
+
+
+/**
+	\internal
+	\struct ffuzzy_store_entry
+	\brief  Digest in delta segments
+**/
+typedef struct
+{
+	size_t id;
+	ffuzzy_digest digest;
+} ffuzzy_store_entry;
+
+
+/**
+	\internal
+	\struct ffuzzy_store_deltas
+	\brief  Array of delta entries shared with searches
+	\details
+		Entries in the array are never modified once they are appended.
+		Searches take a reference and scan a prefix of the array
+		without the store lock. The store replaces the array
+		(instead of modifying it) when it grows or drops merged entries.
+
+	\internal
+	\var   ffuzzy_store_deltas::refs
+	\brief Number of references (the store holds one to the current array).
+**/
+typedef struct
+{
+	unsigned long refs;
+	size_t capacity;
+	ffuzzy_store_entry *entries;
+} ffuzzy_store_deltas;
+
+
+/**
+	\internal
+	\struct ffuzzy_store
+	\brief  Persistent incremental digest store
+
+	\internal
+	\var   ffuzzy_store::lock
+	\brief Protects all members except the base database (which has its own snapshots).
+	\internal
+	\var   ffuzzy_store::compact_lock
+	\brief Serializes compactions.
+	\internal
+	\var   ffuzzy_store::deltas
+	\brief Digests in live delta segments (first nentries entries in append order).
+	\internal
+	\var   ffuzzy_store::log
+	\brief The last delta segment (opened for appending; NULL if its repair failed).
+	\internal
+	\var   ffuzzy_store::log_flushed
+	\brief Size of the last delta segment known to be written.
+	\internal
+	\var   ffuzzy_store::nflushed
+	\brief Number of delta entries written before ffuzzy_store::log_flushed.
+	\internal
+	\var   ffuzzy_store::log_broken
+	\brief true if a write to the last delta segment failed.
+**/
+struct ffuzzy_store
+{
+	char *dir;
+	ffuzzy_mutex lock;
+	ffuzzy_mutex compact_lock;
+	ffuzzy_db *base;
+	ffuzzy_store_manifest manifest;
+	unsigned long long next_gen;
+	ffuzzy_store_deltas *deltas;
+	size_t nentries;
+	FILE *log;
+	off_t log_flushed;
+	size_t nflushed;
+	bool log_broken;
+};
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_store_path_(char**, const ffuzzy_store*, const char*)
+	\brief  Make the path of a file in the store (to be freed by the caller)
+**/
+static bool ffuzzy_store_path_(char **path, const ffuzzy_store *store, const char *name)
+{
+	size_t len = strlen(store->dir) + 1 + strlen(name) + 1;
+	*path = malloc(len);
+	if (!*path)
+		return false;
+	snprintf(*path, len, "%s/%s", store->dir, name);
+	return true;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_store_gen_path_(char**, const ffuzzy_store*, const char*, unsigned long long)
+	\brief  Make the path of a generation file in the store (format takes the generation)
+**/
+static bool ffuzzy_store_gen_path_(char **path, const ffuzzy_store *store, const char *format, unsigned long long gen)
+{
+	char name[FFUZZY_STORE_NAME_MAX];
+	snprintf(name, sizeof(name), format, gen);
+	return ffuzzy_store_path_(path, store, name);
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_store_fsync_(int)
+	\brief  Flush the file descriptor to the storage
+**/
+static bool ffuzzy_store_fsync_(int fd)
+{
+#ifdef HAVE_FSYNC
+	return !fsync(fd);
+#else
+	(void)fd;
+	return true;
+#endif
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_store_sync_dir_(const ffuzzy_store*)
+	\brief  Make directory entries (creation, rename and removal) durable
+**/
+static bool ffuzzy_store_sync_dir_(const ffuzzy_store *store)
+{
+	int fd = open(store->dir, O_RDONLY);
+	if (fd < 0)
+		return false;
+	bool ok = ffuzzy_store_fsync_(fd);
+	close(fd);
+	return ok;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_store_close_file_(FILE*)
+	\brief  Flush, fsync and close the file
+**/
+static bool ffuzzy_store_close_file_(FILE *fp)
+{
+	bool ok = !fflush(fp) && ffuzzy_store_fsync_(fileno(fp));
+	return !fclose(fp) && ok;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_store_write_manifest_(ffuzzy_store*, const ffuzzy_store_manifest*)
+	\brief  Replace the manifest atomically
+	\return true if succeeds; false otherwise (the old manifest is kept).
+**/
+static bool ffuzzy_store_write_manifest_(ffuzzy_store *store, const ffuzzy_store_manifest *m)
+{
+	char buf[64 * (FFUZZY_STORE_DELTA_MAX + 4)];
+	int n = snprintf(buf, sizeof(buf), "ffuzzy-store 1\nbase %llu\nnext %llu\n", m->base, m->next_id);
+	for (size_t i = 0; i < m->ndeltas; i++)
+		n += snprintf(buf + n, sizeof(buf) - (size_t)n, "delta %llu\n", m->deltas[i]);
+	n += snprintf(buf + n, sizeof(buf) - (size_t)n, "crc %08lx\n", (unsigned long)util_crc32(0, buf, (size_t)n));
+	char *tmp, *path;
+	if (!ffuzzy_store_path_(&tmp, store, "MANIFEST.tmp"))
+		return false;
+	if (!ffuzzy_store_path_(&path, store, "MANIFEST"))
+	{
+		free(tmp);
+		return false;
+	}
+	bool ok = false;
+	FILE *fp = fopen(tmp, "wb");
+	if (fp)
+	{
+		ok = fwrite(buf, (size_t)n, 1, fp) == 1;
+		ok = ffuzzy_store_close_file_(fp) && ok;
+		ok = ok && !rename(tmp, path) && ffuzzy_store_sync_dir_(store);
+	}
+	free(path);
+	free(tmp);
+	return ok;
+}
+
+
+/**
+	\internal
+	\fn     int ffuzzy_store_read_manifest_(ffuzzy_store*, ffuzzy_store_manifest*)
+	\brief  Read and verify the manifest
+	\return 1 if succeeds, 0 if the manifest does not exist and -1 on failure.
+**/
+static int ffuzzy_store_read_manifest_(ffuzzy_store *store, ffuzzy_store_manifest *m)
+{
+	char *path;
+	if (!ffuzzy_store_path_(&path, store, "MANIFEST"))
+		return -1;
+	FILE *fp = fopen(path, "rb");
+	free(path);
+	if (!fp)
+		return errno == ENOENT ? 0 : -1;
+	char buf[64 * (FFUZZY_STORE_DELTA_MAX + 4)];
+	size_t len = fread(buf, 1, sizeof(buf) - 1, fp);
+	fclose(fp);
+	buf[len] = '\0';
+	memset(m, 0, sizeof(ffuzzy_store_manifest));
+	char *line = buf, *end;
+	if (strncmp(line, "ffuzzy-store 1\n", 15))
+		return -1;
+	for (line += 15; *line; line = end + 1)
+	{
+		end = strchr(line, '\n');
+		if (!end)
+			return -1;
+		unsigned long long value;
+		unsigned long crc;
+		if (sscanf(line, "base %llu", &value) == 1)
+			m->base = value;
+		else if (sscanf(line, "next %llu", &value) == 1)
+			m->next_id = value;
+		else if (sscanf(line, "delta %llu", &value) == 1)
+		{
+			if (m->ndeltas == FFUZZY_STORE_DELTA_MAX)
+				return -1;
+			m->deltas[m->ndeltas++] = value;
+		}
+		else if (sscanf(line, "crc %lx", &crc) == 1)
+			return crc == util_crc32(0, buf, (size_t)(line - buf)) && m->base ? 1 : -1;
+		else
+			return -1;
+	}
+	return -1;
+}
+
+
+/**
+	\internal
+	\fn     void ffuzzy_store_deltas_release_(ffuzzy_store_deltas*)
+	\brief  Release a reference to the delta array (may be NULL)
+**/
+static void ffuzzy_store_deltas_release_(ffuzzy_store_deltas *deltas)
+{
+	if (deltas && ffuzzy_atomic_fetch_sub_(&deltas->refs, 1ul) == 1)
+	{
+		free(deltas->entries);
+		free(deltas);
+	}
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_store_replace_deltas_(ffuzzy_store*, size_t, size_t)
+	\brief  Replace the delta array with a copy of entries [first,nentries)
+	\details
+		The store lock must be held.
+		The new array has room for at least capacity entries.
+**/
+static bool ffuzzy_store_replace_deltas_(ffuzzy_store *store, size_t first, size_t capacity)
+{
+	size_t n = store->nentries - first;
+	capacity = MAX(MAX(capacity, n), 64);
+	ffuzzy_store_deltas *deltas = malloc(sizeof(ffuzzy_store_deltas));
+	if (!deltas)
+		return false;
+	deltas->entries = malloc(sizeof(ffuzzy_store_entry) * capacity);
+	if (!deltas->entries)
+	{
+		free(deltas);
+		return false;
+	}
+	deltas->refs = 1;
+	deltas->capacity = capacity;
+	if (n)
+		memcpy(deltas->entries, store->deltas->entries + first, sizeof(ffuzzy_store_entry) * n);
+	ffuzzy_store_deltas_release_(store->deltas);
+	store->deltas = deltas;
+	store->nentries = n;
+	return true;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_store_reserve_(ffuzzy_store*)
+	\brief  Make room for one more delta entry
+**/
+static bool ffuzzy_store_reserve_(ffuzzy_store *store)
+{
+	if (store->nentries < store->deltas->capacity)
+		return true;
+	if (store->deltas->capacity > ((size_t)-1 / sizeof(ffuzzy_store_entry)) / 2)
+		return false;
+	return ffuzzy_store_replace_deltas_(store, 0, store->deltas->capacity * 2);
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_store_push_(ffuzzy_store*, size_t, const ffuzzy_digest*)
+	\brief  Append a digest to in-memory delta entries
+	\details
+		The new entry is written after the prefix visible to searches.
+**/
+static bool ffuzzy_store_push_(ffuzzy_store *store, size_t id, const ffuzzy_digest *digest)
+{
+	if (!ffuzzy_store_reserve_(store))
+		return false;
+	store->deltas->entries[store->nentries].id = id;
+	store->deltas->entries[store->nentries].digest = *digest;
+	store->nentries++;
+	return true;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_store_load_delta_(ffuzzy_store*, unsigned long long)
+	\brief  Load a delta segment (truncating a torn tail)
+	\return true if succeeds; false otherwise.
+**/
+static bool ffuzzy_store_load_delta_(ffuzzy_store *store, unsigned long long gen)
+{
+	char *path;
+	if (!ffuzzy_store_gen_path_(&path, store, "delta-%llu.log", gen))
+		return false;
+	FILE *fp = fopen(path, "rb");
+	if (!fp)
+	{
+		free(path);
+		return false;
+	}
+	bool ok = true;
+	off_t good = 0;
+	unsigned char buf[FFUZZY_STORE_ENTRY_SIZE];
+	while (fread(buf, FFUZZY_STORE_ENTRY_SIZE, 1, fp) == 1)
+	{
+		unsigned long long id;
+		ffuzzy_digest digest;
+		uint_least32_t crc = (uint_least32_t)buf[FFUZZY_RECORD_SIZE]
+			| (uint_least32_t)buf[FFUZZY_RECORD_SIZE + 1] << 8
+			| (uint_least32_t)buf[FFUZZY_RECORD_SIZE + 2] << 16
+			| (uint_least32_t)buf[FFUZZY_RECORD_SIZE + 3] << 24;
+		if (crc != util_crc32(0, buf, FFUZZY_RECORD_SIZE) || !ffuzzy_decode_digest_record(&id, &digest, buf))
+			break;
+		if (id > (size_t)-1 || !ffuzzy_store_push_(store, (size_t)id, &digest))
+		{
+			ok = false;
+			break;
+		}
+		if (id >= store->manifest.next_id)
+			store->manifest.next_id = id + 1;
+		good += FFUZZY_STORE_ENTRY_SIZE;
+	}
+	if (ferror(fp))
+		ok = false;
+	fclose(fp);
+	// discard the torn tail (left by a crash while appending)
+	struct stat st;
+	if (ok && !stat(path, &st) && st.st_size != good)
+		ok = !truncate(path, good);
+	free(path);
+	return ok;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_store_open_log_(ffuzzy_store*, unsigned long long)
+	\brief  Open (or create) a delta segment for appending
+**/
+static bool ffuzzy_store_open_log_(ffuzzy_store *store, unsigned long long gen)
+{
+	char *path;
+	if (!ffuzzy_store_gen_path_(&path, store, "delta-%llu.log", gen))
+		return false;
+	store->log = fopen(path, "ab");
+	free(path);
+	return store->log && ffuzzy_store_sync_dir_(store);
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_store_write_entry_(FILE*, size_t, const ffuzzy_digest*)
+	\brief  Write a delta segment entry (a record and its CRC-32)
+**/
+static bool ffuzzy_store_write_entry_(FILE *fp, size_t id, const ffuzzy_digest *digest)
+{
+	unsigned char buf[FFUZZY_STORE_ENTRY_SIZE];
+	ffuzzy_encode_digest_record(buf, id, digest);
+	uint_least32_t crc = util_crc32(0, buf, FFUZZY_RECORD_SIZE);
+	for (int i = 0; i < 4; i++)
+		buf[FFUZZY_RECORD_SIZE + i] = (unsigned char)(crc >> (8 * i));
+	return fwrite(buf, FFUZZY_STORE_ENTRY_SIZE, 1, fp) == 1;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_store_flush_log_(ffuzzy_store*, bool)
+	\brief  Flush (and optionally fsync) the last delta segment
+	\details
+		On failure, the segment is marked broken
+		(some of the buffered entries may be written partially).
+**/
+static bool ffuzzy_store_flush_log_(ffuzzy_store *store, bool sync)
+{
+	bool ok = !fflush(store->log) && (!sync || ffuzzy_store_fsync_(fileno(store->log)));
+	if (ok)
+	{
+		store->log_flushed += (off_t)(store->nentries - store->nflushed) * FFUZZY_STORE_ENTRY_SIZE;
+		store->nflushed = store->nentries;
+	}
+	store->log_broken = !ok;
+	return ok;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_store_repair_log_(ffuzzy_store*)
+	\brief  Truncate the last delta segment to flushed entries and write the rest again
+	\details
+		The store lock must be held.
+		The segment stays broken if this function fails.
+**/
+static bool ffuzzy_store_repair_log_(ffuzzy_store *store)
+{
+	char *path;
+	if (!ffuzzy_store_gen_path_(&path, store, "delta-%llu.log", store->manifest.deltas[store->manifest.ndeltas - 1]))
+		return false;
+	// buffered data (if any) is written again after truncation
+	if (store->log)
+		fclose(store->log);
+	store->log = NULL;
+	if (!truncate(path, store->log_flushed))
+		store->log = fopen(path, "ab");
+	free(path);
+	if (!store->log)
+		return false;
+	bool ok = true;
+	for (size_t i = store->nflushed; ok && i < store->nentries; i++)
+		ok = ffuzzy_store_write_entry_(store->log, store->deltas->entries[i].id, &store->deltas->entries[i].digest);
+	return ok && ffuzzy_store_flush_log_(store, false);
+}
+
+
+/**
+	\internal
+	\fn     void ffuzzy_store_remove_stale_(ffuzzy_store*)
+	\brief  Remove files which are not referred from the manifest
+**/
+static void ffuzzy_store_remove_stale_(ffuzzy_store *store)
+{
+	DIR *dir = opendir(store->dir);
+	if (!dir)
+		return;
+	struct dirent *ent;
+	while ((ent = readdir(dir)))
+	{
+		unsigned long long gen;
+		char c;
+		bool live = true;
+		if (sscanf(ent->d_name, "base-%llu.db%c", &gen, &c) == 1)
+			live = gen == store->manifest.base;
+		else if (sscanf(ent->d_name, "delta-%llu.log%c", &gen, &c) == 1)
+		{
+			live = false;
+			for (size_t i = 0; i < store->manifest.ndeltas; i++)
+				live |= gen == store->manifest.deltas[i];
+		}
+		else if (strstr(ent->d_name, ".tmp"))
+			live = false;
+		else
+			continue;
+		if (!live)
+		{
+			char *path;
+			if (ffuzzy_store_path_(&path, store, ent->d_name))
+			{
+				unlink(path);
+				free(path);
+			}
+		}
+	}
+	closedir(dir);
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_store_create_(ffuzzy_store*)
+	\brief  Initialize an empty store (an empty base and a delta segment)
+**/
+static bool ffuzzy_store_create_(ffuzzy_store *store)
+{
+	if (mkdir(store->dir, 0777) && errno != EEXIST)
+		return false;
+	char *path;
+	if (!ffuzzy_store_gen_path_(&path, store, "base-%llu.db", 1))
+		return false;
+	FILE *fp = fopen(path, "wb");
+	free(path);
+	if (!fp || !ffuzzy_store_close_file_(fp))
+		return false;
+	if (!ffuzzy_store_open_log_(store, 2))
+		return false;
+	store->manifest.base = 1;
+	store->manifest.next_id = 0;
+	store->manifest.deltas[0] = 2;
+	store->manifest.ndeltas = 1;
+	return ffuzzy_store_write_manifest_(store, &store->manifest);
+}
+
+
+/**
+	\internal
+	\fn     void ffuzzy_store_free_(ffuzzy_store*)
+	\brief  Free the store without syncing
+**/
+static void ffuzzy_store_free_(ffuzzy_store *store)
+{
+	if (store->log)
+		fclose(store->log);
+	ffuzzy_db_close(store->base);
+	ffuzzy_mutex_destroy_(&store->compact_lock);
+	ffuzzy_mutex_destroy_(&store->lock);
+	ffuzzy_store_deltas_release_(store->deltas);
+	free(store->dir);
+	free(store);
+}
+
+
+ffuzzy_store *ffuzzy_store_open(const char *dir)
+{
+	ffuzzy_store *store = calloc(1, sizeof(ffuzzy_store));
+	if (!store)
+		return NULL;
+	store->dir = malloc(strlen(dir) + 1);
+	if (!store->dir || !ffuzzy_mutex_init_(&store->lock))
+	{
+		free(store->dir);
+		free(store);
+		return NULL;
+	}
+	if (!ffuzzy_mutex_init_(&store->compact_lock))
+	{
+		ffuzzy_mutex_destroy_(&store->lock);
+		free(store->dir);
+		free(store);
+		return NULL;
+	}
+	strcpy(store->dir, dir);
+	if (!ffuzzy_store_replace_deltas_(store, 0, 0))
+		goto fail;
+	int r = ffuzzy_store_read_manifest_(store, &store->manifest);
+	if (r < 0 || (r == 0 && !ffuzzy_store_create_(store)))
+		goto fail;
+	ffuzzy_store_remove_stale_(store);
+	// next generation follows all live files
+	store->next_gen = store->manifest.base + 1;
+	for (size_t i = 0; i < store->manifest.ndeltas; i++)
+		store->next_gen = MAX(store->next_gen, store->manifest.deltas[i] + 1);
+	char *path;
+	if (!ffuzzy_store_gen_path_(&path, store, "base-%llu.db", store->manifest.base))
+		goto fail;
+	store->base = ffuzzy_db_open(path);
+	free(path);
+	if (!store->base)
+		goto fail;
+	if (r > 0)
+	{
+		for (size_t i = 0; i < store->manifest.ndeltas; i++)
+		{
+			store->nflushed = store->nentries;
+			if (!ffuzzy_store_load_delta_(store, store->manifest.deltas[i]))
+				goto fail;
+		}
+		// entries of the last segment are already written
+		store->log_flushed = (off_t)(store->nentries - store->nflushed) * FFUZZY_STORE_ENTRY_SIZE;
+		store->nflushed = store->nentries;
+		if (!store->manifest.ndeltas || !ffuzzy_store_open_log_(store, store->manifest.deltas[store->manifest.ndeltas - 1]))
+			goto fail;
+	}
+	return store;
+fail:
+	ffuzzy_store_free_(store);
+	return NULL;
+}
+
+
+bool ffuzzy_store_close(ffuzzy_store *store)
+{
+	if (!store)
+		return true;
+	bool ok = !store->log_broken || ffuzzy_store_repair_log_(store);
+	if (store->log)
+		ok = ffuzzy_store_close_file_(store->log) && ok;
+	store->log = NULL;
+	ffuzzy_store_free_(store);
+	return ok;
+}
+
+
+bool ffuzzy_store_add(ffuzzy_store *store, const ffuzzy_digest *digest, size_t *id)
+{
+	assert(ffuzzy_digest_is_valid(digest));
+	bool ok = false;
+	ffuzzy_mutex_lock_(&store->lock);
+	if (store->manifest.next_id >= (size_t)-1)
+		goto cleanup;
+	size_t newid = (size_t)store->manifest.next_id;
+	// reserve memory first so that nothing fails after writing
+	if (!ffuzzy_store_reserve_(store))
+		goto cleanup;
+	// never append after a torn entry
+	if (store->log_broken && !ffuzzy_store_repair_log_(store))
+		goto cleanup;
+	if (!ffuzzy_store_write_entry_(store->log, newid, digest))
+	{
+		store->log_broken = true;
+		goto cleanup;
+	}
+	ffuzzy_store_push_(store, newid, digest);
+	store->manifest.next_id++;
+	if (id)
+		*id = newid;
+	ok = true;
+cleanup:
+	ffuzzy_mutex_unlock_(&store->lock);
+	return ok;
+}
+
+
+bool ffuzzy_store_sync(ffuzzy_store *store)
+{
+	ffuzzy_mutex_lock_(&store->lock);
+	bool ok = (!store->log_broken || ffuzzy_store_repair_log_(store)) && ffuzzy_store_flush_log_(store, true);
+	ffuzzy_mutex_unlock_(&store->lock);
+	return ok;
+}
+
+
+size_t ffuzzy_store_size(ffuzzy_store *store)
+{
+	ffuzzy_mutex_lock_(&store->lock);
+	size_t n = (size_t)store->manifest.next_id;
+	ffuzzy_mutex_unlock_(&store->lock);
+	return n;
+}
+
+
+static int ffuzzy_store_id_cmp_(const void *p1, const void *p2)
+{
+	const ffuzzy_match *m1 = p1, *m2 = p2;
+	return m1->id < m2->id ? -1 : m1->id > m2->id ? +1 : 0;
+}
+
+
+bool ffuzzy_store_search(
+	ffuzzy_store *store, const ffuzzy_digest *query,
+	int threshold, ffuzzy_match_list *results
+)
+{
+	assert(ffuzzy_digest_is_valid(query));
+	bool ok = true;
+	threshold = MAX(threshold, 1);
+	ffuzzy_match_list base;
+	ffuzzy_match_list_init(&base);
+	results->count = 0;
+	// pin the base and deltas together (a consistent view)
+	ffuzzy_mutex_lock_(&store->lock);
+	const ffuzzy_db_snapshot *snap = ffuzzy_db_pin(store->base);
+	ffuzzy_store_deltas *deltas = store->deltas;
+	size_t nentries = store->nentries;
+	ffuzzy_atomic_fetch_add_(&deltas->refs, 1ul);
+	ffuzzy_mutex_unlock_(&store->lock);
+	for (size_t i = 0; i < nentries; i++)
+	{
+		const ffuzzy_store_entry *e = &deltas->entries[i];
+		if (!ffuzzy_blocksize_is_near_(query->block_size, e->digest.block_size))
+			continue;
+		if (ffuzzy_compare_digest_near_max_(query, &e->digest) < threshold)
+			continue;
+		int score = ffuzzy_compare_digest_near(query, &e->digest);
+		if (score >= threshold && !ffuzzy_match_list_push_(results, e->id, score))
+			ok = false;
+	}
+	ffuzzy_store_deltas_release_(deltas);
+	ok &= ffuzzy_db_snapshot_search(snap, query, threshold, &base);
+	for (size_t i = 0; i < base.count; i++)
+	{
+		unsigned long long id;
+		ffuzzy_digest d;
+		if (!ffuzzy_db_snapshot_get(snap, base.matches[i].id, &id, &d) || id > (size_t)-1)
+			ok = false;
+		else if (!ffuzzy_match_list_push_(results, (size_t)id, base.matches[i].score))
+			ok = false;
+	}
+	ffuzzy_db_release(snap);
+	ffuzzy_match_list_free(&base);
+	// a digest may be in both the new base and old deltas while compacting
+	qsort(results->matches, results->count, sizeof(ffuzzy_match), ffuzzy_store_id_cmp_);
+	size_t n = 0;
+	for (size_t i = 0; i < results->count; i++)
+		if (!n || results->matches[n-1].id != results->matches[i].id)
+			results->matches[n++] = results->matches[i];
+	results->count = n;
+	ffuzzy_match_sort_(results->matches, results->count);
+	return ok;
+}
+
+
+static int ffuzzy_store_entry_cmp_(const void *p1, const void *p2)
+{
+	const ffuzzy_store_entry *e1 = p1, *e2 = p2;
+	int c = ffuzzy_blocksizecmp(e1->digest.block_size, e2->digest.block_size);
+	if (c)
+		return c;
+	return e1->id < e2->id ? -1 : e1->id > e2->id ? +1 : 0;
+}
+
+
+/**
+	\internal
+	\fn     bool ffuzzy_store_write_base_(const char*, const ffuzzy_db_snapshot*, const ffuzzy_store_entry*, size_t)
+	\brief  Write a new base by merging the old base and sorted delta entries
+	\details
+		For the same block size, old base records come first
+		(they are older than any delta entries).
+	\return true if succeeds (the file is durable); false otherwise.
+**/
+static bool ffuzzy_store_write_base_(
+	const char *path, const ffuzzy_db_snapshot *snap,
+	const ffuzzy_store_entry *entries, size_t n
+)
+{
+	FILE *fp = fopen(path, "wb");
+	if (!fp)
+		return false;
+	bool ok = true;
+	size_t nbase = ffuzzy_db_snapshot_size(snap);
+	size_t i = 0, j = 0;
+	while (ok && (i < nbase || j < n))
+	{
+		unsigned long long id;
+		ffuzzy_digest d;
+		if (i < nbase && !ffuzzy_db_snapshot_get(snap, i, &id, &d))
+		{
+			ok = false;
+			break;
+		}
+		if (i < nbase && (j == n || d.block_size <= entries[j].digest.block_size))
+		{
+			ok = ffuzzy_write_digest_record(fp, id, &d);
+			i++;
+		}
+		else
+		{
+			ok = ffuzzy_write_digest_record(fp, entries[j].id, &entries[j].digest);
+			j++;
+		}
+	}
+	return ffuzzy_store_close_file_(fp) && ok;
+}
+
+
+bool ffuzzy_store_compact(ffuzzy_store *store)
+{
+	bool ok = false;
+	ffuzzy_store_entry *merged = NULL;
+	char *newpath = NULL;
+	unsigned long long oldbase = 0, newbase = 0;
+	ffuzzy_store_manifest old;
+	size_t nmerged = 0;
+	ffuzzy_mutex_lock_(&store->compact_lock);
+
+	// 1. rotate the delta segment (new entries go to the new segment)
+	ffuzzy_mutex_lock_(&store->lock);
+	if (!store->nentries)
+	{
+		ffuzzy_mutex_unlock_(&store->lock);
+		ffuzzy_mutex_unlock_(&store->compact_lock);
+		return true;
+	}
+	if (store->manifest.ndeltas == FFUZZY_STORE_DELTA_MAX)
+		goto unlock;
+	if (store->log_broken && !ffuzzy_store_repair_log_(store))
+		goto unlock;
+	old = store->manifest;
+	FILE *oldlog = store->log;
+	unsigned long long loggen = store->next_gen;
+	if (!ffuzzy_store_open_log_(store, loggen))
+	{
+		if (store->log)
+			fclose(store->log);
+		store->log = oldlog;
+		goto unlock;
+	}
+	store->manifest.deltas[store->manifest.ndeltas++] = loggen;
+	if (!ffuzzy_store_write_manifest_(store, &store->manifest))
+	{
+		fclose(store->log);
+		store->log = oldlog;
+		store->manifest = old;
+		goto unlock;
+	}
+	store->next_gen++;
+	store->log_flushed = 0;
+	store->nflushed = store->nentries;
+	// the old segment is never appended again
+	// (if it cannot be flushed, its entries stay in memory for the next compaction)
+	if (!ffuzzy_store_close_file_(oldlog))
+		goto unlock;
+	nmerged = store->nentries;
+	merged = malloc(sizeof(ffuzzy_store_entry) * nmerged);
+	if (!merged)
+		goto unlock;
+	memcpy(merged, store->deltas->entries, sizeof(ffuzzy_store_entry) * nmerged);
+	newbase = store->next_gen++;
+	oldbase = store->manifest.base;
+	const ffuzzy_db_snapshot *snap = ffuzzy_db_pin(store->base);
+	ffuzzy_mutex_unlock_(&store->lock);
+
+	// 2. write the new base (without blocking appends and searches)
+	qsort(merged, nmerged, sizeof(ffuzzy_store_entry), ffuzzy_store_entry_cmp_);
+	char *tmppath = NULL;
+	bool written =
+		ffuzzy_store_gen_path_(&tmppath, store, "base-%llu.db.tmp", newbase) &&
+		ffuzzy_store_gen_path_(&newpath, store, "base-%llu.db", newbase) &&
+		ffuzzy_store_write_base_(tmppath, snap, merged, nmerged) &&
+		!rename(tmppath, newpath) &&
+		ffuzzy_store_sync_dir_(store);
+	ffuzzy_db_release(snap);
+	if (!written && tmppath)
+		unlink(tmppath);
+	free(tmppath);
+	if (!written)
+		goto done;
+
+	// 3. commit: the new base replaces the old base and merged segments
+	// (searches may see merged entries twice until they are dropped; they are deduplicated)
+	if (!ffuzzy_db_swap(store->base, newpath))
+		goto done;
+	ffuzzy_mutex_lock_(&store->lock);
+	ffuzzy_store_manifest m = store->manifest;
+	m.base = newbase;
+	m.ndeltas = 0;
+	for (size_t i = 0; i < store->manifest.ndeltas; i++)
+	{
+		bool was_merged = false;
+		for (size_t k = 0; k < old.ndeltas; k++)
+			was_merged |= store->manifest.deltas[i] == old.deltas[k];
+		if (!was_merged)
+			m.deltas[m.ndeltas++] = store->manifest.deltas[i];
+	}
+	// drop merged entries (searches may still use the old array)
+	ffuzzy_store_deltas *olddeltas = store->deltas;
+	ffuzzy_atomic_fetch_add_(&olddeltas->refs, 1ul);
+	if (!ffuzzy_store_replace_deltas_(store, nmerged, 0) || !ffuzzy_store_write_manifest_(store, &m))
+	{
+		if (store->deltas != olddeltas)
+		{
+			ffuzzy_store_deltas_release_(store->deltas);
+			store->deltas = olddeltas;
+			store->nentries += nmerged;
+		}
+		else
+			ffuzzy_store_deltas_release_(olddeltas);
+		// keep the old base (merged entries are still in deltas)
+		char *path;
+		if (ffuzzy_store_gen_path_(&path, store, "base-%llu.db", oldbase))
+		{
+			ffuzzy_db_swap(store->base, path);
+			free(path);
+		}
+		goto unlock;
+	}
+	store->manifest = m;
+	store->nflushed -= nmerged;
+	ffuzzy_store_deltas_release_(olddeltas);
+	ffuzzy_mutex_unlock_(&store->lock);
+
+	// 4. remove files which are no longer referred
+	char *path;
+	if (ffuzzy_store_gen_path_(&path, store, "base-%llu.db", oldbase))
+	{
+		unlink(path);
+		free(path);
+	}
+	for (size_t k = 0; k < old.ndeltas; k++)
+	{
+		if (ffuzzy_store_gen_path_(&path, store, "delta-%llu.log", old.deltas[k]))
+		{
+			unlink(path);
+			free(path);
+		}
+	}
+	ok = true;
+	goto done;
+unlock:
+	ffuzzy_mutex_unlock_(&store->lock);
+done:
+	free(newpath);
+	free(merged);
+	ffuzzy_mutex_unlock_(&store->compact_lock);
+	return ok;
+}
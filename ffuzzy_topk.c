@@ -0,0 +1,210 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	ffuzzy_topk.c
+	Top-k nearest neighbor search
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\internal
+	\file  ffuzzy_topk.c
+	\brief Top-k nearest neighbor search
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_collection.h"
+#include "ffuzzy_compare.h"
+#include "ffuzzy_match.h"
+#include "ffuzzy_parallel.h"
+#include "ffuzzy_stats.h"
+
+
+/**
+	\internal
+	\fn     void ffuzzy_topk_sift_down_(ffuzzy_match*, size_t, size_t)
+	\brief  Restore the heap property (the worst match on the top)
+**/
+static inline void ffuzzy_topk_sift_down_(ffuzzy_match *heap, size_t n, size_t i)
+{
+	ffuzzy_match m = heap[i];
+	while (true)
+	{
+		size_t c = i * 2 + 1;
+		if (c >= n)
+			break;
+		if (c + 1 < n && ffuzzy_match_worse_(&heap[c + 1], &heap[c]))
+			c++;
+		if (!ffuzzy_match_worse_(&heap[c], &m))
+			break;
+		heap[i] = heap[c];
+		i = c;
+	}
+	heap[i] = m;
+}
+
+
+/**
+	\internal
+	\fn     void ffuzzy_topk_sift_up_(ffuzzy_match*, size_t)
+	\brief  Restore the heap property after appending heap[i]
+**/
+static inline void ffuzzy_topk_sift_up_(ffuzzy_match *heap, size_t i)
+{
+	ffuzzy_match m = heap[i];
+	while (i)
+	{
+		size_t p = (i - 1) / 2;
+		if (!ffuzzy_match_worse_(&m, &heap[p]))
+			break;
+		heap[i] = heap[p];
+		i = p;
+	}
+	heap[i] = m;
+}
+
+
+/**
+	\internal
+	\fn     size_t ffuzzy_collection_topk_(const ffuzzy_collection*, const ffuzzy_digest*, size_t, int, size_t, ffuzzy_match*)
+	\brief  Top-k search (excluding given ID)
+	\see    size_t ffuzzy_collection_topk(const ffuzzy_collection*, const ffuzzy_digest*, size_t, int, ffuzzy_match*)
+**/
+static size_t ffuzzy_collection_topk_(
+	const ffuzzy_collection *coll, const ffuzzy_digest *query,
+	size_t k, int min_score, size_t exclude,
+	ffuzzy_match *heap
+)
+{
+	size_t n = 0;
+	if (k == 0)
+		return 0;
+	if (min_score < 1)
+		min_score = 1;
+	ffuzzy_partition *parts[3];
+	size_t nparts = ffuzzy_collection_near_partitions_(coll, query->block_size, parts);
+	for (size_t p = 0; p < nparts; p++)
+	{
+		const ffuzzy_partition *part = parts[p];
+		for (size_t j = 0; j < part->count; j++)
+		{
+			size_t id = part->ids[j];
+			if (id == exclude)
+				continue;
+			// reject candidates by score bound (before computing edit distance)
+			int bound = ffuzzy_compare_digest_near_max_(query, &part->digests[j]);
+			if (bound < min_score)
+				continue;
+			if (n == k && bound == heap[0].score && id > heap[0].id)
+				continue;
+			int score = ffuzzy_compare_digest_near(query, &part->digests[j]);
+			if (score < min_score)
+				continue;
+			ffuzzy_match m;
+			m.id = id;
+			m.score = score;
+			if (n < k)
+			{
+				heap[n] = m;
+				ffuzzy_topk_sift_up_(heap, n++);
+			}
+			else if (ffuzzy_match_worse_(&heap[0], &m))
+			{
+				heap[0] = m;
+				ffuzzy_topk_sift_down_(heap, n, 0);
+			}
+			else
+				continue;
+			// raise the threshold once the heap is full
+			if (n == k)
+				min_score = heap[0].score;
+		}
+	}
+	ffuzzy_match_sort_(heap, n);
+	return n;
+}
+
+
+size_t ffuzzy_collection_topk(
+	const ffuzzy_collection *coll, const ffuzzy_digest *query,
+	size_t k, int min_score, ffuzzy_match *matches
+)
+{
+	assert(ffuzzy_digest_is_valid(query));
+	FFUZZY_LATENCY_BEGIN_(FFUZZY_TIMER_TOPK);
+	size_t n = ffuzzy_collection_topk_(coll, query, k, min_score, (size_t)-1, matches);
+	FFUZZY_LATENCY_END_(FFUZZY_TIMER_TOPK);
+	return n;
+}
+
+
+/**
+	\internal
+	\struct ffuzzy_knn_ctx
+	\brief  Context for parallel k-NN graph construction
+**/
+typedef struct
+{
+	const ffuzzy_collection *coll;
+	size_t k;
+	int min_score;
+	ffuzzy_match *matches;
+	size_t *counts;
+} ffuzzy_knn_ctx;
+
+
+static void ffuzzy_knn_task_(void *arg, unsigned worker, size_t begin, size_t end)
+{
+	ffuzzy_knn_ctx *ctx = arg;
+	(void)worker;
+	for (size_t id = begin; id < end; id++)
+	{
+		ctx->counts[id] = ffuzzy_collection_topk_(
+			ctx->coll, ffuzzy_collection_get(ctx->coll, id),
+			ctx->k, ctx->min_score, id, ctx->matches + id * ctx->k
+		);
+	}
+}
+
+
+bool ffuzzy_collection_knn_graph(
+	const ffuzzy_collection *coll,
+	size_t k, int min_score, unsigned nthreads,
+	ffuzzy_match *matches, size_t *counts
+)
+{
+	ffuzzy_knn_ctx ctx;
+	if (k && coll->count > ((size_t)-1) / sizeof(ffuzzy_match) / k)
+		return false;
+	ctx.coll = coll;
+	ctx.k = k;
+	ctx.min_score = min_score;
+	ctx.matches = matches;
+	ctx.counts = counts;
+	ffuzzy_parallel_for_(coll->count, 64, ffuzzy_parallel_nthreads_(nthreads), ffuzzy_knn_task_, &ctx);
+	return true;
+}
@@ -0,0 +1,160 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	str_lcs_bitpar.h
+	Bit-parallel LCS and common substring finder
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef FFUZZY_STR_LCS_BITPAR_H
+#define FFUZZY_STR_LCS_BITPAR_H
+
+/**
+	\internal
+	\file  str_lcs_bitpar.h
+	\brief Bit-parallel LCS and common substring finder
+	\details
+		Strings up to 64 characters are represented as bit vectors
+		(one bit per position of string 1) and string 2 is processed
+		one character at a time (Hyyrö's bit-parallel LCS).
+		Edit distance with insertion and removal only is
+		s1len + s2len - 2 * LCS.
+
+		Runs of matching characters along diagonals are tracked in the
+		same loop so that a common substring of length FFUZZY_MIN_MATCH
+		is detected without rolling hashes.
+**/
+
+#include "ffuzzy_config.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ffuzzy.h"
+#include "util.h"
+
+/** \internal \brief Maximum length for bit-parallel functions **/
+#define LCS_BITPAR_MAXLEN 64
+
+#if FFUZZY_MIN_MATCH < 2
+#error FFUZZY_MIN_MATCH must be at least 2 on current implementation.
+#endif
+
+
+/**
+	\internal
+	\struct lcs_bitpar_state
+	\brief  State of bit-parallel LCS and common substring finder
+	\details
+		runs[t] has bit i set if a common substring of length t+1
+		ends at s1[i] and the last processed character of s2.
+**/
+typedef struct
+{
+	uint_least64_t v;
+	uint_least64_t runs[FFUZZY_MIN_MATCH - 1];
+	uint_least64_t hit;
+} lcs_bitpar_state;
+
+
+/**
+	\internal
+	\fn     void lcs_bitpar_init(lcs_bitpar_state*)
+	\brief  Initialize the state
+**/
+static inline void lcs_bitpar_init(lcs_bitpar_state *st)
+{
+	st->v = ~(uint_least64_t)0;
+	for (size_t t = 0; t < FFUZZY_MIN_MATCH - 1; t++)
+		st->runs[t] = 0;
+	st->hit = 0;
+}
+
+
+/**
+	\internal
+	\fn     void lcs_bitpar_step(lcs_bitpar_state*, uint_least64_t)
+	\brief  Process one character of string 2
+	\param  [in,out] st  The state
+	\param           m   Positions of string 1 which match the character
+**/
+static inline void lcs_bitpar_step(lcs_bitpar_state *st, uint_least64_t m)
+{
+	uint_least64_t u = st->v & m;
+	st->v = (st->v + u) | (st->v - u);
+	// extend diagonal runs (longest runs first)
+	st->hit |= m & (st->runs[FFUZZY_MIN_MATCH - 2] << 1);
+	for (size_t t = FFUZZY_MIN_MATCH - 2; t > 0; t--)
+		st->runs[t] = m & (st->runs[t - 1] << 1);
+	st->runs[0] = m;
+}
+
+
+/**
+	\internal
+	\fn     int lcs_bitpar_result(const lcs_bitpar_state*, size_t)
+	\brief  Get the length of LCS
+	\param  [in] st     The state
+	\param       s1len  Length of string 1
+	\return The length of the longest common subsequence.
+**/
+static inline int lcs_bitpar_result(const lcs_bitpar_state *st, size_t s1len)
+{
+	assert(s1len <= LCS_BITPAR_MAXLEN);
+	uint_least64_t mask = s1len >= 64 ? ~(uint_least64_t)0 : (((uint_least64_t)1 << s1len) - 1);
+	return util_popcount64(~st->v & mask);
+}
+
+
+/**
+	\internal
+	\brief  Position table of string 1 (indexed by unsigned char)
+	\details
+		Only entries which appear in string 1 or string 2 are valid.
+		Entry zero is always zero (used to pad string 2).
+**/
+typedef uint_least64_t lcs_bitpar_table[256];
+
+
+/**
+	\internal
+	\fn     void lcs_bitpar_table_set(lcs_bitpar_table, const char*, size_t, const char*, size_t)
+	\brief  Fill the position table for string 1 (valid for lookups by characters of string 2)
+**/
+static inline void lcs_bitpar_table_set(
+	lcs_bitpar_table table,
+	const char *s1, size_t s1len,
+	const char *s2, size_t s2len
+)
+{
+	assert(s1len <= LCS_BITPAR_MAXLEN);
+	// clear only entries to be used
+	table[0] = 0;
+	for (size_t j = 0; j < s2len; j++)
+		table[(unsigned char)s2[j]] = 0;
+	for (size_t i = 0; i < s1len; i++)
+		table[(unsigned char)s1[i]] = 0;
+	for (size_t i = 0; i < s1len; i++)
+		table[(unsigned char)s1[i]] |= (uint_least64_t)1 << i;
+}
+
+#endif
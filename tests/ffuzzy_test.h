@@ -0,0 +1,115 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tests/ffuzzy_test.h
+	Minimal helpers for unit tests
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef FFUZZY_TESTS_FFUZZY_TEST_H
+#define FFUZZY_TESTS_FFUZZY_TEST_H
+
+/**
+	\file  tests/ffuzzy_test.h
+	\brief Minimal helpers for unit tests
+	\details
+		Each test is a program run by "make check". CHECK records a
+		failure (and continues); TEST_EXIT returns the exit status.
+		Tests which need files work in a temporary directory
+		(under $TMPDIR) which is removed on success.
+**/
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ffuzzy.h"
+
+static unsigned test_failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) \
+		{ \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			test_failures++; \
+		} \
+	} while (0)
+
+#define CHECK_INT(actual, expected) \
+	do { \
+		long long a_ = (long long)(actual), e_ = (long long)(expected); \
+		if (a_ != e_) \
+		{ \
+			fprintf(stderr, "%s:%d: %s == %lld (expected %lld)\n", \
+				__FILE__, __LINE__, #actual, a_, e_); \
+			test_failures++; \
+		} \
+	} while (0)
+
+#define TEST_EXIT() (test_failures ? EXIT_FAILURE : EXIT_SUCCESS)
+
+/** \brief Parse a digest which must be valid **/
+static inline ffuzzy_digest test_digest(const char *s)
+{
+	ffuzzy_digest d;
+	if (!ffuzzy_read_digest(&d, s))
+	{
+		fprintf(stderr, "cannot parse digest: %s\n", s);
+		exit(EXIT_FAILURE);
+	}
+	return d;
+}
+
+/** \brief Create a temporary directory (the buffer needs 256 bytes) **/
+static inline void test_mkdtemp(char *dir)
+{
+	const char *tmp = getenv("TMPDIR");
+	snprintf(dir, 256, "%s/ffuzzy_test.XXXXXX", tmp && *tmp ? tmp : "/tmp");
+	if (!mkdtemp(dir))
+	{
+		perror(dir);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/** \brief Remove a directory and files in it (not recursive) **/
+static inline void test_rmdir(const char *dir)
+{
+	char path[512];
+	DIR *d = opendir(dir);
+	if (d)
+	{
+		struct dirent *e;
+		while ((e = readdir(d)) != NULL)
+		{
+			if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, ".."))
+				continue;
+			snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+			unlink(path);
+		}
+		closedir(d);
+	}
+	rmdir(dir);
+}
+
+#endif
@@ -0,0 +1,201 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tests/test_block_index.c
+	Tests for block-granular indices
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\file  tests/test_block_index.c
+	\brief Tests for block-granular indices
+	\details
+		Linear and trie searches must return exactly the digests
+		ffuzzy_compare_digest scores at or above the threshold (best match
+		first), including buckets modified after preparing trie views.
+		Besides generated families, the index contains small and
+		huge block sizes (2^62 and 2^63, where block 2 of the former
+		matches block 1 of the latter).
+**/
+
+#include "ffuzzy_config.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_test.h"
+#include "tools/ffuzzy_corpus.h"
+
+#define NGENERATED 1500
+#define NADDED 100
+#define NMAX (NGENERATED + 16 + NADDED)
+
+static ffuzzy_digest digests[NMAX];
+static size_t ndigests;
+
+
+/** \brief Check search results of a query against pairwise comparison **/
+static void check_results(const char *name, const ffuzzy_digest *query, int threshold, const ffuzzy_match_list *list)
+{
+	size_t nexpected = 0;
+	for (size_t i = 0; i < ndigests; i++)
+		if (ffuzzy_compare_digest(query, &digests[i]) >= threshold)
+			nexpected++;
+	if (list->count != nexpected)
+	{
+		fprintf(stderr, "%s (threshold %d): %zu matches (expected %zu)\n", name, threshold, list->count, nexpected);
+		test_failures++;
+		return;
+	}
+	for (size_t i = 0; i < list->count; i++)
+	{
+		const ffuzzy_match *m = &list->matches[i];
+		if (m->id >= ndigests || m->score != ffuzzy_compare_digest(query, &digests[m->id]))
+		{
+			fprintf(stderr, "%s (threshold %d): unexpected match (id=%zu, score=%d)\n", name, threshold, m->id, m->score);
+			test_failures++;
+			return;
+		}
+		if (i && (list->matches[i - 1].score < m->score ||
+			(list->matches[i - 1].score == m->score && list->matches[i - 1].id > m->id)))
+		{
+			fprintf(stderr, "%s (threshold %d): matches are not ordered\n", name, threshold);
+			test_failures++;
+			return;
+		}
+	}
+}
+
+
+/** \brief Check searches of some generated digests and all others **/
+static void check_searches(const char *name, const ffuzzy_block_index *idx, bool trie)
+{
+	static const int thresholds[] = { 1, 50, 80, 100 };
+	ffuzzy_match_list list;
+	ffuzzy_match_list_init(&list);
+	for (size_t t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); t++)
+	{
+		for (size_t q = 0; q < ndigests; q++)
+		{
+			if (q < NGENERATED && q % 13)
+				continue;
+			if (trie)
+				CHECK(ffuzzy_block_index_search_trie(idx, &digests[q], thresholds[t], &list));
+			else
+				CHECK(ffuzzy_block_index_search(idx, &digests[q], thresholds[t], &list));
+			check_results(name, &digests[q], thresholds[t], &list);
+		}
+	}
+	ffuzzy_match_list_free(&list);
+}
+
+
+int main(void)
+{
+	static const char *edges[] = {
+		"3:ABCDEFGH:IJKLMNOP",
+		"6:IJKLMNOP:QR",
+		"3:ABCDEF:GH",
+		"3:ABCDEF:GH",
+	};
+	static const char *huge_edges[] = {
+		// block 2 of 2^62 and block 1 of 2^63 share the effective block size
+		"%lu:ABCDEFGHIJ:KLMNOPQRSTU",
+		"%lu:KLMNOPQRSTU:VWXYZab",
+		"%lu:KLMNOPQRSTV:VWXYZab",
+		"%lu:KLMNOPQRSTV:VWXYZab",
+	};
+	char buf[FFUZZY_PRETTY_LEN];
+	corpus_gen gen;
+	corpus_gen_init(&gen, 8);
+	for (size_t i = 0; i < NGENERATED; i++)
+	{
+		corpus_gen_next(&gen, buf);
+		digests[ndigests++] = test_digest(buf);
+	}
+	for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++)
+		digests[ndigests++] = test_digest(edges[i]);
+	for (size_t i = 0; i < sizeof(huge_edges) / sizeof(huge_edges[0]); i++)
+	{
+		unsigned long bs = ULONG_MAX / 2 + 1;
+		snprintf(buf, sizeof(buf), huge_edges[i], i ? bs : bs / 2);
+		digests[ndigests++] = test_digest(buf);
+	}
+	CHECK(ffuzzy_compare_digest(&digests[ndigests - 4], &digests[ndigests - 3]) == 100);
+
+	ffuzzy_block_index *idx = ffuzzy_block_index_new();
+	CHECK(idx != NULL);
+	if (!idx)
+		return TEST_EXIT();
+	size_t nentries = 0;
+	for (size_t i = 0; i < ndigests; i++)
+	{
+		size_t id;
+		CHECK(ffuzzy_block_index_add(idx, &digests[i], &id) && id == i);
+		if (digests[i].len1 >= FFUZZY_MIN_MATCH)
+			nentries++;
+		if (digests[i].len2 >= FFUZZY_MIN_MATCH && digests[i].block_size <= ULONG_MAX / 2)
+			nentries++;
+	}
+	CHECK_INT(ffuzzy_block_index_size(idx), ndigests);
+	CHECK(ffuzzy_block_index_get(idx, ndigests - 1) != NULL);
+	CHECK(ffuzzy_block_index_get(idx, ndigests) == NULL);
+
+	// buckets are sorted by effective block sizes and hold every long block
+	size_t nbuckets = ffuzzy_block_index_num_buckets(idx), total = 0;
+	unsigned long last = 0;
+	for (size_t i = 0; i < nbuckets; i++)
+	{
+		unsigned long bs;
+		size_t count;
+		CHECK(ffuzzy_block_index_bucket(idx, i, &bs, &count));
+		CHECK(count != 0 && (i == 0 || bs > last));
+		last = bs;
+		total += count;
+	}
+	CHECK(!ffuzzy_block_index_bucket(idx, nbuckets, NULL, NULL));
+	CHECK_INT(total, nentries);
+
+	check_searches("linear", idx, false);
+	// trie search without trie views is a linear scan
+	check_searches("trie (not prepared)", idx, true);
+	CHECK(ffuzzy_block_index_prepare(idx));
+	check_searches("trie", idx, true);
+
+	// modified buckets fall back to the linear scan until prepared again
+	for (size_t i = 0; i < NADDED; i++)
+	{
+		size_t id;
+		corpus_gen_next(&gen, buf);
+		digests[ndigests] = test_digest(buf);
+		CHECK(ffuzzy_block_index_add(idx, &digests[ndigests], &id) && id == ndigests);
+		ndigests++;
+	}
+	check_searches("trie (modified)", idx, true);
+	CHECK(ffuzzy_block_index_prepare(idx));
+	check_searches("trie (prepared again)", idx, true);
+	check_searches("linear (after trie views)", idx, false);
+	ffuzzy_block_index_free(idx);
+	return TEST_EXIT();
+}
@@ -0,0 +1,172 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tests/test_cluster.c
+	Tests for incremental clustering
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\file  tests/test_cluster.c
+	\brief Tests for incremental clustering
+	\details
+		After each batch, clusters must be the connected components of
+		the pairwise score graph (labeled by their minimum digest IDs) and
+		the callback must have received every pair at or above the
+		threshold exactly once.
+**/
+
+#include "ffuzzy_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_test.h"
+#include "tools/ffuzzy_corpus.h"
+
+#define NDIGESTS 1200
+
+static ffuzzy_digest digests[NDIGESTS];
+/* pairwise scores (upper triangle) */
+static signed char scores[NDIGESTS][NDIGESTS];
+/* number of times each pair is reported */
+static unsigned char reported[NDIGESTS][NDIGESTS];
+static size_t nreported;
+static bool bad_pair;
+
+
+static void on_pair(void *ctx, size_t id1, size_t id2, int score)
+{
+	const int *threshold = ctx;
+	if (id1 >= id2 || id2 >= NDIGESTS || reported[id1][id2]
+		|| score != scores[id1][id2] || score < *threshold)
+	{
+		bad_pair = true;
+		return;
+	}
+	reported[id1][id2] = 1;
+	nreported++;
+}
+
+
+static size_t find(size_t *parent, size_t i)
+{
+	while (parent[i] != i)
+		i = parent[i] = parent[parent[i]];
+	return i;
+}
+
+/** \brief Check clusters of the first n digests against connected components **/
+static void check_clusters(const char *name, ffuzzy_clustering *cl, size_t n, int threshold)
+{
+	static size_t parent[NDIGESTS];
+	size_t nclusters = n;
+	for (size_t i = 0; i < n; i++)
+		parent[i] = i;
+	for (size_t i = 0; i < n; i++)
+		for (size_t j = i + 1; j < n; j++)
+		{
+			if (scores[i][j] < threshold)
+				continue;
+			size_t r1 = find(parent, i), r2 = find(parent, j);
+			if (r1 == r2)
+				continue;
+			// the root is the minimum ID
+			if (r1 < r2)
+				parent[r2] = r1;
+			else
+				parent[r1] = r2;
+			nclusters--;
+		}
+	if (ffuzzy_clustering_num_clusters(cl) != nclusters)
+	{
+		fprintf(stderr, "%s: %zu clusters (expected %zu)\n", name, ffuzzy_clustering_num_clusters(cl), nclusters);
+		test_failures++;
+	}
+	for (size_t i = 0; i < n; i++)
+	{
+		size_t label = ffuzzy_clustering_label(cl, i);
+		if (label != find(parent, i))
+		{
+			fprintf(stderr, "%s: digest %zu has label %zu (expected %zu)\n", name, i, label, find(parent, i));
+			test_failures++;
+			break;
+		}
+	}
+}
+
+
+int main(void)
+{
+	static const size_t batches[] = { 1, 1, 7, 100, 391, 700 };
+	static const int thresholds[] = { 1, 50, 90 };
+	char buf[FFUZZY_PRETTY_LEN];
+	corpus_gen gen;
+	corpus_gen_init(&gen, 5);
+	for (size_t i = 0; i < NDIGESTS; i++)
+	{
+		corpus_gen_next(&gen, buf);
+		digests[i] = test_digest(buf);
+	}
+	for (size_t i = 0; i < NDIGESTS; i++)
+		for (size_t j = i + 1; j < NDIGESTS; j++)
+			scores[i][j] = (signed char)ffuzzy_compare_digest(&digests[i], &digests[j]);
+
+	for (size_t t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); t++)
+	{
+		int threshold = thresholds[t];
+		// with a callback (all pairs) and without (pairs in a cluster are skipped)
+		for (int with_callback = 1; with_callback >= 0; with_callback--)
+		{
+			ffuzzy_clustering *cl = ffuzzy_clustering_new(threshold);
+			CHECK(cl != NULL);
+			if (!cl)
+				return TEST_EXIT();
+			memset(reported, 0, sizeof(reported));
+			nreported = 0;
+			bad_pair = false;
+			size_t n = 0;
+			for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++)
+			{
+				CHECK(ffuzzy_clustering_add(cl, digests + n, batches[b],
+					with_callback ? on_pair : NULL, (void*)&threshold));
+				n += batches[b];
+				CHECK_INT(ffuzzy_collection_size(ffuzzy_clustering_collection(cl)), n);
+				check_clusters(with_callback ? "callback" : "no callback", cl, n, threshold);
+			}
+			CHECK_INT(n, NDIGESTS);
+			if (with_callback)
+			{
+				size_t nexpected = 0;
+				for (size_t i = 0; i < NDIGESTS; i++)
+					for (size_t j = i + 1; j < NDIGESTS; j++)
+						if (scores[i][j] >= threshold)
+							nexpected++;
+				CHECK(!bad_pair);
+				CHECK_INT(nreported, nexpected);
+			}
+			ffuzzy_clustering_free(cl);
+		}
+	}
+	return TEST_EXIT();
+}
@@ -0,0 +1,152 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tests/test_db.c
+	Tests for digest databases
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\file  tests/test_db.c
+	\brief Tests for digest databases
+	\details
+		Databases are validated on opening but a mapped file may be
+		modified afterwards. Searches must skip records which became
+		invalid instead of trusting lengths in them.
+**/
+
+#include "ffuzzy_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_record.h"
+#include "ffuzzy_test.h"
+
+static const char *const digests[] = {
+	"192:ABCDEFGHIJ:KLMNOPQR",
+	"192:ABCDEFGHIJ:KLMNOPQS",
+	"192:ABCDEFGHIK:KLMNOPQR",
+	"384:UVWXYZabcd:efghijkl",
+};
+#define NDIGESTS (sizeof(digests) / sizeof(digests[0]))
+
+static void write_db(const char *path)
+{
+	FILE *fp = fopen(path, "wb");
+	if (!fp)
+	{
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	for (size_t i = 0; i < NDIGESTS; i++)
+	{
+		unsigned char rec[FFUZZY_RECORD_SIZE];
+		ffuzzy_digest d = test_digest(digests[i]);
+		ffuzzy_encode_digest_record(rec, 100 + i, &d);
+		fwrite(rec, FFUZZY_RECORD_SIZE, 1, fp);
+	}
+	if (fclose(fp))
+	{
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+}
+
+int main(void)
+{
+	char dir[256], path[512], bad[512];
+	test_mkdtemp(dir);
+	snprintf(path, sizeof(path), "%s/a.db", dir);
+	snprintf(bad, sizeof(bad), "%s/bad.db", dir);
+	write_db(path);
+
+	// unsorted or truncated files are rejected
+	FILE *fp = fopen(bad, "wb");
+	CHECK(fp != NULL);
+	if (fp)
+	{
+		unsigned char rec[FFUZZY_RECORD_SIZE];
+		ffuzzy_digest d = test_digest(digests[3]);
+		ffuzzy_encode_digest_record(rec, 0, &d);
+		fwrite(rec, FFUZZY_RECORD_SIZE, 1, fp);
+		d = test_digest(digests[0]);
+		ffuzzy_encode_digest_record(rec, 1, &d);
+		fwrite(rec, FFUZZY_RECORD_SIZE, 1, fp);
+		fclose(fp);
+	}
+	CHECK(ffuzzy_db_open(bad) == NULL);
+	CHECK(truncate(path, FFUZZY_RECORD_SIZE * NDIGESTS - 1) == 0);
+	CHECK(ffuzzy_db_open(path) == NULL);
+	write_db(path);
+
+	ffuzzy_db *db = ffuzzy_db_open(path);
+	CHECK(db != NULL);
+	if (!db)
+		return TEST_EXIT();
+	ffuzzy_digest query = test_digest(digests[0]);
+	ffuzzy_match_list list;
+	ffuzzy_match_list_init(&list);
+	const ffuzzy_db_snapshot *snap = ffuzzy_db_pin(db);
+	CHECK_INT(ffuzzy_db_snapshot_size(snap), NDIGESTS);
+	CHECK(ffuzzy_db_snapshot_search(snap, &query, 1, &list));
+	CHECK_INT(list.count, 3);
+	CHECK(list.count && list.matches[0].id == 0 && list.matches[0].score == 100);
+	unsigned long long id;
+	ffuzzy_digest d;
+	CHECK(ffuzzy_db_snapshot_get(snap, 3, &id, &d) && id == 103);
+	CHECK(!ffuzzy_db_snapshot_get(snap, NDIGESTS, &id, &d));
+
+	// modify lengths of a record in the mapped file
+	fp = fopen(path, "r+b");
+	CHECK(fp != NULL);
+	if (fp)
+	{
+		static const unsigned char lengths[2] = {0xff, 0xff};
+		fseek(fp, FFUZZY_RECORD_SIZE * 1 + FFUZZY_RECORD_OFFSET_LEN1, SEEK_SET);
+		fwrite(lengths, 1, 2, fp);
+		fclose(fp);
+	}
+	CHECK(ffuzzy_db_snapshot_search(snap, &query, 1, &list));
+	CHECK(list.count == 2 || list.count == 3);
+	for (size_t i = 0; i < list.count; i++)
+		CHECK(ffuzzy_db_snapshot_get(snap, list.matches[i].id, &id, &d));
+	ffuzzy_db_release(snap);
+
+	// swapping to an invalid file keeps the current snapshot
+	CHECK(!ffuzzy_db_swap(db, path));
+	snap = ffuzzy_db_pin(db);
+	CHECK_INT(ffuzzy_db_snapshot_size(snap), NDIGESTS);
+	ffuzzy_db_release(snap);
+	write_db(bad);
+	CHECK(ffuzzy_db_swap(db, bad));
+	snap = ffuzzy_db_pin(db);
+	CHECK(ffuzzy_db_snapshot_search(snap, &query, 1, &list));
+	CHECK_INT(list.count, 3);
+	ffuzzy_db_release(snap);
+
+	ffuzzy_match_list_free(&list);
+	ffuzzy_db_close(db);
+	if (!test_failures)
+		test_rmdir(dir);
+	return TEST_EXIT();
+}
@@ -0,0 +1,86 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tests/test_digest.c
+	Tests for digest validation
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <string.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_test.h"
+
+/** \brief Make a digest from raw blocks (without normalization) **/
+static ffuzzy_digest raw_digest(unsigned long block_size, const char *b1, const char *b2)
+{
+	ffuzzy_digest d;
+	d.block_size = block_size;
+	d.len1 = strlen(b1);
+	d.len2 = strlen(b2);
+	memcpy(d.digest, b1, d.len1);
+	memcpy(d.digest + d.len1, b2, d.len2);
+	return d;
+}
+
+int main(void)
+{
+	ffuzzy_digest d;
+
+	// sequences are checked within each block
+	d = raw_digest(3, "ABCDEFG", "HIJKLMN");
+	CHECK(ffuzzy_digest_is_valid(&d));
+	CHECK(ffuzzy_digest_is_natural(&d));
+	d = raw_digest(3, "AAAABC", "DEF");
+	CHECK(!ffuzzy_digest_is_valid(&d));
+	d = raw_digest(3, "ABCDEFG", "HIJKKKK");
+	CHECK(!ffuzzy_digest_is_valid(&d));
+	CHECK(!ffuzzy_digest_is_natural(&d));
+	d = raw_digest(3, "ABCDEFG", "XYQQQQ");
+	CHECK(!ffuzzy_digest_is_valid(&d));
+
+	// a sequence spanning the two blocks is valid
+	d = raw_digest(3, "ABCZ", "ZZZXYWVU");
+	CHECK(ffuzzy_digest_is_valid(&d));
+	CHECK(ffuzzy_digest_is_natural(&d));
+	d = raw_digest(3, "ABCZZZ", "ZZZ");
+	CHECK(ffuzzy_digest_is_valid(&d));
+	CHECK(ffuzzy_digest_is_natural(&d));
+
+	// non-base64 characters in either block
+	d = raw_digest(3, "AB*", "CDE");
+	CHECK(ffuzzy_digest_is_valid(&d));
+	CHECK(!ffuzzy_digest_is_natural(&d));
+	d = raw_digest(3, "ABCDEFG", "HI");
+	CHECK(ffuzzy_digest_is_natural(&d));
+	d = raw_digest(3, "ABCDEFG", "H*");
+	CHECK(!ffuzzy_digest_is_natural(&d));
+	d = raw_digest(3, "ABCDEFG", "HIJKLM*");
+	CHECK(!ffuzzy_digest_is_natural(&d));
+
+	// parsed digests are always valid
+	d = test_digest("3:ABCZZZZZ:ZZZZZZXY");
+	CHECK_INT(d.len1, 6);
+	CHECK_INT(d.len2, 5);
+	CHECK(ffuzzy_digest_is_valid(&d));
+
+	return TEST_EXIT();
+}
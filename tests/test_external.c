@@ -0,0 +1,191 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tests/test_external.c
+	Tests for external sort and out-of-core all-pairs comparison
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\file  tests/test_external.c
+	\brief Tests for external sort and out-of-core all-pairs comparison
+	\details
+		Sorted files must contain every input digest exactly once in
+		block size order, even if the runs are merged in multiple passes.
+		All-pairs comparison must report the same pairs as brute-force
+		ffuzzy_compare_digest, with and without chunked groups.
+**/
+
+#include "ffuzzy_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_test.h"
+#include "tools/ffuzzy_corpus.h"
+
+#define NDIGESTS 1000
+/* memory budget for about 8 records (125 runs, more than the merge fan-in) */
+#define SMALL_BUDGET (8 * (sizeof(unsigned long long) + sizeof(ffuzzy_digest)))
+
+static ffuzzy_digest digests[NDIGESTS];
+/* score of each pair reported by all-pairs comparison (plus one) */
+static unsigned char reported[NDIGESTS][NDIGESTS];
+static size_t nreported;
+static bool bad_pair;
+
+
+/** \brief Check that the file contains all digests sorted by block sizes **/
+static void check_sorted(const char *name, FILE *fp)
+{
+	static bool seen[NDIGESTS];
+	unsigned long long id, last_id = 0;
+	ffuzzy_digest d, last;
+	size_t n = 0;
+	memset(seen, 0, sizeof(seen));
+	rewind(fp);
+	while (ffuzzy_read_digest_record(fp, &id, &d))
+	{
+		if (id >= NDIGESTS || seen[id] || ffuzzy_digestcmp(&d, &digests[id]))
+		{
+			fprintf(stderr, "%s: unexpected record (id=%llu)\n", name, id);
+			test_failures++;
+			return;
+		}
+		if (n)
+		{
+			int c = ffuzzy_digestcmp_blocksize(&last, &d);
+			if (c > 0 || (c == 0 && last_id > id))
+			{
+				fprintf(stderr, "%s: not sorted at record %zu\n", name, n);
+				test_failures++;
+				return;
+			}
+		}
+		seen[id] = true;
+		last = d;
+		last_id = id;
+		n++;
+	}
+	CHECK(feof(fp) && !ferror(fp));
+	if (n != NDIGESTS)
+	{
+		fprintf(stderr, "%s: %zu records (expected %d)\n", name, n, NDIGESTS);
+		test_failures++;
+	}
+}
+
+
+static void on_pair(void *ctx, size_t id1, size_t id2, int score)
+{
+	(void)ctx;
+	if (id1 > id2)
+	{
+		size_t t = id1; id1 = id2; id2 = t;
+	}
+	if (id2 >= NDIGESTS || id1 == id2 || reported[id1][id2])
+	{
+		bad_pair = true;
+		return;
+	}
+	reported[id1][id2] = (unsigned char)(score + 1);
+	nreported++;
+}
+
+
+/** \brief Check all-pairs comparison against brute force **/
+static void check_allpairs(FILE *sorted, int threshold, size_t mem_budget)
+{
+	memset(reported, 0, sizeof(reported));
+	nreported = 0;
+	bad_pair = false;
+	CHECK(ffuzzy_external_allpairs(sorted, threshold, mem_budget, on_pair, NULL));
+	CHECK(!bad_pair);
+	size_t nexpected = 0;
+	for (size_t i = 0; i < NDIGESTS; i++)
+	{
+		for (size_t j = i + 1; j < NDIGESTS; j++)
+		{
+			int score = ffuzzy_compare_digest(&digests[i], &digests[j]);
+			if (score >= threshold)
+				nexpected++;
+			if (reported[i][j] != (score >= threshold ? score + 1 : 0))
+			{
+				fprintf(stderr, "threshold %d, budget %zu: pair (%zu, %zu) scored %d, reported %d\n",
+					threshold, mem_budget, i, j, score, reported[i][j] - 1);
+				test_failures++;
+				return;
+			}
+		}
+	}
+	CHECK(nexpected != 0);
+	CHECK_INT(nreported, nexpected);
+}
+
+
+int main(void)
+{
+	char buf[FFUZZY_PRETTY_LEN];
+	corpus_gen gen;
+	corpus_gen_init(&gen, 3);
+	FILE *text = tmpfile();
+	CHECK(text != NULL);
+	if (!text)
+		return TEST_EXIT();
+	fputs("ssdeep,1.1--blocksize:hash:hash,filename\n", text);
+	for (size_t i = 0; i < NDIGESTS; i++)
+	{
+		corpus_gen_next(&gen, buf);
+		digests[i] = test_digest(buf);
+		fprintf(text, "%s,\"file%zu\"\n", buf, i);
+	}
+	CHECK(!fflush(text));
+
+	// sort in memory and with many runs (multiple merge passes)
+	FILE *inmem = tmpfile(), *sorted = tmpfile(), *resorted = tmpfile();
+	CHECK(inmem != NULL && sorted != NULL && resorted != NULL);
+	if (!inmem || !sorted || !resorted)
+		return TEST_EXIT();
+	rewind(text);
+	CHECK(ffuzzy_external_sort(text, true, inmem, (size_t)1 << 24));
+	check_sorted("in memory", inmem);
+	rewind(text);
+	CHECK(ffuzzy_external_sort(text, true, sorted, SMALL_BUDGET));
+	check_sorted("multiple passes", sorted);
+	// sorting binary records preserves IDs
+	rewind(sorted);
+	CHECK(ffuzzy_external_sort(sorted, false, resorted, SMALL_BUDGET / 2));
+	check_sorted("binary input", resorted);
+
+	// all-pairs with resident groups and with chunked groups
+	check_allpairs(sorted, 1, (size_t)1 << 24);
+	check_allpairs(sorted, 60, (size_t)1 << 24);
+	check_allpairs(sorted, 1, SMALL_BUDGET);
+	check_allpairs(sorted, 60, SMALL_BUDGET);
+
+	fclose(text);
+	fclose(inmem);
+	fclose(sorted);
+	fclose(resorted);
+	return TEST_EXIT();
+}
@@ -0,0 +1,228 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tests/test_intern.c
+	Tests for block string interning and score memoization
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\file  tests/test_intern.c
+	\brief Tests for block string interning and score memoization
+	\details
+		Interning must map equal (effective block size, block string)
+		pairs and only them to the same ID. Scores of interned blocks and
+		digests must be the same with and without a memo table, including
+		a memo table so small that entries are evicted all the time.
+**/
+
+#include "ffuzzy_config.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_intern.h"
+#include "ffuzzy_test.h"
+#include "tools/ffuzzy_corpus.h"
+
+#define NGENERATED 500
+#define NMAX (NGENERATED * 2 + 8)
+
+static ffuzzy_digest digests[NMAX];
+static size_t ids[NMAX][2];
+static size_t ndigests;
+
+/* interned blocks (indexed by block IDs) */
+static struct
+{
+	unsigned long block_size;
+	const char *s;
+	size_t len;
+} blocks[NMAX * 2];
+static size_t nblocks;
+
+
+/** \brief Intern a block and check its ID **/
+static void intern(ffuzzy_block_table *tbl, unsigned long block_size, const char *s, size_t len, size_t *id)
+{
+	size_t expected = nblocks;
+	for (size_t i = 0; i < nblocks; i++)
+	{
+		if (blocks[i].block_size == block_size && blocks[i].len == len && !memcmp(blocks[i].s, s, len))
+		{
+			expected = i;
+			break;
+		}
+	}
+	CHECK(ffuzzy_block_table_intern(tbl, block_size, s, len, id));
+	CHECK_INT(*id, expected);
+	if (expected == nblocks)
+	{
+		blocks[nblocks].block_size = block_size;
+		blocks[nblocks].s = s;
+		blocks[nblocks].len = len;
+		nblocks++;
+	}
+}
+
+
+/** \brief Check scores of all block pairs with the same effective block size **/
+static void check_block_scores(const char *name, const ffuzzy_block_table *tbl, ffuzzy_score_memo *memo)
+{
+	for (size_t i = 0; i < nblocks; i++)
+	{
+		for (size_t j = 0; j < nblocks; j++)
+		{
+			int score = ffuzzy_block_table_score(tbl, memo, i, j);
+			int expected = blocks[i].block_size != blocks[j].block_size ? -1 :
+				ffuzzy_score_strings(blocks[i].s, blocks[i].len, blocks[j].s, blocks[j].len, blocks[i].block_size);
+			if (score != expected)
+			{
+				fprintf(stderr, "%s: blocks %zu and %zu scored %d (expected %d)\n", name, i, j, score, expected);
+				test_failures++;
+				return;
+			}
+		}
+	}
+}
+
+
+/** \brief Check digest comparison by interned blocks **/
+static void check_digest_scores(const char *name, const ffuzzy_block_table *tbl, ffuzzy_score_memo *memo, int threshold)
+{
+	for (size_t i = 0; i < ndigests; i++)
+	{
+		for (size_t j = 0; j < ndigests; j++)
+		{
+			if (!ffuzzy_blocksize_is_near(digests[i].block_size, digests[j].block_size))
+				continue;
+			int score = ffuzzy_block_table_compare_(tbl, memo, &digests[i], ids[i], &digests[j], ids[j], threshold);
+			int expected = ffuzzy_compare_digest(&digests[i], &digests[j]);
+			// only scores at or above the threshold are exact
+			if (expected >= threshold ? score != expected : score >= threshold)
+			{
+				fprintf(stderr, "%s (threshold %d): digests %zu and %zu scored %d (expected %d)\n",
+					name, threshold, i, j, score, expected);
+				test_failures++;
+				return;
+			}
+		}
+	}
+}
+
+
+int main(void)
+{
+	static const char *huge_edges[] = {
+		"%lu:ABCDEFGHIJ:KLMNOPQRS",
+		"%lu:KLMNOPQRS:ABC",
+		"%lu:KLMNOPQRS:ABC",
+	};
+	char buf[FFUZZY_PRETTY_LEN];
+	corpus_gen gen;
+	corpus_gen_init(&gen, 9);
+	for (size_t i = 0; i < NGENERATED; i++)
+	{
+		corpus_gen_next(&gen, buf);
+		digests[ndigests++] = test_digest(buf);
+	}
+	// duplicate digests and blocks (block 1 of one digest as block 2 of another)
+	for (size_t i = 0; i < NGENERATED / 2; i++)
+		digests[ndigests++] = digests[i * 2];
+	for (size_t i = 0; i < NGENERATED / 2; i++)
+	{
+		const ffuzzy_digest *d = &digests[i];
+		if (d->block_size % 2 || d->len1 < FFUZZY_MIN_MATCH)
+			continue;
+		snprintf(buf, sizeof(buf), "%lu:xyz:%.*s", d->block_size / 2, (int)d->len1, d->digest);
+		digests[ndigests++] = test_digest(buf);
+	}
+	for (size_t i = 0; i < sizeof(huge_edges) / sizeof(huge_edges[0]); i++)
+	{
+		unsigned long bs = ULONG_MAX / 2 + 1;
+		snprintf(buf, sizeof(buf), huge_edges[i], i ? bs : bs / 2);
+		digests[ndigests++] = test_digest(buf);
+	}
+
+	ffuzzy_block_table *tbl = ffuzzy_block_table_new();
+	ffuzzy_score_memo *tiny = ffuzzy_score_memo_new(2);
+	ffuzzy_score_memo *large = ffuzzy_score_memo_new(1 << 20);
+	CHECK(tbl && tiny && large);
+	if (!tbl || !tiny || !large)
+		return TEST_EXIT();
+
+	// interning (ffuzzy_block_table_intern_digest must agree with blocks)
+	unsigned long long total = 0;
+	for (size_t i = 0; i < ndigests; i++)
+	{
+		const ffuzzy_digest *d = &digests[i];
+		size_t id[2];
+		intern(tbl, d->block_size, d->digest, d->len1, &ids[i][0]);
+		total++;
+		if (d->block_size <= ULONG_MAX / 2)
+		{
+			intern(tbl, d->block_size * 2, d->digest + d->len1, d->len2, &ids[i][1]);
+			total++;
+		}
+		else
+			ids[i][1] = FFUZZY_BLOCK_ID_NONE;
+		CHECK(ffuzzy_block_table_intern_digest(tbl, d, id));
+		CHECK(id[0] == ids[i][0] && id[1] == ids[i][1]);
+		total += d->block_size <= ULONG_MAX / 2 ? 2 : 1;
+	}
+	CHECK_INT(ffuzzy_block_table_size(tbl), nblocks);
+	CHECK_INT(ffuzzy_block_table_total(tbl), total);
+	CHECK(nblocks < total / 2);
+	CHECK_INT(ffuzzy_block_table_score(tbl, NULL, 0, nblocks), -1);
+
+	// block scores (memo tables are direct-mapped: the tiny one keeps evicting)
+	unsigned long long hits, misses, misses_before;
+	check_block_scores("no memo", tbl, NULL);
+	check_block_scores("large memo", tbl, large);
+	check_block_scores("large memo (again)", tbl, large);
+	ffuzzy_score_memo_stats(large, &hits, NULL);
+	CHECK(hits != 0);
+	check_block_scores("tiny memo", tbl, tiny);
+	ffuzzy_score_memo_stats(tiny, &hits, &misses_before);
+	check_block_scores("tiny memo (after eviction)", tbl, tiny);
+	ffuzzy_score_memo_stats(tiny, &hits, &misses);
+	CHECK(misses > misses_before);
+	ffuzzy_score_memo_clear(tiny);
+	ffuzzy_score_memo_stats(tiny, &hits, &misses);
+	CHECK(hits == 0 && misses == 0);
+
+	// digest scores
+	static const int thresholds[] = { 1, 50, 90 };
+	for (size_t t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); t++)
+	{
+		check_digest_scores("no memo", tbl, NULL, thresholds[t]);
+		check_digest_scores("large memo", tbl, large, thresholds[t]);
+		check_digest_scores("tiny memo", tbl, tiny, thresholds[t]);
+	}
+
+	ffuzzy_score_memo_free(large);
+	ffuzzy_score_memo_free(tiny);
+	ffuzzy_block_table_free(tbl);
+	return TEST_EXIT();
+}
@@ -0,0 +1,171 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tests/test_join.c
+	Tests for similarity joins
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\file  tests/test_join.c
+	\brief Tests for similarity joins
+	\details
+		ffuzzy_join and ffuzzy_join_self must report exactly the pairs
+		ffuzzy_compare_digest scores at or above the threshold, once each,
+		with any number of threads. The sets contain generated families,
+		duplicates (interned blocks) and digests with huge block sizes.
+**/
+
+#include "ffuzzy_config.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_test.h"
+#include "tools/ffuzzy_corpus.h"
+
+#define NGENERATED 1600
+#define NMAX 1000
+
+static ffuzzy_digest a[NMAX], b[NMAX];
+static size_t na, nb;
+/* pairwise scores between a and b, and within a */
+static signed char scores_ab[NMAX][NMAX], scores_aa[NMAX][NMAX];
+/* score of each reported pair (plus one) */
+static unsigned char reported[NMAX][NMAX];
+static size_t nreported;
+static bool bad_pair;
+
+
+static void on_pair(void *ctx, size_t id1, size_t id2, int score)
+{
+	size_t n2 = *(const size_t*)ctx;
+	if (id1 >= na || id2 >= n2 || reported[id1][id2])
+	{
+		bad_pair = true;
+		return;
+	}
+	reported[id1][id2] = (unsigned char)(score + 1);
+	nreported++;
+}
+
+
+/** \brief Check reported pairs against pairwise scores **/
+static void check_pairs(const char *name, signed char (*scores)[NMAX], size_t n2, bool self, int threshold)
+{
+	size_t nexpected = 0;
+	CHECK(!bad_pair);
+	for (size_t i = 0; i < na; i++)
+	{
+		for (size_t j = self ? i + 1 : 0; j < n2; j++)
+		{
+			int score = scores[i][j];
+			if (score >= threshold)
+				nexpected++;
+			if (reported[i][j] != (score >= threshold ? score + 1 : 0))
+			{
+				fprintf(stderr, "%s (threshold %d): pair (%zu, %zu) scored %d, reported %d\n",
+					name, threshold, i, j, score, reported[i][j] - 1);
+				test_failures++;
+				return;
+			}
+		}
+	}
+	CHECK_INT(nreported, nexpected);
+}
+
+
+static void reset(void)
+{
+	memset(reported, 0, sizeof(reported));
+	nreported = 0;
+	bad_pair = false;
+}
+
+
+int main(void)
+{
+	static const char *edges[] = {
+		// block 2 of a huge block size has the same effective block size
+		// as block 1 of double of it (only if it fits)
+		"%lu:ABCDEFGHIJ:KLMNOPQRS",
+		"%lu:KLMNOPQRS:ABC",
+		"%lu:ABC:KLMNOPQRS",
+	};
+	static const int thresholds[] = { 1, 50, 80, 100 };
+	static const unsigned nthreads[] = { 1, 4 };
+	char buf[FFUZZY_PRETTY_LEN];
+	corpus_gen gen;
+	corpus_gen_init(&gen, 6);
+	// families are split between two sets
+	for (size_t i = 0; i < NGENERATED; i++)
+	{
+		corpus_gen_next(&gen, buf);
+		if (i % 2)
+			b[nb++] = test_digest(buf);
+		else
+			a[na++] = test_digest(buf);
+	}
+	// duplicates within and across sets
+	for (size_t i = 0; i < 50; i++)
+	{
+		a[na++] = a[i * 7];
+		b[nb++] = a[i * 7 + 1];
+	}
+	for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++)
+	{
+		unsigned long bs = ULONG_MAX / 2 + 1;
+		snprintf(buf, sizeof(buf), edges[i], i ? bs : bs / 2);
+		a[na++] = test_digest(buf);
+		b[nb++] = test_digest(buf);
+	}
+	for (size_t i = 0; i < na; i++)
+	{
+		for (size_t j = 0; j < nb; j++)
+			scores_ab[i][j] = (signed char)ffuzzy_compare_digest(&a[i], &b[j]);
+		for (size_t j = i + 1; j < na; j++)
+			scores_aa[i][j] = (signed char)ffuzzy_compare_digest(&a[i], &a[j]);
+	}
+	CHECK_INT(scores_ab[na - 1][nb - 1], 100);
+
+	for (size_t t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); t++)
+	{
+		for (size_t k = 0; k < sizeof(nthreads) / sizeof(nthreads[0]); k++)
+		{
+			reset();
+			CHECK(ffuzzy_join(a, na, b, nb, thresholds[t], nthreads[k], on_pair, &nb));
+			check_pairs("join", scores_ab, nb, false, thresholds[t]);
+			reset();
+			CHECK(ffuzzy_join_self(a, na, thresholds[t], nthreads[k], on_pair, &na));
+			check_pairs("join_self", scores_aa, na, true, thresholds[t]);
+		}
+	}
+	// empty sets
+	reset();
+	CHECK(ffuzzy_join(a, 0, b, nb, 1, 1, on_pair, &nb));
+	CHECK(ffuzzy_join(a, na, b, 0, 1, 1, on_pair, &nb));
+	CHECK(ffuzzy_join_self(a, 1, 1, 1, on_pair, &na));
+	CHECK_INT(nreported, 0);
+	return TEST_EXIT();
+}
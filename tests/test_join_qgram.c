@@ -0,0 +1,189 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tests/test_join_qgram.c
+	Tests for q-gram similarity joins
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\file  tests/test_join_qgram.c
+	\brief Tests for q-gram similarity joins
+	\details
+		Count filtering must not lose pairs: ffuzzy_join_qgram and
+		ffuzzy_join_self_qgram must report exactly the pairs
+		ffuzzy_compare_digest scores at or above the threshold, once each
+		and in ascending order, for thresholds from 1 to 100. The sets
+		contain generated families, blocks around FFUZZY_MIN_MATCH
+		characters and digests with huge block sizes.
+**/
+
+#include "ffuzzy_config.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_test.h"
+#include "tools/ffuzzy_corpus.h"
+
+#define NGENERATED 1200
+#define NMAX 700
+
+static ffuzzy_digest a[NMAX], b[NMAX];
+static size_t na, nb;
+/* pairwise scores between a and b, and within a */
+static signed char scores_ab[NMAX][NMAX], scores_aa[NMAX][NMAX];
+/* score of each reported pair (plus one) */
+static unsigned char reported[NMAX][NMAX];
+static size_t nreported, last1, last2;
+static bool bad_pair;
+
+
+static void on_pair(void *ctx, size_t id1, size_t id2, int score)
+{
+	size_t n2 = *(const size_t*)ctx;
+	if (id1 >= na || id2 >= n2 || reported[id1][id2]
+		|| (nreported && (id1 < last1 || (id1 == last1 && id2 <= last2))))
+	{
+		bad_pair = true;
+		return;
+	}
+	reported[id1][id2] = (unsigned char)(score + 1);
+	nreported++;
+	last1 = id1;
+	last2 = id2;
+}
+
+
+/** \brief Check reported pairs against pairwise scores **/
+static void check_pairs(const char *name, signed char (*scores)[NMAX], size_t n2, bool self, int threshold)
+{
+	size_t nexpected = 0;
+	CHECK(!bad_pair);
+	for (size_t i = 0; i < na; i++)
+	{
+		for (size_t j = self ? i + 1 : 0; j < n2; j++)
+		{
+			int score = scores[i][j];
+			if (score >= threshold)
+				nexpected++;
+			if (reported[i][j] != (score >= threshold ? score + 1 : 0))
+			{
+				fprintf(stderr, "%s (threshold %d): pair (%zu, %zu) scored %d, reported %d\n",
+					name, threshold, i, j, score, reported[i][j] - 1);
+				test_failures++;
+				return;
+			}
+		}
+	}
+	CHECK_INT(nreported, nexpected);
+}
+
+
+static void reset(void)
+{
+	memset(reported, 0, sizeof(reported));
+	nreported = 0;
+	bad_pair = false;
+}
+
+
+int main(void)
+{
+	static const char *edges[] = {
+		// blocks with (around) FFUZZY_MIN_MATCH characters
+		"192:ABCDEFG:HIJKLMN",
+		"192:ABCDEFG:HIJKLMO",
+		"192:ABCDEFH:HIJKLMN",
+		"192:ABCDEF:HIJKLMN",
+		"192:ABCDEFGH:HIJKLM",
+		"192:ABCDEFGXYZabcdefghijkl:HIJKLMNxyz",
+		"384:HIJKLMN:ABC",
+		"384:HIJKLMNO:QRS",
+		"96:xyz:ABCDEFG",
+		"96:xyzw:ABCDEFGH",
+	};
+	static const char *huge_edges[] = {
+		// block 2 of a huge block size has the same effective block size
+		// as block 1 of double of it (only if it fits)
+		"%lu:ABCDEFGHIJ:KLMNOPQRS",
+		"%lu:KLMNOPQRS:ABC",
+		"%lu:ABC:KLMNOPQRS",
+	};
+	char buf[FFUZZY_PRETTY_LEN];
+	corpus_gen gen;
+	corpus_gen_init(&gen, 7);
+	// families are split between two sets
+	for (size_t i = 0; i < NGENERATED; i++)
+	{
+		corpus_gen_next(&gen, buf);
+		if (i % 2)
+			b[nb++] = test_digest(buf);
+		else
+			a[na++] = test_digest(buf);
+	}
+	for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++)
+	{
+		a[na++] = test_digest(edges[i]);
+		b[nb++] = test_digest(edges[i]);
+	}
+	for (size_t i = 0; i < sizeof(huge_edges) / sizeof(huge_edges[0]); i++)
+	{
+		unsigned long bs = ULONG_MAX / 2 + 1;
+		snprintf(buf, sizeof(buf), huge_edges[i], i ? bs : bs / 2);
+		a[na++] = test_digest(buf);
+		b[nb++] = test_digest(buf);
+	}
+	for (size_t i = 0; i < na; i++)
+	{
+		for (size_t j = 0; j < nb; j++)
+			scores_ab[i][j] = (signed char)ffuzzy_compare_digest(&a[i], &b[j]);
+		for (size_t j = i + 1; j < na; j++)
+			scores_aa[i][j] = (signed char)ffuzzy_compare_digest(&a[i], &a[j]);
+	}
+	CHECK_INT(scores_ab[na - 1][nb - 1], 100);
+
+	for (int threshold = 1; threshold <= 100; threshold++)
+	{
+		reset();
+		CHECK(ffuzzy_join_qgram(a, na, b, nb, threshold, on_pair, &nb));
+		check_pairs("join_qgram", scores_ab, nb, false, threshold);
+		reset();
+		CHECK(ffuzzy_join_self_qgram(a, na, threshold, on_pair, &na));
+		check_pairs("join_self_qgram", scores_aa, na, true, threshold);
+	}
+	// thresholds out of range
+	reset();
+	CHECK(ffuzzy_join_qgram(a, na, b, nb, 0, on_pair, &nb));
+	check_pairs("join_qgram", scores_ab, nb, false, 1);
+	reset();
+	CHECK(ffuzzy_join_qgram(a, na, b, nb, 101, on_pair, &nb));
+	CHECK_INT(nreported, 0);
+	// empty sets
+	CHECK(ffuzzy_join_qgram(a, 0, b, nb, 1, on_pair, &nb));
+	CHECK(ffuzzy_join_qgram(a, na, b, 0, 1, on_pair, &nb));
+	CHECK(ffuzzy_join_self_qgram(a, 1, 1, on_pair, &na));
+	CHECK_INT(nreported, 0);
+	return TEST_EXIT();
+}
@@ -0,0 +1,144 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tests/test_lsh.c
+	Tests for MinHash/LSH indices
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\file  tests/test_lsh.c
+	\brief Tests for MinHash/LSH indices
+	\details
+		Searches are approximate but every result must be a real match
+		with the exact score, and identical digests must always be found
+		(including those with block sizes too large to double).
+**/
+
+#include "ffuzzy_config.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_test.h"
+#include "tools/ffuzzy_corpus.h"
+
+#define NDIGESTS 1000
+#define NHUGE 6
+
+static ffuzzy_digest digests[NDIGESTS + NHUGE];
+
+
+/** \brief Check search results of a query against brute force **/
+static void check_query(const ffuzzy_lsh_index *idx, size_t n, size_t q, int threshold)
+{
+	ffuzzy_match_list list;
+	ffuzzy_match_list_init(&list);
+	CHECK(ffuzzy_lsh_index_search(idx, &digests[q], threshold, &list, NULL));
+	bool self = false;
+	for (size_t i = 0; i < list.count; i++)
+	{
+		size_t id = list.matches[i].id;
+		int score = id < n ? ffuzzy_compare_digest(&digests[q], &digests[id]) : -1;
+		if (score != list.matches[i].score || score < threshold)
+		{
+			fprintf(stderr, "query %zu: unexpected match (id=%zu, score=%d)\n", q, id, list.matches[i].score);
+			test_failures++;
+			break;
+		}
+		if (i && list.matches[i - 1].score < score)
+		{
+			fprintf(stderr, "query %zu: results are not sorted\n", q);
+			test_failures++;
+			break;
+		}
+		if (id == q)
+			self = true;
+	}
+	if (!self && ffuzzy_compare_digest(&digests[q], &digests[q]) >= threshold)
+	{
+		fprintf(stderr, "query %zu: identical digest is not found\n", q);
+		test_failures++;
+	}
+	ffuzzy_match_list_free(&list);
+}
+
+
+int main(void)
+{
+	char buf[FFUZZY_PRETTY_LEN];
+	corpus_gen gen;
+	corpus_gen_init(&gen, 4);
+	for (size_t i = 0; i < NDIGESTS; i++)
+	{
+		corpus_gen_next(&gen, buf);
+		digests[i] = test_digest(buf);
+	}
+	// huge block sizes: block 1 is too short to match (only block 2 is)
+	// and block 1 of the last digest is the same as block 2 of others
+	unsigned long huge1 = ULONG_MAX / 4 + 1, huge2 = ULONG_MAX / 2 + 1;
+	snprintf(buf, sizeof(buf), "%lu:ABC:KLMNOPQRS", huge1);
+	digests[NDIGESTS + 0] = test_digest(buf);
+	snprintf(buf, sizeof(buf), "%lu:ABC:KLMNOPQRS", huge2);
+	digests[NDIGESTS + 1] = test_digest(buf);
+	snprintf(buf, sizeof(buf), "%lu:KLMNOPQRS:ABC", huge2);
+	digests[NDIGESTS + 2] = test_digest(buf);
+	snprintf(buf, sizeof(buf), "%lu:ABCDEFGHIJ:TUVWXYZab", huge2);
+	digests[NDIGESTS + 3] = test_digest(buf);
+	snprintf(buf, sizeof(buf), "%lu:ABCDEFGHIJ:TUVWXYZac", huge2);
+	digests[NDIGESTS + 4] = test_digest(buf);
+	snprintf(buf, sizeof(buf), "%lu:KLMNOPQRS:KLMNOPQRS", huge2);
+	digests[NDIGESTS + 5] = test_digest(buf);
+	// the effective block size of huge1 block 2 is huge2
+	CHECK_INT(ffuzzy_compare_digest(&digests[NDIGESTS + 0], &digests[NDIGESTS + 2]), 100);
+	CHECK_INT(ffuzzy_compare_digest(&digests[NDIGESTS + 1], &digests[NDIGESTS + 1]), 100);
+
+	static const unsigned settings[][2] = { { 1, 1 }, { 8, 4 }, { 32, 2 } };
+	for (size_t s = 0; s < sizeof(settings) / sizeof(settings[0]); s++)
+	{
+		ffuzzy_lsh_index *idx = ffuzzy_lsh_index_new(settings[s][0], settings[s][1]);
+		CHECK(idx != NULL);
+		if (!idx)
+			return TEST_EXIT();
+		for (size_t i = 0; i < NDIGESTS + NHUGE; i++)
+		{
+			size_t id;
+			CHECK(ffuzzy_lsh_index_add(idx, &digests[i], &id));
+			CHECK_INT(id, i);
+		}
+		CHECK_INT(ffuzzy_lsh_index_size(idx), NDIGESTS + NHUGE);
+		for (size_t q = 0; q < NDIGESTS; q += 7)
+		{
+			check_query(idx, NDIGESTS + NHUGE, q, 1);
+			check_query(idx, NDIGESTS + NHUGE, q, 80);
+		}
+		for (size_t q = NDIGESTS; q < NDIGESTS + NHUGE; q++)
+		{
+			check_query(idx, NDIGESTS + NHUGE, q, 1);
+			check_query(idx, NDIGESTS + NHUGE, q, 100);
+		}
+		ffuzzy_lsh_index_free(idx);
+	}
+	return TEST_EXIT();
+}
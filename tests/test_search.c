@@ -0,0 +1,332 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tests/test_search.c
+	Tests for search entry points against pairwise comparison
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\file  tests/test_search.c
+	\brief Tests for search entry points against pairwise comparison
+	\details
+		Every search entry point must return exactly the digests
+		ffuzzy_compare_digest scores at or above the threshold
+		(best match first). The corpus contains generated families
+		and digests with edge-case block sizes. Bounded searches which
+		run out of the budget must return a subset of the matches.
+**/
+
+#include "ffuzzy_config.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_test.h"
+#include "tools/ffuzzy_corpus.h"
+
+#define NGENERATED 3000
+
+static ffuzzy_digest *corpus;
+static size_t ncorpus;
+
+
+/** \brief Check a result list against expected scores (-1 if not to be found) **/
+static void check_list(const char *name, const ffuzzy_match *matches, size_t count, const int *expected)
+{
+	size_t nexpected = 0;
+	for (size_t i = 0; i < ncorpus; i++)
+		if (expected[i] >= 0)
+			nexpected++;
+	if (count != nexpected)
+	{
+		fprintf(stderr, "%s: %zu matches (expected %zu)\n", name, count, nexpected);
+		test_failures++;
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		if (matches[i].id >= ncorpus || matches[i].score != expected[matches[i].id])
+		{
+			fprintf(stderr, "%s: unexpected match (id=%zu, score=%d)\n", name, matches[i].id, matches[i].score);
+			test_failures++;
+			break;
+		}
+		if (i && (matches[i - 1].score < matches[i].score ||
+			(matches[i - 1].score == matches[i].score && matches[i - 1].id > matches[i].id)))
+		{
+			fprintf(stderr, "%s: matches are not ordered\n", name);
+			test_failures++;
+			break;
+		}
+	}
+}
+
+
+/** \brief Check partial results (all matches must be expected; complete results must be exact) **/
+static void check_subset(const char *name, const ffuzzy_match *matches, size_t count, const int *expected, bool complete)
+{
+	if (complete)
+	{
+		check_list(name, matches, count, expected);
+		return;
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		if (matches[i].id >= ncorpus || matches[i].score != expected[matches[i].id])
+		{
+			fprintf(stderr, "%s: unexpected match (id=%zu, score=%d)\n", name, matches[i].id, matches[i].score);
+			test_failures++;
+			break;
+		}
+	}
+}
+
+
+static int blocksize_cmp(const void *a, const void *b)
+{
+	const ffuzzy_digest *d1 = &corpus[*(const size_t*)a], *d2 = &corpus[*(const size_t*)b];
+	if (d1->block_size != d2->block_size)
+		return d1->block_size < d2->block_size ? -1 : +1;
+	return *(const size_t*)a < *(const size_t*)b ? -1 : +1;
+}
+
+/** \brief Write the corpus as a digest database (records sorted by block sizes) **/
+static void write_db(const char *path)
+{
+	size_t *order = malloc(sizeof(size_t) * ncorpus);
+	FILE *fp = fopen(path, "wb");
+	if (!order || !fp)
+	{
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	for (size_t i = 0; i < ncorpus; i++)
+		order[i] = i;
+	qsort(order, ncorpus, sizeof(size_t), blocksize_cmp);
+	for (size_t i = 0; i < ncorpus; i++)
+	{
+		unsigned char rec[FFUZZY_RECORD_SIZE];
+		ffuzzy_encode_digest_record(rec, order[i], &corpus[order[i]]);
+		fwrite(rec, FFUZZY_RECORD_SIZE, 1, fp);
+	}
+	if (fclose(fp))
+	{
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	free(order);
+}
+
+
+int main(void)
+{
+	static const char *edges[] = {
+		// block 2 of huge block sizes only matters for identical digests
+		"%lu::ABCDEFGHIJKLMN",
+		"%lu:ABCDEFGHIJKLMN:OPQRSTUVWXYZab",
+		"%lu:OPQRSTUVWXYZab:",
+	};
+	static const int thresholds[] = {1, 50};
+	char dir[256], path[512], buf[FFUZZY_PRETTY_LEN];
+	corpus_gen gen;
+	corpus = malloc(sizeof(ffuzzy_digest) * (NGENERATED + 8));
+	if (!corpus)
+		return EXIT_FAILURE;
+	corpus_gen_init(&gen, 1);
+	for (size_t i = 0; i < NGENERATED; i++)
+	{
+		corpus_gen_next(&gen, buf);
+		corpus[ncorpus++] = test_digest(buf);
+	}
+	for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++)
+	{
+		snprintf(buf, sizeof(buf), edges[i], i < 2 ? ULONG_MAX - 3 : (ULONG_MAX - 3) / 2);
+		corpus[ncorpus++] = test_digest(buf);
+	}
+	corpus[ncorpus++] = test_digest("3:ABCDEFGH:IJKLMNOP");
+	corpus[ncorpus++] = test_digest("3:ABCDEF:GH");
+
+	// queries: edge cases and some generated digests
+	size_t nqueries = 0;
+	ffuzzy_digest queries[64];
+	for (size_t i = NGENERATED; i < ncorpus; i++)
+		queries[nqueries++] = corpus[i];
+	for (size_t i = 0; i < NGENERATED && nqueries < 64; i += 97)
+		queries[nqueries++] = corpus[i];
+
+	ffuzzy_collection *coll = ffuzzy_collection_new();
+	ffuzzy_concurrent_index *cidx = ffuzzy_concurrent_index_new();
+	test_mkdtemp(dir);
+	snprintf(path, sizeof(path), "%s/store", dir);
+	ffuzzy_store *store = ffuzzy_store_open(path);
+	CHECK(coll && cidx && store);
+	if (!coll || !cidx || !store)
+		return TEST_EXIT();
+	for (size_t i = 0; i < ncorpus; i++)
+	{
+		size_t id;
+		CHECK(ffuzzy_collection_add(coll, &corpus[i], &id) && id == i);
+		CHECK(ffuzzy_concurrent_index_add(cidx, &corpus[i], &id) && id == i);
+		CHECK(ffuzzy_store_add(store, &corpus[i], &id) && id == i);
+	}
+	snprintf(path, sizeof(path), "%s/corpus.db", dir);
+	write_db(path);
+	ffuzzy_db *db = ffuzzy_db_open(path);
+	ffuzzy_concurrent_reader *reader = ffuzzy_concurrent_reader_new(cidx);
+	ffuzzy_result_cache *cache = ffuzzy_result_cache_new(64, 4);
+	CHECK(db && reader && cache);
+	if (!db || !reader || !cache)
+		return TEST_EXIT();
+
+	int *expected = malloc(sizeof(int) * ncorpus * nqueries);
+	ffuzzy_match *matches = malloc(sizeof(ffuzzy_match) * ncorpus);
+	ffuzzy_match_list list, batch[64];
+	ffuzzy_match_list_init(&list);
+	for (size_t q = 0; q < nqueries; q++)
+		ffuzzy_match_list_init(&batch[q]);
+	if (!expected || !matches)
+		return EXIT_FAILURE;
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		// the second pass uses n-gram indexes and compacted structures
+		if (pass)
+		{
+			CHECK(ffuzzy_collection_build_index(coll, 1));
+			CHECK(ffuzzy_concurrent_index_compact(cidx));
+			CHECK(ffuzzy_store_compact(store));
+			ffuzzy_result_cache_clear(cache);
+		}
+		for (size_t t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); t++)
+		{
+			int threshold = thresholds[t];
+			for (size_t q = 0; q < nqueries; q++)
+			{
+				int *exp = expected + ncorpus * q;
+				for (size_t i = 0; i < ncorpus; i++)
+				{
+					int score = ffuzzy_compare_digest(&queries[q], &corpus[i]);
+					exp[i] = score >= threshold ? score : -1;
+				}
+			}
+			CHECK(ffuzzy_collection_search_batch(coll, queries, nqueries, threshold, 0, batch));
+			for (size_t q = 0; q < nqueries; q++)
+			{
+				const ffuzzy_digest *query = &queries[q];
+				const int *exp = expected + ncorpus * q;
+				ffuzzy_search_coverage coverage;
+				ffuzzy_search_budget budget = { 0, 1 };
+				ffuzzy_plan plan;
+				size_t n;
+
+				check_list("batch", batch[q].matches, batch[q].count, exp);
+				CHECK(ffuzzy_collection_search(coll, query, threshold, &list));
+				check_list("search", list.matches, list.count, exp);
+				n = ffuzzy_collection_topk(coll, query, ncorpus, threshold, matches);
+				check_list("topk", matches, n, exp);
+				CHECK(ffuzzy_collection_search_planned(coll, query, threshold, NULL, &list));
+				check_list("planned", list.matches, list.count, exp);
+				CHECK(ffuzzy_collection_plan(coll, query, threshold, &plan));
+				CHECK(plan.threshold == threshold && plan.nsteps <= 3);
+				CHECK(ffuzzy_collection_search_planned(coll, query, threshold, &plan, &list));
+				check_list("planned (explicit)", list.matches, list.count, exp);
+				CHECK(ffuzzy_collection_search_bounded(coll, query, threshold, NULL, &list, &coverage));
+				CHECK(coverage.complete);
+				check_list("bounded", list.matches, list.count, exp);
+				// one tile per partition at most
+				CHECK(ffuzzy_collection_search_bounded(coll, query, threshold, &budget, &list, &coverage));
+				CHECK(coverage.covered <= coverage.count);
+				CHECK(coverage.complete == (coverage.covered == coverage.count));
+				check_subset("bounded (budget)", list.matches, list.count, exp, coverage.complete);
+				for (int r = 0; r < 2; r++)
+				{
+					CHECK(ffuzzy_collection_search_cached(cache, coll, query, threshold, &list));
+					check_list("cached", list.matches, list.count, exp);
+					n = ffuzzy_collection_topk_cached(cache, coll, query, ncorpus, threshold, matches);
+					check_list("topk_cached", matches, n, exp);
+				}
+				CHECK(ffuzzy_concurrent_index_search(reader, query, threshold, &list));
+				check_list("concurrent", list.matches, list.count, exp);
+				CHECK(ffuzzy_store_search(store, query, threshold, &list));
+				check_list("store", list.matches, list.count, exp);
+
+				// database matches are record indices
+				const ffuzzy_db_snapshot *snap = ffuzzy_db_pin(db);
+				CHECK(ffuzzy_db_snapshot_search(snap, query, threshold, &list));
+				for (size_t i = 0; i < list.count; i++)
+				{
+					unsigned long long id;
+					ffuzzy_digest d;
+					CHECK(ffuzzy_db_snapshot_get(snap, list.matches[i].id, &id, &d));
+					matches[i].id = (size_t)id;
+					matches[i].score = list.matches[i].score;
+				}
+				ffuzzy_db_release(snap);
+				n = list.count;
+				// reorder ties by digest IDs
+				for (size_t i = 1; i < n; i++)
+					for (size_t j = i; j && matches[j - 1].score == matches[j].score && matches[j - 1].id > matches[j].id; j--)
+					{
+						ffuzzy_match tmp = matches[j];
+						matches[j] = matches[j - 1];
+						matches[j - 1] = tmp;
+					}
+				check_list("db", matches, n, exp);
+			}
+		}
+	}
+
+	// identical digests with huge block sizes are found by every entry point
+	CHECK(expected[NGENERATED] == 100);
+
+	// cached results are not reused after the collection is modified
+	ffuzzy_result_cache_counters counters;
+	ffuzzy_result_cache_stats(cache, &counters);
+	CHECK(counters.hits != 0);
+	CHECK(ffuzzy_collection_search_cached(cache, coll, &queries[0], 1, &list));
+	size_t nbefore = list.count;
+	CHECK(ffuzzy_collection_add(coll, &queries[0], NULL));
+	CHECK(ffuzzy_collection_search_cached(cache, coll, &queries[0], 1, &list));
+	CHECK_INT(list.count, nbefore + 1);
+
+	for (size_t q = 0; q < nqueries; q++)
+		ffuzzy_match_list_free(&batch[q]);
+	ffuzzy_match_list_free(&list);
+	free(matches);
+	free(expected);
+	ffuzzy_result_cache_free(cache);
+	ffuzzy_concurrent_reader_free(reader);
+	ffuzzy_concurrent_index_free(cidx);
+	ffuzzy_db_close(db);
+	CHECK(ffuzzy_store_close(store));
+	ffuzzy_collection_free(coll);
+	free(corpus);
+	if (!test_failures)
+	{
+		snprintf(path, sizeof(path), "%s/store", dir);
+		test_rmdir(path);
+		test_rmdir(dir);
+	}
+	return TEST_EXIT();
+}
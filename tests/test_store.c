@@ -0,0 +1,235 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tests/test_store.c
+	Tests for persistent digest stores
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\file  tests/test_store.c
+	\brief Tests for persistent digest stores
+	\details
+		Digests added to a store must survive reopening, compaction,
+		a torn tail of a delta segment (left by a crash) and
+		failed writes (all successful additions are kept).
+**/
+
+#include "ffuzzy_config.h"
+
+#include <dirent.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_test.h"
+#include "tools/ffuzzy_corpus.h"
+
+#define NDIGESTS 1000
+
+static ffuzzy_digest digests[NDIGESTS];
+/* digest added with each ID (index into digests) */
+static size_t added[NDIGESTS * 2];
+static size_t nadded;
+
+
+/** \brief Add a digest and record its ID **/
+static bool add(ffuzzy_store *store, size_t i)
+{
+	size_t id;
+	if (!ffuzzy_store_add(store, &digests[i], &id))
+		return false;
+	CHECK_INT(id, nadded);
+	if (id == nadded)
+		added[nadded++] = i;
+	return true;
+}
+
+
+/** \brief Check the size and search results of the store against added digests **/
+static void check_store(const char *name, ffuzzy_store *store)
+{
+	ffuzzy_match_list list;
+	ffuzzy_match_list_init(&list);
+	if (ffuzzy_store_size(store) != nadded)
+	{
+		fprintf(stderr, "%s: %zu digests (expected %zu)\n", name, ffuzzy_store_size(store), nadded);
+		test_failures++;
+	}
+	for (size_t q = 0; q < NDIGESTS; q += 37)
+	{
+		size_t nexpected = 0;
+		for (size_t i = 0; i < nadded; i++)
+			if (ffuzzy_compare_digest(&digests[q], &digests[added[i]]))
+				nexpected++;
+		CHECK(ffuzzy_store_search(store, &digests[q], 1, &list));
+		if (list.count != nexpected)
+		{
+			fprintf(stderr, "%s: %zu matches (expected %zu)\n", name, list.count, nexpected);
+			test_failures++;
+			break;
+		}
+		for (size_t i = 0; i < list.count; i++)
+		{
+			if (list.matches[i].id >= nadded ||
+				ffuzzy_compare_digest(&digests[q], &digests[added[list.matches[i].id]]) != list.matches[i].score)
+			{
+				fprintf(stderr, "%s: unexpected match (id=%zu)\n", name, list.matches[i].id);
+				test_failures++;
+				break;
+			}
+		}
+	}
+	ffuzzy_match_list_free(&list);
+}
+
+
+/** \brief Append bytes to the last delta segment (as a crash while appending) **/
+static void append_to_log(const char *dir, const void *buf, size_t size)
+{
+	char path[512];
+	unsigned long long gen, last = 0;
+	DIR *d = opendir(dir);
+	CHECK(d != NULL);
+	if (!d)
+		return;
+	struct dirent *e;
+	while ((e = readdir(d)) != NULL)
+		if (sscanf(e->d_name, "delta-%llu.log", &gen) == 1 && gen > last)
+			last = gen;
+	closedir(d);
+	snprintf(path, sizeof(path), "%s/delta-%llu.log", dir, last);
+	FILE *fp = fopen(path, "ab");
+	CHECK(fp != NULL);
+	if (fp)
+	{
+		fwrite(buf, 1, size, fp);
+		fclose(fp);
+	}
+}
+
+
+int main(void)
+{
+	char dir[256], path[512], buf[FFUZZY_PRETTY_LEN];
+	corpus_gen gen;
+	corpus_gen_init(&gen, 2);
+	for (size_t i = 0; i < NDIGESTS; i++)
+	{
+		corpus_gen_next(&gen, buf);
+		digests[i] = test_digest(buf);
+	}
+	test_mkdtemp(dir);
+	snprintf(path, sizeof(path), "%s/store", dir);
+
+	// add, reopen and compact
+	ffuzzy_store *store = ffuzzy_store_open(path);
+	CHECK(store != NULL);
+	if (!store)
+		return TEST_EXIT();
+	for (size_t i = 0; i < NDIGESTS / 2; i++)
+		CHECK(add(store, i));
+	check_store("added", store);
+	CHECK(ffuzzy_store_close(store));
+	store = ffuzzy_store_open(path);
+	CHECK(store != NULL);
+	if (!store)
+		return TEST_EXIT();
+	check_store("reopened", store);
+	CHECK(ffuzzy_store_compact(store));
+	check_store("compacted", store);
+	for (size_t i = NDIGESTS / 2; i < NDIGESTS * 3 / 4; i++)
+		CHECK(add(store, i));
+	check_store("added after compaction", store);
+	CHECK(ffuzzy_store_close(store));
+	store = ffuzzy_store_open(path);
+	CHECK(store != NULL);
+	if (!store)
+		return TEST_EXIT();
+	check_store("reopened after compaction", store);
+	CHECK(ffuzzy_store_close(store));
+
+	// torn tails (a short entry and an entry with a CRC mismatch) are discarded
+	static const unsigned char garbage[FFUZZY_RECORD_SIZE + 4 + 70] = { 0x01 };
+	append_to_log(path, garbage, 70);
+	store = ffuzzy_store_open(path);
+	CHECK(store != NULL);
+	if (!store)
+		return TEST_EXIT();
+	check_store("torn tail", store);
+	CHECK(add(store, 0));
+	CHECK(ffuzzy_store_close(store));
+	append_to_log(path, garbage, sizeof(garbage));
+	store = ffuzzy_store_open(path);
+	CHECK(store != NULL);
+	if (!store)
+		return TEST_EXIT();
+	check_store("corrupted tail", store);
+
+#if defined(RLIMIT_FSIZE) && defined(SIGXFSZ)
+	// failed writes do not lose later additions
+	struct rlimit limit, saved;
+	if (!getrlimit(RLIMIT_FSIZE, &saved) && saved.rlim_cur == RLIM_INFINITY)
+	{
+		// start with an empty delta segment
+		CHECK(ffuzzy_store_compact(store));
+		signal(SIGXFSZ, SIG_IGN);
+		limit = saved;
+		limit.rlim_cur = 4096 * 3 + 1000;
+		CHECK(!setrlimit(RLIMIT_FSIZE, &limit));
+		size_t nfailed = 0;
+		for (size_t i = NDIGESTS * 3 / 4; i < NDIGESTS; i++)
+			if (!add(store, i))
+				nfailed++;
+		CHECK(nfailed != 0);
+		CHECK(!ffuzzy_store_sync(store));
+		CHECK(!setrlimit(RLIMIT_FSIZE, &saved));
+		for (size_t i = 0; i < 10; i++)
+			CHECK(add(store, i));
+		CHECK(ffuzzy_store_sync(store));
+		check_store("failed writes", store);
+		CHECK(ffuzzy_store_close(store));
+		store = ffuzzy_store_open(path);
+		CHECK(store != NULL);
+		if (!store)
+			return TEST_EXIT();
+		check_store("reopened after failed writes", store);
+	}
+#endif
+
+	CHECK(ffuzzy_store_compact(store));
+	CHECK(ffuzzy_store_close(store));
+	store = ffuzzy_store_open(path);
+	CHECK(store != NULL);
+	if (!store)
+		return TEST_EXIT();
+	check_store("final", store);
+	CHECK(ffuzzy_store_close(store));
+	if (!test_failures)
+	{
+		test_rmdir(path);
+		test_rmdir(dir);
+	}
+	return TEST_EXIT();
+}
@@ -0,0 +1,512 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tools/ffuzzy_bench.c
+	Microbenchmarks of kernels and entry points
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\file  tools/ffuzzy_bench.c
+	\brief Microbenchmarks of kernels and entry points
+	\details
+		Usage: ffuzzy_bench [-f text|csv|json] [-w WARMUP_MS] [-r REPS] [-m MIN_MS] [-s SEED] [-b FILTER]
+
+		Each benchmark runs one function over 256 prepared inputs
+		(cycled) with given parameters:
+		-  len : length of the blocks compared (or of the first block
+		         for parsing and formatting)
+		-  sim : similarity of the compared blocks (percentage of
+		         characters not edited; 0 means unrelated blocks
+		         and is also shown for benchmarks without it)
+		-  rel : block size relation of two digests
+		         (eq, lt: second is twice, gt: first is twice,
+		          far: not comparable)
+
+		The number of iterations is calibrated so that one repetition
+		takes at least MIN_MS. After WARMUP_MS of warmup, REPS
+		repetitions are measured and statistics of nanoseconds per
+		operation (min, median, mean, standard deviation and max)
+		are printed as a table, CSV or JSON lines.
+		Only benchmarks whose names contain FILTER are run.
+		roll_hash is measured per input byte.
+**/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "ffuzzy_config.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ffuzzy.h"
+#include "str_common_substr.h"
+#include "str_edit_dist.h"
+#include "str_hash_rolling.h"
+
+#define BENCH_NPAIRS   256
+#define BENCH_NBYTES   4096
+#define BENCH_MAX_REPS 1000
+#define BENCH_BASE_BS  384ul
+
+typedef enum { REL_NONE, REL_EQ, REL_LT, REL_GT, REL_FAR } bench_rel;
+static const char *const rel_names[] = { "-", "eq", "lt", "gt", "far" };
+
+typedef enum { FMT_TEXT, FMT_CSV, FMT_JSON } bench_format;
+
+/** \brief One input (two digests and the blocks they compare) **/
+typedef struct
+{
+	char s1[FFUZZY_PRETTY_LEN], s2[FFUZZY_PRETTY_LEN];
+	ffuzzy_digest d1, d2;
+	ffuzzy_udigest u1;
+	char a[FFUZZY_SPAMSUM_LENGTH], b[FFUZZY_SPAMSUM_LENGTH];
+	size_t alen, blen;
+} bench_pair;
+
+typedef unsigned long long (*bench_fn)(size_t iters);
+
+/** \brief Benchmark and the parameters it takes **/
+typedef struct
+{
+	const char *name;
+	bench_fn fn;
+	bool uses_sim;
+	const bench_rel *rels; // terminated by REL_NONE (NULL: no relation)
+} bench_def;
+
+static bench_pair pairs[BENCH_NPAIRS];
+static unsigned char bytes[BENCH_NBYTES];
+static volatile unsigned long long sink;
+static uint64_t rng_state;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmp_double(const void *p1, const void *p2)
+{
+	double d1 = *(const double*)p1, d2 = *(const double*)p2;
+	return d1 < d2 ? -1 : d1 > d2 ? +1 : 0;
+}
+
+/* splitmix64 */
+static uint64_t rng_next(void)
+{
+	uint64_t z = (rng_state += UINT64_C(0x9e3779b97f4a7c15));
+	z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+	z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+	return z ^ (z >> 31);
+}
+
+static size_t rng_below(size_t n)
+{
+	return (size_t)(rng_next() % n);
+}
+
+static char rng_char(void)
+{
+	static const char b64[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	return b64[rng_below(64)];
+}
+
+static size_t gen_block(char *buf, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		buf[i] = rng_char();
+	return len;
+}
+
+/** \brief Derive a block with given similarity (edits are substitutions, insertions and deletions) **/
+static size_t mutate_block(char *dst, const char *src, size_t len, unsigned sim)
+{
+	if (!sim)
+		return gen_block(dst, len);
+	memcpy(dst, src, len);
+	size_t nedits = (size_t)((100 - sim) * len / 100.0 + 0.5);
+	for (size_t e = 0; e < nedits; e++)
+	{
+		size_t kind = rng_below(3);
+		if (kind == 1 && len < FFUZZY_SPAMSUM_LENGTH)
+		{
+			size_t i = rng_below(len + 1);
+			memmove(dst + i + 1, dst + i, len - i);
+			dst[i] = rng_char();
+			len++;
+		}
+		else if (kind == 2 && len > FFUZZY_MIN_MATCH)
+		{
+			size_t i = rng_below(len);
+			memmove(dst + i, dst + i + 1, len - i - 1);
+			len--;
+		}
+		else
+			dst[rng_below(len)] = rng_char();
+	}
+	return len;
+}
+
+static bool make_digest(char *str, ffuzzy_digest *digest,
+	unsigned long bs, const char *b1, size_t l1, const char *b2, size_t l2)
+{
+	snprintf(str, FFUZZY_PRETTY_LEN, "%lu:%.*s:%.*s", bs, (int)l1, b1, (int)l2, b2);
+	return ffuzzy_read_digest(digest, str);
+}
+
+/**
+	\brief Prepare inputs
+	\details
+		The blocks compared (a and b) have length len and d1/d2 are
+		digests containing them as the pair of blocks compared in
+		given relation (other blocks are unrelated).
+**/
+static bool prepare(size_t len, unsigned sim, bench_rel rel, uint64_t seed)
+{
+	rng_state = seed ^ ((uint64_t)len << 32) ^ ((uint64_t)sim << 16) ^ (uint64_t)rel;
+	for (size_t i = 0; i < BENCH_NBYTES; i++)
+		bytes[i] = (unsigned char)rng_next();
+	for (size_t k = 0; k < BENCH_NPAIRS; k++)
+	{
+		bench_pair *p = &pairs[k];
+		char x1[FFUZZY_SPAMSUM_LENGTH], x2[FFUZZY_SPAMSUM_LENGTH];
+		char y1[FFUZZY_SPAMSUM_LENGTH], y2[FFUZZY_SPAMSUM_LENGTH];
+		size_t half = len / 2 ? len / 2 : 1;
+		p->alen = gen_block(p->a, len);
+		p->blen = mutate_block(p->b, p->a, len, sim);
+		size_t lx1, lx2, ly1, ly2;
+		unsigned long bs1 = BENCH_BASE_BS, bs2 = BENCH_BASE_BS;
+		switch (rel)
+		{
+			case REL_LT:
+				// d1.block2 vs d2.block1
+				lx1 = gen_block(x1, len); lx2 = len; memcpy(x2, p->a, len);
+				ly1 = p->blen; memcpy(y1, p->b, p->blen); ly2 = gen_block(y2, half);
+				bs2 = bs1 * 2;
+				break;
+			case REL_GT:
+				// d1.block1 vs d2.block2
+				lx1 = len; memcpy(x1, p->a, len); lx2 = gen_block(x2, half);
+				ly1 = gen_block(y1, len); ly2 = p->blen; memcpy(y2, p->b, p->blen);
+				bs1 = bs2 * 2;
+				break;
+			case REL_FAR:
+				lx1 = len; memcpy(x1, p->a, len); lx2 = gen_block(x2, half);
+				ly1 = p->blen; memcpy(y1, p->b, p->blen); ly2 = gen_block(y2, half);
+				bs2 = bs1 * 8;
+				break;
+			default:
+				// both block pairs are related
+				lx1 = len; memcpy(x1, p->a, len); lx2 = gen_block(x2, half);
+				ly1 = p->blen; memcpy(y1, p->b, p->blen);
+				ly2 = mutate_block(y2, x2, lx2, sim);
+				break;
+		}
+		if (!make_digest(p->s1, &p->d1, bs1, x1, lx1, x2, lx2)
+			|| !make_digest(p->s2, &p->d2, bs2, y1, ly1, y2, ly2)
+			|| !ffuzzy_read_udigest(&p->u1, p->s1))
+			return false;
+		// pass the shorter block first (as edit_distn_norm does)
+		if (p->alen > p->blen)
+		{
+			char tmp[FFUZZY_SPAMSUM_LENGTH];
+			size_t tlen = p->alen;
+			memcpy(tmp, p->a, p->alen);
+			memcpy(p->a, p->b, p->blen);
+			memcpy(p->b, tmp, tlen);
+			p->alen = p->blen;
+			p->blen = tlen;
+		}
+	}
+	return true;
+}
+
+
+#define BENCH_PAIR(i) (&pairs[(i) & (BENCH_NPAIRS - 1)])
+
+static unsigned long long run_edit_distn(size_t iters)
+{
+	unsigned long long r = 0;
+	for (size_t i = 0; i < iters; i++)
+	{
+		const bench_pair *p = BENCH_PAIR(i);
+		r += (unsigned)edit_distn(p->a, p->alen, p->b, p->blen);
+	}
+	return r;
+}
+
+static unsigned long long run_has_common_substring(size_t iters)
+{
+	unsigned long long r = 0;
+	for (size_t i = 0; i < iters; i++)
+	{
+		const bench_pair *p = BENCH_PAIR(i);
+		r += has_common_substring(p->a, p->alen, p->b, p->blen);
+	}
+	return r;
+}
+
+static unsigned long long run_roll_hash(size_t iters)
+{
+	roll_state st;
+	unsigned long long r = 0;
+	roll_init(&st);
+	for (size_t i = 0; i < iters; i++)
+	{
+		roll_hash(&st, bytes[i & (BENCH_NBYTES - 1)]);
+		r += roll_sum(&st);
+	}
+	return r;
+}
+
+static unsigned long long run_read_digest(size_t iters)
+{
+	unsigned long long r = 0;
+	ffuzzy_digest d;
+	for (size_t i = 0; i < iters; i++)
+		r += ffuzzy_read_digest(&d, BENCH_PAIR(i)->s1) + d.len1;
+	return r;
+}
+
+static unsigned long long run_read_udigest(size_t iters)
+{
+	unsigned long long r = 0;
+	ffuzzy_udigest d;
+	for (size_t i = 0; i < iters; i++)
+		r += ffuzzy_read_udigest(&d, BENCH_PAIR(i)->s1) + d.len1;
+	return r;
+}
+
+static unsigned long long run_convert_udigest(size_t iters)
+{
+	unsigned long long r = 0;
+	ffuzzy_digest d;
+	for (size_t i = 0; i < iters; i++)
+	{
+		ffuzzy_convert_udigest_to_digest(&d, &BENCH_PAIR(i)->u1);
+		r += d.len1;
+	}
+	return r;
+}
+
+static unsigned long long run_pretty_digest(size_t iters)
+{
+	unsigned long long r = 0;
+	char buf[FFUZZY_PRETTY_LEN];
+	for (size_t i = 0; i < iters; i++)
+		r += ffuzzy_pretty_digest(buf, sizeof(buf), &BENCH_PAIR(i)->d1) + (unsigned char)buf[4];
+	return r;
+}
+
+#define BENCH_COMPARE_DIGEST(fn) \
+	static unsigned long long run_##fn(size_t iters) \
+	{ \
+		unsigned long long r = 0; \
+		for (size_t i = 0; i < iters; i++) \
+		{ \
+			const bench_pair *p = BENCH_PAIR(i); \
+			r += (unsigned)fn(&p->d1, &p->d2); \
+		} \
+		return r; \
+	}
+
+BENCH_COMPARE_DIGEST(ffuzzy_compare_digest)
+BENCH_COMPARE_DIGEST(ffuzzy_compare_digest_near)
+BENCH_COMPARE_DIGEST(ffuzzy_compare_digest_near_eq)
+BENCH_COMPARE_DIGEST(ffuzzy_compare_digest_near_lt)
+
+static unsigned long long run_compare(size_t iters)
+{
+	unsigned long long r = 0;
+	for (size_t i = 0; i < iters; i++)
+	{
+		const bench_pair *p = BENCH_PAIR(i);
+		r += (unsigned)ffuzzy_compare(p->s1, p->s2);
+	}
+	return r;
+}
+
+
+static const bench_rel rels_all[]  = { REL_EQ, REL_LT, REL_GT, REL_FAR, REL_NONE };
+static const bench_rel rels_near[] = { REL_EQ, REL_LT, REL_GT, REL_NONE };
+static const bench_rel rels_eq[]   = { REL_EQ, REL_NONE };
+static const bench_rel rels_lt[]   = { REL_LT, REL_NONE };
+
+static const bench_def benches[] =
+{
+	{ "edit_distn",                       run_edit_distn,                      true,  NULL },
+	{ "has_common_substring",             run_has_common_substring,            true,  NULL },
+	{ "roll_hash",                        run_roll_hash,                       false, NULL },
+	{ "ffuzzy_read_digest",               run_read_digest,                     false, NULL },
+	{ "ffuzzy_read_udigest",              run_read_udigest,                    false, NULL },
+	{ "ffuzzy_convert_udigest_to_digest", run_convert_udigest,                 false, NULL },
+	{ "ffuzzy_pretty_digest",             run_pretty_digest,                   false, NULL },
+	{ "ffuzzy_compare_digest",            run_ffuzzy_compare_digest,           true,  rels_all },
+	{ "ffuzzy_compare_digest_near",       run_ffuzzy_compare_digest_near,      true,  rels_near },
+	{ "ffuzzy_compare_digest_near_eq",    run_ffuzzy_compare_digest_near_eq,   true,  rels_eq },
+	{ "ffuzzy_compare_digest_near_lt",    run_ffuzzy_compare_digest_near_lt,   true,  rels_lt },
+	{ "ffuzzy_compare",                   run_compare,                         true,  rels_all },
+};
+
+static const size_t lens[] = { 16, 32, 64 };
+static const unsigned sims[] = { 0, 50, 80, 100 };
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+
+static bench_format format = FMT_TEXT;
+static double warmup = 0.05, min_time = 0.01;
+static unsigned reps = 10;
+static bool first_row = true;
+
+static double time_run(bench_fn fn, size_t iters)
+{
+	double start = now();
+	sink += fn(iters);
+	return now() - start;
+}
+
+static void run_one(const bench_def *b, size_t len, unsigned sim, bench_rel rel, uint64_t seed)
+{
+	double ns[BENCH_MAX_REPS];
+	if (!prepare(len, sim, rel, seed))
+	{
+		fprintf(stderr, "%s: failed to prepare inputs\n", b->name);
+		exit(1);
+	}
+	// calibrate (also warms up)
+	size_t iters = BENCH_NPAIRS;
+	double start = now(), t;
+	while ((t = time_run(b->fn, iters)) < min_time)
+		iters = t > min_time / 16 ? (size_t)(iters * (min_time * 1.2 / t)) + 1 : iters * 8;
+	while (now() - start < warmup)
+		time_run(b->fn, iters);
+	double sum = 0, sum2 = 0;
+	for (unsigned r = 0; r < reps; r++)
+	{
+		ns[r] = time_run(b->fn, iters) * 1e9 / iters;
+		sum += ns[r];
+		sum2 += ns[r] * ns[r];
+	}
+	double mean = sum / reps;
+	double var = reps > 1 ? (sum2 - sum * mean) / (reps - 1) : 0;
+	double stddev = var > 0 ? sqrt(var) : 0;
+	qsort(ns, reps, sizeof(double), cmp_double);
+	double median = reps & 1 ? ns[reps / 2] : (ns[reps / 2 - 1] + ns[reps / 2]) / 2;
+	const char *relname = rel_names[rel];
+	switch (format)
+	{
+		case FMT_TEXT:
+			if (first_row)
+				printf("%-34s %4s %4s %4s %12s %10s %10s %10s %8s %10s\n",
+					"benchmark", "len", "sim", "rel", "iters",
+					"min_ns", "median_ns", "mean_ns", "stddev", "max_ns");
+			printf("%-34s %4zu %4u %4s %12zu %10.2f %10.2f %10.2f %8.2f %10.2f\n",
+				b->name, len, sim, relname, iters,
+				ns[0], median, mean, stddev, ns[reps - 1]);
+			break;
+		case FMT_CSV:
+			if (first_row)
+				puts("benchmark,len,sim,rel,iters,reps,min_ns,median_ns,mean_ns,stddev_ns,max_ns");
+			printf("%s,%zu,%u,%s,%zu,%u,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+				b->name, len, sim, relname, iters, reps,
+				ns[0], median, mean, stddev, ns[reps - 1]);
+			break;
+		case FMT_JSON:
+			printf("{\"benchmark\":\"%s\",\"len\":%zu,\"sim\":%u,\"rel\":\"%s\","
+				"\"iters\":%zu,\"reps\":%u,\"min_ns\":%.3f,\"median_ns\":%.3f,"
+				"\"mean_ns\":%.3f,\"stddev_ns\":%.3f,\"max_ns\":%.3f}\n",
+				b->name, len, sim, relname, iters, reps,
+				ns[0], median, mean, stddev, ns[reps - 1]);
+			break;
+	}
+	first_row = false;
+	fflush(stdout);
+}
+
+
+int main(int argc, char **argv)
+{
+	const char *filter = NULL;
+	uint64_t seed = 1;
+	bool ok = true;
+	int opt;
+	while ((opt = getopt(argc, argv, "f:w:r:m:s:b:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'f':
+				if (!strcmp(optarg, "text"))
+					format = FMT_TEXT;
+				else if (!strcmp(optarg, "csv"))
+					format = FMT_CSV;
+				else if (!strcmp(optarg, "json"))
+					format = FMT_JSON;
+				else
+					ok = false;
+				break;
+			case 'w': warmup   = strtod(optarg, NULL) / 1e3; break;
+			case 'r': reps     = (unsigned)strtoul(optarg, NULL, 10); break;
+			case 'm': min_time = strtod(optarg, NULL) / 1e3; break;
+			case 's': seed     = strtoull(optarg, NULL, 0); break;
+			case 'b': filter   = optarg; break;
+			default:  ok = false; break;
+		}
+	}
+	if (!ok || optind != argc || !reps || reps > BENCH_MAX_REPS || !(min_time > 0) || warmup < 0)
+	{
+		fputs("usage: ffuzzy_bench [-f text|csv|json] [-w WARMUP_MS] [-r REPS] [-m MIN_MS] [-s SEED] [-b FILTER]\n", stderr);
+		return 2;
+	}
+	for (size_t i = 0; i < ARRAY_SIZE(benches); i++)
+	{
+		const bench_def *b = &benches[i];
+		if (filter && !strstr(b->name, filter))
+			continue;
+		if (b->fn == run_roll_hash)
+		{
+			run_one(b, 0, 0, REL_NONE, seed);
+			continue;
+		}
+		for (size_t l = 0; l < ARRAY_SIZE(lens); l++)
+		{
+			for (size_t s = 0; s < (b->uses_sim ? ARRAY_SIZE(sims) : 1); s++)
+			{
+				unsigned sim = b->uses_sim ? sims[s] : 0;
+				if (!b->rels)
+					run_one(b, lens[l], sim, REL_NONE, seed);
+				else
+					for (const bench_rel *rel = b->rels; *rel != REL_NONE; rel++)
+						run_one(b, lens[l], sim, *rel, seed);
+			}
+		}
+	}
+	return 0;
+}
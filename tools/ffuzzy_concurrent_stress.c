@@ -0,0 +1,284 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tools/ffuzzy_concurrent_stress.c
+	Stress test of concurrent index
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\file  tools/ffuzzy_concurrent_stress.c
+	\brief Stress test of concurrent index
+	\details
+		Usage: ffuzzy_concurrent_stress [-r READERS] [-w WRITERS] [-n DIGESTS] [-t THRESHOLD] [-c INTERVAL_MS]
+
+		Writer threads insert generated digests while reader threads
+		search random queries and the background compactor runs.
+		Each search is checked against the snapshot taken before it:
+		all matching digests published before the search must be found,
+		and every result must have the correct score.
+		The exit status is 0 only if no errors are found.
+**/
+
+#include "ffuzzy_config.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef FFUZZY_ENABLE_THREADS
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "ffuzzy.h"
+
+
+#ifdef FFUZZY_ENABLE_THREADS
+
+static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static unsigned long long next_random(unsigned long long *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+/* generate families of similar digests (with random edits) */
+static void generate(ffuzzy_digest *digests, size_t n)
+{
+	unsigned long long rs = 88172645463325252ull;
+	char base[2][FFUZZY_SPAMSUM_LENGTH];
+	size_t baselen[2] = {0, 0};
+	unsigned long bs = 3;
+	for (size_t i = 0; i < n; )
+	{
+		if (i % 16 == 0)
+		{
+			bs = 3ul << (next_random(&rs) % 8);
+			for (int b = 0; b < 2; b++)
+			{
+				baselen[b] = 16 + next_random(&rs) % (b ? 17 : 49);
+				for (size_t k = 0; k < baselen[b]; k++)
+					base[b][k] = b64[next_random(&rs) % 64];
+			}
+		}
+		char s[FFUZZY_SPAMSUM_LENGTH * 2 + 32];
+		int p = sprintf(s, "%lu:", bs);
+		for (int b = 0; b < 2; b++)
+		{
+			size_t len = 0;
+			for (size_t k = 0; k < baselen[b] && len < (b ? FFUZZY_SPAMSUM_LENGTH / 2 : FFUZZY_SPAMSUM_LENGTH); k++)
+			{
+				unsigned r = next_random(&rs) % 100;
+				if (r < 5)
+					continue;
+				if (r < 10)
+					s[p + len++] = b64[next_random(&rs) % 64];
+				else
+					s[p + len++] = base[b][k];
+			}
+			p += (int)len;
+			if (!b)
+				s[p++] = ':';
+		}
+		s[p] = '\0';
+		if (ffuzzy_read_digest(&digests[i], s))
+			i++;
+	}
+}
+
+
+static ffuzzy_concurrent_index *idx;
+static ffuzzy_digest *digests;
+static size_t ndigests;
+static size_t *origin;     /* index of digest + 1 for each ID (0 if not stored yet) */
+static size_t next_digest;
+static int threshold = 50;
+static bool done;
+static unsigned long long nqueries, nerrors;
+
+static void *writer_main(void *arg)
+{
+	(void)arg;
+	for (;;)
+	{
+		size_t k = __atomic_fetch_add(&next_digest, 1, __ATOMIC_SEQ_CST);
+		if (k >= ndigests)
+			break;
+		size_t id;
+		if (!ffuzzy_concurrent_index_add(idx, &digests[k], &id))
+		{
+			fputs("insertion failed\n", stderr);
+			__atomic_fetch_add(&nerrors, 1, __ATOMIC_SEQ_CST);
+			continue;
+		}
+		__atomic_store_n(&origin[id], k + 1, __ATOMIC_RELEASE);
+		// let readers interleave with insertions (even on a single processor)
+		sched_yield();
+	}
+	return NULL;
+}
+
+static const ffuzzy_digest *digest_of(size_t id)
+{
+	size_t k;
+	while (!(k = __atomic_load_n(&origin[id], __ATOMIC_ACQUIRE)))
+		;
+	return &digests[k - 1];
+}
+
+static int cmp_id(const void *p1, const void *p2)
+{
+	const ffuzzy_match *m1 = p1, *m2 = p2;
+	return m1->id < m2->id ? -1 : m1->id > m2->id ? +1 : 0;
+}
+
+static void *reader_main(void *arg)
+{
+	unsigned long long rs = 0x9e3779b97f4a7c15ull * ((size_t)arg + 1);
+	ffuzzy_concurrent_reader *reader = ffuzzy_concurrent_reader_new(idx);
+	ffuzzy_match_list results;
+	ffuzzy_match_list_init(&results);
+	if (!reader)
+	{
+		__atomic_fetch_add(&nerrors, 1, __ATOMIC_SEQ_CST);
+		return NULL;
+	}
+	while (!__atomic_load_n(&done, __ATOMIC_ACQUIRE))
+	{
+		const ffuzzy_digest *query = &digests[next_random(&rs) % ndigests];
+		size_t before = ffuzzy_concurrent_index_size(idx);
+		if (!ffuzzy_concurrent_index_search(reader, query, threshold, &results))
+		{
+			__atomic_fetch_add(&nerrors, 1, __ATOMIC_SEQ_CST);
+			continue;
+		}
+		size_t after = ffuzzy_concurrent_index_size(idx);
+		unsigned long long errors = 0;
+		qsort(results.matches, results.count, sizeof(ffuzzy_match), cmp_id);
+		// results must be valid (published, correct scores, no duplicates)
+		for (size_t i = 0; i < results.count; i++)
+		{
+			size_t id = results.matches[i].id;
+			if (id >= after || (i && results.matches[i-1].id == id))
+			{
+				errors++;
+				continue;
+			}
+			int score = ffuzzy_compare_digest(query, digest_of(id));
+			if (score != results.matches[i].score || score < threshold)
+				errors++;
+		}
+		// results must contain all matches in the snapshot
+		size_t j = 0;
+		for (size_t id = 0; id < before; id++)
+		{
+			if (ffuzzy_compare_digest(query, digest_of(id)) < threshold)
+				continue;
+			while (j < results.count && results.matches[j].id < id)
+				j++;
+			if (j == results.count || results.matches[j].id != id)
+				errors++;
+		}
+		if (errors)
+			__atomic_fetch_add(&nerrors, errors, __ATOMIC_SEQ_CST);
+		__atomic_fetch_add(&nqueries, 1, __ATOMIC_SEQ_CST);
+	}
+	ffuzzy_match_list_free(&results);
+	ffuzzy_concurrent_reader_free(reader);
+	return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+	unsigned nreaders = 4, nwriters = 2, interval_ms = 5;
+	ndigests = 10000;
+	int opt;
+	while ((opt = getopt(argc, argv, "r:w:n:t:c:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'r': nreaders    = (unsigned)strtoul(optarg, NULL, 10); break;
+			case 'w': nwriters    = (unsigned)strtoul(optarg, NULL, 10); break;
+			case 'n': ndigests    = strtoul(optarg, NULL, 10); break;
+			case 't': threshold   = atoi(optarg); break;
+			case 'c': interval_ms = (unsigned)strtoul(optarg, NULL, 10); break;
+			default:
+				fputs("usage: ffuzzy_concurrent_stress [-r READERS] [-w WRITERS] [-n DIGESTS] [-t THRESHOLD] [-c INTERVAL_MS]\n", stderr);
+				return 2;
+		}
+	}
+	if (!ndigests || !nwriters)
+		return 2;
+	digests = malloc(sizeof(ffuzzy_digest) * ndigests);
+	origin = calloc(ndigests, sizeof(size_t));
+	idx = ffuzzy_concurrent_index_new();
+	pthread_t *threads = malloc(sizeof(pthread_t) * (nreaders + nwriters));
+	if (!digests || !origin || !idx || !threads)
+	{
+		fputs("out of memory\n", stderr);
+		return 1;
+	}
+	generate(digests, ndigests);
+	if (interval_ms && !ffuzzy_concurrent_index_start_compactor(idx, interval_ms))
+	{
+		fputs("failed to start the compactor\n", stderr);
+		return 1;
+	}
+	for (unsigned i = 0; i < nreaders; i++)
+		if (pthread_create(&threads[i], NULL, reader_main, (void*)(size_t)i))
+			return 1;
+	for (unsigned i = 0; i < nwriters; i++)
+		if (pthread_create(&threads[nreaders + i], NULL, writer_main, NULL))
+			return 1;
+	for (unsigned i = 0; i < nwriters; i++)
+		pthread_join(threads[nreaders + i], NULL);
+	__atomic_store_n(&done, true, __ATOMIC_RELEASE);
+	for (unsigned i = 0; i < nreaders; i++)
+		pthread_join(threads[i], NULL);
+	ffuzzy_concurrent_index_stop_compactor(idx);
+	if (ffuzzy_concurrent_index_size(idx) != ndigests)
+	{
+		fputs("some digests are missing\n", stderr);
+		nerrors++;
+	}
+	printf("%zu digests, %llu queries, %llu errors\n", ndigests, nqueries, nerrors);
+	ffuzzy_concurrent_index_free(idx);
+	free(threads);
+	free(origin);
+	free(digests);
+	return nerrors ? 1 : 0;
+}
+
+#else
+
+int main(void)
+{
+	fputs("ffuzzy_concurrent_stress: threads are disabled\n", stderr);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,209 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tools/ffuzzy_corpus.h
+	Synthetic corpus generator
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef FFUZZY_TOOLS_FFUZZY_CORPUS_H
+#define FFUZZY_TOOLS_FFUZZY_CORPUS_H
+
+/**
+	\file  tools/ffuzzy_corpus.h
+	\brief Synthetic corpus generator
+	\details
+		Digests are generated in families. The root of each family
+		models a file whose size follows a log-normal distribution
+		(median 32KiB) and gets the block size ssdeep would choose
+		(the smallest 3*2^n with at least 32 pieces per 64 characters)
+		and block lengths around size/block_size.
+
+		Other members are variants of the root: each character of
+		both blocks is deleted, substituted or followed by an
+		inserted character with given rates. With the probability
+		bs_change, a variant moves to the double or the half block
+		size (as a file crossing a block size boundary does), keeping
+		the block of the common block size.
+
+		Family sizes follow a geometric distribution (singletons are
+		the most common). The output only depends on the seed and
+		parameters.
+**/
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ffuzzy.h"
+
+/** \brief Generator parameters and state **/
+typedef struct
+{
+	uint64_t state;
+	double ins_rate, del_rate, sub_rate;
+	double bs_change;
+	double family_mean;
+	// root of the current family
+	unsigned long bs;
+	char b1[FFUZZY_SPAMSUM_LENGTH], b2[FFUZZY_SPAMSUM_LENGTH];
+	size_t l1, l2;
+	size_t remaining;
+} corpus_gen;
+
+/** \brief Initialize the generator with default parameters **/
+static void corpus_gen_init(corpus_gen *g, uint64_t seed)
+{
+	memset(g, 0, sizeof(*g));
+	g->state = seed;
+	g->ins_rate = g->del_rate = g->sub_rate = 0.05;
+	g->bs_change = 0.1;
+	g->family_mean = 8;
+}
+
+/* splitmix64 */
+static uint64_t corpus_rand(corpus_gen *g)
+{
+	uint64_t z = (g->state += UINT64_C(0x9e3779b97f4a7c15));
+	z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+	z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+	return z ^ (z >> 31);
+}
+
+/** \brief Uniform random number in [0,1) **/
+static double corpus_uniform(corpus_gen *g)
+{
+	return (corpus_rand(g) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static char corpus_char(corpus_gen *g)
+{
+	static const char b64[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	return b64[corpus_rand(g) & 63];
+}
+
+static size_t corpus_block(corpus_gen *g, char *buf, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		buf[i] = corpus_char(g);
+	return len;
+}
+
+/** \brief Block length around the expected one (clamped to [1,maxlen]) **/
+static size_t corpus_length(corpus_gen *g, double expected, size_t maxlen)
+{
+	double len = expected * (0.8 + 0.4 * corpus_uniform(g)) + 0.5;
+	if (len < 1)
+		return 1;
+	if (len > maxlen)
+		return maxlen;
+	return (size_t)len;
+}
+
+/** \brief Mutate a block by per-character rates (the result is up to maxlen characters) **/
+static size_t corpus_mutate(corpus_gen *g, char *dst, const char *src, size_t len, size_t maxlen)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < len && n < maxlen; i++)
+	{
+		double r = corpus_uniform(g);
+		if (r < g->del_rate)
+			continue;
+		dst[n++] = r < g->del_rate + g->sub_rate ? corpus_char(g) : src[i];
+		if (n < maxlen && corpus_uniform(g) < g->ins_rate)
+			dst[n++] = corpus_char(g);
+	}
+	return n;
+}
+
+/** \brief Start a new family **/
+static void corpus_new_family(corpus_gen *g)
+{
+	// file size (log-normal by Box-Muller)
+	double u1 = 1.0 - corpus_uniform(g), u2 = corpus_uniform(g);
+	double z = sqrt(-2.0 * log(u1)) * cos(6.283185307179586 * u2);
+	double size = exp(log(32768.0) + 2.0 * z);
+	unsigned long bs = FFUZZY_MIN_BLOCKSIZE;
+	while (bs < FFUZZY_MAX_BLOCKSIZE && bs * FFUZZY_SPAMSUM_LENGTH < size)
+		bs *= 2;
+	g->bs = bs;
+	g->l1 = corpus_block(g, g->b1, corpus_length(g, size / bs, FFUZZY_SPAMSUM_LENGTH));
+	g->l2 = corpus_block(g, g->b2, corpus_length(g, size / bs / 2, FFUZZY_SPAMSUM_LENGTH / 2));
+	// geometric family size with given mean
+	double p = 1.0 / (g->family_mean < 1 ? 1 : g->family_mean);
+	g->remaining = p >= 1 ? 1 : 1 + (size_t)(log(1.0 - corpus_uniform(g)) / log(1.0 - p));
+}
+
+/**
+	\brief  Generate a digest
+	\param  [in,out] g    The generator
+	\param  [out]    buf  Buffer to store the digest (FFUZZY_PRETTY_LEN bytes)
+**/
+static void corpus_gen_next(corpus_gen *g, char *buf)
+{
+	char b1[FFUZZY_SPAMSUM_LENGTH], b2[FFUZZY_SPAMSUM_LENGTH];
+	size_t l1, l2;
+	unsigned long bs;
+	bool root = !g->remaining;
+	if (root)
+		corpus_new_family(g);
+	g->remaining--;
+	if (root)
+	{
+		bs = g->bs;
+		memcpy(b1, g->b1, l1 = g->l1);
+		memcpy(b2, g->b2, l2 = g->l2);
+	}
+	else if (corpus_uniform(g) < g->bs_change)
+	{
+		if (corpus_uniform(g) < 0.5 && g->bs < FFUZZY_MAX_BLOCKSIZE)
+		{
+			// larger file: the second block becomes the first
+			bs = g->bs * 2;
+			l1 = corpus_mutate(g, b1, g->b2, g->l2, FFUZZY_SPAMSUM_LENGTH);
+			l2 = corpus_block(g, b2, corpus_length(g, l1 / 2.0, FFUZZY_SPAMSUM_LENGTH / 2));
+		}
+		else if (g->bs > FFUZZY_MIN_BLOCKSIZE)
+		{
+			// smaller file: the first block becomes the second
+			bs = g->bs / 2;
+			l2 = corpus_mutate(g, b2, g->b1, g->l1, FFUZZY_SPAMSUM_LENGTH / 2);
+			l1 = corpus_block(g, b1, corpus_length(g, g->l1 * 2.0, FFUZZY_SPAMSUM_LENGTH));
+		}
+		else
+		{
+			bs = g->bs;
+			l1 = corpus_mutate(g, b1, g->b1, g->l1, FFUZZY_SPAMSUM_LENGTH);
+			l2 = corpus_mutate(g, b2, g->b2, g->l2, FFUZZY_SPAMSUM_LENGTH / 2);
+		}
+	}
+	else
+	{
+		bs = g->bs;
+		l1 = corpus_mutate(g, b1, g->b1, g->l1, FFUZZY_SPAMSUM_LENGTH);
+		l2 = corpus_mutate(g, b2, g->b2, g->l2, FFUZZY_SPAMSUM_LENGTH / 2);
+	}
+	snprintf(buf, FFUZZY_PRETTY_LEN, "%lu:%.*s:%.*s", bs, (int)l1, b1, (int)l2, b2);
+}
+
+#endif
@@ -0,0 +1,94 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tools/ffuzzy_corpus_gen.c
+	Synthetic corpus generator
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\file  tools/ffuzzy_corpus_gen.c
+	\brief Synthetic corpus generator
+	\details
+		Usage: ffuzzy_corpus_gen [-n COUNT] [-s SEED] [-m FAMILY_MEAN] [-i INS] [-d DEL] [-u SUB] [-b BS_CHANGE]
+
+		Prints COUNT (default: 10000) ssdeep-like digests, one per line.
+		Members of a family are printed consecutively.
+		INS, DEL and SUB are per-character rates of insertions,
+		deletions and substitutions in variants (default: 0.05 each)
+		and BS_CHANGE is the probability that a variant moves to a
+		neighbouring block size (default: 0.1).
+		See tools/ffuzzy_corpus.h for the model.
+**/
+
+#include "ffuzzy_config.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "ffuzzy.h"
+#include "ffuzzy_corpus.h"
+
+
+int main(int argc, char **argv)
+{
+	corpus_gen gen;
+	unsigned long long count = 10000, seed = 1;
+	double ins = 0.05, del = 0.05, sub = 0.05, bs_change = 0.1, family_mean = 8;
+	bool ok = true;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:s:m:i:d:u:b:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n': count       = strtoull(optarg, NULL, 10); break;
+			case 's': seed        = strtoull(optarg, NULL, 0); break;
+			case 'm': family_mean = strtod(optarg, NULL); break;
+			case 'i': ins         = strtod(optarg, NULL); break;
+			case 'd': del         = strtod(optarg, NULL); break;
+			case 'u': sub         = strtod(optarg, NULL); break;
+			case 'b': bs_change   = strtod(optarg, NULL); break;
+			default:  ok = false; break;
+		}
+	}
+	if (!ok || optind != argc || !(family_mean >= 1)
+		|| !(ins >= 0 && ins <= 1) || !(del >= 0 && sub >= 0 && del + sub <= 1)
+		|| !(bs_change >= 0 && bs_change <= 1))
+	{
+		fputs("usage: ffuzzy_corpus_gen [-n COUNT] [-s SEED] [-m FAMILY_MEAN] [-i INS] [-d DEL] [-u SUB] [-b BS_CHANGE]\n", stderr);
+		return 2;
+	}
+	corpus_gen_init(&gen, seed);
+	gen.ins_rate = ins;
+	gen.del_rate = del;
+	gen.sub_rate = sub;
+	gen.bs_change = bs_change;
+	gen.family_mean = family_mean;
+	for (unsigned long long i = 0; i < count; i++)
+	{
+		char buf[FFUZZY_PRETTY_LEN];
+		corpus_gen_next(&gen, buf);
+		puts(buf);
+	}
+	return ferror(stdout) ? 1 : 0;
+}
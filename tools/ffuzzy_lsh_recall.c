@@ -0,0 +1,244 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tools/ffuzzy_lsh_recall.c
+	Recall measurement of MinHash/LSH index
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\file  tools/ffuzzy_lsh_recall.c
+	\brief Recall measurement of MinHash/LSH index
+	\details
+		Usage: ffuzzy_lsh_recall [-t THRESHOLD] [-q QUERIES] [-s BANDSxROWS[,...]] FILE
+
+		FILE contains one ssdeep digest per line (the output of ssdeep
+		is also accepted; unparsable lines are ignored). The first QUERIES
+		digests are searched against all digests by brute force
+		(ffuzzy_collection_search) and by MinHash/LSH indices with
+		given band/row settings. For each setting, this program prints
+		recall (matched pairs found), average number of verified candidates
+		per query and build/query time. Self matches are excluded.
+**/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "ffuzzy_config.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ffuzzy.h"
+
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+
+static void usage(void)
+{
+	fputs("usage: ffuzzy_lsh_recall [-t THRESHOLD] [-q QUERIES] [-s BANDSxROWS[,...]] FILE\n", stderr);
+	exit(2);
+}
+
+
+static ffuzzy_digest *read_digests(const char *path, size_t *count)
+{
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+	{
+		perror(path);
+		exit(1);
+	}
+	ffuzzy_digest *digests = NULL;
+	size_t n = 0, cap = 0;
+	char line[4096];
+	while (fgets(line, sizeof(line), fp))
+	{
+		line[strcspn(line, "\r\n")] = '\0';
+		ffuzzy_digest d;
+		if (!ffuzzy_read_digest(&d, line))
+			continue;
+		if (n == cap)
+		{
+			cap = cap ? cap * 2 : 1024;
+			digests = realloc(digests, sizeof(ffuzzy_digest) * cap);
+			if (!digests)
+			{
+				fputs("out of memory\n", stderr);
+				exit(1);
+			}
+		}
+		digests[n++] = d;
+	}
+	fclose(fp);
+	*count = n;
+	return digests;
+}
+
+
+/* number of matches in found which also appear in truth (both sorted by ID) */
+static size_t count_common(ffuzzy_match *found, size_t nfound, ffuzzy_match *truth, size_t ntruth)
+{
+	size_t i = 0, j = 0, common = 0;
+	while (i < nfound && j < ntruth)
+	{
+		if (found[i].id == truth[j].id)
+		{
+			common++;
+			i++;
+			j++;
+		}
+		else if (found[i].id < truth[j].id)
+			i++;
+		else
+			j++;
+	}
+	return common;
+}
+
+static int cmp_id(const void *p1, const void *p2)
+{
+	const ffuzzy_match *m1 = p1, *m2 = p2;
+	return m1->id < m2->id ? -1 : m1->id > m2->id ? +1 : 0;
+}
+
+/* sort by ID and remove the query itself */
+static void normalize(ffuzzy_match_list *list, size_t self)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < list->count; i++)
+		if (list->matches[i].id != self)
+			list->matches[n++] = list->matches[i];
+	list->count = n;
+	qsort(list->matches, list->count, sizeof(ffuzzy_match), cmp_id);
+}
+
+
+int main(int argc, char **argv)
+{
+	int threshold = 60;
+	size_t nqueries = 1000;
+	const char *settings = "8x4,32x2,16x1,64x1,128x1";
+	int opt;
+	while ((opt = getopt(argc, argv, "t:q:s:")) != -1)
+	{
+		switch (opt)
+		{
+			case 't': threshold = atoi(optarg); break;
+			case 'q': nqueries = strtoul(optarg, NULL, 10); break;
+			case 's': settings = optarg; break;
+			default: usage();
+		}
+	}
+	if (optind + 1 != argc)
+		usage();
+	size_t n;
+	ffuzzy_digest *digests = read_digests(argv[optind], &n);
+	if (nqueries > n)
+		nqueries = n;
+	fprintf(stderr, "%zu digests, %zu queries, threshold %d\n", n, nqueries, threshold);
+
+	// ground truth by brute force
+	ffuzzy_collection *coll = ffuzzy_collection_new();
+	for (size_t i = 0; coll && i < n; i++)
+		if (!ffuzzy_collection_add(coll, &digests[i], NULL))
+			return 1;
+	if (!coll)
+		return 1;
+	ffuzzy_match_list *truth = malloc(sizeof(ffuzzy_match_list) * (nqueries ? nqueries : 1));
+	if (!truth)
+		return 1;
+	size_t total = 0;
+	double t0 = now();
+	for (size_t q = 0; q < nqueries; q++)
+	{
+		ffuzzy_match_list_init(&truth[q]);
+		if (!ffuzzy_collection_search(coll, &digests[q], threshold, &truth[q]))
+			return 1;
+		normalize(&truth[q], q);
+		total += truth[q].count;
+	}
+	double t1 = now();
+	printf("bands\trows\trecall\tcandidates\tbuild_s\tquery_s\n");
+	printf("-\t-\t1.0000\t-\t-\t%.3f\n", t1 - t0);
+
+	// each setting
+	const char *p = settings;
+	while (*p)
+	{
+		char *end;
+		unsigned bands = (unsigned)strtoul(p, &end, 10);
+		if (*end != 'x')
+			usage();
+		unsigned rows = (unsigned)strtoul(end + 1, &end, 10);
+		if (*end && *end != ',')
+			usage();
+		p = *end ? end + 1 : end;
+		ffuzzy_lsh_index *idx = ffuzzy_lsh_index_new(bands, rows);
+		if (!idx)
+		{
+			fprintf(stderr, "invalid setting: %ux%u\n", bands, rows);
+			continue;
+		}
+		t0 = now();
+		for (size_t i = 0; i < n; i++)
+			if (!ffuzzy_lsh_index_add(idx, &digests[i], NULL))
+				return 1;
+		t1 = now();
+		size_t found = 0, candidates = 0;
+		ffuzzy_match_list list;
+		ffuzzy_match_list_init(&list);
+		double t2 = now();
+		for (size_t q = 0; q < nqueries; q++)
+		{
+			size_t nc;
+			if (!ffuzzy_lsh_index_search(idx, &digests[q], threshold, &list, &nc))
+				return 1;
+			normalize(&list, q);
+			found += count_common(list.matches, list.count, truth[q].matches, truth[q].count);
+			candidates += nc;
+		}
+		double t3 = now();
+		printf("%u\t%u\t%.4f\t%.1f\t%.3f\t%.3f\n",
+			bands, rows,
+			total ? (double)found / (double)total : 1.0,
+			nqueries ? (double)candidates / (double)nqueries : 0.0,
+			t1 - t0, t3 - t2);
+		ffuzzy_match_list_free(&list);
+		ffuzzy_lsh_index_free(idx);
+	}
+
+	for (size_t q = 0; q < nqueries; q++)
+		ffuzzy_match_list_free(&truth[q]);
+	free(truth);
+	ffuzzy_collection_free(coll);
+	free(digests);
+	return 0;
+}
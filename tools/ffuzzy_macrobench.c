@@ -0,0 +1,429 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tools/ffuzzy_macrobench.c
+	End-to-end benchmark on synthetic corpora
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\file  tools/ffuzzy_macrobench.c
+	\brief End-to-end benchmark on synthetic corpora
+	\details
+		Usage: ffuzzy_macrobench [-n SIZES] [-j THREADS] [-t THRESHOLD] [-J MAX_JOIN]
+		                         [-s SEED] [-m FAMILY_MEAN] [-i INS] [-d DEL] [-u SUB] [-b BS_CHANGE]
+		                         [-f text|json]
+
+		For each corpus size in SIZES (comma-separated, default:
+		10000,100000), a corpus is generated (see tools/ffuzzy_corpus.h),
+		shuffled and processed in three stages with each thread count
+		in THREADS (comma-separated, default: powers of two up to the
+		number of online processors):
+		-  parse : ffuzzy_read_digest on all digests (split into chunks)
+		-  sort  : sort by ffuzzy_digestcmp (chunks are sorted and merged)
+		-  join  : all pairs with scores of at least THRESHOLD
+		           (default: 60) by ffuzzy_join_self
+		The join stage is skipped for corpora larger than MAX_JOIN
+		(default: 10000) because its time grows quadratically
+		(100k digests take about a hundred times as long as 10k).
+
+		For each stage, it prints the elapsed time, the throughput
+		(digests per second), the speedup over the first thread count
+		and the scaling efficiency (speedup per thread ratio).
+
+		Corpora of 10M digests need several gigabytes of memory.
+**/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "ffuzzy_config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef FFUZZY_ENABLE_THREADS
+#include <pthread.h>
+#endif
+
+#include "ffuzzy.h"
+#include "ffuzzy_corpus.h"
+
+#define MAX_LIST 64
+
+typedef enum { STAGE_PARSE, STAGE_SORT, STAGE_JOIN, NUM_STAGES } stage;
+static const char *const stage_names[] = { "parse", "sort", "join" };
+
+static bool json;
+static bool header_printed;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/** \brief Run fn on nthreads arguments (of size argsize) concurrently **/
+static bool run_threads(unsigned nthreads, void *(*fn)(void*), void *args, size_t argsize)
+{
+#ifdef FFUZZY_ENABLE_THREADS
+	if (nthreads > 1)
+	{
+		pthread_t threads[MAX_LIST];
+		unsigned n;
+		for (n = 0; n < nthreads; n++)
+			if (pthread_create(&threads[n], NULL, fn, (char*)args + argsize * n))
+				break;
+		for (unsigned i = 0; i < n; i++)
+			pthread_join(threads[i], NULL);
+		return n == nthreads;
+	}
+#endif
+	for (unsigned i = 0; i < nthreads; i++)
+		fn((char*)args + argsize * i);
+	return true;
+}
+
+
+typedef struct
+{
+	const char (*strs)[FFUZZY_PRETTY_LEN];
+	ffuzzy_digest *digests;
+	size_t begin, end;
+	size_t failed;
+} parse_job;
+
+static void *parse_main(void *arg)
+{
+	parse_job *job = arg;
+	for (size_t i = job->begin; i < job->end; i++)
+		if (!ffuzzy_read_digest(&job->digests[i], job->strs[i]))
+			job->failed++;
+	return NULL;
+}
+
+static int cmp_digest(const void *p1, const void *p2)
+{
+	return ffuzzy_digestcmp(p1, p2);
+}
+
+typedef struct
+{
+	const ffuzzy_digest *src;
+	ffuzzy_digest *dst;
+	size_t begin, mid, end;
+} sort_job;
+
+static void *sort_main(void *arg)
+{
+	sort_job *job = arg;
+	qsort(job->dst + job->begin, job->end - job->begin, sizeof(ffuzzy_digest), cmp_digest);
+	return NULL;
+}
+
+static void *merge_main(void *arg)
+{
+	sort_job *job = arg;
+	size_t i = job->begin, j = job->mid, k = job->begin;
+	while (i < job->mid && j < job->end)
+		job->dst[k++] = ffuzzy_digestcmp(&job->src[j], &job->src[i]) < 0 ? job->src[j++] : job->src[i++];
+	while (i < job->mid)
+		job->dst[k++] = job->src[i++];
+	while (j < job->end)
+		job->dst[k++] = job->src[j++];
+	return NULL;
+}
+
+/**
+	\brief  Sort digests with given number of threads
+	\details
+		Each thread sorts a chunk and sorted runs are merged in pairs
+		(in parallel) until one run remains.
+	\return The sorted array (a or tmp).
+**/
+static ffuzzy_digest *parallel_sort(ffuzzy_digest *a, ffuzzy_digest *tmp, size_t n, unsigned nthreads)
+{
+	sort_job jobs[MAX_LIST];
+	size_t bounds[MAX_LIST + 1];
+	unsigned nruns = nthreads;
+	for (unsigned t = 0; t <= nruns; t++)
+		bounds[t] = n * t / nruns;
+	for (unsigned t = 0; t < nruns; t++)
+	{
+		jobs[t].dst = a;
+		jobs[t].begin = bounds[t];
+		jobs[t].end = bounds[t + 1];
+	}
+	if (!run_threads(nruns, sort_main, jobs, sizeof(sort_job)))
+		return NULL;
+	ffuzzy_digest *src = a, *dst = tmp;
+	while (nruns > 1)
+	{
+		unsigned njobs = 0;
+		for (unsigned r = 0; r < nruns; r += 2, njobs++)
+		{
+			jobs[njobs].src = src;
+			jobs[njobs].dst = dst;
+			jobs[njobs].begin = bounds[r];
+			jobs[njobs].mid = bounds[r + 1];
+			jobs[njobs].end = r + 1 < nruns ? bounds[r + 2] : bounds[r + 1];
+			bounds[njobs] = bounds[r];
+		}
+		bounds[njobs] = n;
+		if (!run_threads(njobs, merge_main, jobs, sizeof(sort_job)))
+			return NULL;
+		nruns = njobs;
+		ffuzzy_digest *t = src;
+		src = dst;
+		dst = t;
+	}
+	return src;
+}
+
+static void count_pair(void *ctx, size_t id1, size_t id2, int score)
+{
+	(void)id1;
+	(void)id2;
+	(void)score;
+	(*(unsigned long long*)ctx)++;
+}
+
+
+static void report(size_t n, stage st, unsigned nthreads, double elapsed,
+	double base_elapsed, unsigned base_threads, unsigned long long matches)
+{
+	double speedup = base_elapsed / elapsed;
+	double efficiency = speedup * base_threads / nthreads;
+	double rate = n / elapsed;
+	if (json)
+	{
+		printf("{\"size\":%zu,\"stage\":\"%s\",\"threads\":%u,\"seconds\":%.6f,"
+			"\"digests_per_sec\":%.1f,\"speedup\":%.3f,\"efficiency\":%.3f",
+			n, stage_names[st], nthreads, elapsed, rate, speedup, efficiency);
+		if (st == STAGE_JOIN)
+			printf(",\"matches\":%llu", matches);
+		puts("}");
+	}
+	else
+	{
+		if (!header_printed)
+			printf("%10s %-6s %7s %10s %14s %8s %10s %12s\n",
+				"size", "stage", "threads", "seconds", "digests/s",
+				"speedup", "efficiency", "matches");
+		printf("%10zu %-6s %7u %10.4f %14.1f %8.3f %10.3f",
+			n, stage_names[st], nthreads, elapsed, rate, speedup, efficiency);
+		if (st == STAGE_JOIN)
+			printf(" %12llu", matches);
+		putchar('\n');
+	}
+	header_printed = true;
+	fflush(stdout);
+}
+
+static size_t parse_list(const char *s, unsigned long long *list)
+{
+	size_t n = 0;
+	while (*s && n < MAX_LIST)
+	{
+		char *end;
+		list[n] = strtoull(s, &end, 10);
+		if (end == s || !list[n])
+			return 0;
+		n++;
+		s = end;
+		if (*s == ',')
+			s++;
+		else if (*s)
+			return 0;
+	}
+	return *s ? 0 : n;
+}
+
+static bool run_size(size_t n, const unsigned long long *threads, size_t nthreadcounts,
+	int threshold, size_t max_join, const corpus_gen *params)
+{
+	bool ok = false;
+	char (*strs)[FFUZZY_PRETTY_LEN] = malloc(sizeof(*strs) * n);
+	ffuzzy_digest *digests = malloc(sizeof(ffuzzy_digest) * n);
+	ffuzzy_digest *work = malloc(sizeof(ffuzzy_digest) * n);
+	ffuzzy_digest *tmp = malloc(sizeof(ffuzzy_digest) * n);
+	parse_job jobs[MAX_LIST];
+	if (!strs || !digests || !work || !tmp)
+	{
+		fprintf(stderr, "size %zu: out of memory\n", n);
+		goto cleanup;
+	}
+	// touch buffers first so that page faults are not measured
+	memset(digests, 0, sizeof(ffuzzy_digest) * n);
+	memset(work, 0, sizeof(ffuzzy_digest) * n);
+	memset(tmp, 0, sizeof(ffuzzy_digest) * n);
+	// generate and shuffle (members of a family are not adjacent)
+	corpus_gen gen = *params;
+	for (size_t i = 0; i < n; i++)
+		corpus_gen_next(&gen, strs[i]);
+	for (size_t i = n; i > 1; i--)
+	{
+		size_t j = (size_t)(corpus_rand(&gen) % i);
+		char t[FFUZZY_PRETTY_LEN];
+		memcpy(t, strs[i - 1], sizeof(t));
+		memcpy(strs[i - 1], strs[j], sizeof(t));
+		memcpy(strs[j], t, sizeof(t));
+	}
+	double base[NUM_STAGES];
+	for (size_t k = 0; k < nthreadcounts; k++)
+	{
+		unsigned nthreads = (unsigned)threads[k];
+		double start, elapsed;
+		// parse
+		for (unsigned t = 0; t < nthreads; t++)
+		{
+			jobs[t].strs = (const char (*)[FFUZZY_PRETTY_LEN])strs;
+			jobs[t].digests = digests;
+			jobs[t].begin = n * t / nthreads;
+			jobs[t].end = n * (t + 1) / nthreads;
+			jobs[t].failed = 0;
+		}
+		start = now();
+		if (!run_threads(nthreads, parse_main, jobs, sizeof(parse_job)))
+			goto cleanup;
+		elapsed = now() - start;
+		for (unsigned t = 0; t < nthreads; t++)
+			if (jobs[t].failed)
+			{
+				fputs("generated digest is not valid\n", stderr);
+				goto cleanup;
+			}
+		if (!k)
+			base[STAGE_PARSE] = elapsed;
+		report(n, STAGE_PARSE, nthreads, elapsed, base[STAGE_PARSE], (unsigned)threads[0], 0);
+		// sort
+		memcpy(work, digests, sizeof(ffuzzy_digest) * n);
+		start = now();
+		if (!parallel_sort(work, tmp, n, nthreads))
+			goto cleanup;
+		elapsed = now() - start;
+		if (!k)
+			base[STAGE_SORT] = elapsed;
+		report(n, STAGE_SORT, nthreads, elapsed, base[STAGE_SORT], (unsigned)threads[0], 0);
+		// all pairs
+		if (n > max_join)
+			continue;
+		unsigned long long matches = 0;
+		start = now();
+		if (!ffuzzy_join_self(digests, n, threshold, nthreads, count_pair, &matches))
+		{
+			fputs("ffuzzy_join_self failed\n", stderr);
+			goto cleanup;
+		}
+		elapsed = now() - start;
+		if (!k)
+			base[STAGE_JOIN] = elapsed;
+		report(n, STAGE_JOIN, nthreads, elapsed, base[STAGE_JOIN], (unsigned)threads[0], matches);
+	}
+	ok = true;
+cleanup:
+	free(tmp);
+	free(work);
+	free(digests);
+	free(strs);
+	return ok;
+}
+
+
+int main(int argc, char **argv)
+{
+	unsigned long long sizes[MAX_LIST] = { 10000, 100000 }, threads[MAX_LIST];
+	size_t nsizes = 2, nthreadcounts = 0;
+	unsigned long long seed = 1, max_join = 10000;
+	int threshold = 60;
+	double ins = 0.05, del = 0.05, sub = 0.05, bs_change = 0.1, family_mean = 8;
+	bool ok = true;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:j:t:J:s:m:i:d:u:b:f:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n': ok = ok && (nsizes = parse_list(optarg, sizes)); break;
+			case 'j': ok = ok && (nthreadcounts = parse_list(optarg, threads)); break;
+			case 't': threshold   = atoi(optarg); break;
+			case 'J': max_join    = strtoull(optarg, NULL, 10); break;
+			case 's': seed        = strtoull(optarg, NULL, 0); break;
+			case 'm': family_mean = strtod(optarg, NULL); break;
+			case 'i': ins         = strtod(optarg, NULL); break;
+			case 'd': del         = strtod(optarg, NULL); break;
+			case 'u': sub         = strtod(optarg, NULL); break;
+			case 'b': bs_change   = strtod(optarg, NULL); break;
+			case 'f':
+				if (!strcmp(optarg, "json"))
+					json = true;
+				else if (strcmp(optarg, "text"))
+					ok = false;
+				break;
+			default:  ok = false; break;
+		}
+	}
+	for (size_t i = 0; i < nthreadcounts; i++)
+	{
+		if (threads[i] > MAX_LIST)
+			ok = false;
+#ifndef FFUZZY_ENABLE_THREADS
+		if (threads[i] > 1)
+			ok = false;
+#endif
+	}
+	if (!ok || optind != argc || threshold > 100 || !(family_mean >= 1)
+		|| !(ins >= 0 && ins <= 1) || !(del >= 0 && sub >= 0 && del + sub <= 1)
+		|| !(bs_change >= 0 && bs_change <= 1))
+	{
+		fputs("usage: ffuzzy_macrobench [-n SIZES] [-j THREADS] [-t THRESHOLD] [-J MAX_JOIN]\n"
+			"                         [-s SEED] [-m FAMILY_MEAN] [-i INS] [-d DEL] [-u SUB] [-b BS_CHANGE]\n"
+			"                         [-f text|json]\n", stderr);
+		return 2;
+	}
+	if (!nthreadcounts)
+	{
+		long nproc = 1;
+#ifdef FFUZZY_ENABLE_THREADS
+		nproc = sysconf(_SC_NPROCESSORS_ONLN);
+		if (nproc > MAX_LIST)
+			nproc = MAX_LIST;
+#endif
+		for (unsigned long long t = 1; t <= (unsigned long long)nproc; t *= 2)
+			threads[nthreadcounts++] = t;
+		if (!nthreadcounts || threads[nthreadcounts - 1] != (unsigned long long)nproc)
+			threads[nthreadcounts++] = nproc > 0 ? (unsigned long long)nproc : 1;
+	}
+	corpus_gen params;
+	corpus_gen_init(&params, seed);
+	params.ins_rate = ins;
+	params.del_rate = del;
+	params.sub_rate = sub;
+	params.bs_change = bs_change;
+	params.family_mean = family_mean;
+	for (size_t i = 0; i < nsizes; i++)
+		if (!run_size((size_t)sizes[i], threads, nthreadcounts, threshold, (size_t)max_join, &params))
+			return 1;
+	return 0;
+}
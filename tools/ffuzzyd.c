@@ -0,0 +1,479 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tools/ffuzzyd.c
+	Similarity lookup daemon
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\file  tools/ffuzzyd.c
+	\brief Similarity lookup daemon
+	\details
+		Usage: ffuzzyd -s SOCKET [-f CORPUS] [-w WORKERS] [-c INTERVAL_MS]
+
+		The daemon keeps digests in a concurrent index (partitioned by
+		block sizes) and serves requests over a Unix domain socket
+		(see tools/ffuzzyd_proto.h for the protocol).
+		The corpus file contains one digest per line (ssdeep output is
+		accepted; the text after the first comma is ignored) and
+		digest IDs are assigned in the order of insertion.
+		When the daemon serves a shard, the coordinator
+		(tools/ffuzzyd_coord.c) inserts digests with global IDs.
+
+		Each connection is handled by its own thread which decodes
+		requests. Queries in a batch are searched by the worker pool
+		in parallel and responses are streamed in the request order.
+		Insertions are visible to queries received after the response.
+**/
+
+#include "ffuzzy_config.h"
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef FFUZZY_ENABLE_THREADS
+#include <pthread.h>
+#endif
+
+#include "ffuzzy.h"
+#include "ffuzzyd_proto.h"
+
+
+#ifdef FFUZZY_ENABLE_THREADS
+
+struct conn;
+
+/* a query in a batch (searched by a worker) */
+typedef struct job
+{
+	struct conn *conn;
+	struct job *next;
+	ffuzzy_digest query;
+	int threshold;
+	bool valid, ok, done;
+	ffuzzy_match_list results;
+} job;
+
+typedef struct conn
+{
+	int fd;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	job *jobs;
+	size_t njobs;
+} conn;
+
+static ffuzzy_concurrent_index *idx;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static job *queue_head, *queue_tail;
+/* external IDs of digests (indexed by IDs in the index) */
+static pthread_mutex_t insert_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t ids_lock = PTHREAD_RWLOCK_INITIALIZER;
+static uint_least64_t *ext_ids;
+static size_t ext_cap;
+static uint_least64_t next_ext;
+static volatile sig_atomic_t stopping;
+
+
+static void *worker_main(void *arg)
+{
+	ffuzzy_concurrent_reader *reader = arg;
+	for (;;)
+	{
+		pthread_mutex_lock(&queue_lock);
+		while (!queue_head)
+			pthread_cond_wait(&queue_cond, &queue_lock);
+		job *j = queue_head;
+		queue_head = j->next;
+		if (!queue_head)
+			queue_tail = NULL;
+		pthread_mutex_unlock(&queue_lock);
+		bool ok = ffuzzy_concurrent_index_search(reader, &j->query, j->threshold, &j->results);
+		pthread_mutex_lock(&j->conn->lock);
+		j->ok = ok;
+		j->done = true;
+		pthread_cond_broadcast(&j->conn->cond);
+		pthread_mutex_unlock(&j->conn->lock);
+	}
+	return NULL;
+}
+
+
+/* parse a digest at the beginning of the line (until a comma) */
+static bool parse_digest(ffuzzy_digest *digest, const char *line)
+{
+	char buf[256];
+	size_t len = strcspn(line, ",\r\n");
+	if (len >= sizeof(buf))
+		return false;
+	memcpy(buf, line, len);
+	buf[len] = '\0';
+	return ffuzzy_read_digest(digest, buf);
+}
+
+
+/*
+	insert a digest (with the external ID if explicit; otherwise the next ID)
+	The external ID is recorded before the digest is published.
+*/
+static bool insert_digest(const ffuzzy_digest *digest, bool explicit, uint_least64_t *ext)
+{
+	bool ok = false;
+	pthread_mutex_lock(&insert_lock);
+	size_t id = ffuzzy_concurrent_index_size(idx);
+	if (!explicit)
+		*ext = next_ext;
+	pthread_rwlock_wrlock(&ids_lock);
+	if (id == ext_cap)
+	{
+		size_t cap = ext_cap ? ext_cap * 2 : 1024;
+		uint_least64_t *p = realloc(ext_ids, sizeof(uint_least64_t) * cap);
+		if (p)
+		{
+			ext_ids = p;
+			ext_cap = cap;
+		}
+	}
+	if (id < ext_cap)
+		ext_ids[id] = *ext;
+	pthread_rwlock_unlock(&ids_lock);
+	if (id < ext_cap && ffuzzy_concurrent_index_add(idx, digest, NULL))
+	{
+		if (*ext >= next_ext)
+			next_ext = *ext + 1;
+		ok = true;
+	}
+	pthread_mutex_unlock(&insert_lock);
+	return ok;
+}
+
+
+/* reply an error to a request which cannot be processed (the connection is closed) */
+static bool reject(conn *c, unsigned status)
+{
+	ffuzzyd_send(c->fd, status, NULL, 0);
+	return false;
+}
+
+
+static bool handle_query(conn *c, ffuzzyd_reader *r, ffuzzyd_buf *out)
+{
+	int threshold = (int)ffuzzyd_get8(r);
+	uint_least32_t limit = ffuzzyd_get32(r);
+	uint_least32_t count = ffuzzyd_get32(r);
+	// every digest takes at least one byte
+	if (r->error || count > FFUZZYD_BATCH_MAX || count > (size_t)(r->end - r->p))
+		return reject(c, FFUZZYD_EINVAL);
+	if (count > c->njobs)
+	{
+		job *jobs = realloc(c->jobs, sizeof(job) * count);
+		if (!jobs)
+			return reject(c, FFUZZYD_EFAIL);
+		for (size_t i = c->njobs; i < count; i++)
+			ffuzzy_match_list_init(&jobs[i].results);
+		c->jobs = jobs;
+		c->njobs = count;
+	}
+	job *first = NULL, *last = NULL;
+	for (size_t i = 0; i < count; i++)
+	{
+		job *j = &c->jobs[i];
+		char str[256];
+		if (!ffuzzyd_getstr(r, str))
+			return reject(c, FFUZZYD_EINVAL);
+		j->conn = c;
+		j->next = NULL;
+		j->threshold = threshold;
+		j->valid = ffuzzy_read_digest(&j->query, str);
+		j->done = !j->valid;
+		if (!j->valid)
+			continue;
+		if (last)
+			last->next = j;
+		else
+			first = j;
+		last = j;
+	}
+	if (first)
+	{
+		pthread_mutex_lock(&queue_lock);
+		if (queue_tail)
+			queue_tail->next = first;
+		else
+			queue_head = first;
+		queue_tail = last;
+		pthread_cond_broadcast(&queue_cond);
+		pthread_mutex_unlock(&queue_lock);
+	}
+	// stream responses in the request order (workers may still use later jobs)
+	bool ok = true;
+	for (size_t i = 0; i < count; i++)
+	{
+		job *j = &c->jobs[i];
+		pthread_mutex_lock(&c->lock);
+		while (!j->done)
+			pthread_cond_wait(&c->cond, &c->lock);
+		pthread_mutex_unlock(&c->lock);
+		if (!ok)
+			continue;
+		if (!j->valid)
+		{
+			ok = ffuzzyd_send(c->fd, FFUZZYD_EINVAL, NULL, 0);
+			continue;
+		}
+		if (!j->ok)
+		{
+			ok = ffuzzyd_send(c->fd, FFUZZYD_EFAIL, NULL, 0);
+			continue;
+		}
+		size_t n = j->results.count;
+		if (limit && n > limit)
+			n = limit;
+		out->len = 0;
+		ok = ffuzzyd_buf_reserve(out, 4 + n * FFUZZYD_MATCH_SIZE)
+			&& ffuzzyd_buf_put32(out, (uint_least32_t)n);
+		pthread_rwlock_rdlock(&ids_lock);
+		for (size_t k = 0; ok && k < n; k++)
+			ok = ffuzzyd_buf_put64(out, ext_ids[j->results.matches[k].id])
+				&& ffuzzyd_buf_put8(out, (unsigned)j->results.matches[k].score);
+		pthread_rwlock_unlock(&ids_lock);
+		ok = ok && ffuzzyd_send(c->fd, FFUZZYD_OK, out->data, out->len);
+	}
+	return ok;
+}
+
+
+static bool handle_insert(conn *c, ffuzzyd_reader *r, ffuzzyd_buf *out, bool explicit)
+{
+	uint_least32_t count = ffuzzyd_get32(r);
+	if (r->error || count > FFUZZYD_BATCH_MAX || count > (size_t)(r->end - r->p))
+		return reject(c, FFUZZYD_EINVAL);
+	out->len = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		char str[256];
+		ffuzzy_digest digest;
+		uint_least64_t ext = explicit ? ffuzzyd_get64(r) : 0;
+		if (!ffuzzyd_getstr(r, str) || ext == FFUZZYD_NO_ID)
+			return reject(c, FFUZZYD_EINVAL);
+		if (!ffuzzy_read_digest(&digest, str))
+			ext = FFUZZYD_NO_ID;
+		else if (!insert_digest(&digest, explicit, &ext))
+			return reject(c, FFUZZYD_EFAIL);
+		if (!ffuzzyd_buf_put64(out, ext))
+			return reject(c, FFUZZYD_EFAIL);
+	}
+	return ffuzzyd_send(c->fd, FFUZZYD_OK, out->data, out->len);
+}
+
+
+static void *conn_main(void *arg)
+{
+	conn *c = arg;
+	ffuzzyd_buf in = {NULL, 0, 0}, out = {NULL, 0, 0};
+	unsigned op;
+	bool ok = true;
+	while (ok && ffuzzyd_recv(c->fd, &op, &in))
+	{
+		ffuzzyd_reader r = {in.data, in.data + in.len, false};
+		switch (op)
+		{
+			case FFUZZYD_OP_QUERY:
+				ok = handle_query(c, &r, &out);
+				break;
+			case FFUZZYD_OP_INSERT:
+				ok = handle_insert(c, &r, &out, false);
+				break;
+			case FFUZZYD_OP_INSERT_IDS:
+				ok = handle_insert(c, &r, &out, true);
+				break;
+			case FFUZZYD_OP_STAT:
+				out.len = 0;
+				ok = ffuzzyd_buf_put64(&out, ffuzzy_concurrent_index_size(idx))
+					&& ffuzzyd_send(c->fd, FFUZZYD_OK, out.data, out.len);
+				break;
+			default:
+				// malformed requests close the connection
+				ffuzzyd_send(c->fd, FFUZZYD_EINVAL, NULL, 0);
+				ok = false;
+				break;
+		}
+	}
+	close(c->fd);
+	for (size_t i = 0; i < c->njobs; i++)
+		ffuzzy_match_list_free(&c->jobs[i].results);
+	free(c->jobs);
+	free(in.data);
+	free(out.data);
+	pthread_cond_destroy(&c->cond);
+	pthread_mutex_destroy(&c->lock);
+	free(c);
+	return NULL;
+}
+
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stopping = 1;
+}
+
+
+static bool load_corpus(const char *path)
+{
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+	{
+		perror(path);
+		return false;
+	}
+	char line[1024];
+	size_t skipped = 0;
+	while (fgets(line, sizeof(line), fp))
+	{
+		ffuzzy_digest digest;
+		uint_least64_t ext;
+		if (!parse_digest(&digest, line))
+			skipped++;
+		else if (!insert_digest(&digest, false, &ext))
+		{
+			fputs("out of memory\n", stderr);
+			fclose(fp);
+			return false;
+		}
+	}
+	fclose(fp);
+	ffuzzy_concurrent_index_compact(idx);
+	fprintf(stderr, "ffuzzyd: loaded %zu digests (%zu lines skipped)\n",
+		ffuzzy_concurrent_index_size(idx), skipped);
+	return true;
+}
+
+
+int main(int argc, char **argv)
+{
+	const char *sockpath = NULL, *corpus = NULL;
+	long nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned interval_ms = 100;
+	int opt;
+	while ((opt = getopt(argc, argv, "s:f:w:c:")) != -1)
+	{
+		switch (opt)
+		{
+			case 's': sockpath    = optarg; break;
+			case 'f': corpus      = optarg; break;
+			case 'w': nworkers    = strtol(optarg, NULL, 10); break;
+			case 'c': interval_ms = (unsigned)strtoul(optarg, NULL, 10); break;
+			default:
+				sockpath = NULL;
+				optind = argc;
+				break;
+		}
+	}
+	if (!sockpath)
+	{
+		fputs("usage: ffuzzyd -s SOCKET [-f CORPUS] [-w WORKERS] [-c INTERVAL_MS]\n", stderr);
+		return 2;
+	}
+	if (nworkers < 1)
+		nworkers = 1;
+	idx = ffuzzy_concurrent_index_new();
+	if (!idx)
+	{
+		fputs("out of memory\n", stderr);
+		return 1;
+	}
+	if (corpus && !load_corpus(corpus))
+		return 1;
+	if (interval_ms && !ffuzzy_concurrent_index_start_compactor(idx, interval_ms))
+	{
+		fputs("failed to start the compactor\n", stderr);
+		return 1;
+	}
+	for (long i = 0; i < nworkers; i++)
+	{
+		pthread_t th;
+		ffuzzy_concurrent_reader *reader = ffuzzy_concurrent_reader_new(idx);
+		if (!reader || pthread_create(&th, NULL, worker_main, reader))
+		{
+			fputs("failed to start workers\n", stderr);
+			return 1;
+		}
+		pthread_detach(th);
+	}
+	int lfd = ffuzzyd_listen(sockpath);
+	if (lfd < 0)
+	{
+		perror(sockpath);
+		return 1;
+	}
+	// accept is interrupted by signals to stop
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+	while (!stopping)
+	{
+		int fd = accept(lfd, NULL, NULL);
+		if (fd < 0)
+			continue;
+		pthread_t th;
+		conn *c = calloc(1, sizeof(conn));
+		if (!c || pthread_mutex_init(&c->lock, NULL))
+		{
+			free(c);
+			close(fd);
+			continue;
+		}
+		pthread_cond_init(&c->cond, NULL);
+		c->fd = fd;
+		if (pthread_create(&th, NULL, conn_main, c))
+		{
+			pthread_cond_destroy(&c->cond);
+			pthread_mutex_destroy(&c->lock);
+			free(c);
+			close(fd);
+			continue;
+		}
+		pthread_detach(th);
+	}
+	close(lfd);
+	unlink(sockpath);
+	return 0;
+}
+
+#else
+
+int main(void)
+{
+	fputs("ffuzzyd: threads are disabled\n", stderr);
+	return 1;
+}
+
+#endif
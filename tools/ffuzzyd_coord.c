@@ -0,0 +1,621 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tools/ffuzzyd_coord.c
+	Shard coordinator for the similarity lookup daemon
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\file  tools/ffuzzyd_coord.c
+	\brief Shard coordinator for the similarity lookup daemon
+	\details
+		Usage: ffuzzyd_coord -s SOCKET -S SHARD1,SHARD2,... [-p range|hash] [-f CORPUS]
+
+		The coordinator partitions the corpus into shards served by
+		ffuzzyd processes (started with empty corpora on the given sockets)
+		and speaks the same protocol as ffuzzyd on its own socket.
+		Digest IDs are global: corpus digests are numbered in file order
+		and inserted digests are numbered after them.
+
+		A query batch is split by the target shards of each query and
+		sub-batches are sent to all shards before reading any responses
+		(shards search in parallel). Per-shard results (top-k if a limit
+		is given) are merged deterministically by ffuzzy_match_list_merge.
+**/
+
+#include "ffuzzy_config.h"
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef FFUZZY_ENABLE_THREADS
+#include <pthread.h>
+#endif
+
+#include "ffuzzy.h"
+#include "ffuzzyd_proto.h"
+
+
+#ifdef FFUZZY_ENABLE_THREADS
+
+static ffuzzy_shard_map *map;
+static unsigned nshards;
+static char **shard_paths;
+static uint_least64_t next_id;
+static volatile sig_atomic_t stopping;
+
+/* state of a client connection */
+typedef struct
+{
+	int fd;
+	int *shards;            /* connections to shards */
+	ffuzzyd_buf *reqs;      /* sub-requests for each shard */
+	size_t *counts;         /* number of digests in sub-requests */
+	ffuzzyd_buf in, out;
+	/* per query */
+	size_t cap;
+	ffuzzy_digest *queries;
+	bool *valid;
+	unsigned *status;
+	ffuzzy_match_list *lists;  /* [query * nshards + shard] */
+	bool *sent;                /* [query * nshards + shard] */
+	uint_least64_t *ids;
+	ffuzzy_match_list merged;
+} client;
+
+
+/* reply an error to a request which cannot be processed (the connection is closed) */
+static bool reject(client *c, unsigned status)
+{
+	ffuzzyd_send(c->fd, status, NULL, 0);
+	return false;
+}
+
+
+static bool push_match(ffuzzy_match_list *list, size_t id, int score)
+{
+	if (list->count == list->capacity)
+	{
+		size_t cap = list->capacity ? list->capacity * 2 : 16;
+		ffuzzy_match *matches = realloc(list->matches, sizeof(ffuzzy_match) * cap);
+		if (!matches)
+			return false;
+		list->matches = matches;
+		list->capacity = cap;
+	}
+	list->matches[list->count].id = id;
+	list->matches[list->count].score = score;
+	list->count++;
+	return true;
+}
+
+
+/* send sub-requests to shards and let each shard process them */
+static bool send_requests(client *c, unsigned op)
+{
+	for (unsigned s = 0; s < nshards; s++)
+	{
+		if (!c->reqs[s].len)
+			continue;
+		if (!ffuzzyd_send(c->shards[s], op, c->reqs[s].data, c->reqs[s].len))
+			return false;
+	}
+	return true;
+}
+
+
+static bool reserve_queries(client *c, size_t count)
+{
+	if (count <= c->cap)
+		return true;
+	ffuzzy_digest *queries = realloc(c->queries, sizeof(ffuzzy_digest) * count);
+	if (queries)
+		c->queries = queries;
+	bool *valid = realloc(c->valid, sizeof(bool) * count);
+	if (valid)
+		c->valid = valid;
+	unsigned *status = realloc(c->status, sizeof(unsigned) * count);
+	if (status)
+		c->status = status;
+	uint_least64_t *ids = realloc(c->ids, sizeof(uint_least64_t) * count);
+	if (ids)
+		c->ids = ids;
+	bool *sent = realloc(c->sent, sizeof(bool) * count * nshards);
+	if (sent)
+		c->sent = sent;
+	ffuzzy_match_list *lists = realloc(c->lists, sizeof(ffuzzy_match_list) * count * nshards);
+	if (lists)
+	{
+		for (size_t i = c->cap * nshards; i < count * nshards; i++)
+			ffuzzy_match_list_init(&lists[i]);
+		c->lists = lists;
+	}
+	if (!queries || !valid || !status || !ids || !sent || !lists)
+		return false;
+	c->cap = count;
+	return true;
+}
+
+
+static bool handle_query(client *c, ffuzzyd_reader *r)
+{
+	unsigned threshold = ffuzzyd_get8(r);
+	uint_least32_t limit = ffuzzyd_get32(r);
+	uint_least32_t count = ffuzzyd_get32(r);
+	if (r->error || count > FFUZZYD_BATCH_MAX || count > (size_t)(r->end - r->p) || count > SIZE_MAX / nshards)
+		return reject(c, FFUZZYD_EINVAL);
+	if (!reserve_queries(c, count))
+		return reject(c, FFUZZYD_EFAIL);
+	// split the batch (each sub-batch keeps the request order)
+	unsigned *targets = malloc(sizeof(unsigned) * nshards);
+	bool ok = targets;
+	for (unsigned s = 0; ok && s < nshards; s++)
+	{
+		c->reqs[s].len = 0;
+		c->counts[s] = 0;
+		ok = ffuzzyd_buf_put8(&c->reqs[s], threshold)
+			&& ffuzzyd_buf_put32(&c->reqs[s], limit)
+			&& ffuzzyd_buf_put32(&c->reqs[s], 0);
+	}
+	for (size_t i = 0; ok && i < count; i++)
+	{
+		char str[256];
+		if (!ffuzzyd_getstr(r, str))
+		{
+			free(targets);
+			return reject(c, FFUZZYD_EINVAL);
+		}
+		for (unsigned s = 0; s < nshards; s++)
+		{
+			c->lists[i * nshards + s].count = 0;
+			c->sent[i * nshards + s] = false;
+		}
+		c->status[i] = FFUZZYD_OK;
+		c->valid[i] = ffuzzy_read_digest(&c->queries[i], str);
+		if (!c->valid[i])
+		{
+			c->status[i] = FFUZZYD_EINVAL;
+			continue;
+		}
+		unsigned n = ffuzzy_shard_map_targets(map, &c->queries[i], targets);
+		for (unsigned k = 0; ok && k < n; k++)
+		{
+			c->counts[targets[k]]++;
+			c->sent[i * nshards + targets[k]] = true;
+			ok = ffuzzyd_buf_putstr(&c->reqs[targets[k]], str);
+		}
+	}
+	for (unsigned s = 0; ok && s < nshards; s++)
+	{
+		if (!c->counts[s])
+			c->reqs[s].len = 0;
+		else
+			ffuzzyd_buf_set32(&c->reqs[s], 5, (uint_least32_t)c->counts[s]);
+	}
+	ok = ok && send_requests(c, FFUZZYD_OP_QUERY);
+	// gather responses (in the order of sub-batches)
+	for (unsigned s = 0; ok && s < nshards; s++)
+	{
+		if (!c->counts[s])
+			continue;
+		for (size_t i = 0; ok && i < count; i++)
+		{
+			if (!c->sent[i * nshards + s])
+				continue;
+			unsigned status;
+			if (!ffuzzyd_recv(c->shards[s], &status, &c->in))
+			{
+				ok = false;
+				break;
+			}
+			if (status != FFUZZYD_OK)
+			{
+				c->status[i] = status;
+				continue;
+			}
+			ffuzzyd_reader rr = {c->in.data, c->in.data + c->in.len, false};
+			ffuzzy_match_list *list = &c->lists[i * nshards + s];
+			uint_least32_t m = ffuzzyd_get32(&rr);
+			for (size_t k = 0; k < m && !rr.error; k++)
+			{
+				uint_least64_t id = ffuzzyd_get64(&rr);
+				int score = (int)ffuzzyd_get8(&rr);
+				if (!push_match(list, (size_t)id, score))
+					c->status[i] = FFUZZYD_EFAIL;
+			}
+			if (rr.error)
+				c->status[i] = FFUZZYD_EFAIL;
+		}
+	}
+	free(targets);
+	if (!ok)
+		return reject(c, FFUZZYD_EFAIL);
+	// merge and respond in the request order
+	for (size_t i = 0; i < count; i++)
+	{
+		if (c->status[i] == FFUZZYD_OK &&
+			!ffuzzy_match_list_merge(&c->merged, &c->lists[i * nshards], nshards, limit))
+			c->status[i] = FFUZZYD_EFAIL;
+		if (c->status[i] != FFUZZYD_OK)
+		{
+			if (!ffuzzyd_send(c->fd, c->status[i], NULL, 0))
+				return false;
+			continue;
+		}
+		c->out.len = 0;
+		ok = ffuzzyd_buf_reserve(&c->out, 4 + c->merged.count * FFUZZYD_MATCH_SIZE)
+			&& ffuzzyd_buf_put32(&c->out, (uint_least32_t)c->merged.count);
+		for (size_t k = 0; ok && k < c->merged.count; k++)
+			ok = ffuzzyd_buf_put64(&c->out, c->merged.matches[k].id)
+				&& ffuzzyd_buf_put8(&c->out, (unsigned)c->merged.matches[k].score);
+		if (!ok || !ffuzzyd_send(c->fd, FFUZZYD_OK, c->out.data, c->out.len))
+			return false;
+	}
+	return true;
+}
+
+
+/*
+	send insertion sub-requests (with IDs) and wait for all shards
+	Each sub-request is a count (filled here) and pairs of an ID and a digest.
+*/
+static bool finish_inserts(client *c)
+{
+	for (unsigned s = 0; s < nshards; s++)
+	{
+		if (c->counts[s])
+			ffuzzyd_buf_set32(&c->reqs[s], 0, (uint_least32_t)c->counts[s]);
+		else
+			c->reqs[s].len = 0;
+	}
+	if (!send_requests(c, FFUZZYD_OP_INSERT_IDS))
+		return false;
+	for (unsigned s = 0; s < nshards; s++)
+	{
+		unsigned status;
+		if (c->reqs[s].len && (!ffuzzyd_recv(c->shards[s], &status, &c->in) || status != FFUZZYD_OK))
+			return false;
+	}
+	return true;
+}
+
+
+static bool handle_insert(client *c, ffuzzyd_reader *r)
+{
+	uint_least32_t count = ffuzzyd_get32(r);
+	if (r->error || count > FFUZZYD_BATCH_MAX || count > (size_t)(r->end - r->p))
+		return reject(c, FFUZZYD_EINVAL);
+	if (!reserve_queries(c, count))
+		return reject(c, FFUZZYD_EFAIL);
+	bool ok = true;
+	for (unsigned s = 0; ok && s < nshards; s++)
+	{
+		c->reqs[s].len = 0;
+		c->counts[s] = 0;
+		ok = ffuzzyd_buf_put32(&c->reqs[s], 0);
+	}
+	// assign global IDs and route each digest to its owner
+	for (size_t i = 0; ok && i < count; i++)
+	{
+		char str[256];
+		if (!ffuzzyd_getstr(r, str))
+			return reject(c, FFUZZYD_EINVAL);
+		c->ids[i] = FFUZZYD_NO_ID;
+		if (!ffuzzy_read_digest(&c->queries[i], str))
+			continue;
+		unsigned s = ffuzzy_shard_map_owner(map, &c->queries[i]);
+		c->ids[i] = __atomic_fetch_add(&next_id, 1, __ATOMIC_SEQ_CST);
+		c->counts[s]++;
+		ok = ffuzzyd_buf_put64(&c->reqs[s], c->ids[i]) && ffuzzyd_buf_putstr(&c->reqs[s], str);
+	}
+	ok = ok && finish_inserts(c);
+	if (!ok)
+		return reject(c, FFUZZYD_EFAIL);
+	c->out.len = 0;
+	for (size_t i = 0; ok && i < count; i++)
+		ok = ffuzzyd_buf_put64(&c->out, c->ids[i]);
+	return ok && ffuzzyd_send(c->fd, FFUZZYD_OK, c->out.data, c->out.len);
+}
+
+
+static bool handle_stat(client *c)
+{
+	uint_least64_t total = 0;
+	for (unsigned s = 0; s < nshards; s++)
+	{
+		unsigned status;
+		if (!ffuzzyd_send(c->shards[s], FFUZZYD_OP_STAT, NULL, 0)
+			|| !ffuzzyd_recv(c->shards[s], &status, &c->in) || status != FFUZZYD_OK)
+			return reject(c, FFUZZYD_EFAIL);
+		ffuzzyd_reader rr = {c->in.data, c->in.data + c->in.len, false};
+		total += ffuzzyd_get64(&rr);
+	}
+	c->out.len = 0;
+	return ffuzzyd_buf_put64(&c->out, total) && ffuzzyd_send(c->fd, FFUZZYD_OK, c->out.data, c->out.len);
+}
+
+
+static void client_free(client *c)
+{
+	for (unsigned s = 0; s < nshards; s++)
+	{
+		if (c->shards[s] >= 0)
+			close(c->shards[s]);
+		free(c->reqs[s].data);
+	}
+	for (size_t i = 0; i < c->cap * nshards; i++)
+		ffuzzy_match_list_free(&c->lists[i]);
+	ffuzzy_match_list_free(&c->merged);
+	free(c->lists);
+	free(c->sent);
+	free(c->ids);
+	free(c->status);
+	free(c->valid);
+	free(c->queries);
+	free(c->in.data);
+	free(c->out.data);
+	free(c->counts);
+	free(c->reqs);
+	free(c->shards);
+	if (c->fd >= 0)
+		close(c->fd);
+	free(c);
+}
+
+
+/* create a client state with connections to all shards */
+static client *client_new(int fd)
+{
+	client *c = calloc(1, sizeof(client));
+	if (!c)
+		return NULL;
+	c->fd = fd;
+	c->shards = malloc(sizeof(int) * nshards);
+	c->reqs = calloc(nshards, sizeof(ffuzzyd_buf));
+	c->counts = calloc(nshards, sizeof(size_t));
+	ffuzzy_match_list_init(&c->merged);
+	if (!c->shards || !c->reqs || !c->counts)
+	{
+		free(c->counts);
+		free(c->shards);
+		free(c->reqs);
+		free(c);
+		return NULL;
+	}
+	for (unsigned s = 0; s < nshards; s++)
+		c->shards[s] = -1;
+	for (unsigned s = 0; s < nshards; s++)
+	{
+		if ((c->shards[s] = ffuzzyd_connect(shard_paths[s])) < 0)
+		{
+			perror(shard_paths[s]);
+			c->fd = -1;
+			client_free(c);
+			return NULL;
+		}
+	}
+	return c;
+}
+
+
+static void *client_main(void *arg)
+{
+	client *c = arg;
+	unsigned op;
+	bool ok = true;
+	ffuzzyd_buf req = {NULL, 0, 0};
+	while (ok && ffuzzyd_recv(c->fd, &op, &req))
+	{
+		ffuzzyd_reader r = {req.data, req.data + req.len, false};
+		switch (op)
+		{
+			case FFUZZYD_OP_QUERY:  ok = handle_query(c, &r);  break;
+			case FFUZZYD_OP_INSERT: ok = handle_insert(c, &r); break;
+			case FFUZZYD_OP_STAT:   ok = handle_stat(c);       break;
+			default:                ok = reject(c, FFUZZYD_EINVAL); break;
+		}
+	}
+	free(req.data);
+	client_free(c);
+	return NULL;
+}
+
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stopping = 1;
+}
+
+
+/* load the corpus and distribute it to shards */
+static bool load_corpus(const char *path, bool by_hash)
+{
+	ffuzzy_digest *digests = NULL;
+	char (*strs)[256] = NULL;
+	size_t n = 0, cap = 0;
+	if (path)
+	{
+		FILE *fp = fopen(path, "r");
+		if (!fp)
+		{
+			perror(path);
+			return false;
+		}
+		char line[1024];
+		while (fgets(line, sizeof(line), fp))
+		{
+			line[strcspn(line, ",\r\n")] = '\0';
+			if (strlen(line) > 255)
+				continue;
+			if (n == cap)
+			{
+				cap = cap ? cap * 2 : 1024;
+				digests = realloc(digests, sizeof(ffuzzy_digest) * cap);
+				strs = realloc(strs, sizeof(strs[0]) * cap);
+				if (!digests || !strs)
+				{
+					fputs("out of memory\n", stderr);
+					return false;
+				}
+			}
+			if (ffuzzy_read_digest(&digests[n], line))
+				strcpy(strs[n++], line);
+		}
+		fclose(fp);
+	}
+	map = by_hash ? ffuzzy_shard_map_new_hash(nshards) : ffuzzy_shard_map_new_range(digests, n, nshards);
+	client *c = map ? client_new(-1) : NULL;
+	if (!c)
+		return false;
+	bool ok = true;
+	for (size_t i = 0; ok && i < n; )
+	{
+		// send up to 1024 digests per shard at once
+		size_t end = i + 1024 * nshards < n ? i + 1024 * nshards : n;
+		for (unsigned s = 0; ok && s < nshards; s++)
+		{
+			c->reqs[s].len = 0;
+			c->counts[s] = 0;
+			ok = ffuzzyd_buf_put32(&c->reqs[s], 0);
+		}
+		for (; ok && i < end; i++)
+		{
+			unsigned s = ffuzzy_shard_map_owner(map, &digests[i]);
+			c->counts[s]++;
+			ok = ffuzzyd_buf_put64(&c->reqs[s], i) && ffuzzyd_buf_putstr(&c->reqs[s], strs[i]);
+		}
+		ok = ok && finish_inserts(c);
+	}
+	next_id = n;
+	for (unsigned s = 0; ok && s < nshards; s++)
+	{
+		unsigned status;
+		ok = ffuzzyd_send(c->shards[s], FFUZZYD_OP_STAT, NULL, 0)
+			&& ffuzzyd_recv(c->shards[s], &status, &c->in) && status == FFUZZYD_OK;
+		ffuzzyd_reader rr = {c->in.data, c->in.data + c->in.len, false};
+		if (ok)
+			fprintf(stderr, "ffuzzyd_coord: shard %u (%s): %llu digests\n",
+				s, shard_paths[s], (unsigned long long)ffuzzyd_get64(&rr));
+	}
+	client_free(c);
+	free(strs);
+	free(digests);
+	return ok;
+}
+
+
+int main(int argc, char **argv)
+{
+	const char *sockpath = NULL, *corpus = NULL;
+	char *shards = NULL;
+	bool by_hash = false, usage = false;
+	int opt;
+	while ((opt = getopt(argc, argv, "s:S:p:f:")) != -1)
+	{
+		switch (opt)
+		{
+			case 's': sockpath = optarg; break;
+			case 'S': shards   = optarg; break;
+			case 'f': corpus   = optarg; break;
+			case 'p':
+				if (!strcmp(optarg, "hash"))
+					by_hash = true;
+				else if (strcmp(optarg, "range"))
+					usage = true;
+				break;
+			default:
+				usage = true;
+				break;
+		}
+	}
+	if (usage || !sockpath || !shards)
+	{
+		fputs("usage: ffuzzyd_coord -s SOCKET -S SHARD1,SHARD2,... [-p range|hash] [-f CORPUS]\n", stderr);
+		return 2;
+	}
+	for (char *p = strtok(shards, ","); p; p = strtok(NULL, ","))
+	{
+		char **paths = realloc(shard_paths, sizeof(char*) * (nshards + 1));
+		if (!paths)
+			return 1;
+		shard_paths = paths;
+		shard_paths[nshards++] = p;
+	}
+	if (!nshards)
+		return 2;
+	signal(SIGPIPE, SIG_IGN);
+	if (!load_corpus(corpus, by_hash))
+	{
+		fputs("failed to distribute the corpus\n", stderr);
+		return 1;
+	}
+	int lfd = ffuzzyd_listen(sockpath);
+	if (lfd < 0)
+	{
+		perror(sockpath);
+		return 1;
+	}
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	while (!stopping)
+	{
+		int fd = accept(lfd, NULL, NULL);
+		if (fd < 0)
+			continue;
+		pthread_t th;
+		client *c = client_new(fd);
+		if (!c)
+		{
+			close(fd);
+			continue;
+		}
+		if (pthread_create(&th, NULL, client_main, c))
+		{
+			client_free(c);
+			continue;
+		}
+		pthread_detach(th);
+	}
+	close(lfd);
+	unlink(sockpath);
+	ffuzzy_shard_map_free(map);
+	free(shard_paths);
+	return 0;
+}
+
+#else
+
+int main(void)
+{
+	fputs("ffuzzyd_coord: threads are disabled\n", stderr);
+	return 1;
+}
+
+#endif
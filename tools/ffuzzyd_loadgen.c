@@ -0,0 +1,262 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tools/ffuzzyd_loadgen.c
+	Load generator for the similarity lookup daemon
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+	\file  tools/ffuzzyd_loadgen.c
+	\brief Load generator for the similarity lookup daemon
+	\details
+		Usage: ffuzzyd_loadgen -s SOCKET -f QUERIES [-i] [-c CONNECTIONS] [-b BATCH] [-n BATCHES] [-t THRESHOLD] [-k LIMIT]
+
+		Each connection (a thread) sends BATCHES query batches of BATCH
+		digests taken from the query file (one digest per line) and
+		measures the latency of each batch (until its last response).
+		With -i, the query file is inserted first.
+		It prints the throughput (queries per second) and
+		batch latency percentiles of completed batches
+		(a connection stops at the first error).
+**/
+
+#include "ffuzzy_config.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef FFUZZY_ENABLE_THREADS
+#include <pthread.h>
+#endif
+
+#include "ffuzzy.h"
+#include "ffuzzyd_proto.h"
+
+
+#ifdef FFUZZY_ENABLE_THREADS
+
+static const char *sockpath;
+static char (*queries)[256];
+static size_t nqueries;
+static unsigned batch = 16, nbatches = 1000, threshold = 50, limit = 0;
+static double *latencies;
+static size_t nlatencies;
+static unsigned long long nmatches, nerrors;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmp_double(const void *p1, const void *p2)
+{
+	double d1 = *(const double*)p1, d2 = *(const double*)p2;
+	return d1 < d2 ? -1 : d1 > d2 ? +1 : 0;
+}
+
+static void *client_main(void *arg)
+{
+	size_t client = (size_t)arg;
+	unsigned long long matches = 0, errors = 0;
+	ffuzzyd_buf req = {NULL, 0, 0}, resp = {NULL, 0, 0};
+	int fd = ffuzzyd_connect(sockpath);
+	if (fd < 0)
+	{
+		perror(sockpath);
+		__atomic_fetch_add(&nerrors, 1, __ATOMIC_SEQ_CST);
+		return NULL;
+	}
+	size_t next = client * nbatches * batch;
+	for (unsigned b = 0; b < nbatches; b++)
+	{
+		req.len = 0;
+		bool ok = ffuzzyd_buf_put8(&req, threshold)
+			&& ffuzzyd_buf_put32(&req, limit)
+			&& ffuzzyd_buf_put32(&req, batch);
+		for (unsigned i = 0; ok && i < batch; i++)
+			ok = ffuzzyd_buf_putstr(&req, queries[next++ % nqueries]);
+		double start = now();
+		if (!ok || !ffuzzyd_send(fd, FFUZZYD_OP_QUERY, req.data, req.len))
+		{
+			errors++;
+			break;
+		}
+		for (unsigned i = 0; i < batch; i++)
+		{
+			unsigned status;
+			if (!ffuzzyd_recv(fd, &status, &resp))
+			{
+				ok = false;
+				break;
+			}
+			ffuzzyd_reader r = {resp.data, resp.data + resp.len, false};
+			if (status == FFUZZYD_OK)
+				matches += ffuzzyd_get32(&r);
+			else
+				errors++;
+		}
+		if (!ok)
+		{
+			errors++;
+			break;
+		}
+		// only completed batches are measured
+		double latency = now() - start;
+		latencies[__atomic_fetch_add(&nlatencies, 1, __ATOMIC_SEQ_CST)] = latency;
+	}
+	close(fd);
+	free(req.data);
+	free(resp.data);
+	__atomic_fetch_add(&nmatches, matches, __ATOMIC_SEQ_CST);
+	__atomic_fetch_add(&nerrors, errors, __ATOMIC_SEQ_CST);
+	return NULL;
+}
+
+static bool insert_queries(void)
+{
+	int fd = ffuzzyd_connect(sockpath);
+	if (fd < 0)
+		return false;
+	ffuzzyd_buf req = {NULL, 0, 0}, resp = {NULL, 0, 0};
+	bool ok = true;
+	for (size_t i = 0; ok && i < nqueries; i += 1024)
+	{
+		size_t n = nqueries - i < 1024 ? nqueries - i : 1024;
+		unsigned status;
+		req.len = 0;
+		ok = ffuzzyd_buf_put32(&req, (uint_least32_t)n);
+		for (size_t k = 0; ok && k < n; k++)
+			ok = ffuzzyd_buf_putstr(&req, queries[i + k]);
+		ok = ok && ffuzzyd_send(fd, FFUZZYD_OP_INSERT, req.data, req.len)
+			&& ffuzzyd_recv(fd, &status, &resp) && status == FFUZZYD_OK;
+	}
+	close(fd);
+	free(req.data);
+	free(resp.data);
+	return ok;
+}
+
+
+int main(int argc, char **argv)
+{
+	const char *path = NULL;
+	unsigned nclients = 4;
+	bool insert = false;
+	int opt;
+	while ((opt = getopt(argc, argv, "s:f:ic:b:n:t:k:")) != -1)
+	{
+		switch (opt)
+		{
+			case 's': sockpath  = optarg; break;
+			case 'f': path      = optarg; break;
+			case 'i': insert    = true; break;
+			case 'c': nclients  = (unsigned)strtoul(optarg, NULL, 10); break;
+			case 'b': batch     = (unsigned)strtoul(optarg, NULL, 10); break;
+			case 'n': nbatches  = (unsigned)strtoul(optarg, NULL, 10); break;
+			case 't': threshold = (unsigned)strtoul(optarg, NULL, 10); break;
+			case 'k': limit     = (unsigned)strtoul(optarg, NULL, 10); break;
+			default:
+				sockpath = NULL;
+				optind = argc;
+				break;
+		}
+	}
+	if (!sockpath || !path || !nclients || !batch || batch > FFUZZYD_BATCH_MAX || !nbatches || threshold > 255)
+	{
+		fputs("usage: ffuzzyd_loadgen -s SOCKET -f QUERIES [-i] [-c CONNECTIONS] [-b BATCH] [-n BATCHES] [-t THRESHOLD] [-k LIMIT]\n", stderr);
+		return 2;
+	}
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+	{
+		perror(path);
+		return 1;
+	}
+	size_t cap = 0;
+	char line[1024];
+	while (fgets(line, sizeof(line), fp))
+	{
+		ffuzzy_digest digest;
+		size_t len = strcspn(line, ",\r\n");
+		if (len >= sizeof(queries[0]))
+			continue;
+		line[len] = '\0';
+		if (!ffuzzy_read_digest(&digest, line))
+			continue;
+		if (nqueries == cap)
+		{
+			cap = cap ? cap * 2 : 1024;
+			queries = realloc(queries, sizeof(queries[0]) * cap);
+			if (!queries)
+				return 1;
+		}
+		strcpy(queries[nqueries++], line);
+	}
+	fclose(fp);
+	if (!nqueries)
+	{
+		fputs("no valid digests in the query file\n", stderr);
+		return 1;
+	}
+	if (insert && !insert_queries())
+	{
+		fputs("insertion failed\n", stderr);
+		return 1;
+	}
+	latencies = calloc((size_t)nclients * nbatches, sizeof(double));
+	pthread_t *threads = malloc(sizeof(pthread_t) * nclients);
+	if (!latencies || !threads)
+		return 1;
+	double start = now();
+	for (unsigned i = 0; i < nclients; i++)
+		if (pthread_create(&threads[i], NULL, client_main, (void*)(size_t)i))
+			return 1;
+	for (unsigned i = 0; i < nclients; i++)
+		pthread_join(threads[i], NULL);
+	double elapsed = now() - start;
+	size_t n = nlatencies;
+	qsort(latencies, n, sizeof(double), cmp_double);
+	printf("%zu queries in %.3f s: %.0f queries/s, %llu matches, %llu errors\n",
+		n * batch, elapsed, n * batch / elapsed, nmatches, nerrors);
+	if (n)
+		printf("batch latency (ms): p50 %.3f, p99 %.3f, max %.3f\n",
+			latencies[n / 2] * 1e3, latencies[n * 99 / 100] * 1e3, latencies[n - 1] * 1e3);
+	free(threads);
+	free(latencies);
+	free(queries);
+	return nerrors ? 1 : 0;
+}
+
+#else
+
+int main(void)
+{
+	fputs("ffuzzyd_loadgen: threads are disabled\n", stderr);
+	return 1;
+}
+
+#endif
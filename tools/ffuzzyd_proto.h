@@ -0,0 +1,341 @@
+/*
+
+	libffuzzy : Fast ssdeep comparison library
+
+	tools/ffuzzyd_proto.h
+	Wire protocol of the similarity lookup daemon
+
+
+	Copyright (C) 2026 Tsukasa OI <li@livegrid.org>
+
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef FFUZZY_TOOLS_FFUZZYD_PROTO_H
+#define FFUZZY_TOOLS_FFUZZYD_PROTO_H
+
+/**
+	\file  tools/ffuzzyd_proto.h
+	\brief Wire protocol of the similarity lookup daemon
+	\details
+		Every message is a frame: a 32-bit payload length, an 8-bit code
+		and the payload. All integers are little-endian. Digests are sent
+		as strings prefixed by their 8-bit length.
+
+		Requests (the code is the operation):
+
+		- FFUZZYD_OP_QUERY : threshold (8), limit (32, 0 for all matches),
+		  count (32, at most FFUZZYD_BATCH_MAX) and count digests.
+		  The server streams one response per query in the request order.
+		- FFUZZYD_OP_INSERT : count (32, at most FFUZZYD_BATCH_MAX) and count digests.
+		  The response has count IDs (64, FFUZZYD_NO_ID for invalid digests).
+		- FFUZZYD_OP_INSERT_IDS : count (32, at most FFUZZYD_BATCH_MAX) and
+		  count pairs of an ID (64) and a digest. Digests are stored with given IDs
+		  (used by the shard coordinator which assigns global IDs).
+		  The response is the same as FFUZZYD_OP_INSERT.
+		- FFUZZYD_OP_STAT : no payload.
+		  The response has the number of digests (64).
+
+		Responses (the code is the status):
+
+		- FFUZZYD_OK : successful. For a query, the payload is
+		  the number of matches (32) and matches (ID (64) and score (8)),
+		  best match first.
+		- FFUZZYD_EINVAL : the request or the query digest is invalid.
+		- FFUZZYD_EFAIL : the server failed to process the request.
+**/
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/** \brief Query digests (stream matches back) **/
+#define FFUZZYD_OP_QUERY  1
+/** \brief Insert digests **/
+#define FFUZZYD_OP_INSERT 2
+/** \brief Retrieve number of digests **/
+#define FFUZZYD_OP_STAT   3
+/** \brief Insert digests with given IDs **/
+#define FFUZZYD_OP_INSERT_IDS 4
+
+/** \brief Successful **/
+#define FFUZZYD_OK     0
+/** \brief Invalid request or digest **/
+#define FFUZZYD_EINVAL 1
+/** \brief Processing failure **/
+#define FFUZZYD_EFAIL  2
+
+/** \brief ID for digests which are not inserted **/
+#define FFUZZYD_NO_ID  UINT64_C(0xffffffffffffffff)
+/** \brief Maximum payload length of a frame **/
+#define FFUZZYD_FRAME_MAX (16u << 20)
+/** \brief Maximum number of queries or digests to insert in a request **/
+#define FFUZZYD_BATCH_MAX 4096
+/** \brief Size of an encoded match **/
+#define FFUZZYD_MATCH_SIZE 9
+
+
+/**
+	\struct ffuzzyd_buf
+	\brief  Growable byte buffer (for frame payloads)
+**/
+typedef struct
+{
+	unsigned char *data;
+	size_t len, cap;
+} ffuzzyd_buf;
+
+static inline bool ffuzzyd_buf_reserve(ffuzzyd_buf *buf, size_t len)
+{
+	if (buf->len + len <= buf->cap)
+		return true;
+	size_t cap = buf->cap ? buf->cap : 256;
+	while (cap < buf->len + len)
+		cap *= 2;
+	unsigned char *p = realloc(buf->data, cap);
+	if (!p)
+		return false;
+	buf->data = p;
+	buf->cap = cap;
+	return true;
+}
+
+static inline bool ffuzzyd_buf_put(ffuzzyd_buf *buf, const void *data, size_t len)
+{
+	if (!ffuzzyd_buf_reserve(buf, len))
+		return false;
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+	return true;
+}
+
+static inline bool ffuzzyd_buf_put8(ffuzzyd_buf *buf, unsigned v)
+{
+	unsigned char b = (unsigned char)v;
+	return ffuzzyd_buf_put(buf, &b, 1);
+}
+
+static inline bool ffuzzyd_buf_put32(ffuzzyd_buf *buf, uint_least32_t v)
+{
+	unsigned char b[4];
+	for (int i = 0; i < 4; i++)
+		b[i] = (unsigned char)(v >> (8 * i));
+	return ffuzzyd_buf_put(buf, b, 4);
+}
+
+static inline bool ffuzzyd_buf_put64(ffuzzyd_buf *buf, uint_least64_t v)
+{
+	unsigned char b[8];
+	for (int i = 0; i < 8; i++)
+		b[i] = (unsigned char)(v >> (8 * i));
+	return ffuzzyd_buf_put(buf, b, 8);
+}
+
+/** \brief Overwrite a 32-bit value (a count in the header of the payload) **/
+static inline void ffuzzyd_buf_set32(ffuzzyd_buf *buf, size_t offset, uint_least32_t v)
+{
+	for (int i = 0; i < 4; i++)
+		buf->data[offset + i] = (unsigned char)(v >> (8 * i));
+}
+
+/** \brief Append a length-prefixed string (at most 255 bytes) **/
+static inline bool ffuzzyd_buf_putstr(ffuzzyd_buf *buf, const char *s)
+{
+	size_t len = strlen(s);
+	return len <= 255 && ffuzzyd_buf_put8(buf, (unsigned)len) && ffuzzyd_buf_put(buf, s, len);
+}
+
+
+/**
+	\struct ffuzzyd_reader
+	\brief  Cursor to decode a frame payload
+	\details
+		Reading past the end sets the error flag (and returns zeros).
+**/
+typedef struct
+{
+	const unsigned char *p, *end;
+	bool error;
+} ffuzzyd_reader;
+
+static inline const unsigned char *ffuzzyd_get(ffuzzyd_reader *r, size_t len)
+{
+	if ((size_t)(r->end - r->p) < len)
+	{
+		r->error = true;
+		return NULL;
+	}
+	const unsigned char *p = r->p;
+	r->p += len;
+	return p;
+}
+
+static inline unsigned ffuzzyd_get8(ffuzzyd_reader *r)
+{
+	const unsigned char *p = ffuzzyd_get(r, 1);
+	return p ? p[0] : 0;
+}
+
+static inline uint_least32_t ffuzzyd_get32(ffuzzyd_reader *r)
+{
+	const unsigned char *p = ffuzzyd_get(r, 4);
+	uint_least32_t v = 0;
+	for (int i = 3; p && i >= 0; i--)
+		v = v << 8 | p[i];
+	return v;
+}
+
+static inline uint_least64_t ffuzzyd_get64(ffuzzyd_reader *r)
+{
+	const unsigned char *p = ffuzzyd_get(r, 8);
+	uint_least64_t v = 0;
+	for (int i = 7; p && i >= 0; i--)
+		v = v << 8 | p[i];
+	return v;
+}
+
+/** \brief Read a length-prefixed string into str (of 256 bytes) **/
+static inline bool ffuzzyd_getstr(ffuzzyd_reader *r, char *str)
+{
+	size_t len = ffuzzyd_get8(r);
+	const unsigned char *p = ffuzzyd_get(r, len);
+	if (!p)
+		return false;
+	memcpy(str, p, len);
+	str[len] = '\0';
+	return true;
+}
+
+
+static inline bool ffuzzyd_read_full(int fd, void *buf, size_t len)
+{
+	unsigned char *p = buf;
+	while (len)
+	{
+		ssize_t n = read(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= (size_t)n;
+	}
+	return true;
+}
+
+static inline bool ffuzzyd_write_full(int fd, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	while (len)
+	{
+		ssize_t n = write(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= (size_t)n;
+	}
+	return true;
+}
+
+/**
+	\brief  Send a frame
+	\param  fd       The socket
+	\param  code     Operation or status
+	\param  payload  Payload (may be NULL if len is 0)
+	\param  len      Length of payload
+**/
+static inline bool ffuzzyd_send(int fd, unsigned code, const void *payload, size_t len)
+{
+	unsigned char hdr[5];
+	if (len > FFUZZYD_FRAME_MAX)
+		return false;
+	for (int i = 0; i < 4; i++)
+		hdr[i] = (unsigned char)(len >> (8 * i));
+	hdr[4] = (unsigned char)code;
+	return ffuzzyd_write_full(fd, hdr, 5) && (!len || ffuzzyd_write_full(fd, payload, len));
+}
+
+/**
+	\brief  Receive a frame
+	\param        fd       The socket
+	\param  [out] code     Operation or status
+	\param  [out] payload  Buffer to store the payload (overwritten)
+	\return true if succeeds; false on EOF, errors or too large frames.
+**/
+static inline bool ffuzzyd_recv(int fd, unsigned *code, ffuzzyd_buf *payload)
+{
+	unsigned char hdr[5];
+	if (!ffuzzyd_read_full(fd, hdr, 5))
+		return false;
+	size_t len = (size_t)hdr[0] | (size_t)hdr[1] << 8 | (size_t)hdr[2] << 16 | (size_t)hdr[3] << 24;
+	if (len > FFUZZYD_FRAME_MAX)
+		return false;
+	*code = hdr[4];
+	payload->len = 0;
+	if (!ffuzzyd_buf_reserve(payload, len))
+		return false;
+	payload->len = len;
+	return !len || ffuzzyd_read_full(fd, payload->data, len);
+}
+
+/** \brief Connect to the daemon (returns the socket or -1) **/
+static inline int ffuzzyd_connect(const char *path)
+{
+	struct sockaddr_un addr;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)))
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/** \brief Create a listening socket (an existing socket file is replaced) **/
+static inline int ffuzzyd_listen(const char *path)
+{
+	struct sockaddr_un addr;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	unlink(path);
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) || listen(fd, 64))
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+#endif
@@ -48,4 +48,131 @@
 **/
 #define MAX(a,b) ((a)>(b)?(a):(b))
 
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+	\internal
+	\brief  Count set bits in 64-bit value
+	\param  x  The value
+	\return Number of set bits in x.
+**/
+static inline int util_popcount64(uint_least64_t x)
+{
+#if defined(__GNUC__)
+	return __builtin_popcountll((unsigned long long)x);
+#else
+	x = x - ((x >> 1) & UINT64_C(0x5555555555555555));
+	x = (x & UINT64_C(0x3333333333333333)) + ((x >> 2) & UINT64_C(0x3333333333333333));
+	x = (x + (x >> 4)) & UINT64_C(0x0f0f0f0f0f0f0f0f);
+	return (int)((x * UINT64_C(0x0101010101010101)) >> 56 & 0xff);
+#endif
+}
+
+/**
+	\internal
+	\brief  Retrieve the index of the highest set bit
+	\param  x  The value (must not be zero)
+	\return floor(log2(x)).
+**/
+static inline int util_log2_64(uint_least64_t x)
+{
+#if defined(__GNUC__)
+	return 63 - __builtin_clzll((unsigned long long)x);
+#else
+	int r = 0;
+	while (x >>= 1)
+		r++;
+	return r;
+#endif
+}
+
+/**
+	\internal
+	\brief  Update CRC-32 (IEEE 802.3) with given bytes
+	\param  crc  CRC of preceding bytes (0 for the first call)
+	\param  buf  Bytes to process
+	\param  len  Length of buf
+	\return CRC of all bytes processed.
+**/
+static inline uint_least32_t util_crc32(uint_least32_t crc, const void *buf, size_t len)
+{
+	// half-byte table (compact and fast enough for small records)
+	static const uint_least32_t table[16] = {
+		0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+		0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+		0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+		0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+	};
+	const unsigned char *p = buf;
+	crc = ~crc & UINT32_C(0xffffffff);
+	for (size_t i = 0; i < len; i++)
+	{
+		crc = (crc >> 4) ^ table[(crc ^ p[i]) & 0x0f];
+		crc = (crc >> 4) ^ table[(crc ^ (p[i] >> 4)) & 0x0f];
+	}
+	return ~crc & UINT32_C(0xffffffff);
+}
+
+/**
+	\internal
+	\brief  Grow the array (by doubling) to contain at least given number of elements
+	\param  [in,out] ptr       The pointer to the array
+	\param  [in,out] capacity  The pointer to the allocated number of elements
+	\param           required  Required number of elements
+	\param           elemsize  Size of each element
+	\return true if succeeds; false otherwise (the array is left untouched).
+**/
+static inline bool util_grow_array(void **ptr, size_t *capacity, size_t required, size_t elemsize)
+{
+	if (required <= *capacity)
+		return true;
+	size_t newcap = *capacity ? *capacity : 16;
+	while (newcap < required)
+	{
+		if (newcap > ((size_t)-1) / 2)
+			return false;
+		newcap *= 2;
+	}
+	if (newcap > ((size_t)-1) / elemsize)
+		return false;
+	void *p = realloc(*ptr, newcap * elemsize);
+	if (!p)
+		return false;
+	*ptr = p;
+	*capacity = newcap;
+	return true;
+}
+
+/**
+	\internal
+	\brief  Read a monotonic clock (for deadlines and latency measurement)
+	\details
+		Without clock_gettime, the processor time is used instead.
+	\return Current time in nanoseconds (from an unspecified origin).
+**/
+static inline unsigned long long util_now_nsec(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000u + (unsigned long long)ts.tv_nsec;
+#else
+	return (unsigned long long)((double)clock() * 1e9 / CLOCKS_PER_SEC);
+#endif
+}
+
+/**
+	\internal
+	\brief  Read a monotonic clock in microseconds
+	\see    util_now_nsec
+**/
+static inline unsigned long long util_now_usec(void)
+{
+	return util_now_nsec() / 1000u;
+}
+
 #endif